@@ -0,0 +1,293 @@
+/*
+ * bench.c — microbenchmark harness (timing, statistics, JSON, compare)
+ */
+
+#include "bench.h"
+#include "../vendor/cJSON.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+/* ================================================================== */
+/*  Clocks                                                             */
+/* ================================================================== */
+
+static inline uint64_t
+now_ns (void)
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime (CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static inline uint64_t
+now_cycles (void)
+{
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc ();
+#else
+    return 0;
+#endif
+}
+
+const char *
+bench_cycle_counter_name (void)
+{
+#ifdef BENCH_HAVE_TSC
+    return "tsc";
+#else
+    return NULL;
+#endif
+}
+
+void
+bench_config_defaults (BenchConfig *cfg)
+{
+    cfg->warmup = 3;
+    cfg->reps   = 30;
+    cfg->trim   = 0.1;
+}
+
+void
+bench_fill_random (guint8 *buf, size_t n, uint32_t seed)
+{
+    uint32_t s = seed ? seed : 0x9e3779b9u;
+    for (size_t i = 0; i < n; i++) {
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        buf[i] = (guint8) (s >> 24);
+    }
+}
+
+/* ================================================================== */
+/*  Measurement                                                        */
+/* ================================================================== */
+
+static int
+cmp_double (const void *a, const void *b)
+{
+    double da = *(const double *) a, db = *(const double *) b;
+    return (da > db) - (da < db);
+}
+
+/* Mean of the sorted samples with `trim` dropped from each tail. */
+static double
+trimmed_mean (const double *sorted, int n, double trim)
+{
+    int drop = (int) (n * trim);
+    if (2 * drop >= n) drop = (n - 1) / 2;
+    double sum = 0.0;
+    for (int i = drop; i < n - drop; i++)
+        sum += sorted[i];
+    return sum / (n - 2 * drop);
+}
+
+const BenchResult *
+bench_run (BenchSuite *suite, const char *kernel,
+           guint width, guint height,
+           double pixels, double bytes,
+           BenchFn fn, void *ctx)
+{
+    if (suite->n_results >= BENCH_MAX_RESULTS) {
+        fprintf (stderr, "error: bench suite full, skipping %s\n", kernel);
+        return NULL;
+    }
+
+    const BenchConfig *cfg = &suite->config;
+    int reps = cfg->reps > 0 ? cfg->reps : 1;
+
+    for (int i = 0; i < cfg->warmup; i++)
+        fn (ctx);
+
+    double *ns  = g_new (double, reps);
+    double *cyc = g_new (double, reps);
+    for (int i = 0; i < reps; i++) {
+        uint64_t c0 = now_cycles ();
+        uint64_t t0 = now_ns ();
+        fn (ctx);
+        uint64_t t1 = now_ns ();
+        uint64_t c1 = now_cycles ();
+        ns[i]  = (double) (t1 - t0);
+        cyc[i] = (double) (c1 - c0);
+    }
+
+    qsort (ns, reps, sizeof *ns, cmp_double);
+    qsort (cyc, reps, sizeof *cyc, cmp_double);
+
+    BenchResult *r = &suite->results[suite->n_results++];
+    memset (r, 0, sizeof *r);
+    g_strlcpy (r->kernel, kernel, sizeof r->kernel);
+    r->width     = width;
+    r->height    = height;
+    r->pixels    = pixels;
+    r->bytes     = bytes;
+    r->mean_ns   = trimmed_mean (ns, reps, cfg->trim);
+    r->median_ns = ns[reps / 2];
+    r->min_ns    = ns[0];
+    r->ns_per_px = r->mean_ns / pixels;
+    r->mpx_per_s = pixels / r->mean_ns * 1e3;
+    r->mb_per_s  = bytes > 0.0 ? bytes / r->mean_ns * 1e3 : 0.0;
+    r->cycles_per_px = bench_cycle_counter_name ()
+                     ? trimmed_mean (cyc, reps, cfg->trim) / pixels
+                     : -1.0;
+
+    g_free (ns);
+    g_free (cyc);
+    return r;
+}
+
+/* ================================================================== */
+/*  Reporting                                                          */
+/* ================================================================== */
+
+void
+bench_print_table (const BenchSuite *suite)
+{
+    printf ("%-34s %11s %10s %9s %10s %10s\n",
+            "kernel", "geometry", "Mpx/s", "ns/px", "cycles/px", "MB/s");
+    for (int i = 0; i < suite->n_results; i++) {
+        const BenchResult *r = &suite->results[i];
+        char geom[32], cpp[16], mbs[16];
+        snprintf (geom, sizeof geom, "%ux%u", r->width, r->height);
+        if (r->cycles_per_px >= 0.0)
+            snprintf (cpp, sizeof cpp, "%.2f", r->cycles_per_px);
+        else
+            g_strlcpy (cpp, "-", sizeof cpp);
+        if (r->mb_per_s > 0.0)
+            snprintf (mbs, sizeof mbs, "%.1f", r->mb_per_s);
+        else
+            g_strlcpy (mbs, "-", sizeof mbs);
+        printf ("%-34s %11s %10.1f %9.3f %10s %10s\n",
+                r->kernel, geom, r->mpx_per_s, r->ns_per_px, cpp, mbs);
+    }
+}
+
+int
+bench_write_json (const BenchSuite *suite, const char *path)
+{
+    cJSON *root = cJSON_CreateObject ();
+    const char *counter = bench_cycle_counter_name ();
+    cJSON_AddNumberToObject (root, "version", 1);
+    if (counter)
+        cJSON_AddStringToObject (root, "cycle_counter", counter);
+    else
+        cJSON_AddNullToObject (root, "cycle_counter");
+    cJSON_AddNumberToObject (root, "warmup", suite->config.warmup);
+    cJSON_AddNumberToObject (root, "reps", suite->config.reps);
+    cJSON_AddNumberToObject (root, "trim", suite->config.trim);
+
+    cJSON *arr = cJSON_AddArrayToObject (root, "results");
+    for (int i = 0; i < suite->n_results; i++) {
+        const BenchResult *r = &suite->results[i];
+        cJSON *o = cJSON_CreateObject ();
+        cJSON_AddStringToObject (o, "kernel", r->kernel);
+        cJSON_AddNumberToObject (o, "width", r->width);
+        cJSON_AddNumberToObject (o, "height", r->height);
+        cJSON_AddNumberToObject (o, "mean_ns", r->mean_ns);
+        cJSON_AddNumberToObject (o, "median_ns", r->median_ns);
+        cJSON_AddNumberToObject (o, "min_ns", r->min_ns);
+        cJSON_AddNumberToObject (o, "mpx_per_s", r->mpx_per_s);
+        cJSON_AddNumberToObject (o, "ns_per_px", r->ns_per_px);
+        if (r->cycles_per_px >= 0.0)
+            cJSON_AddNumberToObject (o, "cycles_per_px", r->cycles_per_px);
+        else
+            cJSON_AddNullToObject (o, "cycles_per_px");
+        if (r->mb_per_s > 0.0)
+            cJSON_AddNumberToObject (o, "mb_per_s", r->mb_per_s);
+        cJSON_AddItemToArray (arr, o);
+    }
+
+    char *text = cJSON_Print (root);
+    cJSON_Delete (root);
+
+    int rc = 0;
+    GError *error = NULL;
+    if (!g_file_set_contents (path, text, -1, &error)) {
+        fprintf (stderr, "error: cannot write %s: %s\n", path, error->message);
+        g_error_free (error);
+        rc = -1;
+    }
+    cJSON_free (text);
+    return rc;
+}
+
+int
+bench_compare (const BenchSuite *suite, const char *baseline_path,
+               double threshold_pct)
+{
+    gchar *contents = NULL;
+    gsize length = 0;
+    GError *error = NULL;
+    if (!g_file_get_contents (baseline_path, &contents, &length, &error)) {
+        fprintf (stderr, "error: cannot read baseline %s: %s\n",
+                 baseline_path, error->message);
+        g_error_free (error);
+        return -1;
+    }
+
+    cJSON *root = cJSON_ParseWithLength (contents, length);
+    g_free (contents);
+    cJSON *arr = root ? cJSON_GetObjectItemCaseSensitive (root, "results") : NULL;
+    if (!cJSON_IsArray (arr)) {
+        fprintf (stderr, "error: %s is not a bench results file\n", baseline_path);
+        cJSON_Delete (root);
+        return -1;
+    }
+
+    printf ("\nComparison against %s (threshold %.1f%%):\n",
+            baseline_path, threshold_pct);
+    printf ("%-34s %11s %10s %10s %8s\n",
+            "kernel", "geometry", "base ns/px", "ns/px", "delta");
+
+    int regressions = 0;
+    for (int i = 0; i < suite->n_results; i++) {
+        const BenchResult *r = &suite->results[i];
+        const cJSON *match = NULL;
+        const cJSON *item;
+        cJSON_ArrayForEach (item, arr) {
+            const cJSON *k = cJSON_GetObjectItemCaseSensitive (item, "kernel");
+            const cJSON *w = cJSON_GetObjectItemCaseSensitive (item, "width");
+            const cJSON *h = cJSON_GetObjectItemCaseSensitive (item, "height");
+            if (cJSON_IsString (k) && strcmp (k->valuestring, r->kernel) == 0 &&
+                cJSON_IsNumber (w) && (guint) w->valueint == r->width &&
+                cJSON_IsNumber (h) && (guint) h->valueint == r->height) {
+                match = item;
+                break;
+            }
+        }
+
+        char geom[32];
+        snprintf (geom, sizeof geom, "%ux%u", r->width, r->height);
+
+        const cJSON *base = match
+            ? cJSON_GetObjectItemCaseSensitive (match, "ns_per_px") : NULL;
+        if (!cJSON_IsNumber (base) || base->valuedouble <= 0.0) {
+            printf ("%-34s %11s %10s %10.3f %8s\n",
+                    r->kernel, geom, "-", r->ns_per_px, "new");
+            continue;
+        }
+
+        double delta = (r->ns_per_px / base->valuedouble - 1.0) * 100.0;
+        gboolean regressed = delta > threshold_pct;
+        if (regressed) regressions++;
+        printf ("%-34s %11s %10.3f %10.3f %+7.1f%%%s\n",
+                r->kernel, geom, base->valuedouble, r->ns_per_px, delta,
+                regressed ? "  REGRESSION" : "");
+    }
+
+    cJSON_Delete (root);
+    return regressions;
+}
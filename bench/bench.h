@@ -0,0 +1,92 @@
+/*
+ * bench.h — microbenchmark harness for the image-processing kernels
+ *
+ * Times a kernel callback with warm-up, repeated runs and outlier
+ * trimming, and reports throughput as Mpx/s, ns/px and (where a cycle
+ * counter is available) cycles/px.  Results can be printed as a table,
+ * written as JSON, and compared against a previously saved baseline.
+ *
+ * No camera hardware or Aravis libraries are required.
+ */
+
+#ifndef AG_BENCH_H
+#define AG_BENCH_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_MAX_RESULTS  128
+
+/* Kernel under test.  Called once per repetition with the caller's ctx. */
+typedef void (*BenchFn) (void *ctx);
+
+typedef struct {
+    int    warmup;        /* untimed runs before measuring (default: 3)    */
+    int    reps;          /* timed runs (default: 30)                      */
+    double trim;          /* fraction dropped from each tail (default: .1) */
+} BenchConfig;
+
+typedef struct {
+    char   kernel[64];    /* e.g. "debayer_rg8_to_rgb"                     */
+    guint  width;         /* per-eye frame geometry the kernel ran at      */
+    guint  height;
+    double pixels;        /* output pixels produced per call               */
+    double bytes;         /* payload bytes per call (0 = not reported)     */
+    double mean_ns;       /* trimmed mean wall time per call               */
+    double median_ns;
+    double min_ns;
+    double mpx_per_s;
+    double ns_per_px;
+    double cycles_per_px; /* < 0 when no cycle counter is available        */
+    double mb_per_s;      /* bytes / mean_ns, 0 when bytes == 0            */
+} BenchResult;
+
+typedef struct {
+    BenchConfig config;
+    BenchResult results[BENCH_MAX_RESULTS];
+    int         n_results;
+} BenchSuite;
+
+/* Fill a BenchConfig with defaults. */
+void bench_config_defaults (BenchConfig *cfg);
+
+/* Name of the cycle counter in use ("tsc"), or NULL if none. */
+const char *bench_cycle_counter_name (void);
+
+/*
+ * Run fn(ctx) cfg->warmup times untimed, then cfg->reps times timed,
+ * and append a result to the suite.  pixels is the number of output
+ * pixels one call produces; bytes is optional payload size for MB/s.
+ * Returns the appended result, or NULL if the suite is full.
+ */
+const BenchResult *bench_run (BenchSuite *suite, const char *kernel,
+                              guint width, guint height,
+                              double pixels, double bytes,
+                              BenchFn fn, void *ctx);
+
+/* Print the suite as an aligned table on stdout. */
+void bench_print_table (const BenchSuite *suite);
+
+/*
+ * Write the suite to path as JSON.
+ * Returns 0 on success, -1 on error (prints its own diagnostic).
+ */
+int bench_write_json (const BenchSuite *suite, const char *path);
+
+/*
+ * Compare the suite against a baseline JSON file written by
+ * bench_write_json.  Entries are matched on kernel name and geometry;
+ * an entry is a regression when its ns/px grew by more than
+ * threshold_pct percent.  Prints a comparison table on stdout.
+ *
+ * Returns the number of regressions, or -1 if the baseline could not
+ * be read.
+ */
+int bench_compare (const BenchSuite *suite, const char *baseline_path,
+                   double threshold_pct);
+
+/* Deterministic xorshift fill so runs are reproducible. */
+void bench_fill_random (guint8 *buf, size_t n, uint32_t seed);
+
+#endif /* AG_BENCH_H */
@@ -0,0 +1,472 @@
+/*
+ * bench_kernels.c — throughput benchmarks for the per-frame hot path
+ *
+ * Times every kernel the acquisition loops run per frame at the two
+ * per-eye geometries the tools use in practice (1440x1080 full
+ * resolution, 720x540 binned):
+ *
+ *   extract_dual_bayer_eyes, debayer_rg8_to_rgb/gray, apply_lut_inplace,
+ *   software_bin_2x2, ag_remap_rgb/gray, ag_focus_score (every metric),
+ *   ag_focus_score_all, ag_disparity_colorize, ag_png_encode (RGB, at
+ *   every zlib level, on one thread and on one per core, as MB/s of
+ *   pixels in) and ag_jpeg_encode (RGB, gray and planar 4:2:0 YCbCr, on
+ *   whichever backend the build has).
+ *
+ * Remap tables come from gen_test_calibration sessions (--calib-dir);
+ * without one an identical in-memory identity table is used.
+ *
+ * Usage:
+ *   bench_kernels [--json out.json] [--compare baseline.json]
+ *                 [--threshold pct] [--reps N] [--warmup N]
+ *                 [--filter substr] [--calib-dir dir]
+ *
+ * Exit status is 1 when --compare finds a regression.
+ *
+ * Build and run:  make bench
+ */
+
+#include "bench.h"
+#include "imgproc.h"
+#include "remap.h"
+#include "focus.h"
+#include "stereo.h"
+#include "png_fast.h"
+#include "jpeg_enc.h"
+#include "../vendor/argtable3.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    guint  w, h;                 /* per-eye geometry */
+    guint8 *interleaved;         /* 2w x h DualBayer frame */
+    guint8 *interleaved_2x;      /* 4w x 2h DualBayer frame (software bin) */
+    guint8 *bayer;               /* w x h */
+    guint8 *bayer_2x;            /* 2w x 2h */
+    guint8 *left, *right;        /* w x h */
+    guint8 *rgb, *rgb_out;       /* w x h x 3 */
+    guint8 *gray, *gray_out;     /* w x h */
+    int16_t *disparity;          /* w x h, Q4.4 */
+    guint8 *photo;               /* w x h x 3, smooth: compresses like a scene */
+    guint8 *photo_yuv;           /* photo as Y plane + 4:2:0 Cb, Cr planes */
+    AgRemapTable *table;
+    const guint8 *lut;
+    AgFocusMetric metric;
+    AgPngOptions png;
+    AgJpegImage jpeg_img;
+    AgJpegOptions jpeg;
+    volatile double sink;        /* keeps focus scores observable */
+    double scores[AG_FOCUS_METRIC_COUNT];
+} KernelCtx;
+
+/* ------------------------------------------------------------------ */
+/*  Kernels                                                            */
+/* ------------------------------------------------------------------ */
+
+static void
+k_extract (void *p)
+{
+    KernelCtx *c = p;
+    extract_dual_bayer_eyes (c->interleaved, c->w * 2, c->h, 1,
+                             c->left, c->right);
+}
+
+static void
+k_extract_bin2 (void *p)
+{
+    KernelCtx *c = p;
+    extract_dual_bayer_eyes (c->interleaved_2x, c->w * 4, c->h * 2, 2,
+                             c->left, c->right);
+}
+
+static void
+k_debayer_rgb (void *p)
+{
+    KernelCtx *c = p;
+    debayer_rg8_to_rgb (c->bayer, c->rgb, c->w, c->h);
+}
+
+static void
+k_debayer_gray (void *p)
+{
+    KernelCtx *c = p;
+    debayer_rg8_to_gray (c->bayer, c->gray, c->w, c->h);
+}
+
+static void
+k_lut (void *p)
+{
+    KernelCtx *c = p;
+    apply_lut_inplace (c->gray, (size_t) c->w * c->h, c->lut);
+}
+
+static void
+k_bin (void *p)
+{
+    KernelCtx *c = p;
+    software_bin_2x2 (c->bayer_2x, c->w * 2, c->h * 2, c->gray_out, c->w, c->h);
+}
+
+static void
+k_remap_rgb (void *p)
+{
+    KernelCtx *c = p;
+    ag_remap_rgb (c->table, c->rgb, c->rgb_out);
+}
+
+static void
+k_remap_gray (void *p)
+{
+    KernelCtx *c = p;
+    ag_remap_gray (c->table, c->gray, c->gray_out);
+}
+
+static void
+k_focus (void *p)
+{
+    KernelCtx *c = p;
+    c->sink = ag_focus_score (c->metric, c->gray, (int) c->w, (int) c->h,
+                              0, 0, (int) c->w, (int) c->h);
+}
+
+static void
+k_focus_all (void *p)
+{
+    KernelCtx *c = p;
+    ag_focus_score_all (c->gray, (int) c->w, (int) c->h,
+                        0, 0, (int) c->w, (int) c->h, c->scores);
+    c->sink = c->scores[0];
+}
+
+static void
+k_colorize (void *p)
+{
+    KernelCtx *c = p;
+    ag_disparity_colorize (c->disparity, c->w, c->h, 16, 128, c->rgb_out);
+}
+
+static void
+k_png (void *p)
+{
+    KernelCtx *c = p;
+    size_t len = 0;
+    guint8 *png = ag_png_encode (c->photo, c->w, c->h, 3, (size_t) c->w * 3,
+                                 &c->png, &len);
+    c->sink = (double) len;
+    g_free (png);
+}
+
+static void
+k_jpeg (void *p)
+{
+    KernelCtx *c = p;
+    size_t len = 0;
+    guint8 *jpeg = ag_jpeg_encode (&c->jpeg_img, &c->jpeg, &len);
+    c->sink = (double) len;
+    g_free (jpeg);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Fixtures                                                           */
+/* ------------------------------------------------------------------ */
+
+/* Same layout gen_test_calibration writes: identity offsets. */
+static AgRemapTable *
+identity_table (guint w, guint h)
+{
+    AgRemapTable *t = g_new0 (AgRemapTable, 1);
+    t->width   = w;
+    t->height  = h;
+    t->offsets = g_new (uint32_t, (size_t) w * h);
+    for (size_t i = 0; i < (size_t) w * h; i++)
+        t->offsets[i] = (uint32_t) i;
+    return t;
+}
+
+static AgRemapTable *
+load_table (const char *calib_dir, guint w, guint h)
+{
+    if (!calib_dir)
+        return identity_table (w, h);
+
+    char path[4096];
+    snprintf (path, sizeof path, "%s/%ux%u/calib_result/remap_left.bin",
+              calib_dir, w, h);
+    AgRemapTable *t = ag_remap_table_load (path);
+    if (t && (t->width != w || t->height != h)) {
+        fprintf (stderr, "error: %s is %ux%u, expected %ux%u\n",
+                 path, t->width, t->height, w, h);
+        ag_remap_table_free (t);
+        return NULL;
+    }
+    return t;
+}
+
+static int
+ctx_init (KernelCtx *c, guint w, guint h, const char *calib_dir)
+{
+    memset (c, 0, sizeof *c);
+    c->w = w;
+    c->h = h;
+
+    size_t px = (size_t) w * h;
+    c->interleaved    = g_malloc (px * 2);
+    c->interleaved_2x = g_malloc (px * 8);
+    c->bayer          = g_malloc (px);
+    c->bayer_2x       = g_malloc (px * 4);
+    c->left           = g_malloc (px);
+    c->right          = g_malloc (px);
+    c->rgb            = g_malloc (px * 3);
+    c->rgb_out        = g_malloc (px * 3);
+    c->gray           = g_malloc (px);
+    c->gray_out       = g_malloc (px);
+    c->disparity      = g_new (int16_t, px);
+    c->photo          = g_malloc (px * 3);
+    c->photo_yuv      = g_malloc (px + 2 * (size_t) ((w + 1) / 2) * ((h + 1) / 2));
+
+    bench_fill_random (c->interleaved, px * 2, 1);
+    bench_fill_random (c->interleaved_2x, px * 8, 2);
+    bench_fill_random (c->bayer, px, 3);
+    bench_fill_random (c->bayer_2x, px * 4, 4);
+    bench_fill_random (c->rgb, px * 3, 5);
+    bench_fill_random (c->gray, px, 6);
+
+    /* Disparity spanning invalid, in-range and saturated values. */
+    bench_fill_random ((guint8 *) c->disparity, px * sizeof (int16_t), 7);
+    for (size_t i = 0; i < px; i++)
+        c->disparity[i] = (int16_t) ((uint16_t) c->disparity[i] % (160 * 16));
+
+    /* Gradients with 3 bits of noise: random bytes would time deflate's
+     * incompressible path, not the one captures take. */
+    bench_fill_random (c->photo, px * 3, 8);
+    for (guint y = 0; y < h; y++)
+        for (guint x = 0; x < w * 3; x++) {
+            guint8 *v = &c->photo[(size_t) y * w * 3 + x];
+            *v = (guint8) ((x / 3 + y) / 4 + 60 * (x % 3) + (*v & 7));
+        }
+
+    /* JFIF YCbCr of the same picture; chroma from the top-left pixel of
+     * each 2x2 block is close enough for timing. */
+    guint cw = (w + 1) / 2, ch = (h + 1) / 2;
+    guint8 *py = c->photo_yuv, *pb = py + px, *pr = pb + (size_t) cw * ch;
+    for (guint y = 0; y < h; y++)
+        for (guint x = 0; x < w; x++) {
+            const guint8 *v = &c->photo[((size_t) y * w + x) * 3];
+            int yy = (19595 * v[0] + 38470 * v[1] + 7471 * v[2]) >> 16;
+            py[(size_t) y * w + x] = (guint8) yy;
+            if ((x | y) & 1)
+                continue;
+            pb[(size_t) (y / 2) * cw + x / 2] =
+                (guint8) CLAMP (128 + ((v[2] - yy) * 37028 >> 16), 0, 255);
+            pr[(size_t) (y / 2) * cw + x / 2] =
+                (guint8) CLAMP (128 + ((v[0] - yy) * 46727 >> 16), 0, 255);
+        }
+
+    c->lut   = gamma_lut_2p5 ();
+    c->table = load_table (calib_dir, w, h);
+    return c->table ? 0 : -1;
+}
+
+static void
+ctx_clear (KernelCtx *c)
+{
+    g_free (c->interleaved);
+    g_free (c->interleaved_2x);
+    g_free (c->bayer);
+    g_free (c->bayer_2x);
+    g_free (c->left);
+    g_free (c->right);
+    g_free (c->rgb);
+    g_free (c->rgb_out);
+    g_free (c->gray);
+    g_free (c->gray_out);
+    g_free (c->disparity);
+    g_free (c->photo);
+    g_free (c->photo_yuv);
+    if (c->table) ag_remap_table_free (c->table);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Driver                                                             */
+/* ------------------------------------------------------------------ */
+
+static void
+run_one (BenchSuite *suite, const char *filter, const char *kernel,
+         KernelCtx *c, double pixels, BenchFn fn)
+{
+    if (filter && !strstr (kernel, filter))
+        return;
+    bench_run (suite, kernel, c->w, c->h, pixels, 0.0, fn, c);
+}
+
+static void
+run_png (BenchSuite *suite, const char *filter, KernelCtx *c)
+{
+    double px = (double) c->w * c->h;
+    ag_png_options_defaults (&c->png);
+    for (int threads = 1; threads >= 0; threads--) {
+        for (int level = 0; level <= 9; level++) {
+            char name[64];
+            snprintf (name, sizeof name, "ag_png_encode/l%d%s",
+                      level, threads ? "" : "/mt");
+            if (filter && !strstr (name, filter))
+                continue;
+            c->png.level   = level;
+            c->png.threads = threads;
+            bench_run (suite, name, c->w, c->h, px, px * 3, k_png, c);
+        }
+    }
+}
+
+static void
+run_jpeg (BenchSuite *suite, const char *filter, KernelCtx *c)
+{
+    guint w = c->w, h = c->h;
+    guint cw = (w + 1) / 2, ch = (h + 1) / 2;
+    size_t px = (size_t) w * h;
+    const AgJpegImage sources[] = {
+        { AG_JPEG_RGB,   w, h, { c->photo }, { (size_t) w * 3 } },
+        { AG_JPEG_GRAY,  w, h, { c->photo_yuv }, { w } },
+        { AG_JPEG_YCBCR, w, h,
+          { c->photo_yuv, c->photo_yuv + px, c->photo_yuv + px + (size_t) cw * ch },
+          { w, cw, cw } },
+    };
+    static const char *names[] = { "rgb", "gray", "ycbcr420" };
+
+    ag_jpeg_options_defaults (&c->jpeg);
+    for (size_t i = 0; i < G_N_ELEMENTS (sources); i++) {
+        char name[64];
+        snprintf (name, sizeof name, "ag_jpeg_encode/%s", names[i]);
+        if (filter && !strstr (name, filter))
+            continue;
+        c->jpeg_img = sources[i];
+        double bytes = i == 0 ? 3.0 * (double) px
+                     : i == 1 ? (double) px
+                     : (double) px + 2.0 * cw * ch;
+        bench_run (suite, name, w, h, (double) px, bytes, k_jpeg, c);
+    }
+}
+
+static void
+run_geometry (BenchSuite *suite, const char *filter, KernelCtx *c)
+{
+    double px = (double) c->w * c->h;
+
+    run_one (suite, filter, "extract_dual_bayer_eyes", c, 2 * px, k_extract);
+    run_one (suite, filter, "extract_dual_bayer_eyes/bin2", c, 2 * px,
+             k_extract_bin2);
+    run_one (suite, filter, "debayer_rg8_to_rgb", c, px, k_debayer_rgb);
+    run_one (suite, filter, "debayer_rg8_to_gray", c, px, k_debayer_gray);
+    run_one (suite, filter, "apply_lut_inplace", c, px, k_lut);
+    run_one (suite, filter, "software_bin_2x2", c, px, k_bin);
+    run_one (suite, filter, "ag_remap_rgb", c, px, k_remap_rgb);
+    run_one (suite, filter, "ag_remap_gray", c, px, k_remap_gray);
+
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++) {
+        char name[64];
+        c->metric = (AgFocusMetric) m;
+        snprintf (name, sizeof name, "ag_focus_score/%s",
+                  ag_focus_metric_name (c->metric));
+        run_one (suite, filter, name, c, px, k_focus);
+    }
+    run_one (suite, filter, "ag_focus_score_all", c, px, k_focus_all);
+
+    run_one (suite, filter, "ag_disparity_colorize", c, px, k_colorize);
+
+    run_png (suite, filter, c);
+    run_jpeg (suite, filter, c);
+}
+
+int
+main (int argc, char *argv[])
+{
+    struct arg_str *json_a    = arg_str0 (NULL, "json", "<path>",
+                                          "write results as JSON");
+    struct arg_str *compare_a = arg_str0 (NULL, "compare", "<baseline.json>",
+                                          "flag regressions against a baseline");
+    struct arg_dbl *thresh_a  = arg_dbl0 (NULL, "threshold", "<pct>",
+                                          "regression threshold in percent (default: 5)");
+    struct arg_int *reps_a    = arg_int0 (NULL, "reps", "<N>",
+                                          "timed repetitions (default: 30)");
+    struct arg_int *warmup_a  = arg_int0 (NULL, "warmup", "<N>",
+                                          "untimed warm-up runs (default: 3)");
+    struct arg_str *filter_a  = arg_str0 (NULL, "filter", "<substr>",
+                                          "only run kernels whose name contains substr");
+    struct arg_str *calib_a   = arg_str0 (NULL, "calib-dir", "<dir>",
+                                          "gen_test_calibration sessions as <dir>/<W>x<H>");
+    struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
+    struct arg_end *end       = arg_end (10);
+
+    void *argtable[] = { json_a, compare_a, thresh_a, reps_a, warmup_a,
+                         filter_a, calib_a, help, end };
+
+    int exitcode = EXIT_SUCCESS;
+    if (arg_nullcheck (argtable) != 0) {
+        fprintf (stderr, "error: insufficient memory\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    thresh_a->dval[0] = 5.0;
+
+    int nerrors = arg_parse (argc, argv, argtable);
+    if (help->count) {
+        printf ("Usage: bench_kernels");
+        arg_print_syntax (stdout, argtable, "\n");
+        arg_print_glossary (stdout, argtable, "  %-28s %s\n");
+        goto done;
+    }
+    if (nerrors > 0) {
+        arg_print_errors (stderr, end, "bench_kernels");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    BenchSuite *suite = g_new0 (BenchSuite, 1);
+    bench_config_defaults (&suite->config);
+    if (reps_a->count)   suite->config.reps   = reps_a->ival[0];
+    if (warmup_a->count) suite->config.warmup = warmup_a->ival[0];
+    if (suite->config.reps < 1 || suite->config.warmup < 0) {
+        fprintf (stderr, "error: --reps must be >= 1 and --warmup >= 0\n");
+        g_free (suite);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    static const guint geometries[][2] = { { 1440, 1080 }, { 720, 540 } };
+    const char *calib_dir = calib_a->count ? calib_a->sval[0] : NULL;
+    const char *filter    = filter_a->count ? filter_a->sval[0] : NULL;
+
+    for (size_t g = 0; g < G_N_ELEMENTS (geometries); g++) {
+        KernelCtx c;
+        if (ctx_init (&c, geometries[g][0], geometries[g][1], calib_dir) != 0) {
+            ctx_clear (&c);
+            exitcode = EXIT_FAILURE;
+            break;
+        }
+        run_geometry (suite, filter, &c);
+        ctx_clear (&c);
+    }
+
+    if (exitcode == EXIT_SUCCESS) {
+        bench_print_table (suite);
+
+        if (json_a->count && bench_write_json (suite, json_a->sval[0]) != 0)
+            exitcode = EXIT_FAILURE;
+
+        if (compare_a->count) {
+            int n = bench_compare (suite, compare_a->sval[0], thresh_a->dval[0]);
+            if (n != 0) exitcode = EXIT_FAILURE;
+            if (n > 0)
+                fprintf (stderr, "warn: %d kernel(s) regressed by more than %.1f%%\n",
+                         n, thresh_a->dval[0]);
+        }
+    }
+
+    g_free (suite);
+
+done:
+    arg_freetable (argtable, sizeof argtable / sizeof argtable[0]);
+    return exitcode;
+}
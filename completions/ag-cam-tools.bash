@@ -8,7 +8,7 @@ _ag_cam_tools() {
     COMPREPLY=()
     cur="${COMP_WORDS[COMP_CWORD]}"
     prev="${COMP_WORDS[COMP_CWORD-1]}"
-    subcmds="connect list capture stream focus calibration-capture depth-preview-classical depth-preview-neural calibration-stash bounce"
+    subcmds="connect list capture stream focus calibration-capture depth-preview-classical depth-preview-neural calibration-stash bounce net-bench tune-transport"
 
     # Complete subcommand as first argument
     if [[ ${COMP_CWORD} -eq 1 ]]; then
@@ -54,7 +54,43 @@ _ag_cam_tools() {
             COMPREPLY=( $(compgen -W "sgbm onnx igev rt-igev foundation" -- "${cur}") )
             return 0
             ;;
-        --model-path)
+        --packet-socket)
+            COMPREPLY=( $(compgen -W "auto on off" -- "${cur}") )
+            return 0
+            ;;
+        --packet-resend)
+            COMPREPLY=( $(compgen -W "always never" -- "${cur}") )
+            return 0
+            ;;
+        --ae-mode)
+            COMPREPLY=( $(compgen -W "host camera" -- "${cur}") )
+            return 0
+            ;;
+        --ae-metering)
+            COMPREPLY=( $(compgen -W "overlap frame" -- "${cur}") )
+            return 0
+            ;;
+        --png-filter)
+            COMPREPLY=( $(compgen -W "none sub up" -- "${cur}") )
+            return 0
+            ;;
+        --jpeg-subsample)
+            COMPREPLY=( $(compgen -W "420 444" -- "${cur}") )
+            return 0
+            ;;
+        --video-format)
+            COMPREPLY=( $(compgen -W "y4m mjpeg" -- "${cur}") )
+            return 0
+            ;;
+        --video-color)
+            COMPREPLY=( $(compgen -W "gray 420" -- "${cur}") )
+            return 0
+            ;;
+        --video-layout)
+            COMPREPLY=( $(compgen -W "sbs left right split" -- "${cur}") )
+            return 0
+            ;;
+        --model-path|--trace|--json|--video-out|--video-timestamps)
             COMPREPLY=( $(compgen -f -- "${cur}") )
             return 0
             ;;
@@ -74,19 +110,19 @@ _ag_cam_tools() {
             COMPREPLY=( $(compgen -W "-i --interface --machine-readable -h --help" -- "${cur}") )
             ;;
         capture)
-            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -o --output -e --encode -x --exposure -b --binning --calibration-local --calibration-slot -v --verbose -h --help" -- "${cur}") )
+            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -o --output -e --encode --png-level --png-filter --jpeg-quality --jpeg-subsample -x --exposure -b --binning --calibration-local --calibration-slot -n --count --interval --burst -v --verbose --ae-mode -h --help" -- "${cur}") )
             ;;
         stream)
-            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -f --fps -x --exposure -g --gain -A --auto-expose -b --binning -p --packet-size --calibration-local --calibration-slot -t --tag-size -h --help" -- "${cur}") )
+            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -f --fps -x --exposure -g --gain -A --auto-expose -b --binning -p --packet-size --calibration-local --calibration-slot -t --tag-size --trace --metrics --headless --duration --stream-buffers --packet-socket --socket-buffer --packet-timeout --frame-retention --packet-resend --roi --startup-profile --ae-mode --ae-metering --tag-threads --tag-decimate --tag-refresh --tag-stereo --tag-log --video-out --video-format --video-color --video-layout --video-quality --video-timestamps -h --help" -- "${cur}") )
             ;;
         focus)
-            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -f --fps -x --exposure -b --binning -q --quiet-audio --roi -h --help" -- "${cur}") )
+            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -f --fps -x --exposure -b --binning -q --quiet-audio --sites --roi --ae-mode --grid --grid-size --grid-log --sweep --sweep-fit --sweep-decimate --sweep-log -h --help" -- "${cur}") )
             ;;
         calibration-capture)
-            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -o --output -n --count -f --fps -x --exposure -g --gain -A --auto-expose -b --binning -p --packet-size -q --quiet-audio -h --help" -- "${cur}") )
+            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -o --output -n --count -f --fps -x --exposure -g --gain -A --auto-expose -b --binning -p --packet-size -q --quiet-audio --ae-mode -h --help" -- "${cur}") )
             ;;
         depth-preview-classical|depth-preview-neural)
-            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -f --fps -x --exposure -g --gain -A --auto-expose -b --binning -p --packet-size --calibration-local --calibration-slot --stereo-backend --model-path --min-disparity --num-disparities --block-size -h --help" -- "${cur}") )
+            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -f --fps -x --exposure -g --gain -A --auto-expose -b --binning -p --packet-size --calibration-local --calibration-slot --stereo-backend --model-path --min-disparity --num-disparities --block-size --trace --metrics --rect-check --rect-alarm --rect-band --video-out --video-format --video-color --video-layout --video-quality --video-timestamps --headless --duration --stream-buffers --packet-socket --socket-buffer --packet-timeout --frame-retention --packet-resend --roi --startup-profile --ae-mode --ae-metering -h --help" -- "${cur}") )
             ;;
         calibration-stash)
             # Sub-action completion as second argument
@@ -99,6 +135,12 @@ _ag_cam_tools() {
         bounce)
             COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface --no-wait --timeout -h --help" -- "${cur}") )
             ;;
+        tune-transport)
+            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -b --binning -f --fps -d --duration --sizes --delays --save --show --forget --json -h --help" -- "${cur}") )
+            ;;
+        net-bench)
+            COMPREPLY=( $(compgen -W "-s --serial -a --address -i --interface -f --fps -d --duration -b --binning -p --packet-size --roi --packet-socket --socket-buffer --stream-buffers --packet-timeout --frame-retention --packet-resend --json -h --help" -- "${cur}") )
+            ;;
     esac
 }
 
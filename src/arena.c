@@ -0,0 +1,153 @@
+/*
+ * arena.c — aligned bump allocator for per-pipeline scratch buffers
+ */
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE_SIZE ((size_t) 2 << 20)   /* 2 MiB */
+
+struct AgFrameArena {
+    guint8        *base;
+    size_t         capacity;
+    size_t         used;
+    size_t         mapped;      /* mmap length (HUGETLB only) */
+    AgArenaBacking backing;
+};
+
+static size_t
+round_up (size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+AgFrameArena *
+ag_frame_arena_new (size_t capacity, AgArenaFlags flags)
+{
+    AgFrameArena *arena = g_new0 (AgFrameArena, 1);
+    arena->capacity = AG_ARENA_ROUND (capacity ? capacity : 1);
+
+    /* Huge pages only pay off once the arena spans at least one. */
+    gboolean want_huge = (flags & AG_ARENA_HUGEPAGES) &&
+                         arena->capacity >= HUGE_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+    if (want_huge) {
+        size_t len = round_up (arena->capacity, HUGE_PAGE_SIZE);
+        void *p = mmap (NULL, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            arena->base    = p;
+            arena->mapped  = len;
+            arena->backing = AG_ARENA_BACKING_HUGETLB;
+            return arena;
+        }
+        /* No reserved hugetlbfs pages — fall through to THP. */
+    }
+#endif
+
+    size_t align = want_huge ? HUGE_PAGE_SIZE : AG_ARENA_ALIGN;
+    size_t len   = want_huge ? round_up (arena->capacity, HUGE_PAGE_SIZE)
+                             : arena->capacity;
+    void *p = NULL;
+    if (posix_memalign (&p, align, len) != 0 || !p) {
+        fprintf (stderr, "error: out of memory allocating %zu-byte frame arena\n",
+                 len);
+        abort ();
+    }
+    arena->base    = p;
+    arena->backing = AG_ARENA_BACKING_HEAP;
+
+#ifdef MADV_HUGEPAGE
+    if (want_huge && madvise (p, len, MADV_HUGEPAGE) == 0)
+        arena->backing = AG_ARENA_BACKING_THP;
+#endif
+
+    return arena;
+}
+
+void *
+ag_frame_arena_alloc (AgFrameArena *arena, size_t size)
+{
+    size_t need = AG_ARENA_ROUND (size ? size : 1);
+    if (need > arena->capacity - arena->used) {
+        fprintf (stderr, "error: frame arena exhausted "
+                 "(%zu of %zu bytes used, %zu requested)\n",
+                 arena->used, arena->capacity, size);
+        abort ();
+    }
+    void *p = arena->base + arena->used;
+    arena->used += need;
+    return p;
+}
+
+size_t
+ag_frame_arena_mark (const AgFrameArena *arena)
+{
+    return arena->used;
+}
+
+void
+ag_frame_arena_release (AgFrameArena *arena, size_t mark)
+{
+    if (mark <= arena->used)
+        arena->used = mark;
+}
+
+void
+ag_frame_arena_reset (AgFrameArena *arena)
+{
+    arena->used = 0;
+}
+
+size_t
+ag_frame_arena_capacity (const AgFrameArena *arena)
+{
+    return arena->capacity;
+}
+
+size_t
+ag_frame_arena_used (const AgFrameArena *arena)
+{
+    return arena->used;
+}
+
+size_t
+ag_frame_arena_available (const AgFrameArena *arena)
+{
+    return arena->capacity - arena->used;
+}
+
+AgArenaBacking
+ag_frame_arena_backing (const AgFrameArena *arena)
+{
+    return arena->backing;
+}
+
+const char *
+ag_frame_arena_backing_name (const AgFrameArena *arena)
+{
+    switch (arena->backing) {
+    case AG_ARENA_BACKING_HUGETLB: return "hugetlb";
+    case AG_ARENA_BACKING_THP:     return "thp";
+    case AG_ARENA_BACKING_HEAP:    break;
+    }
+    return "heap";
+}
+
+void
+ag_frame_arena_free (AgFrameArena *arena)
+{
+    if (!arena)
+        return;
+    if (arena->backing == AG_ARENA_BACKING_HUGETLB)
+        munmap (arena->base, arena->mapped);
+    else
+        free (arena->base);
+    g_free (arena);
+}
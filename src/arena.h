@@ -0,0 +1,88 @@
+/*
+ * arena.h — aligned bump allocator for per-pipeline scratch buffers
+ *
+ * One large allocation, sized up front from the pipeline geometry,
+ * carved into 64-byte-aligned sub-buffers.  Nothing is freed
+ * individually: the whole arena is reset (or rolled back to a mark)
+ * and reused for the next frame or capture, so the hot path does no
+ * allocator work.
+ *
+ * With AG_ARENA_HUGEPAGES the backing store is 2 MiB pages when the OS
+ * provides them — explicit MAP_HUGETLB pages first, then transparent
+ * huge pages via madvise — which cuts TLB misses on the scattered
+ * remap gathers.  Either way the arena falls back to ordinary aligned
+ * heap memory, so callers never need to handle the difference.
+ *
+ *   size_t cap = AG_ARENA_ROUND (eye_n) * 2 + AG_ARENA_ROUND (eye_n * 3) * 2;
+ *   AgFrameArena *arena = ag_frame_arena_new (cap, AG_ARENA_HUGEPAGES);
+ *   guint8 *bayer_left = ag_frame_arena_alloc (arena, eye_n);
+ *   ...
+ *   ag_frame_arena_free (arena);
+ */
+
+#ifndef AG_ARENA_H
+#define AG_ARENA_H
+
+#include <glib.h>
+#include <stddef.h>
+
+/* Alignment of every sub-buffer: one cache line, enough for AVX-512. */
+#define AG_ARENA_ALIGN 64
+
+/* Bytes an allocation of n bytes consumes (use to size the arena). */
+#define AG_ARENA_ROUND(n) \
+    (((size_t) (n) + AG_ARENA_ALIGN - 1) & ~(size_t) (AG_ARENA_ALIGN - 1))
+
+typedef enum {
+    AG_ARENA_DEFAULT    = 0,
+    AG_ARENA_HUGEPAGES  = 1 << 0,   /* try MAP_HUGETLB, then THP */
+} AgArenaFlags;
+
+typedef enum {
+    AG_ARENA_BACKING_HEAP = 0,      /* posix_memalign                 */
+    AG_ARENA_BACKING_THP,           /* heap + madvise(MADV_HUGEPAGE)  */
+    AG_ARENA_BACKING_HUGETLB,       /* mmap(MAP_HUGETLB)              */
+} AgArenaBacking;
+
+typedef struct AgFrameArena AgFrameArena;
+
+/*
+ * Create an arena holding at least capacity bytes.
+ * Aborts on out-of-memory, like g_malloc.
+ */
+AgFrameArena *ag_frame_arena_new (size_t capacity, AgArenaFlags flags);
+
+/*
+ * Carve a 64-byte-aligned, uninitialised buffer of size bytes.
+ * Running past the capacity is a sizing bug: it prints an error and
+ * aborts rather than silently falling back to the heap.
+ */
+void *ag_frame_arena_alloc (AgFrameArena *arena, size_t size);
+
+/* Typed convenience: n elements of type T. */
+#define ag_frame_arena_alloc_n(arena, T, n) \
+    ((T *) ag_frame_arena_alloc ((arena), sizeof (T) * (size_t) (n)))
+
+/*
+ * Scoped scratch: remember the current fill level and later roll back
+ * to it, releasing everything allocated in between.
+ */
+size_t ag_frame_arena_mark    (const AgFrameArena *arena);
+void   ag_frame_arena_release (AgFrameArena *arena, size_t mark);
+
+/* Release every sub-buffer; the memory is kept for reuse. */
+void   ag_frame_arena_reset (AgFrameArena *arena);
+
+size_t ag_frame_arena_capacity  (const AgFrameArena *arena);
+size_t ag_frame_arena_used      (const AgFrameArena *arena);
+size_t ag_frame_arena_available (const AgFrameArena *arena);
+
+AgArenaBacking ag_frame_arena_backing (const AgFrameArena *arena);
+
+/* "heap", "thp" or "hugetlb" (for startup logging). */
+const char *ag_frame_arena_backing_name (const AgFrameArena *arena);
+
+/* Free the arena and every buffer carved from it.  NULL is a no-op. */
+void ag_frame_arena_free (AgFrameArena *arena);
+
+#endif /* AG_ARENA_H */
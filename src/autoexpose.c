@@ -0,0 +1,286 @@
+/*
+ * autoexpose.c — host-side auto-exposure (-A, --ae-mode host)
+ */
+
+#include "autoexpose.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+int
+ag_parse_ae_mode (const char *str, AgAeMode *out)
+{
+    if (strcmp (str, "host") == 0)
+        *out = AG_AE_HOST;
+    else if (strcmp (str, "camera") == 0)
+        *out = AG_AE_CAMERA;
+    else
+        return -1;
+    return 0;
+}
+
+int
+ag_parse_ae_metering (const char *str, AgAeMetering *out)
+{
+    if (strcmp (str, "frame") == 0)
+        *out = AG_AE_METER_FRAME;
+    else if (strcmp (str, "overlap") == 0)
+        *out = AG_AE_METER_OVERLAP;
+    else
+        return -1;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Histogram                                                          */
+/* ------------------------------------------------------------------ */
+
+/*
+ * In the column-interleaved DualBayer layout one eye's 2x2 CFA quad at
+ * raw offset o is o, o+2, o+stride, o+stride+2; the other eye's quad
+ * starts at o+1.
+ */
+static inline guint
+eye_quad_sum (const guint8 *p, guint stride)
+{
+    return (guint) p[0] + p[2] + p[stride] + p[stride + 2];
+}
+
+static void
+histogram_finish (AgAeHistogram *out, guint64 sum_left, guint64 sum_right,
+                  guint64 n_quads)
+{
+    for (guint i = 0; i < 256; i++)
+        out->n += out->bins[i];
+    if (n_quads) {
+        out->left_mean  = (double) sum_left  / (4.0 * (double) n_quads);
+        out->right_mean = (double) sum_right / (4.0 * (double) n_quads);
+    }
+}
+
+void
+ag_ae_histogram (const guint8 *data, guint width, guint height,
+                 guint step, AgAeHistogram *out)
+{
+    memset (out, 0, sizeof *out);
+    step = (MAX (step, 4u) + 3) & ~3u;
+
+    /* Centre the grid so the borders are not over-weighted; keep the
+     * first quad on an R site of both eyes. */
+    guint x0 = (step / 2) & ~3u;
+    guint y0 = (step / 2) & ~1u;
+    guint64 sum_l = 0, sum_r = 0, n_quads = 0;
+
+    for (guint y = y0; y + 1 < height; y += step) {
+        const guint8 *row = data + (size_t) y * width;
+        for (guint x = x0; x + 3 < width; x += step) {
+            guint l = eye_quad_sum (row + x,     width);
+            guint r = eye_quad_sum (row + x + 1, width);
+            out->bins[(l + 2) >> 2]++;
+            out->bins[(r + 2) >> 2]++;
+            sum_l += l;
+            sum_r += r;
+            n_quads++;
+        }
+    }
+    histogram_finish (out, sum_l, sum_r, n_quads);
+}
+
+double
+ag_ae_histogram_mean (const AgAeHistogram *h)
+{
+    if (h->n == 0)
+        return 0.0;
+    guint64 acc = 0;
+    for (guint i = 0; i < 256; i++)
+        acc += (guint64) i * h->bins[i];
+    return (double) acc / (double) h->n;
+}
+
+double
+ag_ae_histogram_fraction_at_or_above (const AgAeHistogram *h, guint level)
+{
+    if (h->n == 0 || level > 255)
+        return 0.0;
+    guint64 acc = 0;
+    for (guint i = level; i < 256; i++)
+        acc += h->bins[i];
+    return (double) acc / (double) h->n;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Overlap meter                                                      */
+/* ------------------------------------------------------------------ */
+
+/* Raw offset of the CFA quad holding processed eye pixel src_off, or
+ * G_MAXUINT32 if the quad falls outside the frame. */
+static guint32
+raw_quad_offset (guint32 src_off, guint table_w, guint frame_w,
+                 guint frame_h, guint sb)
+{
+    guint ex = (src_off % table_w) * sb;
+    guint ey = (src_off / table_w) * sb;
+    ex &= ~1u;
+    ey &= ~1u;
+    if (2 * ex + 3 >= frame_w || ey + 1 >= frame_h)
+        return G_MAXUINT32;
+    return ey * frame_w + 2 * ex;
+}
+
+AgAeMeter *
+ag_ae_meter_new_overlap (const AgRemapTable *left, const AgRemapTable *right,
+                         guint frame_w, guint frame_h,
+                         int software_binning, guint step,
+                         const AgRoi *weight_roi, guint weight)
+{
+    if (!left || !right ||
+        left->width != right->width || left->height != right->height) {
+        fprintf (stderr, "error: overlap metering needs a matching pair of "
+                 "remap tables\n");
+        return NULL;
+    }
+    guint sb = software_binning > 1 ? (guint) software_binning : 1;
+    step = MAX (step, 1u);
+    guint cap = ((left->width + step - 1) / step) *
+                ((left->height + step - 1) / step);
+
+    AgAeMeter *m = g_new0 (AgAeMeter, 1);
+    m->left    = g_new (guint32, cap);
+    m->right   = g_new (guint32, cap);
+    m->weight  = g_new (guint8, cap);
+    m->frame_w = frame_w;
+    weight = CLAMP (weight, 1u, 255u);
+
+    gboolean weighted = weight_roi && weight_roi->height > 0;
+    for (guint v = step / 2; v < left->height; v += step) {
+        for (guint u = step / 2; u < left->width; u += step) {
+            size_t i = (size_t) v * left->width + u;
+            guint32 sl = left->offsets[i];
+            guint32 sr = right->offsets[i];
+            if (sl == AG_REMAP_SENTINEL || sr == AG_REMAP_SENTINEL)
+                continue;
+            guint32 ol = raw_quad_offset (sl, left->width, frame_w,
+                                          frame_h, sb);
+            guint32 orr = raw_quad_offset (sr, right->width, frame_w,
+                                           frame_h, sb);
+            if (ol == G_MAXUINT32 || orr == G_MAXUINT32)
+                continue;
+
+            gboolean inside = weighted &&
+                u >= weight_roi->x && u < weight_roi->x + weight_roi->width &&
+                v >= weight_roi->y && v < weight_roi->y + weight_roi->height;
+            m->left[m->n]   = ol;
+            m->right[m->n]  = orr + 1;
+            m->weight[m->n] = inside ? (guint8) weight : 1;
+            m->n++;
+        }
+    }
+
+    if (m->n == 0) {
+        fprintf (stderr, "error: the remap tables share no valid overlap "
+                 "for metering\n");
+        ag_ae_meter_free (m);
+        return NULL;
+    }
+    return m;
+}
+
+void
+ag_ae_meter_free (AgAeMeter *m)
+{
+    if (!m)
+        return;
+    g_free (m->left);
+    g_free (m->right);
+    g_free (m->weight);
+    g_free (m);
+}
+
+void
+ag_ae_meter_histogram (const AgAeMeter *m, const guint8 *data,
+                       AgAeHistogram *out)
+{
+    memset (out, 0, sizeof *out);
+    guint64 sum_l = 0, sum_r = 0;
+
+    for (guint i = 0; i < m->n; i++) {
+        guint l = eye_quad_sum (data + m->left[i],  m->frame_w);
+        guint r = eye_quad_sum (data + m->right[i], m->frame_w);
+        out->bins[(l + 2) >> 2] += m->weight[i];
+        out->bins[(r + 2) >> 2] += m->weight[i];
+        sum_l += l;
+        sum_r += r;
+    }
+    histogram_finish (out, sum_l, sum_r, m->n);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Controller                                                         */
+/* ------------------------------------------------------------------ */
+
+void
+ag_ae_controller_init (AgAeController *c,
+                       double exposure_us, double gain_db,
+                       double exposure_min_us, double exposure_max_us,
+                       double gain_min_db, double gain_max_db)
+{
+    memset (c, 0, sizeof *c);
+    c->target          = AG_AE_TARGET_DEFAULT;
+    c->deadband        = AG_AE_DEADBAND_DEFAULT;
+    c->kp              = AG_AE_KP_DEFAULT;
+    c->exposure_min_us = exposure_min_us;
+    c->exposure_max_us = MAX (exposure_max_us, exposure_min_us);
+    c->gain_min_db     = gain_min_db;
+    c->gain_max_db     = MAX (gain_max_db, gain_min_db);
+    c->exposure_us     = CLAMP (exposure_us, c->exposure_min_us,
+                                c->exposure_max_us);
+    c->gain_db         = CLAMP (gain_db, c->gain_min_db, c->gain_max_db);
+    c->balance         = 1.0;
+}
+
+gboolean
+ag_ae_controller_update (AgAeController *c, const AgAeHistogram *h)
+{
+    if (h->n == 0)
+        return FALSE;
+
+    /* A mean on target can still hide clipped highlights; count them
+     * as overexposure so specular patches pull the exposure down. */
+    double level = ag_ae_histogram_mean (h);
+    if (ag_ae_histogram_fraction_at_or_above (h, AG_AE_CLIP_LEVEL)
+        > AG_AE_CLIP_FRACTION)
+        level = MAX (level, c->target * (1.0 + 2.0 * c->deadband));
+    c->brightness = level;
+    c->balance    = h->right_mean > 0.0 ? h->left_mean / h->right_mean : 1.0;
+
+    double err = log (c->target / MAX (level, 1.0));
+    if (fabs (err) <= log (1.0 + c->deadband)) {
+        c->settled++;
+        return FALSE;
+    }
+    c->settled = 0;
+
+    /* A frame that is mostly clipped says nothing about how far over it
+     * is; take the largest step down. */
+    double factor = (level >= AG_AE_CLIP_LEVEL)
+                    ? 1.0 / AG_AE_MAX_STEP
+                    : CLAMP (exp (c->kp * err),
+                             1.0 / AG_AE_MAX_STEP, AG_AE_MAX_STEP);
+
+    /* Total exposure in microseconds at unity gain, spent on exposure
+     * time first (lower noise), then on gain. */
+    double total = c->exposure_us * pow (10.0, c->gain_db / 20.0) * factor;
+    double exp_us = CLAMP (total / pow (10.0, c->gain_min_db / 20.0),
+                           c->exposure_min_us, c->exposure_max_us);
+    double gain = CLAMP (20.0 * log10 (total / exp_us),
+                         c->gain_min_db, c->gain_max_db);
+
+    if (fabs (exp_us - c->exposure_us) < 0.5 &&
+        fabs (gain - c->gain_db) < 0.01)
+        return FALSE;   /* pinned at a limit */
+
+    c->exposure_us = exp_us;
+    c->gain_db     = gain;
+    return TRUE;
+}
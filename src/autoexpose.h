@@ -0,0 +1,142 @@
+/*
+ * autoexpose.h — host-side auto-exposure (-A, --ae-mode host)
+ *
+ * Meters the raw DualBayerRG8 frames the host already receives instead
+ * of polling the camera's own AE over GenICam.  A sparse grid of CFA
+ * quads from both eyes feeds a 256-bin luminance histogram; a
+ * proportional controller on log brightness turns that into one
+ * ExposureTime/Gain for both heads, and asks for a register write only
+ * when the error leaves a deadband.
+ *
+ * Two metering layouts:
+ *   whole frame     ag_ae_histogram(): a regular grid over the raw frame.
+ *   stereo overlap  AgAeMeter: grid points on the rectified image that
+ *                   both remap tables can see, traced back to raw
+ *                   offsets once, optionally weighted toward a window
+ *                   (the disparity band).
+ *
+ *   AgAeController ae;
+ *   ag_ae_controller_init (&ae, exp_us, gain_db, 20, 90000, 0, 24);
+ *   ag_ae_histogram (data, w, h, AG_AE_SAMPLE_STEP, &hist);
+ *   if (ag_ae_controller_update (&ae, &hist))
+ *       write ae.exposure_us / ae.gain_db;
+ *
+ * This file has no Aravis dependency; the camera glue is
+ * auto_expose_settle() / auto_expose_track() in common.c.
+ */
+
+#ifndef AG_AUTOEXPOSE_H
+#define AG_AUTOEXPOSE_H
+
+#include <glib.h>
+
+#include "remap.h"
+#include "roi.h"
+
+#define AG_AE_TARGET_DEFAULT    128.0   /* mean raw level, as TargetBrightness */
+#define AG_AE_DEADBAND_DEFAULT  0.08    /* +/-8 % brightness: no write         */
+#define AG_AE_KP_DEFAULT        0.8     /* fraction of log error per update    */
+#define AG_AE_MAX_STEP          4.0     /* largest exposure change per update  */
+#define AG_AE_SAMPLE_STEP       16      /* px between sampled quads (even)     */
+#define AG_AE_CLIP_LEVEL        250     /* histogram bin counted as clipped    */
+#define AG_AE_CLIP_FRACTION     0.02    /* clipped share that forces a cut     */
+#define AG_AE_WEIGHT_DEFAULT    4       /* overlap samples inside the window   */
+
+typedef enum {
+    AG_AE_OFF = 0,      /* fixed exposure (-x / -g or camera default) */
+    AG_AE_HOST,         /* host histogram controller (default for -A) */
+    AG_AE_CAMERA,       /* camera ExposureAuto, settled then locked   */
+} AgAeMode;
+
+/* Parse "host" / "camera".  Returns 0 on success, -1 otherwise. */
+int ag_parse_ae_mode (const char *str, AgAeMode *out);
+
+typedef enum {
+    AG_AE_METER_FRAME = 0,  /* whole raw frame                        */
+    AG_AE_METER_OVERLAP,    /* rectified overlap of both eyes         */
+} AgAeMetering;
+
+/* Parse "frame" / "overlap".  Returns 0 on success, -1 otherwise. */
+int ag_parse_ae_metering (const char *str, AgAeMetering *out);
+
+/*
+ * One bin per eye per sample: the mean of that eye's 2x2 CFA quad.
+ * left_mean / right_mean (unweighted) expose a brightness mismatch
+ * between the heads at equal exposure.
+ */
+typedef struct {
+    guint32 bins[256];
+    guint32 n;
+    double  left_mean;
+    double  right_mean;
+} AgAeHistogram;
+
+/*
+ * Histogram a width x height column-interleaved DualBayer frame (left
+ * eye on even columns) on a grid every step raw pixels; step is rounded
+ * up to a multiple of 4 so each sample is one CFA quad of each eye.
+ * Cost is proportional to the sampled grid.
+ */
+void   ag_ae_histogram (const guint8 *data, guint width, guint height,
+                        guint step, AgAeHistogram *out);
+double ag_ae_histogram_mean (const AgAeHistogram *h);
+double ag_ae_histogram_fraction_at_or_above (const AgAeHistogram *h,
+                                             guint level);
+
+/* Sample list for overlap metering; build once per remap table pair. */
+typedef struct {
+    guint32 *left;      /* raw offset of each sample's left-eye CFA quad  */
+    guint32 *right;     /* raw offset of the matching right-eye quad      */
+    guint8  *weight;
+    guint    n;
+    guint    frame_w;   /* raw row stride the offsets assume */
+} AgAeMeter;
+
+/*
+ * Trace a grid (every step rectified px) through both remap tables and
+ * keep the points where both eyes have a source pixel.  The tables map
+ * processed eye pixels (raw eye pixels / software_binning) for a
+ * frame_w x frame_h raw DualBayer frame.  Samples inside *weight_roi
+ * (rectified coordinates; NULL or height 0 = none) count `weight`
+ * times.  Returns NULL (with a diagnostic) if no point is seen by both
+ * eyes.  Free with ag_ae_meter_free().
+ */
+AgAeMeter *ag_ae_meter_new_overlap (const AgRemapTable *left,
+                                    const AgRemapTable *right,
+                                    guint frame_w, guint frame_h,
+                                    int software_binning, guint step,
+                                    const AgRoi *weight_roi, guint weight);
+void       ag_ae_meter_free (AgAeMeter *m);
+
+/* Histogram one raw frame through the meter's sample list. */
+void ag_ae_meter_histogram (const AgAeMeter *m, const guint8 *data,
+                            AgAeHistogram *out);
+
+typedef struct {
+    double target;
+    double deadband;
+    double kp;
+    double exposure_min_us, exposure_max_us;
+    double gain_min_db, gain_max_db;
+
+    double exposure_us;     /* current command */
+    double gain_db;
+    double brightness;      /* last metered level (clip-adjusted) */
+    double balance;         /* last left/right mean ratio (1 = matched) */
+    guint  settled;         /* consecutive updates inside the deadband */
+} AgAeController;
+
+/* Start from the camera's current values; limits are clamped into range. */
+void ag_ae_controller_init (AgAeController *c,
+                            double exposure_us, double gain_db,
+                            double exposure_min_us, double exposure_max_us,
+                            double gain_min_db, double gain_max_db);
+
+/*
+ * Meter one histogram.  Exposure time is raised before gain and gain
+ * is cut before exposure time.  Returns TRUE when exposure_us/gain_db
+ * changed and should be written to the camera.
+ */
+gboolean ag_ae_controller_update (AgAeController *c, const AgAeHistogram *h);
+
+#endif /* AG_AUTOEXPOSE_H */
@@ -557,6 +557,59 @@ archive_foreach (const uint8_t *data, size_t len, entry_visitor_fn visitor,
     return 0;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Metadata                                                           */
+/* ------------------------------------------------------------------ */
+
+/* [x, y] number pair. */
+static gboolean
+read_point (const cJSON *item, double *x, double *y)
+{
+    if (!cJSON_IsArray (item) || cJSON_GetArraySize (item) != 2)
+        return FALSE;
+    const cJSON *jx = cJSON_GetArrayItem (item, 0);
+    const cJSON *jy = cJSON_GetArrayItem (item, 1);
+    if (!cJSON_IsNumber (jx) || !cJSON_IsNumber (jy))
+        return FALSE;
+    *x = jx->valuedouble;
+    *y = jy->valuedouble;
+    return TRUE;
+}
+
+int
+ag_calib_meta_parse (const char *json, size_t len, AgCalibMeta *out)
+{
+    cJSON *root = cJSON_ParseWithLength (json, len);
+    if (!root)
+        return -1;
+
+    cJSON *dr = cJSON_GetObjectItemCaseSensitive (root, "disparity_range");
+    if (dr) {
+        cJSON *md = cJSON_GetObjectItemCaseSensitive (dr, "min_disparity");
+        cJSON *nd = cJSON_GetObjectItemCaseSensitive (dr, "num_disparities");
+        if (cJSON_IsNumber (md)) out->min_disparity   = md->valueint;
+        if (cJSON_IsNumber (nd)) out->num_disparities = nd->valueint;
+    }
+    cJSON *fl = cJSON_GetObjectItemCaseSensitive (root, "focal_length_px");
+    if (cJSON_IsNumber (fl)) out->focal_length_px = fl->valuedouble;
+    cJSON *bl = cJSON_GetObjectItemCaseSensitive (root, "baseline_cm");
+    if (cJSON_IsNumber (bl)) out->baseline_cm = bl->valuedouble;
+
+    double lx, ly, rx, ry;
+    if (read_point (cJSON_GetObjectItemCaseSensitive (root, "principal_point_px"),
+                    &lx, &ly) &&
+        read_point (cJSON_GetObjectItemCaseSensitive (root, "principal_point_right_px"),
+                    &rx, &ry)) {
+        out->has_projection = TRUE;
+        out->cx_left  = lx;
+        out->cx_right = rx;
+        out->cy       = ly;
+    }
+
+    cJSON_Delete (root);
+    return 0;
+}
+
 /* ------------------------------------------------------------------ */
 /*  Unpack                                                             */
 /* ------------------------------------------------------------------ */
@@ -613,24 +666,8 @@ unpack_visitor (const char *name, uint32_t name_len,
         if (!ctx->right)
             return -1;
     } else if (strcmp (name, "calibration_meta.json") == 0 && ctx->meta) {
-        /* Parse JSON metadata. */
-        cJSON *root = cJSON_ParseWithLength ((const char *) data, data_len);
-        if (root) {
-            cJSON *dr = cJSON_GetObjectItemCaseSensitive (root, "disparity_range");
-            if (dr) {
-                cJSON *md = cJSON_GetObjectItemCaseSensitive (dr, "min_disparity");
-                cJSON *nd = cJSON_GetObjectItemCaseSensitive (dr, "num_disparities");
-                if (cJSON_IsNumber (md)) ctx->meta->min_disparity   = md->valueint;
-                if (cJSON_IsNumber (nd)) ctx->meta->num_disparities = nd->valueint;
-            }
-            cJSON *fl = cJSON_GetObjectItemCaseSensitive (root, "focal_length_px");
-            if (cJSON_IsNumber (fl)) ctx->meta->focal_length_px = fl->valuedouble;
-            cJSON *bl = cJSON_GetObjectItemCaseSensitive (root, "baseline_cm");
-            if (cJSON_IsNumber (bl)) ctx->meta->baseline_cm = bl->valuedouble;
-            cJSON_Delete (root);
-        } else {
+        if (ag_calib_meta_parse ((const char *) data, data_len, ctx->meta) != 0)
             fprintf (stderr, "calib_archive: warn: failed to parse calibration_meta.json\n");
-        }
     }
 
     return 0;
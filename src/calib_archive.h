@@ -93,6 +93,13 @@ int ag_calib_archive_unpack (const uint8_t *data, size_t len,
                              AgRemapTable **out_right,
                              AgCalibMeta *out_meta);
 
+/*
+ * Parse calibration_meta.json text into *out.  Only keys present in the
+ * JSON are written; has_projection is set when both principal points
+ * are.  Returns 0 on success, -1 if the text is not valid JSON.
+ */
+int ag_calib_meta_parse (const char *json, size_t len, AgCalibMeta *out);
+
 /*
  * Print the table-of-contents and calibration summary of an archive.
  * Accepts AGST, AGCZ, or raw AGCAL.
@@ -8,7 +8,6 @@
 #include "calib_load.h"
 #include "calib_archive.h"
 #include "device_file.h"
-#include "../vendor/cJSON.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -17,6 +16,49 @@
 /*  Metadata-only loader                                               */
 /* ------------------------------------------------------------------ */
 
+/*
+ * Read a 3x4 float64 C-order .npy, as numpy saves OpenCV's P1/P2.
+ * Returns 0 on success, -1 if missing or of another layout.
+ */
+static int
+load_projection_npy (const char *session_path, const char *name,
+                     double P[12])
+{
+    char *path = g_build_filename (session_path, "calib_result", name, NULL);
+    gchar *contents = NULL;
+    gsize  length   = 0;
+    gboolean ok = g_file_get_contents (path, &contents, &length, NULL);
+    g_free (path);
+    if (!ok)
+        return -1;
+
+    int rc = -1;
+    const guint8 *u = (const guint8 *) contents;
+    if (length >= 12 && memcmp (contents, "\x93NUMPY", 6) == 0) {
+        gsize off  = u[6] == 1 ? 10 : 12;
+        gsize hlen = u[6] == 1 ? (gsize) (u[8] | u[9] << 8)
+                               : (gsize) (u[8] | u[9] << 8 | u[10] << 16 |
+                                          (guint32) u[11] << 24);
+        if (off + hlen + 12 * sizeof (double) <= length) {
+            gchar *hdr = g_strndup (contents + off, hlen);
+            if (strstr (hdr, "'descr': '<f8'") &&
+                strstr (hdr, "'fortran_order': False") &&
+                strstr (hdr, "'shape': (3, 4)")) {
+                for (int i = 0; i < 12; i++) {
+                    guint64 bits;
+                    memcpy (&bits, contents + off + hlen + i * 8, 8);
+                    bits = GUINT64_FROM_LE (bits);
+                    memcpy (&P[i], &bits, 8);
+                }
+                rc = 0;
+            }
+            g_free (hdr);
+        }
+    }
+    g_free (contents);
+    return rc;
+}
+
 int
 ag_calib_load_meta (const char *session_path, AgCalibMeta *out)
 {
@@ -35,30 +77,26 @@ ag_calib_load_meta (const char *session_path, AgCalibMeta *out)
     }
     g_free (json_path);
 
-    cJSON *root = cJSON_ParseWithLength (contents, length);
+    int rc = ag_calib_meta_parse (contents, length, out);
     g_free (contents);
 
-    if (!root) {
+    if (rc != 0) {
         fprintf (stderr, "warn: failed to parse calibration_meta.json\n");
         return -1;
     }
 
-    /* disparity_range object. */
-    cJSON *dr = cJSON_GetObjectItemCaseSensitive (root, "disparity_range");
-    if (dr) {
-        cJSON *md = cJSON_GetObjectItemCaseSensitive (dr, "min_disparity");
-        cJSON *nd = cJSON_GetObjectItemCaseSensitive (dr, "num_disparities");
-        if (cJSON_IsNumber (md)) out->min_disparity   = md->valueint;
-        if (cJSON_IsNumber (nd)) out->num_disparities  = nd->valueint;
+    /* Sessions exported before principal_point_right_px still carry
+     * the projection matrices themselves. */
+    double P1[12], P2[12];
+    if (!out->has_projection &&
+        load_projection_npy (session_path, "proj_mats_left.npy",  P1) == 0 &&
+        load_projection_npy (session_path, "proj_mats_right.npy", P2) == 0) {
+        out->has_projection = TRUE;
+        out->cx_left  = P1[2];
+        out->cx_right = P2[2];
+        out->cy       = P1[6];
     }
 
-    cJSON *fl = cJSON_GetObjectItemCaseSensitive (root, "focal_length_px");
-    if (cJSON_IsNumber (fl)) out->focal_length_px = fl->valuedouble;
-
-    cJSON *bl = cJSON_GetObjectItemCaseSensitive (root, "baseline_cm");
-    if (cJSON_IsNumber (bl)) out->baseline_cm = bl->valuedouble;
-
-    cJSON_Delete (root);
     return 0;
 }
 
@@ -169,3 +207,40 @@ ag_calib_load (ArvDevice *device,
     fprintf (stderr, "error: no calibration source specified\n");
     return -1;
 }
+
+/* ------------------------------------------------------------------ */
+/*  Sensor ROI                                                         */
+/* ------------------------------------------------------------------ */
+
+int
+ag_calib_crop_to_roi (AgRemapTable **left, AgRemapTable **right,
+                      const AgRoi *roi, guint full_w, guint full_h)
+{
+    if (!ag_roi_active (roi))
+        return 0;
+
+    if ((*left)->width != full_w || (*left)->height != full_h ||
+        (*right)->width != full_w || (*right)->height != full_h) {
+        fprintf (stderr, "error: remap dimensions %ux%u do not match frame %ux%u\n",
+                 (*left)->width, (*left)->height, full_w, full_h);
+        return -1;
+    }
+
+    AgRemapTable *l = ag_remap_table_crop (*left,  roi->x, roi->y,
+                                           roi->width, roi->height);
+    AgRemapTable *r = ag_remap_table_crop (*right, roi->x, roi->y,
+                                           roi->width, roi->height);
+    if (!l || !r) {
+        ag_remap_table_free (l);
+        ag_remap_table_free (r);
+        return -1;
+    }
+
+    ag_remap_table_free (*left);
+    ag_remap_table_free (*right);
+    *left  = l;
+    *right = r;
+    printf ("Rectification maps cropped to ROI %ux%u+%u+%u.\n",
+            roi->width, roi->height, roi->x, roi->y);
+    return 0;
+}
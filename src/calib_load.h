@@ -39,6 +39,16 @@ int ag_calib_load (ArvDevice *device,
                    AgRemapTable **out_right,
                    AgCalibMeta *out_meta);
 
+/*
+ * Crop freshly loaded full-frame tables to a sensor ROI (see roi.h).
+ * Both tables must be full_w x full_h (the per-eye processed frame
+ * without ROI); they are replaced by ag_remap_table_crop() results.
+ * No-op when roi is inactive.  Returns 0 on success, -1 on error
+ * (prints its own diagnostics; the tables are left untouched).
+ */
+int ag_calib_crop_to_roi (AgRemapTable **left, AgRemapTable **right,
+                          const AgRoi *roi, guint full_w, guint full_h);
+
 /*
  * Load only calibration metadata from a local session path.
  * Reads <session_path>/calib_result/calibration_meta.json.
@@ -9,10 +9,16 @@
  * Binning defaults to 1 (1440×1080 per eye, full resolution) but can be
  * overridden with -b 2 (720×540).  Output is always colour PNG so that
  * the calibration notebook can consume the images without changes.
+ *
+ * Each eye of a saved pair is encoded on an image-writer thread, so the
+ * preview keeps running while the PNGs are written; the count, title and
+ * beep are updated when both files of a pair are on disk.
  */
 
 #include "common.h"
+#include "arena.h"
 #include "image.h"
+#include "image_writer.h"
 #include "font.h"
 #include "../vendor/argtable3.h"
 
@@ -87,11 +93,141 @@ sigint_handler (int sig)
     g_quit = 1;
 }
 
+/* Two writers encode the eyes of a pair side by side; the queue holds a
+ * few more pairs in case 's' is pressed faster than they are written. */
+#define SAVE_WRITERS    2
+#define SAVE_QUEUE_MAX  6
+
+/* Progress shown in the window and console, updated on the main loop. */
+typedef struct {
+    SDL_Window *window;
+    char       *title;
+    size_t      title_size;
+    int         saved_count;
+    int         target_count;
+    gboolean    enable_audio;
+} SaveProgress;
+
+/* One pair in flight: both eyes are reported together. */
+typedef struct {
+    SaveProgress *progress;
+    int           index;
+    int           pending;        /* eyes not yet written */
+    gboolean      failed;
+} SavePair;
+
+/* One eye, owned by the image writer once submitted. */
+typedef struct {
+    guint8   *data;
+    guint     width;
+    guint     height;
+    gboolean  color;
+    char     *path;
+} SaveEye;
+
+static int
+save_eye_write (gpointer frame)
+{
+    SaveEye *eye = frame;
+    if (eye->color)
+        return write_color_image (AG_ENC_PNG, eye->path, eye->data,
+                                  eye->width, eye->height);
+    return write_gray_image (AG_ENC_PNG, eye->path, eye->data,
+                             eye->width, eye->height);
+}
+
+static void
+save_eye_free (gpointer frame)
+{
+    SaveEye *eye = frame;
+    g_free (eye->data);
+    g_free (eye->path);
+    g_free (eye);
+}
+
+static void
+save_pair_done (gpointer user_data, int status)
+{
+    SavePair *pair = user_data;
+    if (status != EXIT_SUCCESS)
+        pair->failed = TRUE;
+    if (--pair->pending > 0)
+        return;
+
+    SaveProgress *p = pair->progress;
+    if (pair->failed) {
+        fprintf (stderr, "  error: failed to save pair %d\n", pair->index);
+        g_free (pair);
+        return;
+    }
+
+    p->saved_count++;
+    if (p->enable_audio)
+        audio_play_beep ();
+    printf ("  Saved pair %d / %d\n", p->saved_count, p->target_count);
+
+    snprintf (p->title, p->title_size,
+              "Calibration Capture [%d/%d] — 's' save, 'q' quit",
+              p->saved_count, p->target_count);
+    SDL_SetWindowTitle (p->window, p->title);
+
+    if (p->saved_count >= p->target_count)
+        printf ("\n  Target reached! Press 'q' to finish "
+                "or 's' to capture more.\n\n");
+    g_free (pair);
+}
+
+static SaveEye *
+save_eye_new (const char *dir, const char *prefix, int index,
+              guint width, guint height, gboolean color)
+{
+    SaveEye *eye = g_new0 (SaveEye, 1);
+    char *name = g_strdup_printf ("%s%d.png", prefix, index);
+    eye->path   = g_build_filename (dir, name, NULL);
+    eye->data   = g_malloc ((size_t) width * height);
+    eye->width  = width;
+    eye->height = height;
+    eye->color  = color;
+    g_free (name);
+    return eye;
+}
+
+/*
+ * Queue both eyes of a pair.  Never waits on a full queue: the pair is
+ * dropped with a warning instead, so the preview does not stall.  The
+ * main loop is the only submitter, so once the left eye is accepted
+ * there is room for the right.
+ */
+static gboolean
+save_pair_submit (AgImageWriter *writer, SaveProgress *progress, int index,
+                  SaveEye *left, SaveEye *right)
+{
+    SavePair *pair = g_new0 (SavePair, 1);
+    pair->progress = progress;
+    pair->index    = index;
+    pair->pending  = 2;
+
+    AgImageJob job = { save_eye_write, left, save_eye_free,
+                       save_pair_done, pair };
+    AgImageWriterStats st;
+    ag_image_writer_stats (writer, &st);
+    if (st.queued + 2 > SAVE_QUEUE_MAX ||
+        !ag_image_writer_submit (writer, &job, FALSE)) {
+        save_eye_free (left);
+        save_eye_free (right);
+        g_free (pair);
+        return FALSE;
+    }
+    job.frame = right;
+    ag_image_writer_submit (writer, &job, TRUE);
+    return TRUE;
+}
+
 static int
 calibration_capture_loop (const char *device_id, const char *iface_ip,
                           const char *output_dir, int target_count,
                           double fps, double exposure_us, double gain_db,
-                          gboolean auto_expose, int packet_size, int binning,
+                          AgAeMode ae_mode, int packet_size, int binning,
                           gboolean enable_audio)
 {
     /* Build a unique session folder: calibration_<datetime>_<md5_prefix>
@@ -101,7 +237,7 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
     snprintf (param_str, sizeof param_str,
               "dev=%s fps=%.2f exp=%.1f gain=%.1f auto=%d pkt=%d bin=%d",
               device_id, fps, exposure_us, gain_db,
-              (int) auto_expose, packet_size, binning);
+              (int) (ae_mode != AG_AE_OFF), packet_size, binning);
 
     char *full_md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5,
                                                      param_str, -1);
@@ -137,8 +273,8 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
 
     AgCameraConfig cfg;
     if (camera_configure (camera, AG_MODE_CONTINUOUS,
-                          binning, exposure_us, gain_db, auto_expose,
-                          packet_size, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
+                          binning, exposure_us, gain_db, ae_mode == AG_AE_CAMERA,
+                          packet_size, NULL, NULL, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
         g_free (session_dir);
         g_object_unref (camera);
         arv_shutdown ();
@@ -164,7 +300,7 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
         g_free (session_dir);
         g_free (left_dir);
         g_free (right_dir);
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -177,7 +313,7 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
         g_free (session_dir);
         g_free (left_dir);
         g_free (right_dir);
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -198,7 +334,7 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
         g_free (session_dir);
         g_free (left_dir);
         g_free (right_dir);
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -215,7 +351,7 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
         g_free (session_dir);
         g_free (left_dir);
         g_free (right_dir);
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -232,7 +368,7 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
         g_free (session_dir);
         g_free (left_dir);
         g_free (right_dir);
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -242,11 +378,18 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
     if (enable_audio)
         audio_init ();
 
-    /* Scratch buffers. */
-    guint8 *rgb_left        = g_malloc ((size_t) proc_sub_w * proc_h * 3);
-    guint8 *rgb_right       = g_malloc ((size_t) proc_sub_w * proc_h * 3);
-    guint8 *bayer_left      = g_malloc ((size_t) proc_sub_w * proc_h);
-    guint8 *bayer_right     = g_malloc ((size_t) proc_sub_w * proc_h);
+    /* Scratch buffers, carved from one aligned arena reused every frame. */
+    size_t eye_pixels = (size_t) proc_sub_w * proc_h;
+    AgFrameArena *scratch = ag_frame_arena_new (
+        AG_ARENA_ROUND (eye_pixels) * 2 + AG_ARENA_ROUND (eye_pixels * 3) * 2,
+        AG_ARENA_HUGEPAGES);
+    guint8 *rgb_left        = ag_frame_arena_alloc (scratch, eye_pixels * 3);
+    guint8 *rgb_right       = ag_frame_arena_alloc (scratch, eye_pixels * 3);
+    guint8 *bayer_left      = ag_frame_arena_alloc (scratch, eye_pixels);
+    guint8 *bayer_right     = ag_frame_arena_alloc (scratch, eye_pixels);
+    printf ("Scratch arena: %.1f MB (%s)\n",
+            ag_frame_arena_capacity (scratch) / (1024.0 * 1024.0),
+            ag_frame_arena_backing_name (scratch));
 
     /* Start acquisition. */
     printf ("Starting acquisition at %.1f Hz...\n", fps);
@@ -257,6 +400,8 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
     printf ("Press 's' to save a pair, 'q' to quit.\n");
     printf ("Target: %d image pairs\n\n", target_count);
 
+    AgImageWriter *writer = ag_image_writer_new (SAVE_WRITERS, SAVE_QUEUE_MAX);
+
     arv_camera_start_acquisition (camera, &error);
     if (error) {
         fprintf (stderr, "error: failed to start acquisition: %s\n",
@@ -269,14 +414,20 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
 
     guint64 trigger_interval_us = (guint64) (1000000.0 / fps);
 
-    if (auto_expose)
-        auto_expose_settle (camera, &cfg, (double) trigger_interval_us);
+    if (ae_mode != AG_AE_OFF)
+        auto_expose_settle (camera, &cfg, ae_mode, (double) trigger_interval_us, NULL, NULL);
 
+    /* gamma_lut_2p5() builds its table on first use: do that here, before
+     * any writer thread can reach it. */
     const guint8 *gamma_lut = gamma_lut_2p5 ();
-    int saved_count = 0;
+    SaveProgress progress = { window, title, sizeof title, 0, target_count,
+                              enable_audio };
+    int next_index = 0;
     gboolean want_save = FALSE;
 
     while (!g_quit) {
+        ag_image_writer_dispatch (writer);
+
         SDL_Event ev;
         while (SDL_PollEvent (&ev)) {
             if (ev.type == SDL_QUIT)
@@ -345,10 +496,8 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
             continue;
         }
 
-        extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
-                                 bayer_left, bayer_right);
-
-        /* Save pair if requested. */
+        /* Save pair if requested: extract straight into buffers handed to
+         * the writer, and copy them for display. */
         if (want_save) {
             want_save = FALSE;
 
@@ -356,47 +505,25 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
              * visibility, coverage, and pose diversity before accepting the
              * pair. */
 
-            char *left_name  = g_strdup_printf ("imageL%d.png", saved_count);
-            char *right_name = g_strdup_printf ("imageR%d.png", saved_count);
-            char *left_path  = g_build_filename (left_dir,  left_name,  NULL);
-            char *right_path = g_build_filename (right_dir, right_name, NULL);
-
-            int rc_left, rc_right;
-            if (cfg.data_is_bayer) {
-                rc_left  = write_color_image (AG_ENC_PNG, left_path,
-                                              bayer_left,  proc_sub_w, proc_h);
-                rc_right = write_color_image (AG_ENC_PNG, right_path,
-                                              bayer_right, proc_sub_w, proc_h);
-            } else {
-                rc_left  = write_gray_image (AG_ENC_PNG, left_path,
-                                             bayer_left,  proc_sub_w, proc_h);
-                rc_right = write_gray_image (AG_ENC_PNG, right_path,
-                                             bayer_right, proc_sub_w, proc_h);
-            }
-
-            if (rc_left == EXIT_SUCCESS && rc_right == EXIT_SUCCESS) {
-                saved_count++;
-                if (enable_audio)
-                    audio_play_beep ();
-                printf ("  Saved pair %d / %d\n", saved_count, target_count);
-
-                snprintf (title, sizeof title,
-                          "Calibration Capture [%d/%d] — 's' save, 'q' quit",
-                          saved_count, target_count);
-                SDL_SetWindowTitle (window, title);
-
-                if (saved_count >= target_count)
-                    printf ("\n  Target reached! Press 'q' to finish "
-                            "or 's' to capture more.\n\n");
-            } else {
-                fprintf (stderr, "  error: failed to save pair %d\n",
-                         saved_count);
-            }
-
-            g_free (left_name);
-            g_free (right_name);
-            g_free (left_path);
-            g_free (right_path);
+            SaveEye *left  = save_eye_new (left_dir,  "imageL", next_index,
+                                           proc_sub_w, proc_h,
+                                           cfg.data_is_bayer);
+            SaveEye *right = save_eye_new (right_dir, "imageR", next_index,
+                                           proc_sub_w, proc_h,
+                                           cfg.data_is_bayer);
+            extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
+                                     left->data, right->data);
+            memcpy (bayer_left,  left->data,  eye_pixels);
+            memcpy (bayer_right, right->data, eye_pixels);
+
+            if (save_pair_submit (writer, &progress, next_index, left, right))
+                next_index++;
+            else
+                fprintf (stderr, "  warn: still writing earlier pairs, "
+                         "pair not saved\n");
+        } else {
+            extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
+                                     bayer_left, bayer_right);
         }
 
         /* Gamma-correct and debayer for display. */
@@ -439,8 +566,15 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
             int font_scale = out_w > 1200 ? 3 : 2;
             char overlay[96];
 
-            snprintf (overlay, sizeof overlay, "captured: %d of %d",
-                      saved_count, target_count);
+            guint saving = ag_image_writer_pending (writer);
+            if (saving > 0)
+                snprintf (overlay, sizeof overlay,
+                          "captured: %d of %d (saving %u)",
+                          progress.saved_count, target_count,
+                          (saving + 1) / 2);
+            else
+                snprintf (overlay, sizeof overlay, "captured: %d of %d",
+                          progress.saved_count, target_count);
             ag_font_render (renderer, overlay, 8, 8, font_scale, 0, 255, 0);
         }
 
@@ -451,16 +585,23 @@ calibration_capture_loop (const char *device_id, const char *iface_ip,
 
     printf ("\nStopping...\n");
     arv_camera_stop_acquisition (camera, NULL);
-    printf ("Captured %d image pairs in %s\n", saved_count, session_dir);
 
-    if (saved_count > 0)
+    /* Every pair already queued is written, including after Ctrl-C. */
+    guint unsaved = ag_image_writer_pending (writer);
+    if (unsaved > 0)
+        printf ("Writing %u queued image(s)...\n", unsaved);
+    ag_image_writer_free (writer);
+    writer = NULL;
+
+    printf ("Captured %d image pairs in %s\n", progress.saved_count,
+            session_dir);
+
+    if (progress.saved_count > 0)
         printf ("Open 2.Calibration.ipynb to continue.\n");
 
 cleanup:
-    g_free (bayer_left);
-    g_free (bayer_right);
-    g_free (rgb_left);
-    g_free (rgb_right);
+    ag_image_writer_free (writer);
+    ag_frame_arena_free (scratch);
     g_free (session_dir);
     g_free (left_dir);
     g_free (right_dir);
@@ -470,7 +611,7 @@ cleanup:
     SDL_DestroyRenderer (renderer);
     SDL_DestroyWindow (window);
     SDL_Quit ();
-    g_object_unref (cfg.stream);
+    camera_config_cleanup (&cfg);
     g_object_unref (camera);
     arv_shutdown ();
     return EXIT_SUCCESS;
@@ -500,6 +641,8 @@ cmd_calibration_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
                                           "sensor gain in dB (0-48)");
     struct arg_lit *auto_exp  = arg_lit0 ("A", "auto-expose",
                                           "auto-expose then lock");
+    struct arg_str *ae_mode_a = arg_str0 (NULL, "ae-mode", "<host|camera>",
+                                          "-A metering: host histogram (default) or camera AE");
     struct arg_int *binning_a = arg_int0 ("b", "binning",    "<1|2>",
                                           "sensor binning factor (default: 1)");
     struct arg_int *pkt_size  = arg_int0 ("p", "packet-size", "<bytes>",
@@ -509,8 +652,8 @@ cmd_calibration_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
     struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
     struct arg_end *end       = arg_end (10);
     void *argtable[] = { cmd, serial, address, interface, output, count,
-                         fps_a, exposure, gain, auto_exp, binning_a,
-                         pkt_size, quiet_audio, help, end };
+                         fps_a, exposure, gain, auto_exp, ae_mode_a,
+                         binning_a, pkt_size, quiet_audio, help, end };
 
     int exitcode = EXIT_SUCCESS;
     if (arg_nullcheck (argtable) != 0) {
@@ -563,8 +706,20 @@ cmd_calibration_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
         }
     }
 
-    gboolean do_auto_expose = auto_exp->count > 0;
-    if (do_auto_expose && (exposure->count || gain->count)) {
+    AgAeMode ae_mode = auto_exp->count ? AG_AE_HOST : AG_AE_OFF;
+    if (ae_mode_a->count) {
+        if (!auto_exp->count) {
+            arg_dstr_catf (res, "error: --ae-mode requires --auto-expose\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ag_parse_ae_mode (ae_mode_a->sval[0], &ae_mode) != 0) {
+            arg_dstr_catf (res, "error: --ae-mode must be host or camera\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (ae_mode != AG_AE_OFF && (exposure->count || gain->count)) {
         arg_dstr_catf (res, "error: --auto-expose and --exposure/--gain "
                        "are mutually exclusive\n");
         exitcode = EXIT_FAILURE;
@@ -604,7 +759,7 @@ cmd_calibration_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
 
     exitcode = calibration_capture_loop (device_id, iface_ip, opt_output,
                                           target, fps, exposure_us, gain_db,
-                                          do_auto_expose, pkt_sz, binning,
+                                          ae_mode, pkt_sz, binning,
                                           quiet_audio->count == 0);
     g_free (device_id);
 
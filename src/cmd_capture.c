@@ -3,24 +3,120 @@
  *
  * SingleFrame acquisition with software trigger.  Writes DualBayerRG8
  * stereo pairs to disk.
+ *
+ * With --count, --interval or --burst one configured session captures a
+ * sequence instead.  Received stream buffers are handed, uncopied, to the
+ * image writer threads and returned to the stream once written, so the
+ * capture cadence does not wait on PNG/JPEG encoding; --burst copies
+ * every frame into memory until the last one is in and encodes
+ * afterwards.
  */
 
 #include "common.h"
 #include "calib_load.h"
 #include "image.h"
+#include "image_writer.h"
 #include "../vendor/argtable3.h"
 
 #include <glib/gstdio.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#define CAPTURE_QUEUE_MAX        32    /* frames waiting for a writer */
+#define CAPTURE_WRITERS_MAX       8
+#define CAPTURE_MAX_CONSECUTIVE  10    /* failed frames before giving up */
+
+static volatile sig_atomic_t g_quit = 0;
+
+static void
+sigint_handler (int sig)
+{
+    (void) sig;
+    g_quit = 1;
+}
+
+/* Where and how captured frames are written. */
+typedef struct {
+    const char         *output_dir;
+    AgEncFormat         enc;
+    gboolean            dual_bayer;      /* PixelFormat is DualBayerRG8 */
+    int                 software_binning;
+    gboolean            data_is_bayer;
+    const AgRemapTable *remap_left;
+    const AgRemapTable *remap_right;
+} CaptureSink;
+
+static int
+write_capture (const CaptureSink *sink, const char *base,
+               const guint8 *data, guint width, guint height)
+{
+    if (sink->dual_bayer)
+        return write_dual_bayer_pair (sink->output_dir, base, data,
+                                      width, height, sink->enc,
+                                      sink->software_binning,
+                                      sink->data_is_bayer,
+                                      sink->remap_left, sink->remap_right);
+
+    const char *ext = (sink->enc == AG_ENC_PNG) ? "png"
+                    : (sink->enc == AG_ENC_JPG) ? "jpg" : "pgm";
+    char *name = g_strdup_printf ("%s.%s", base, ext);
+    char *path = g_build_filename (sink->output_dir, name, NULL);
+    int rc;
+    if (sink->enc == AG_ENC_PGM)
+        rc = write_pgm (path, data, width, height);
+    else
+        rc = write_color_image (sink->enc, path, data, width, height);
+    g_free (name);
+    g_free (path);
+    return rc;
+}
+
+/*
+ * Load the rectification maps requested by calib_src, if any, and check
+ * them against the processed frame size.  Returns 0 on success (both
+ * NULL when no calibration was requested).
+ */
+static int
+load_capture_remaps (ArvDevice *device, const AgCalibSource *calib_src,
+                     const AgCameraConfig *cfg,
+                     AgRemapTable **remap_left, AgRemapTable **remap_right)
+{
+    *remap_left  = NULL;
+    *remap_right = NULL;
+    if (!calib_src->local_path && calib_src->slot < 0)
+        return 0;
+
+    if (ag_calib_load (device, calib_src, remap_left, remap_right, NULL) != 0)
+        return -1;
+
+    /* Validate remap dimensions against processed frame size. */
+    guint proc_sub_w = (cfg->frame_w / 2) / (guint) cfg->software_binning;
+    guint proc_h     = cfg->frame_h / (guint) cfg->software_binning;
+    if ((*remap_left)->width != proc_sub_w ||
+        (*remap_left)->height != proc_h) {
+        fprintf (stderr,
+                 "error: remap dimensions %ux%u do not match frame %ux%u\n",
+                 (*remap_left)->width, (*remap_left)->height,
+                 proc_sub_w, proc_h);
+        ag_remap_table_free (*remap_left);
+        ag_remap_table_free (*remap_right);
+        *remap_left = *remap_right = NULL;
+        return -1;
+    }
+
+    printf ("Rectification maps loaded (%ux%u).\n",
+            (*remap_left)->width, (*remap_left)->height);
+    return 0;
+}
+
 static int
 capture_one_frame (const char *device_id, const char *output_dir,
                    const char *iface_ip, AgEncFormat enc,
                    double exposure_us, double gain_db,
-                   gboolean auto_expose, int packet_size, int binning,
+                   AgAeMode ae_mode, int packet_size, int binning,
                    gboolean verbose,
                    const AgCalibSource *calib_src)
 {
@@ -38,8 +134,8 @@ capture_one_frame (const char *device_id, const char *output_dir,
 
     AgCameraConfig cfg;
     if (camera_configure (camera, AG_MODE_SINGLE_FRAME,
-                          binning, exposure_us, gain_db, auto_expose,
-                          packet_size, iface_ip, verbose, &cfg) != EXIT_SUCCESS) {
+                          binning, exposure_us, gain_db, ae_mode == AG_AE_CAMERA,
+                          packet_size, NULL, NULL, iface_ip, verbose, &cfg) != EXIT_SUCCESS) {
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -48,37 +144,13 @@ capture_one_frame (const char *device_id, const char *output_dir,
     ArvDevice *device = arv_camera_get_device (camera);
 
     /* Load rectification remap tables if calibration was requested. */
-    AgRemapTable *remap_left  = NULL;
-    AgRemapTable *remap_right = NULL;
-
-    if (calib_src->local_path || calib_src->slot >= 0) {
-        if (ag_calib_load (device, calib_src,
-                            &remap_left, &remap_right, NULL) != 0) {
-            g_object_unref (cfg.stream);
-            g_object_unref (camera);
-            arv_shutdown ();
-            return EXIT_FAILURE;
-        }
-
-        /* Validate remap dimensions against processed frame size. */
-        guint proc_sub_w = (cfg.frame_w / 2) / (guint) cfg.software_binning;
-        guint proc_h     = cfg.frame_h / (guint) cfg.software_binning;
-        if (remap_left->width != proc_sub_w ||
-            remap_left->height != proc_h) {
-            fprintf (stderr,
-                     "error: remap dimensions %ux%u do not match frame %ux%u\n",
-                     remap_left->width, remap_left->height,
-                     proc_sub_w, proc_h);
-            ag_remap_table_free (remap_left);
-            ag_remap_table_free (remap_right);
-            g_object_unref (cfg.stream);
-            g_object_unref (camera);
-            arv_shutdown ();
-            return EXIT_FAILURE;
-        }
-
-        printf ("Rectification maps loaded (%ux%u).\n",
-                remap_left->width, remap_left->height);
+    AgRemapTable *remap_left, *remap_right;
+    if (load_capture_remaps (device, calib_src, &cfg,
+                             &remap_left, &remap_right) != 0) {
+        camera_config_cleanup (&cfg);
+        g_object_unref (camera);
+        arv_shutdown ();
+        return EXIT_FAILURE;
     }
 
     printf ("Starting acquisition...\n");
@@ -87,14 +159,14 @@ capture_one_frame (const char *device_id, const char *output_dir,
         fprintf (stderr, "error: failed to start acquisition: %s\n",
                  error->message);
         g_clear_error (&error);
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
     }
 
-    if (auto_expose)
-        auto_expose_settle (camera, &cfg, 100000.0);
+    if (ae_mode != AG_AE_OFF)
+        auto_expose_settle (camera, &cfg, ae_mode, 100000.0, NULL, NULL);
 
     /* Wait for TriggerArmed. */
     {
@@ -206,7 +278,7 @@ capture_one_frame (const char *device_id, const char *output_dir,
                      " missing=%" G_GUINT64_FORMAT "\n", resent, missing);
         }
         arv_camera_stop_acquisition (camera, NULL);
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -231,35 +303,326 @@ capture_one_frame (const char *device_id, const char *output_dir,
 
         const char *pixel_format = arv_device_get_string_feature_value (
                                        device, "PixelFormat", NULL);
-        if (pixel_format && strcmp (pixel_format, "DualBayerRG8") == 0) {
-            rc = write_dual_bayer_pair (output_dir, base, data, width, height,
-                                        enc, cfg.software_binning,
-                                        cfg.data_is_bayer,
-                                        remap_left, remap_right);
-        } else {
-            const char *ext = (enc == AG_ENC_PNG) ? "png"
-                            : (enc == AG_ENC_JPG) ? "jpg" : "pgm";
-            char *name = g_strdup_printf ("%s.%s", base, ext);
-            char *path = g_build_filename (output_dir, name, NULL);
-            if (enc == AG_ENC_PGM)
-                rc = write_pgm (path, data, width, height);
-            else
-                rc = write_color_image (enc, path, data, width, height);
-            g_free (name);
-            g_free (path);
-        }
+        CaptureSink sink = {
+            .output_dir       = output_dir,
+            .enc              = enc,
+            .dual_bayer       = pixel_format &&
+                                strcmp (pixel_format, "DualBayerRG8") == 0,
+            .software_binning = cfg.software_binning,
+            .data_is_bayer    = cfg.data_is_bayer,
+            .remap_left       = remap_left,
+            .remap_right      = remap_right,
+        };
+        rc = write_capture (&sink, base, data, width, height);
     }
 
     arv_stream_push_buffer (cfg.stream, buffer);
     arv_camera_stop_acquisition (camera, NULL);
     ag_remap_table_free (remap_left);
     ag_remap_table_free (remap_right);
-    g_object_unref (cfg.stream);
+    camera_config_cleanup (&cfg);
     g_object_unref (camera);
     arv_shutdown ();
     return rc;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Sequences: one session, many frames                                */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    int      count;          /* frames to save */
+    double   interval_ms;    /* trigger period; 0 = as fast as possible */
+    gboolean burst;          /* hold everything in RAM, encode at the end */
+} CaptureSequence;
+
+/* One received frame, owned by the image writer until it is written:
+ * either the stream buffer itself or, in a burst, a copy of it. */
+typedef struct {
+    const CaptureSink *sink;
+    ArvStream         *stream;
+    ArvBuffer         *buffer;   /* pushed back to stream when done */
+    guint8            *copy;     /* freed when done */
+    const guint8      *data;
+    guint              width;
+    guint              height;
+    char               base[96];
+} CaptureJob;
+
+static int
+capture_job_write (gpointer frame)
+{
+    CaptureJob *job = frame;
+    return write_capture (job->sink, job->base, job->data,
+                          job->width, job->height);
+}
+
+static void
+capture_job_free (gpointer frame)
+{
+    CaptureJob *job = frame;
+    if (job->buffer)
+        arv_stream_push_buffer (job->stream, job->buffer);
+    g_free (job->copy);
+    g_free (job);
+}
+
+/* Wait for TriggerArmed, fire the trigger and pop the frame.  NULL on a
+ * timeout or an incomplete frame. */
+static ArvBuffer *
+trigger_and_pop (ArvDevice *device, ArvStream *stream)
+{
+    for (int polls = 0; polls < 500; polls++) {
+        GError *e = NULL;
+        gboolean armed = arv_device_get_boolean_feature_value (
+                             device, "TriggerArmed", &e);
+        g_clear_error (&e);
+        if (armed)
+            break;
+        g_usleep (2000);
+    }
+
+    GError *e = NULL;
+    arv_device_execute_command (device, "TriggerSoftware", &e);
+    if (e) {
+        fprintf (stderr, "warn: TriggerSoftware: %s\n", e->message);
+        g_clear_error (&e);
+        return NULL;
+    }
+
+    ArvBuffer *buffer = arv_stream_timeout_pop_buffer (stream, 2000000);
+    if (buffer && arv_buffer_get_status (buffer) != ARV_BUFFER_STATUS_SUCCESS) {
+        arv_stream_push_buffer (stream, buffer);
+        buffer = NULL;
+    }
+    return buffer;
+}
+
+static int
+capture_sequence (const char *device_id, const char *output_dir,
+                  const char *iface_ip, AgEncFormat enc,
+                  double exposure_us, double gain_db,
+                  AgAeMode ae_mode, int packet_size, int binning,
+                  gboolean verbose,
+                  const AgCalibSource *calib_src,
+                  const CaptureSequence *seq)
+{
+    GError *error = NULL;
+    ArvCamera *camera = arv_camera_new (device_id, &error);
+    if (!camera) {
+        fprintf (stderr, "error: %s\n",
+                 error ? error->message : "failed to open device");
+        g_clear_error (&error);
+        arv_shutdown ();
+        return EXIT_FAILURE;
+    }
+
+    printf ("Connected.\n");
+
+    AgCameraConfig cfg;
+    if (camera_configure (camera, AG_MODE_CONTINUOUS,
+                          binning, exposure_us, gain_db, ae_mode == AG_AE_CAMERA,
+                          packet_size, NULL, NULL, iface_ip, verbose, &cfg) != EXIT_SUCCESS) {
+        g_object_unref (camera);
+        arv_shutdown ();
+        return EXIT_FAILURE;
+    }
+
+    ArvDevice *device = arv_camera_get_device (camera);
+
+    AgRemapTable *remap_left, *remap_right;
+    if (load_capture_remaps (device, calib_src, &cfg,
+                             &remap_left, &remap_right) != 0) {
+        camera_config_cleanup (&cfg);
+        g_object_unref (camera);
+        arv_shutdown ();
+        return EXIT_FAILURE;
+    }
+
+    const char *pixel_format = arv_device_get_string_feature_value (
+                                   device, "PixelFormat", NULL);
+    CaptureSink sink = {
+        .output_dir       = output_dir,
+        .enc              = enc,
+        .dual_bayer       = pixel_format &&
+                            strcmp (pixel_format, "DualBayerRG8") == 0,
+        .software_binning = cfg.software_binning,
+        .data_is_bayer    = cfg.data_is_bayer,
+        .remap_left       = remap_left,
+        .remap_right      = remap_right,
+    };
+
+    /* Writers encode with per-thread scratch; build the shared gamma
+     * table here, before any of them start. */
+    (void) gamma_lut_2p5 ();
+    int n_writers = CLAMP ((int) g_get_num_processors () - 1,
+                           1, CAPTURE_WRITERS_MAX);
+
+    /* Frames written straight from stream buffers hold those buffers
+     * until they are on disk: leave at least two to the stream. */
+    guint n_buffers = ag_stream_pool_n_buffers (cfg.pool);
+    gboolean zero_copy = !seq->burst && n_buffers >= 4;
+    guint queue_max = CAPTURE_QUEUE_MAX;
+    if (zero_copy) {
+        n_writers = MIN (n_writers, (int) n_buffers / 2);
+        queue_max = MAX (1, (int) n_buffers - n_writers - 2);
+    }
+    AgImageWriter *writer = ag_image_writer_new (n_writers, queue_max);
+    GPtrArray *held = seq->burst ? g_ptr_array_new () : NULL;
+
+    guint64 interval_us = (guint64) (seq->interval_ms * 1000.0);
+    printf ("Starting acquisition (%d frame%s, %s)...\n",
+            seq->count, seq->count == 1 ? "" : "s",
+            seq->burst ? "burst into memory"
+            : interval_us ? "paced" : "as fast as the writers allow");
+    arv_camera_start_acquisition (camera, &error);
+    if (error) {
+        fprintf (stderr, "error: failed to start acquisition: %s\n",
+                 error->message);
+        g_clear_error (&error);
+        ag_image_writer_free (writer);
+        if (held)
+            g_ptr_array_free (held, TRUE);
+        ag_remap_table_free (remap_left);
+        ag_remap_table_free (remap_right);
+        camera_config_cleanup (&cfg);
+        g_object_unref (camera);
+        arv_shutdown ();
+        return EXIT_FAILURE;
+    }
+
+    if (ae_mode != AG_AE_OFF)
+        auto_expose_settle (camera, &cfg, ae_mode,
+                            interval_us ? (double) interval_us : 100000.0,
+                            NULL, NULL);
+
+    signal (SIGINT, sigint_handler);
+
+    /* One timestamp for the whole sequence; frames are told apart by
+     * frame_id and device timestamp. */
+    time_t now = time (NULL);
+    struct tm tm_now;
+    localtime_r (&now, &tm_now);
+    char stamp[32];
+    strftime (stamp, sizeof stamp, "capture_%Y%m%d_%H%M%S", &tm_now);
+
+    int captured = 0, dropped = 0, consecutive = 0;
+    gint64 next_trigger_us = 0;
+    GTimer *timer = g_timer_new ();
+
+    while (captured < seq->count && !g_quit) {
+        ArvBuffer *buffer = trigger_and_pop (device, cfg.stream);
+        size_t data_size = 0;
+        const guint8 *data = buffer ? arv_buffer_get_data (buffer, &data_size)
+                                    : NULL;
+        guint width  = buffer ? arv_buffer_get_image_width (buffer) : 0;
+        guint height = buffer ? arv_buffer_get_image_height (buffer) : 0;
+        size_t needed = (size_t) width * (size_t) height;
+
+        CaptureJob *job = NULL;
+        if (data && needed > 0 && data_size >= needed) {
+            job = g_new0 (CaptureJob, 1);
+            job->sink   = &sink;
+            job->stream = cfg.stream;
+            job->width  = width;
+            job->height = height;
+            g_snprintf (job->base, sizeof job->base,
+                        "%s_f%06" G_GUINT64_FORMAT "_t%" G_GUINT64_FORMAT,
+                        stamp, arv_buffer_get_frame_id (buffer),
+                        arv_buffer_get_timestamp (buffer));
+            if (zero_copy) {
+                job->buffer = buffer;
+                job->data   = data;
+                buffer = NULL;
+            } else {
+                job->copy = g_try_malloc (needed);
+                if (!job->copy) {
+                    fprintf (stderr, "warn: out of memory after %d frame(s); "
+                             "stopping\n", captured);
+                    g_free (job);
+                    arv_stream_push_buffer (cfg.stream, buffer);
+                    break;
+                }
+                memcpy (job->copy, data, needed);
+                job->data = job->copy;
+            }
+        }
+        if (buffer)
+            arv_stream_push_buffer (cfg.stream, buffer);
+
+        if (!job) {
+            dropped++;
+            if (++consecutive >= CAPTURE_MAX_CONSECUTIVE) {
+                fprintf (stderr, "error: %d frames in a row failed; "
+                         "stopping\n", consecutive);
+                break;
+            }
+            continue;
+        }
+        consecutive = 0;
+        captured++;
+
+        /* Backpressure: with the writer queue full, wait for room. */
+        AgImageJob wjob = { capture_job_write, job, capture_job_free,
+                            NULL, NULL };
+        if (held)
+            g_ptr_array_add (held, job);
+        else
+            ag_image_writer_submit (writer, &wjob, TRUE);
+
+        if (interval_us && captured < seq->count)
+            ag_pace_trigger (&next_trigger_us, interval_us);
+    }
+
+    double capture_s = g_timer_elapsed (timer, NULL);
+    arv_camera_stop_acquisition (camera, NULL);
+    printf ("Captured %d frame(s) in %.2f s (%.1f fps), %d dropped.\n",
+            captured, capture_s, capture_s > 0.0 ? captured / capture_s : 0.0,
+            dropped);
+    AgImageWriterStats ws;
+    ag_image_writer_stats (writer, &ws);
+    if (ws.blocked)
+        fprintf (stderr, "warn: writers fell %u frames behind %" G_GUINT64_FORMAT
+                 " time(s); capture was slowed to their pace (see --burst)\n",
+                 queue_max, ws.blocked);
+    else if (verbose && !held)
+        printf ("Writer queue: at most %u of %u frame(s) waiting.\n",
+                ws.high_water, queue_max);
+
+    /* Encode what is held, then wait for every queued frame, also after
+     * Ctrl-C: nothing received is lost. */
+    if (held) {
+        for (guint i = 0; i < held->len; i++) {
+            AgImageJob wjob = { capture_job_write, g_ptr_array_index (held, i),
+                                capture_job_free, NULL, NULL };
+            ag_image_writer_submit (writer, &wjob, TRUE);
+        }
+        g_ptr_array_free (held, FALSE);
+    }
+    g_timer_start (timer);
+    ag_image_writer_flush (writer);
+    ag_image_writer_stats (writer, &ws);
+    ag_image_writer_free (writer);
+    guint64 failed = ws.failed;
+    printf ("Wrote %" G_GUINT64_FORMAT " frame(s) to %s "
+            "(%.2f s after the last capture).\n",
+            ws.written, output_dir, g_timer_elapsed (timer, NULL));
+    if (failed)
+        fprintf (stderr, "error: %" G_GUINT64_FORMAT
+                 " frame(s) could not be written\n", failed);
+    g_timer_destroy (timer);
+
+    ag_remap_table_free (remap_left);
+    ag_remap_table_free (remap_right);
+    camera_config_cleanup (&cfg);
+    g_object_unref (camera);
+    arv_shutdown ();
+
+    if (failed || captured == 0 || (captured < seq->count && !g_quit))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
 int
 cmd_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
 {
@@ -276,12 +639,22 @@ cmd_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
                                           "output directory (default: .)");
     struct arg_str *encode    = arg_str0 ("e", "encode",     "<format>",
                                           "output format: pgm, png, jpg (default: pgm)");
+    struct arg_int *png_level = arg_int0 (NULL, "png-level", "<0-9>",
+                                          "PNG zlib level, 0 = stored (default: 1)");
+    struct arg_str *png_filter = arg_str0 (NULL, "png-filter", "<none|sub|up>",
+                                           "PNG row filter (default: up)");
+    struct arg_int *jpeg_quality = arg_int0 (NULL, "jpeg-quality", "<1-100>",
+                                             "JPEG quality (default: 90)");
+    struct arg_str *jpeg_subsample = arg_str0 (NULL, "jpeg-subsample", "<420|444>",
+                                               "JPEG chroma subsampling (default: 420)");
     struct arg_dbl *exposure  = arg_dbl0 ("x", "exposure",   "<us>",
                                           "exposure time in microseconds");
     struct arg_dbl *gain      = arg_dbl0 ("g", "gain",       "<dB>",
                                           "sensor gain in dB (0-48)");
     struct arg_lit *auto_exp  = arg_lit0 ("A", "auto-expose",
                                           "auto-expose then lock");
+    struct arg_str *ae_mode_a = arg_str0 (NULL, "ae-mode", "<host|camera>",
+                                          "-A metering: host histogram (default) or camera AE");
     struct arg_int *binning_a = arg_int0 ("b", "binning",    "<1|2>",
                                           "sensor binning factor (default: 1)");
     struct arg_int *pkt_size  = arg_int0 ("p", "packet-size", "<bytes>",
@@ -290,13 +663,22 @@ cmd_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
                                             "rectify using local calibration session");
     struct arg_int *calib_slot  = arg_int0 (NULL, "calibration-slot", "<0-2>",
                                             "rectify using on-camera calibration slot");
+    struct arg_int *count_a   = arg_int0 ("n", "count",      "<N>",
+                                          "capture N frames in one session (default: 1)");
+    struct arg_dbl *interval_a = arg_dbl0 (NULL, "interval", "<ms>",
+                                           "trigger period for --count (default: as fast as possible)");
+    struct arg_lit *burst_a   = arg_lit0 (NULL, "burst",
+                                          "capture --count frames into memory at full rate, encode afterwards");
     struct arg_lit *verbose   = arg_lit0 ("v", "verbose",
                                           "print diagnostic readback");
     struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
     struct arg_end *end       = arg_end (10);
     void *argtable[] = { cmd, serial, address, interface, output, encode,
-                         exposure, gain, auto_exp, binning_a, pkt_size,
+                         png_level, png_filter, jpeg_quality, jpeg_subsample,
+                         exposure, gain, auto_exp, ae_mode_a,
+                         binning_a, pkt_size,
                          calib_local, calib_slot,
+                         count_a, interval_a, burst_a,
                          verbose, help, end };
 
     int exitcode = EXIT_SUCCESS;
@@ -309,6 +691,7 @@ cmd_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
     /* Defaults. */
     output->sval[0]    = ".";
     binning_a->ival[0] = 1;
+    count_a->ival[0]   = 1;
 
     int nerrors = arg_parse (argc, argv, argtable);
     if (arg_make_syntax_err_help_msg (res, "capture", help->count, nerrors,
@@ -342,8 +725,20 @@ cmd_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
         }
     }
 
-    gboolean do_auto_expose = auto_exp->count > 0;
-    if (do_auto_expose && (exposure->count || gain->count)) {
+    AgAeMode ae_mode = auto_exp->count ? AG_AE_HOST : AG_AE_OFF;
+    if (ae_mode_a->count) {
+        if (!auto_exp->count) {
+            arg_dstr_catf (res, "error: --ae-mode requires --auto-expose\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ag_parse_ae_mode (ae_mode_a->sval[0], &ae_mode) != 0) {
+            arg_dstr_catf (res, "error: --ae-mode must be host or camera\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (ae_mode != AG_AE_OFF && (exposure->count || gain->count)) {
         arg_dstr_catf (res, "error: --auto-expose and --exposure/--gain are mutually exclusive\n");
         exitcode = EXIT_FAILURE;
         goto done;
@@ -396,6 +791,82 @@ cmd_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
         }
     }
 
+    AgPngOptions png_opts;
+    ag_png_options_defaults (&png_opts);
+    if ((png_level->count || png_filter->count) && enc != AG_ENC_PNG) {
+        arg_dstr_catf (res, "error: --png-level and --png-filter require --encode png\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    if (png_level->count) {
+        png_opts.level = png_level->ival[0];
+        if (png_opts.level < 0 || png_opts.level > 9) {
+            arg_dstr_catf (res, "error: --png-level must be between 0 and 9\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (png_filter->count &&
+        ag_png_parse_filter (png_filter->sval[0], &png_opts.filter) != 0) {
+        arg_dstr_catf (res, "error: --png-filter must be 'none', 'sub', or 'up'\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    AgJpegOptions jpeg_opts;
+    ag_jpeg_options_defaults (&jpeg_opts);
+    if ((jpeg_quality->count || jpeg_subsample->count) && enc != AG_ENC_JPG) {
+        arg_dstr_catf (res, "error: --jpeg-quality and --jpeg-subsample require --encode jpg\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    if (jpeg_quality->count) {
+        jpeg_opts.quality = jpeg_quality->ival[0];
+        if (jpeg_opts.quality < 1 || jpeg_opts.quality > 100) {
+            arg_dstr_catf (res, "error: --jpeg-quality must be between 1 and 100\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (jpeg_subsample->count &&
+        ag_jpeg_parse_subsample (jpeg_subsample->sval[0], &jpeg_opts.subsample) != 0) {
+        arg_dstr_catf (res, "error: --jpeg-subsample must be '420' or '444'\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    image_set_jpeg_options (&jpeg_opts);
+    if (enc == AG_ENC_JPG && verbose->count)
+        printf ("JPEG encoder: %s\n", ag_jpeg_backend_name ());
+
+    /* Sequence options. */
+    CaptureSequence seq = {
+        .count       = count_a->ival[0],
+        .interval_ms = interval_a->count ? interval_a->dval[0] : 0.0,
+        .burst       = burst_a->count > 0,
+    };
+    if (seq.count < 1) {
+        arg_dstr_catf (res, "error: --count must be at least 1\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    if (interval_a->count && !(seq.interval_ms > 0.0)) {
+        arg_dstr_catf (res, "error: --interval must be positive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    if (seq.burst && interval_a->count) {
+        arg_dstr_catf (res, "error: --burst and --interval are mutually exclusive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    gboolean sequence = count_a->count || interval_a->count || seq.burst;
+
+    /* A single frame spreads its deflate over every core; a sequence
+     * already encodes one frame per writer thread. */
+    if (sequence)
+        png_opts.threads = 1;
+    image_set_png_options (&png_opts);
+
     const char *opt_serial    = serial->count    ? serial->sval[0]    : NULL;
     const char *opt_address   = address->count   ? address->sval[0]   : NULL;
     const char *opt_interface = interface->count  ? interface->sval[0] : NULL;
@@ -420,10 +891,16 @@ cmd_capture (int argc, char *argv[], arg_dstr_t res, void *ctx)
 
     int pkt_sz = pkt_size->count ? pkt_size->ival[0] : 0;
 
-    exitcode = capture_one_frame (device_id, opt_output, iface_ip, enc,
-                                   exposure_us, gain_db, do_auto_expose,
-                                   pkt_sz, binning, verbose->count > 0,
-                                   &calib_src);
+    if (sequence)
+        exitcode = capture_sequence (device_id, opt_output, iface_ip, enc,
+                                     exposure_us, gain_db, ae_mode,
+                                     pkt_sz, binning, verbose->count > 0,
+                                     &calib_src, &seq);
+    else
+        exitcode = capture_one_frame (device_id, opt_output, iface_ip, enc,
+                                       exposure_us, gain_db, ae_mode,
+                                       pkt_sz, binning, verbose->count > 0,
+                                       &calib_src);
     g_free (device_id);
 
 done:
@@ -4,13 +4,18 @@
  * Live stereo depth preview: acquires rectified stereo frames, computes
  * disparity via a selectable backend (StereoSGBM, IGEV++, FoundationStereo),
  * and displays the rectified left eye alongside a JET-coloured disparity map.
+ * The rectified pair can also be streamed as Y4M or MJPEG (--video-out).
  */
 
 #include "common.h"
+#include "arena.h"
 #include "calib_load.h"
 #include "font.h"
+#include "rect_monitor.h"
 #include "remap.h"
 #include "stereo.h"
+#include "trace.h"
+#include "video_out.h"
 #include "../vendor/argtable3.h"
 
 #include <signal.h>
@@ -114,11 +119,19 @@ print_sgbm_controls (void)
 static int
 depth_preview_loop (const char *device_id, const char *iface_ip,
                     double fps, double exposure_us, double gain_db,
-                    gboolean auto_expose, int packet_size, int binning,
+                    AgAeMode ae_mode, AgAeMetering ae_metering,
+                    int packet_size, int binning,
                     const AgCalibSource *calib_src, AgStereoBackend backend,
                     AgSgbmParams *sgbm_params, const AgOnnxParams *onnx_params,
-                    gboolean enable_runtime_tuning)
+                    gboolean enable_runtime_tuning,
+                    const AgTransportOptions *transport, const AgRoi *roi,
+                    const char *trace_path,
+                    const char *metrics_addr,
+                    const AgRectMonitorConfig *rect_check,
+                    AgVideoOut *video, AgVideoColor video_color,
+                    gboolean headless, double duration_s)
 {
+    int exitcode = EXIT_FAILURE;
     GError *error = NULL;
     ArvCamera *camera = arv_camera_new (device_id, &error);
     if (!camera) {
@@ -130,11 +143,12 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
     }
 
     printf ("Connected.\n");
+    ag_startup_mark ("open camera");
 
     AgCameraConfig cfg;
     if (camera_configure (camera, AG_MODE_CONTINUOUS,
-                          binning, exposure_us, gain_db, auto_expose,
-                          packet_size, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
+                          binning, exposure_us, gain_db, ae_mode == AG_AE_CAMERA,
+                          packet_size, transport, roi, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -153,12 +167,17 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
     /* Load remap tables (required for depth). */
     AgRemapTable *remap_left  = NULL;
     AgRemapTable *remap_right = NULL;
+    AgAeMeter    *ae_meter    = NULL;
 
     {
         AgCalibMeta dev_meta = {0};
         if (ag_calib_load (device, calib_src,
                             &remap_left, &remap_right, &dev_meta) != 0)
             goto cleanup;
+        if (ag_calib_crop_to_roi (&remap_left, &remap_right, &cfg.roi,
+                                  AG_SENSOR_WIDTH / 2 / (guint) binning,
+                                  AG_SENSOR_HEIGHT / (guint) binning) != 0)
+            goto cleanup;
 
         /* Apply device metadata to sgbm_params when loaded from slot. */
         if (calib_src->slot >= 0 &&
@@ -184,6 +203,25 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
         goto cleanup;
     }
 
+    /* Host AE meters only what both rectified eyes see, weighted toward
+     * the columns where the matcher can produce disparity. */
+    if (ae_mode == AG_AE_HOST && ae_metering == AG_AE_METER_OVERLAP) {
+        AgRoi band = { 0 };
+        int x0 = MAX (0, sgbm_params->min_disparity +
+                         sgbm_params->num_disparities);
+        if ((guint) x0 < proc_sub_w) {
+            band.x      = (guint) x0;
+            band.width  = proc_sub_w - band.x;
+            band.height = proc_h;
+        }
+        ae_meter = ag_ae_meter_new_overlap (
+            remap_left, remap_right, cfg.frame_w, cfg.frame_h,
+            cfg.software_binning, AG_AE_SAMPLE_STEP, &band,
+            AG_AE_WEIGHT_DEFAULT);
+        if (!ae_meter)
+            goto cleanup;
+    }
+
     /* Create disparity backend. */
     AgDisparityContext *disp_ctx = ag_disparity_create (
         backend, proc_sub_w, proc_h, sgbm_params, onnx_params);
@@ -200,6 +238,8 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
     }
 
     /* SDL2 setup. */
+    if (headless)
+        g_setenv ("SDL_VIDEODRIVER", "dummy", TRUE);
     if (SDL_Init (SDL_INIT_VIDEO) != 0) {
         fprintf (stderr, "error: SDL_Init: %s\n", SDL_GetError ());
         ag_disparity_destroy (disp_ctx);
@@ -245,23 +285,59 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
     /* Scratch buffers. */
     size_t eye_pixels = (size_t) proc_sub_w * proc_h;
     size_t eye_rgb    = eye_pixels * 3;
+    gboolean video_rgb = video && video_color == AG_VIDEO_YUV420;
+
+    /* One aligned arena holds every per-frame plane; reused each frame. */
+    AgFrameArena *scratch = ag_frame_arena_new (
+        AG_ARENA_ROUND (eye_pixels) * 6 +
+        AG_ARENA_ROUND (eye_pixels * sizeof (int16_t)) +
+        AG_ARENA_ROUND (eye_rgb) * (video_rgb ? 5 : 3),
+        AG_ARENA_HUGEPAGES);
+    printf ("Scratch arena: %.1f MB (%s)\n",
+            ag_frame_arena_capacity (scratch) / (1024.0 * 1024.0),
+            ag_frame_arena_backing_name (scratch));
 
-    guint8 *bayer_left      = g_malloc (eye_pixels);
-    guint8 *bayer_right     = g_malloc (eye_pixels);
+    guint8 *bayer_left      = ag_frame_arena_alloc (scratch, eye_pixels);
+    guint8 *bayer_right     = ag_frame_arena_alloc (scratch, eye_pixels);
 
     /* Display path: gamma → debayer → remap RGB. */
-    guint8 *rgb_left   = g_malloc (eye_rgb);
-    guint8 *rect_rgb_l = g_malloc (eye_rgb);
+    guint8 *rgb_left   = ag_frame_arena_alloc (scratch, eye_rgb);
+    guint8 *rect_rgb_l = ag_frame_arena_alloc (scratch, eye_rgb);
 
     /* Disparity path: debayer to luma (no gamma) → remap gray. */
-    guint8 *gray_left     = g_malloc (eye_pixels);
-    guint8 *gray_right    = g_malloc (eye_pixels);
-    guint8 *rect_gray_l   = g_malloc (eye_pixels);
-    guint8 *rect_gray_r   = g_malloc (eye_pixels);
+    guint8 *gray_left     = ag_frame_arena_alloc (scratch, eye_pixels);
+    guint8 *gray_right    = ag_frame_arena_alloc (scratch, eye_pixels);
+    guint8 *rect_gray_l   = ag_frame_arena_alloc (scratch, eye_pixels);
+    guint8 *rect_gray_r   = ag_frame_arena_alloc (scratch, eye_pixels);
 
     /* Disparity output. */
-    int16_t *disparity_buf = g_malloc (eye_pixels * sizeof (int16_t));
-    guint8  *disparity_rgb = g_malloc (eye_rgb);
+    int16_t *disparity_buf = ag_frame_arena_alloc_n (scratch, int16_t, eye_pixels);
+    guint8  *disparity_rgb = ag_frame_arena_alloc (scratch, eye_rgb);
+
+    /* Colour video needs the right eye's display path as well. */
+    guint8 *rgb_right  = video_rgb ? ag_frame_arena_alloc (scratch, eye_rgb) : NULL;
+    guint8 *rect_rgb_r = video_rgb ? ag_frame_arena_alloc (scratch, eye_rgb) : NULL;
+
+    ag_startup_mark ("display + calibration");
+
+    /* Bind the metrics endpoint before streaming: a taken port fails the
+     * command up front instead of after acquisition and AE settle. */
+    AgStreamMetrics metrics = { 0 };
+    AgHistogram *inference_hist = NULL;
+    if (metrics_addr) {
+        char labels[64];
+        snprintf (labels, sizeof labels, "backend=\"%s\"",
+                  ag_stereo_backend_name (backend));
+        ag_stream_metrics_init (&metrics);
+        inference_hist = ag_metrics_histogram (
+            "ag_disparity_inference_seconds", labels,
+            "Disparity backend compute time per frame.");
+        if (ag_metrics_serve (metrics_addr) != 0) {
+            ag_metrics_reset ();
+            goto cleanup_sdl;
+        }
+    }
+    ag_stream_metrics_set_pool (&metrics, ag_stream_pool_n_buffers (cfg.pool));
 
     /* Start acquisition. */
     printf ("Starting acquisition at %.1f Hz...\n", fps);
@@ -276,13 +352,42 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
 
     guint64 trigger_interval_us = (guint64) (1000000.0 / fps);
 
-    if (auto_expose)
-        auto_expose_settle (camera, &cfg, (double) trigger_interval_us);
+    ag_startup_mark ("start acquisition");
+
+    AgAeController ae;
+    if (ae_mode != AG_AE_OFF) {
+        auto_expose_settle (camera, &cfg, ae_mode,
+                            (double) trigger_interval_us, ae_meter, &ae);
+        ag_startup_mark ("auto-expose settle");
+    }
 
     guint64 frames_displayed = 0;
     guint64 frames_dropped   = 0;
+    guint64 frame_seq        = 0;
     const guint8 *gamma_lut  = gamma_lut_2p5 ();
     GTimer *stats_timer = g_timer_new ();
+    GTimer *run_timer   = g_timer_new ();
+    gint64  next_trigger_us = 0;
+
+    if (trace_path)
+        ag_trace_start ("acquisition");
+
+    if (metrics_addr)
+        ag_metrics_observe_trace_stages ();
+
+    /* Rectification drift check on the search range the disparity
+     * backend uses (from the calibration, before live tuning). */
+    AgRectMonitor *rect_mon = NULL;
+    AgRectCheck    rect_last = { 0 };
+    if (rect_check) {
+        AgRectMonitorConfig rc = *rect_check;
+        rc.min_disparity   = MAX (sgbm_params->min_disparity, 0);
+        rc.num_disparities = CLAMP (sgbm_params->num_disparities, 16,
+                                    AG_RECT_MONITOR_DISPARITIES_MAX);
+        rect_mon = ag_rect_monitor_new (&rc);
+        if (rect_mon && metrics_addr)
+            ag_rect_monitor_enable_metrics (rect_mon);
+    }
 
     while (!g_quit) {
         SDL_Event ev;
@@ -456,6 +561,11 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
         }
         if (g_quit)
             break;
+        if (duration_s > 0.0 && g_timer_elapsed (run_timer, NULL) >= duration_s)
+            break;
+
+        ag_trace_set_frame (frame_seq++);
+        uint64_t t_stage = ag_trace_begin ();
 
         /* Wait for TriggerArmed. */
         {
@@ -487,16 +597,21 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
                 continue;
             }
         }
+        ag_trace_end (AG_STAGE_TRIGGER, t_stage);
 
+        t_stage = ag_trace_begin ();
         ArvBuffer *buffer = arv_stream_timeout_pop_buffer (cfg.stream, 500000);
+        ag_trace_end (AG_STAGE_POP, t_stage);
         if (!buffer) {
             frames_dropped++;
+            ag_stream_metrics_drop (&metrics, AG_DROP_TIMEOUT);
             continue;
         }
 
         ArvBufferStatus st = arv_buffer_get_status (buffer);
         if (st != ARV_BUFFER_STATUS_SUCCESS) {
             frames_dropped++;
+            ag_stream_metrics_drop (&metrics, AG_DROP_STATUS);
             arv_stream_push_buffer (cfg.stream, buffer);
             continue;
         }
@@ -510,14 +625,22 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
         if (!data || data_size < needed || w % 2 != 0 ||
             w != cfg.frame_w || h != cfg.frame_h) {
             frames_dropped++;
+            ag_stream_metrics_drop (&metrics, AG_DROP_SIZE);
             arv_stream_push_buffer (cfg.stream, buffer);
             continue;
         }
 
+        /* Host AE keeps tracking; writes only leave the deadband. */
+        if (ae_mode == AG_AE_HOST)
+            auto_expose_track (device, &ae, ae_meter, data, w, h);
+
+        t_stage = ag_trace_begin ();
         extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
                                  bayer_left, bayer_right);
+        ag_trace_end (AG_STAGE_EXTRACT, t_stage);
 
         /* ---- Disparity path (pre-gamma for better matching) ---- */
+        t_stage = ag_trace_begin ();
         if (cfg.data_is_bayer) {
             debayer_rg8_to_gray (bayer_left,  gray_left,  proc_sub_w, proc_h);
             debayer_rg8_to_gray (bayer_right, gray_right, proc_sub_w, proc_h);
@@ -526,27 +649,85 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
             memcpy (gray_left,  bayer_left,  eye_pixels);
             memcpy (gray_right, bayer_right, eye_pixels);
         }
+        ag_trace_end (AG_STAGE_DEBAYER, t_stage);
+
+        t_stage = ag_trace_begin ();
         ag_remap_gray (remap_left,  gray_left,  rect_gray_l);
         ag_remap_gray (remap_right, gray_right, rect_gray_r);
-
+        ag_trace_end (AG_STAGE_REMAP, t_stage);
+
+        if (rect_mon && ag_rect_monitor_due (rect_mon, frame_seq) &&
+            ag_rect_monitor_check (rect_mon, rect_gray_l, rect_gray_r,
+                                   (int) proc_sub_w, (int) proc_h,
+                                   (int) proc_sub_w, &rect_last))
+            fprintf (stderr, "warn: rectification drift: vertical disparity "
+                     "median %+.2f px, p95 %.2f px (%d matches); "
+                     "recalibrate\n", rect_last.median_dy,
+                     rect_last.p95_abs_dy, rect_last.matches);
+
+        uint64_t t_disp = inference_hist ? ag_trace_now_ns () : 0;
+        t_stage = ag_trace_begin ();
         int disp_ok = ag_disparity_compute (disp_ctx,
                                              rect_gray_l, rect_gray_r,
                                              disparity_buf);
+        ag_trace_end (AG_STAGE_DISPARITY, t_stage);
+        if (inference_hist)
+            ag_histogram_observe_ns (inference_hist, ag_trace_now_ns () - t_disp);
 
+        t_stage = ag_trace_begin ();
         ag_disparity_colorize (disparity_buf, proc_sub_w, proc_h,
                                sgbm_params->min_disparity,
                                sgbm_params->num_disparities,
                                disparity_rgb);
+        ag_trace_end (AG_STAGE_COLORIZE, t_stage);
 
         /* ---- Display path (with gamma for natural look) ---- */
+        t_stage = ag_trace_begin ();
         apply_lut_inplace (bayer_left,  eye_pixels, gamma_lut);
         if (cfg.data_is_bayer)
             debayer_rg8_to_rgb (bayer_left, rgb_left, proc_sub_w, proc_h);
         else
             gray_to_rgb_replicate (bayer_left, rgb_left, (uint32_t) eye_pixels);
+        ag_trace_end (AG_STAGE_DEBAYER, t_stage);
+
+        t_stage = ag_trace_begin ();
         ag_remap_rgb (remap_left, rgb_left, rect_rgb_l);
+        ag_trace_end (AG_STAGE_REMAP, t_stage);
+
+        /* ---- Video path: gray video is the matcher's rectified input,
+         *      colour video the display path for both eyes ---- */
+        if (video) {
+            t_stage = ag_trace_begin ();
+            AgVideoFrame vf = {
+                .eye          = { rect_gray_l, rect_gray_r },
+                .channels     = 1,
+                .width        = proc_sub_w,
+                .height       = proc_h,
+                .stride       = proc_sub_w,
+                .frame_id     = arv_buffer_get_frame_id (buffer),
+                .timestamp_ns = arv_buffer_get_timestamp (buffer),
+                .system_ns    = arv_buffer_get_system_timestamp (buffer),
+            };
+            if (video_rgb) {
+                apply_lut_inplace (bayer_right, eye_pixels, gamma_lut);
+                if (cfg.data_is_bayer)
+                    debayer_rg8_to_rgb (bayer_right, rgb_right, proc_sub_w, proc_h);
+                else
+                    gray_to_rgb_replicate (bayer_right, rgb_right,
+                                           (uint32_t) eye_pixels);
+                ag_remap_rgb (remap_right, rgb_right, rect_rgb_r);
+                vf.eye[0]   = rect_rgb_l;
+                vf.eye[1]   = rect_rgb_r;
+                vf.channels = 3;
+                vf.stride   = (size_t) proc_sub_w * 3;
+            }
+            if (ag_video_out_write (video, &vf) != 0)
+                g_quit = 1;
+            ag_trace_end (AG_STAGE_VIDEO, t_stage);
+        }
 
         /* Upload to SDL texture: [rectified left | disparity colourmap]. */
+        t_stage = ag_trace_begin ();
         void *tex_pixels;
         int tex_pitch;
         if (SDL_LockTexture (texture, NULL, &tex_pixels, &tex_pitch) == 0) {
@@ -565,9 +746,11 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
             }
             SDL_UnlockTexture (texture);
         }
+        ag_trace_end (AG_STAGE_UPLOAD, t_stage);
 
         arv_stream_push_buffer (cfg.stream, buffer);
 
+        t_stage = ag_trace_begin ();
         SDL_RenderClear (renderer);
         SDL_RenderCopy (renderer, texture, NULL, NULL);
 
@@ -611,8 +794,15 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
         }
 
         SDL_RenderPresent (renderer);
+        ag_trace_end (AG_STAGE_PRESENT, t_stage);
 
         frames_displayed++;
+        if (frames_displayed == 1) {
+            ag_startup_mark ("first frame");
+            ag_startup_report (stdout);
+        }
+        ag_stream_metrics_frame (&metrics);
+        ag_stream_metrics_update (&metrics, cfg.stream);
 
         double elapsed = g_timer_elapsed (stats_timer, NULL);
         if (elapsed >= 5.0) {
@@ -620,29 +810,51 @@ depth_preview_loop (const char *device_id, const char *iface_ip,
                     " dropped=%" G_GUINT64_FORMAT ") [%s]\n",
                     frames_displayed / elapsed, frames_displayed,
                     frames_dropped, ag_stereo_backend_name (backend));
+            if (ae_mode == AG_AE_HOST)
+                printf ("  AE level %.0f  L/R %.2f  ExposureTime = %.1f us  "
+                        "Gain = %.1f dB\n", ae.brightness, ae.balance,
+                        ae.exposure_us, ae.gain_db);
+            if (rect_mon && rect_last.matches > 0) {
+                AgRectMonitorState rs;
+                ag_rect_monitor_state (rect_mon, &rs);
+                printf ("  rect dy median %+.2f p95 %.2f px  roll %.1e  "
+                        "scale %.1e  (%d/%d matched, %.2f ms)%s\n",
+                        rect_last.median_dy, rect_last.p95_abs_dy,
+                        rect_last.rotation, rect_last.scale,
+                        rect_last.matches, rect_last.corners,
+                        rect_last.check_ms, rs.alarm ? "  ALARM" : "");
+            }
+            ag_gauge_set (metrics.fps, frames_displayed / elapsed);
+            ag_trace_print_summary ();
             frames_displayed = 0;
             frames_dropped = 0;
             g_timer_start (stats_timer);
         }
 
-        g_usleep ((gulong) trigger_interval_us);
+        ag_pace_trigger (&next_trigger_us, trigger_interval_us);
     }
 
     g_timer_destroy (stats_timer);
+    ag_rect_monitor_free (rect_mon);
     printf ("\nStopping...\n");
     arv_camera_stop_acquisition (camera, NULL);
+    ag_stream_metrics_print_summary (&metrics, g_timer_elapsed (run_timer, NULL));
+    g_timer_destroy (run_timer);
+    if (video)
+        printf ("Video: %" G_GUINT64_FORMAT " frames, %.1f MB written.\n",
+                ag_video_out_frames (video),
+                ag_video_out_bytes (video) / (1024.0 * 1024.0));
+
+    if (trace_path)
+        ag_trace_write_chrome (trace_path);
+    if (trace_path || metrics_addr)
+        ag_trace_stop ();
+    if (metrics_addr)
+        ag_metrics_reset ();
+    exitcode = EXIT_SUCCESS;
 
 cleanup_sdl:
-    g_free (disparity_rgb);
-    g_free (disparity_buf);
-    g_free (rect_gray_r);
-    g_free (rect_gray_l);
-    g_free (gray_right);
-    g_free (gray_left);
-    g_free (rect_rgb_l);
-    g_free (rgb_left);
-    g_free (bayer_left);
-    g_free (bayer_right);
+    ag_frame_arena_free (scratch);
     SDL_DestroyTexture (texture);
     SDL_DestroyRenderer (renderer);
     SDL_DestroyWindow (window);
@@ -652,10 +864,11 @@ cleanup_sdl:
 cleanup:
     ag_remap_table_free (remap_left);
     ag_remap_table_free (remap_right);
-    g_object_unref (cfg.stream);
+    ag_ae_meter_free (ae_meter);
+    camera_config_cleanup (&cfg);
     g_object_unref (camera);
     arv_shutdown ();
-    return EXIT_SUCCESS;
+    return exitcode;
 }
 
 /* ------------------------------------------------------------------ */
@@ -683,10 +896,28 @@ cmd_depth_preview_impl (int argc, char *argv[], arg_dstr_t res, void *ctx,
                                           "sensor gain in dB (0-48)");
     struct arg_lit *auto_exp  = arg_lit0 ("A", "auto-expose",
                                           "auto-expose then lock");
+    struct arg_str *ae_mode_a = arg_str0 (NULL, "ae-mode", "<host|camera>",
+                                          "-A metering: host histogram (default) or camera AE");
+    struct arg_str *ae_meter_a = arg_str0 (NULL, "ae-metering", "<frame|overlap>",
+                                           "host AE samples (default: overlap when rectifying)");
     struct arg_int *binning_a = arg_int0 ("b", "binning",   "<1|2>",
                                           "sensor binning factor (default: 1)");
     struct arg_int *pkt_size  = arg_int0 ("p", "packet-size", "<bytes>",
                                           "GigE packet size (default: auto-negotiate)");
+    struct arg_str *roi_a     = arg_str0 (NULL, "roi", "<y0:h[:x0:w]>",
+                                          "acquire only this per-eye window (default: full frame)");
+    struct arg_int *buffers_a = arg_int0 (NULL, "stream-buffers", "<n>",
+                                          "Aravis stream buffers (default: 16)");
+    struct arg_str *psock_a   = arg_str0 (NULL, "packet-socket", "<auto|on|off>",
+                                          "PF_PACKET receive path (default: auto)");
+    struct arg_str *sockbuf_a = arg_str0 (NULL, "socket-buffer", "<bytes|auto>",
+                                          "GVSP socket receive buffer, e.g. 8M (default: auto)");
+    struct arg_int *ptimeout_a = arg_int0 (NULL, "packet-timeout", "<us>",
+                                           "wait before requesting a resend (default: 20000)");
+    struct arg_int *fretain_a = arg_int0 (NULL, "frame-retention", "<us>",
+                                          "give up on an incomplete frame after (default: 200000)");
+    struct arg_str *resend_a  = arg_str0 (NULL, "packet-resend", "<always|never>",
+                                          "GVSP packet resend policy (default: always)");
     struct arg_str *calib_local = arg_str0 (NULL, "calibration-local", "<path>",
                                             "rectify using local calibration session");
     struct arg_int *calib_slot  = arg_int0 (NULL, "calibration-slot", "<0-2>",
@@ -701,17 +932,52 @@ cmd_depth_preview_impl (int argc, char *argv[], arg_dstr_t res, void *ctx,
                                             "override calibration num_disparities");
     struct arg_int *blk_size_a = arg_int0 (NULL, "block-size", "<int>",
                                             "SGBM block size (default: 5)");
+    struct arg_str *trace_a   = arg_str0 (NULL, "trace", "<out.json>",
+                                          "record per-stage latency (Chrome trace format)");
+    struct arg_str *metrics_a = arg_str0 (NULL, "metrics", "<addr>",
+                                          "serve Prometheus metrics on unix:<path> or [127.0.0.1:]<port>");
+    struct arg_int *rect_check_a = arg_int0 (NULL, "rect-check", "<frames>",
+                                             "check rectification drift every N frames (default: off)");
+    struct arg_dbl *rect_alarm_a = arg_dbl0 (NULL, "rect-alarm", "<px>",
+                                             "vertical disparity that raises the drift alarm (default: 0.5)");
+    struct arg_int *rect_band_a  = arg_int0 (NULL, "rect-band", "<rows>",
+                                             "rows searched above and below the epipolar line (default: 4)");
+    struct arg_str *video_a   = arg_str0 (NULL, "video-out", "<-|path>",
+                                          "stream the rectified pair as video to a file or stdout (-)");
+    struct arg_str *vformat_a = arg_str0 (NULL, "video-format", "<y4m|mjpeg>",
+                                          "video container (default: y4m)");
+    struct arg_str *vcolor_a  = arg_str0 (NULL, "video-color", "<gray|420>",
+                                          "video pixels: luma only or YCbCr 4:2:0 (default: gray)");
+    struct arg_str *vlayout_a = arg_str0 (NULL, "video-layout", "<sbs|left|right|split>",
+                                          "eyes side by side, one eye, or one file per eye (default: sbs)");
+    struct arg_int *vquality_a = arg_int0 (NULL, "video-quality", "<1-100>",
+                                           "MJPEG quality (default: 90)");
+    struct arg_str *vts_a     = arg_str0 (NULL, "video-timestamps", "<path>",
+                                          "per-frame timestamp CSV (default: <path>.timestamps.csv)");
+    struct arg_lit *headless_a = arg_lit0 (NULL, "headless",
+                                           "render offscreen (no window; for tests and benchmarks)");
+    struct arg_dbl *duration_a = arg_dbl0 (NULL, "duration", "<seconds>",
+                                           "stop after this many seconds");
+    struct arg_lit *profile_a = arg_lit0 (NULL, "startup-profile",
+                                          "print time spent in each startup phase");
     struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
     struct arg_end *end       = arg_end (15);
 
     void *argtable[] = { cmd, serial, address, interface, fps_a, exposure,
-                         gain, auto_exp, binning_a, pkt_size,
+                         gain, auto_exp, ae_mode_a, ae_meter_a,
+                         binning_a, pkt_size, roi_a, buffers_a,
+                         psock_a, sockbuf_a, ptimeout_a, fretain_a, resend_a,
                          calib_local, calib_slot,
                          backend_a, model_path_a,
                          min_disp_a, num_disp_a, blk_size_a,
-                         help, end };
+                         trace_a, metrics_a,
+                         rect_check_a, rect_alarm_a, rect_band_a,
+                         video_a, vformat_a, vcolor_a, vlayout_a, vquality_a, vts_a,
+                         headless_a, duration_a,
+                         profile_a, help, end };
 
     int exitcode = EXIT_SUCCESS;
+    AgVideoOut *video = NULL;
     if (arg_nullcheck (argtable) != 0) {
         arg_dstr_catf (res, "error: insufficient memory\n");
         exitcode = EXIT_FAILURE;
@@ -760,8 +1026,34 @@ cmd_depth_preview_impl (int argc, char *argv[], arg_dstr_t res, void *ctx,
         }
     }
 
-    gboolean do_auto_expose = auto_exp->count > 0;
-    if (do_auto_expose && (exposure->count || gain->count)) {
+    AgAeMode ae_mode = auto_exp->count ? AG_AE_HOST : AG_AE_OFF;
+    if (ae_mode_a->count) {
+        if (!auto_exp->count) {
+            arg_dstr_catf (res, "error: --ae-mode requires --auto-expose\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ag_parse_ae_mode (ae_mode_a->sval[0], &ae_mode) != 0) {
+            arg_dstr_catf (res, "error: --ae-mode must be host or camera\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    AgAeMetering ae_metering = AG_AE_METER_OVERLAP;
+    if (ae_meter_a->count) {
+        if (ae_mode != AG_AE_HOST) {
+            arg_dstr_catf (res, "error: --ae-metering requires --auto-expose "
+                           "with --ae-mode host\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ag_parse_ae_metering (ae_meter_a->sval[0], &ae_metering) != 0) {
+            arg_dstr_catf (res, "error: --ae-metering must be frame or overlap\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (ae_mode != AG_AE_OFF && (exposure->count || gain->count)) {
         arg_dstr_catf (res, "error: --auto-expose and --exposure/--gain are mutually exclusive\n");
         exitcode = EXIT_FAILURE;
         goto done;
@@ -774,6 +1066,19 @@ cmd_depth_preview_impl (int argc, char *argv[], arg_dstr_t res, void *ctx,
         goto done;
     }
 
+    AgRoi roi = { 0 };
+    if (roi_a->count) {
+        const char *rerr = "--roi must be y0:height or y0:height:x0:width";
+        if (ag_parse_roi (roi_a->sval[0], &roi) == 0)
+            rerr = ag_roi_resolve (&roi, AG_SENSOR_WIDTH / 2 / (guint) binning,
+                                   AG_SENSOR_HEIGHT / (guint) binning);
+        if (rerr) {
+            arg_dstr_catf (res, "error: %s\n", rerr);
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
     /* Calibration is required for depth-preview. */
     if (!calib_local->count && !calib_slot->count) {
         arg_dstr_catf (res, "error: depth-preview requires either "
@@ -802,6 +1107,42 @@ cmd_depth_preview_impl (int argc, char *argv[], arg_dstr_t res, void *ctx,
     else if (calib_slot->count)
         calib_src.slot = calib_slot->ival[0];
 
+    AgVideoOptions video_opts;
+    ag_video_options_defaults (&video_opts);
+    video_opts.fps = fps;
+    if ((vformat_a->count || vcolor_a->count || vlayout_a->count ||
+         vquality_a->count || vts_a->count) && !video_a->count) {
+        arg_dstr_catf (res, "error: --video-format/--video-color/--video-layout/"
+                       "--video-quality/--video-timestamps require --video-out\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    const char *verr = ag_video_options_set (
+        &video_opts,
+        vformat_a->count  ? vformat_a->sval[0]  : NULL,
+        vcolor_a->count   ? vcolor_a->sval[0]   : NULL,
+        vlayout_a->count  ? vlayout_a->sval[0]  : NULL,
+        vquality_a->count ? vquality_a->ival[0] : -1);
+    if (verr) {
+        arg_dstr_catf (res, "error: %s\n", verr);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    /* Claim stdout for the video before anything is printed. */
+    if (video_a->count) {
+        const char *vpath = video_a->sval[0];
+        char *video_ts = NULL;
+        if (vts_a->count)
+            video_ts = g_strdup (vts_a->sval[0]);
+        else if (strcmp (vpath, "-") != 0)
+            video_ts = g_strdup_printf ("%s.timestamps.csv", vpath);
+        video_opts.timestamps_path = video_ts;
+        video = ag_video_out_open (vpath, &video_opts);
+        g_free (video_ts);
+        if (!video) { exitcode = EXIT_FAILURE; goto done; }
+    }
+
     if (calib_src.local_path)
         printf ("Rectification enabled (calibration from %s).\n",
                 calib_src.local_path);
@@ -872,27 +1213,108 @@ cmd_depth_preview_impl (int argc, char *argv[], arg_dstr_t res, void *ctx,
     const char *opt_address   = address->count   ? address->sval[0]   : NULL;
     const char *opt_interface = interface->count  ? interface->sval[0] : NULL;
 
+    if (buffers_a->count &&
+        (buffers_a->ival[0] < AG_STREAM_BUFFERS_MIN ||
+         buffers_a->ival[0] > AG_STREAM_BUFFERS_MAX)) {
+        arg_dstr_catf (res, "error: --stream-buffers must be between %d and %d\n",
+                       AG_STREAM_BUFFERS_MIN, AG_STREAM_BUFFERS_MAX);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    AgTransportOptions transport = {
+        .stream_buffers = buffers_a->count ? (guint) buffers_a->ival[0] : 0,
+    };
+    const char *terr = ag_transport_options_set (
+        &transport,
+        psock_a->count    ? psock_a->sval[0]    : NULL,
+        sockbuf_a->count  ? sockbuf_a->sval[0]  : NULL,
+        ptimeout_a->count ? ptimeout_a->ival[0] : -1,
+        fretain_a->count  ? fretain_a->ival[0]  : -1,
+        resend_a->count   ? resend_a->sval[0]   : NULL);
+    if (terr) {
+        arg_dstr_catf (res, "error: %s\n", terr);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (duration_a->count && duration_a->dval[0] <= 0.0) {
+        arg_dstr_catf (res, "error: --duration must be positive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (metrics_a->count && !ag_metrics_listen_valid (metrics_a->sval[0])) {
+        arg_dstr_catf (res, "error: --metrics must be unix:<path> or "
+                       "[127.0.0.1:]<port>\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    AgRectMonitorConfig rect_cfg;
+    ag_rect_monitor_config_defaults (&rect_cfg);
+    if ((rect_alarm_a->count || rect_band_a->count) && !rect_check_a->count) {
+        arg_dstr_catf (res, "error: --rect-alarm and --rect-band require "
+                       "--rect-check\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    if (rect_check_a->count) {
+        rect_cfg.every = rect_check_a->ival[0];
+        if (rect_cfg.every < 1) {
+            arg_dstr_catf (res, "error: --rect-check must be at least 1\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (rect_alarm_a->count) {
+        rect_cfg.alarm_px = rect_alarm_a->dval[0];
+        if (!(rect_cfg.alarm_px > 0.0)) {
+            arg_dstr_catf (res, "error: --rect-alarm must be positive\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (rect_band_a->count) {
+        rect_cfg.band = rect_band_a->ival[0];
+        if (rect_cfg.band < 1 || rect_cfg.band > AG_RECT_MONITOR_BAND_MAX) {
+            arg_dstr_catf (res, "error: --rect-band must be between 1 and %d\n",
+                           AG_RECT_MONITOR_BAND_MAX);
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
     const char *iface_ip = NULL;
     if (opt_interface) {
         iface_ip = setup_interface (opt_interface);
         if (!iface_ip) { exitcode = EXIT_FAILURE; goto done; }
     }
 
+    ag_startup_begin (profile_a->count > 0);
     char *device_id = resolve_device (opt_serial, opt_address,
                                        opt_interface, TRUE);
     if (!device_id) { exitcode = EXIT_FAILURE; goto done; }
+    ag_startup_mark ("resolve device");
 
     int pkt_sz = pkt_size->count ? pkt_size->ival[0] : 0;
 
     exitcode = depth_preview_loop (device_id, iface_ip, fps,
                                     exposure_us, gain_db,
-                                    do_auto_expose, pkt_sz, binning,
+                                    ae_mode, ae_metering, pkt_sz, binning,
                                     &calib_src, backend,
                                     &sgbm_params, &onnx_params,
-                                    enable_runtime_tuning);
+                                    enable_runtime_tuning, &transport, &roi,
+                                    trace_a->count ? trace_a->sval[0] : NULL,
+                                    metrics_a->count ? metrics_a->sval[0] : NULL,
+                                    rect_check_a->count ? &rect_cfg : NULL,
+                                    video, video_opts.color,
+                                    headless_a->count > 0,
+                                    duration_a->count ? duration_a->dval[0] : 0.0);
     g_free (device_id);
 
 done:
+    ag_video_out_close (video);
     arg_freetable (argtable, sizeof argtable / sizeof argtable[0]);
     return exitcode;
 }
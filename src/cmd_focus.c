@@ -3,15 +3,29 @@
  *
  * Continuously captures software-triggered DualBayerRG8 frames, computes
  * a configurable focus score for each eye, and displays the live stream
- * with ROI overlay and score readout via SDL2.
+ * with ROI overlay and score readout via SDL2.  --grid adds a per-tile
+ * sharpness heat map (and optional CSV log) for tilt diagnosis.
+ *
+ * On Bayer sensors the scores are taken from the green sites only, read
+ * in place from the interleaved frame (--sites all scores every mosaic
+ * pixel of the extracted eyes instead).
+ *
+ * --sweep records every frame's scores while the lens is turned through
+ * focus, fits the peak of the curve and drives the audio by the distance
+ * to that predicted peak.  Frames are scored at the trigger rate; the
+ * display is refreshed at AG_FOCUS_SWEEP_DISPLAY_HZ.
  */
 
 #include "common.h"
+#include "arena.h"
 #include "focus.h"
 #include "focus_audio.h"
+#include "focus_grid.h"
+#include "focus_sweep.h"
 #include "font.h"
 #include "../vendor/argtable3.h"
 
+#include <errno.h>
 #include <math.h>
 #include <signal.h>
 #include <stdio.h>
@@ -26,6 +40,15 @@ static volatile sig_atomic_t g_quit = 0;
 #define AG_FOCUS_LOCK_HOLD_SECONDS   1.0
 #define AG_FOCUS_SCORE_AVG_FRAMES    5
 #define AG_FOCUS_LOW_DETAIL_SCORE    5.0
+#define AG_FOCUS_GRID_MAX_THREADS    8
+#define AG_FOCUS_SWEEP_DISPLAY_HZ    30
+#define AG_FOCUS_SWEEP_DECIMATE_MAX  4
+
+typedef enum {
+    FOCUS_SITES_AUTO = 0,    /* green on Bayer sensors, all otherwise */
+    FOCUS_SITES_GREEN,
+    FOCUS_SITES_ALL,
+} FocusSites;
 
 static float
 focus_normalized_delta (double score_left, double score_right)
@@ -40,6 +63,107 @@ focus_normalized_delta (double score_left, double score_right)
     return (float) normalized;
 }
 
+/* Heat map of one eye's tiles, scaled so 1.0 is the sharpest tile of
+ * either eye: red (soft) through yellow to green (sharp). */
+static void
+draw_grid_heat_map (SDL_Renderer *renderer, const double *tiles,
+                    int cols, int rows, double max_score,
+                    int eye_x, int eye_w, int eye_h, double sx, double sy)
+{
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            int x, y, w, h;
+            ag_focus_grid_tile_rect (cols, rows, eye_w, eye_h, c, r,
+                                     &x, &y, &w, &h);
+            double t = max_score > 0.0 ? tiles[r * cols + c] / max_score : 0.0;
+            SDL_Rect rc = {
+                (int) ((x + eye_x) * sx), (int) (y * sy),
+                (int) (w * sx), (int) (h * sy)
+            };
+            SDL_SetRenderDrawColor (renderer,
+                                    (guint8) (t < 0.5 ? 255 : 510 * (1.0 - t)),
+                                    (guint8) (t < 0.5 ? 510 * t : 255),
+                                    0, 80);
+            SDL_RenderFillRect (renderer, &rc);
+            SDL_SetRenderDrawColor (renderer, 40, 40, 40, 160);
+            SDL_RenderDrawRect (renderer, &rc);
+        }
+    }
+}
+
+/* Focus curve of the samples held, in a box at the bottom left: left eye
+ * green, right eye cyan, predicted peaks as dashes on the right edge. */
+static void
+draw_sweep_curve (SDL_Renderer *renderer, const AgFocusSweep *sweep,
+                  int out_w, int out_h)
+{
+    guint n = ag_focus_sweep_len (sweep);
+    SDL_Rect box = { 8, out_h - out_h / 4 - 8, out_w * 2 / 5, out_h / 4 };
+    SDL_SetRenderDrawBlendMode (renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor (renderer, 0, 0, 0, 160);
+    SDL_RenderFillRect (renderer, &box);
+    SDL_SetRenderDrawBlendMode (renderer, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor (renderer, 120, 120, 120, 255);
+    SDL_RenderDrawRect (renderer, &box);
+    if (n < 2)
+        return;
+
+    AgFocusPeak peak[2];
+    gboolean have[2];
+    double t0, t1, top = 0.0;
+    ag_focus_sweep_get (sweep, 0, &t0, NULL, NULL);
+    ag_focus_sweep_get (sweep, n - 1, &t1, NULL, NULL);
+    for (guint i = 0; i < n; i++) {
+        double l, r;
+        ag_focus_sweep_get (sweep, i, NULL, &l, &r);
+        top = fmax (top, fmax (l, r));
+    }
+    for (int e = 0; e < 2; e++) {
+        have[e] = ag_focus_sweep_peak (sweep, (AgFocusSweepEye) e, &peak[e]);
+        if (have[e])
+            top = fmax (top, peak[e].score);
+    }
+    if (top <= 0.0 || t1 <= t0)
+        return;
+
+    /* One point per column is enough; samples beyond that are skipped. */
+    int cols = box.w - 2;
+    guint step = MAX (1u, n / (guint) cols);
+    for (int e = 0; e < 2; e++) {
+        SDL_SetRenderDrawColor (renderer, 0, 255, e ? 255 : 0, 255);
+        int px = -1, py = 0;
+        for (guint i = 0; i < n; i += step) {
+            double t, l, r;
+            ag_focus_sweep_get (sweep, i, &t, &l, &r);
+            int x = box.x + 1 + (int) ((t - t0) / (t1 - t0) * (cols - 1));
+            int y = box.y + box.h - 2 -
+                    (int) ((e ? r : l) / top * (box.h - 3));
+            if (px >= 0)
+                SDL_RenderDrawLine (renderer, px, py, x, y);
+            px = x;
+            py = y;
+        }
+        if (have[e]) {
+            int y = box.y + box.h - 2 - (int) (peak[e].score / top * (box.h - 3));
+            SDL_RenderDrawLine (renderer, box.x + box.w - 12, y,
+                                box.x + box.w - 2, y);
+        }
+    }
+}
+
+/* Sleep until the next trigger slot; if processing fell behind, start
+ * counting again from now rather than firing a burst. */
+static void
+sleep_until_next_trigger (gint64 *next_us, guint64 interval_us)
+{
+    gint64 now = g_get_monotonic_time ();
+    *next_us += (gint64) interval_us;
+    if (*next_us > now)
+        g_usleep ((gulong) (*next_us - now));
+    else
+        *next_us = now;
+}
+
 static void
 sigint_handler (int sig)
 {
@@ -50,11 +174,14 @@ sigint_handler (int sig)
 static int
 focus_loop (const char *device_id, const char *iface_ip,
             double fps, double exposure_us, double gain_db,
-            gboolean auto_expose, int packet_size, int binning,
+            AgAeMode ae_mode, int packet_size, int binning,
             int user_roi_x, int user_roi_y,
             int user_roi_w, int user_roi_h,
             int roi_specified, gboolean enable_audio,
-            AgFocusMetric metric)
+            AgFocusMetric metric, FocusSites sites,
+            int grid_cols, int grid_rows, const char *grid_log_path,
+            gboolean sweep_mode, AgFocusFit sweep_fit, int decimate,
+            const char *sweep_log_path)
 {
     GError *error = NULL;
     ArvCamera *camera = arv_camera_new (device_id, &error);
@@ -70,8 +197,8 @@ focus_loop (const char *device_id, const char *iface_ip,
 
     AgCameraConfig cfg;
     if (camera_configure (camera, AG_MODE_CONTINUOUS,
-                          binning, exposure_us, gain_db, auto_expose,
-                          packet_size, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
+                          binning, exposure_us, gain_db, ae_mode == AG_AE_CAMERA,
+                          packet_size, NULL, NULL, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -103,13 +230,70 @@ focus_loop (const char *device_id, const char *iface_ip,
 
     printf ("Focus ROI: x=%d y=%d w=%d h=%d (image %ux%u per eye)\n",
             roi_x, roi_y, roi_w, roi_h, proc_sub_w, proc_h);
-    printf ("Focus metric: %s\n", ag_focus_metric_name (metric));
+    printf ("Focus metric: %s (engine: %s)\n", ag_focus_metric_name (metric),
+            ag_focus_engine ());
+
+    if (sites == FOCUS_SITES_GREEN && !cfg.data_is_bayer)
+        fprintf (stderr, "warn: --sites green needs a Bayer sensor; "
+                 "scoring all pixels\n");
+    gboolean green_sites = cfg.data_is_bayer && sites != FOCUS_SITES_ALL;
+    printf ("Focus sites: %s\n", green_sites
+            ? "green (G sites of the raw frame, half resolution)"
+            : "all");
+
+    AgFocusGrid *grid = NULL;
+    FILE *grid_log = NULL;
+    if (grid_cols > 0) {
+        int threads = MIN ((int) g_get_num_processors (),
+                           AG_FOCUS_GRID_MAX_THREADS);
+        grid = ag_focus_grid_new (grid_cols, grid_rows, threads);
+        printf ("Focus grid: %dx%d tiles per eye, %d threads\n",
+                grid_cols, grid_rows, threads);
+        if (grid_log_path) {
+            grid_log = fopen (grid_log_path, "w");
+            if (!grid_log) {
+                fprintf (stderr, "error: cannot open '%s' for write: %s\n",
+                         grid_log_path, g_strerror (errno));
+                ag_focus_grid_free (grid);
+                camera_config_cleanup (&cfg);
+                g_object_unref (camera);
+                arv_shutdown ();
+                return EXIT_FAILURE;
+            }
+            ag_focus_grid_write_csv_header (grid_log, grid_cols, grid_rows);
+        }
+    }
+
+    AgFocusSweep *sweep = NULL;
+    FILE *sweep_log = NULL;
+    if (sweep_mode) {
+        sweep = ag_focus_sweep_new (AG_FOCUS_SWEEP_CAPACITY_DEFAULT, sweep_fit);
+        printf ("Focus sweep: %s fit, decimate %d, display at %d Hz "
+                "(R restarts the sweep)\n", ag_focus_fit_name (sweep_fit),
+                decimate, AG_FOCUS_SWEEP_DISPLAY_HZ);
+        if (sweep_log_path) {
+            sweep_log = fopen (sweep_log_path, "w");
+            if (!sweep_log) {
+                fprintf (stderr, "error: cannot open '%s' for write: %s\n",
+                         sweep_log_path, g_strerror (errno));
+                ag_focus_sweep_free (sweep);
+                ag_focus_grid_free (grid);
+                if (grid_log)
+                    fclose (grid_log);
+                camera_config_cleanup (&cfg);
+                g_object_unref (camera);
+                arv_shutdown ();
+                return EXIT_FAILURE;
+            }
+            ag_focus_sweep_write_csv_header (sweep_log);
+        }
+    }
 
     /* SDL2 setup. */
     if (SDL_Init (enable_audio ? (SDL_INIT_VIDEO | SDL_INIT_AUDIO)
                                : SDL_INIT_VIDEO) != 0) {
         fprintf (stderr, "error: SDL_Init: %s\n", SDL_GetError ());
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -123,7 +307,7 @@ focus_loop (const char *device_id, const char *iface_ip,
     if (!window) {
         fprintf (stderr, "error: SDL_CreateWindow: %s\n", SDL_GetError ());
         SDL_Quit ();
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -137,7 +321,7 @@ focus_loop (const char *device_id, const char *iface_ip,
         fprintf (stderr, "error: SDL_CreateRenderer: %s\n", SDL_GetError ());
         SDL_DestroyWindow (window);
         SDL_Quit ();
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -151,7 +335,7 @@ focus_loop (const char *device_id, const char *iface_ip,
         SDL_DestroyRenderer (renderer);
         SDL_DestroyWindow (window);
         SDL_Quit ();
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -160,11 +344,18 @@ focus_loop (const char *device_id, const char *iface_ip,
     if (enable_audio)
         focus_audio_init ();
 
-    /* Scratch buffers. */
-    guint8 *rgb_left        = g_malloc ((size_t) proc_sub_w * proc_h * 3);
-    guint8 *rgb_right       = g_malloc ((size_t) proc_sub_w * proc_h * 3);
-    guint8 *bayer_left      = g_malloc ((size_t) proc_sub_w * proc_h);
-    guint8 *bayer_right     = g_malloc ((size_t) proc_sub_w * proc_h);
+    /* Scratch buffers, carved from one aligned arena reused every frame. */
+    size_t eye_pixels = (size_t) proc_sub_w * proc_h;
+    AgFrameArena *scratch = ag_frame_arena_new (
+        AG_ARENA_ROUND (eye_pixels) * 2 + AG_ARENA_ROUND (eye_pixels * 3) * 2,
+        AG_ARENA_HUGEPAGES);
+    guint8 *rgb_left        = ag_frame_arena_alloc (scratch, eye_pixels * 3);
+    guint8 *rgb_right       = ag_frame_arena_alloc (scratch, eye_pixels * 3);
+    guint8 *bayer_left      = ag_frame_arena_alloc (scratch, eye_pixels);
+    guint8 *bayer_right     = ag_frame_arena_alloc (scratch, eye_pixels);
+    printf ("Scratch arena: %.1f MB (%s)\n",
+            ag_frame_arena_capacity (scratch) / (1024.0 * 1024.0),
+            ag_frame_arena_backing_name (scratch));
 
     /* Start acquisition. */
     printf ("Starting focus at %.1f Hz...\n", fps);
@@ -180,12 +371,18 @@ focus_loop (const char *device_id, const char *iface_ip,
 
     guint64 trigger_interval_us = (guint64) (1000000.0 / fps);
 
-    if (auto_expose)
-        auto_expose_settle (camera, &cfg, (double) trigger_interval_us);
+    if (ae_mode != AG_AE_OFF)
+        auto_expose_settle (camera, &cfg, ae_mode, (double) trigger_interval_us, NULL, NULL);
 
     guint64 frames_displayed = 0;
+    guint64 frames_scored    = 0;
     guint64 frames_dropped   = 0;
     double current_fps       = 0.0;
+    double scored_fps        = 0.0;
+    double score_ms          = 0.0;
+    float sweep_cue          = 1.0f;
+    gint64 last_display_us   = 0;
+    gint64 next_trigger_us   = g_get_monotonic_time ();
     const guint8 *gamma_lut  = gamma_lut_2p5 ();
     GTimer *stats_timer  = g_timer_new ();
     GTimer *stdout_timer = g_timer_new ();
@@ -194,6 +391,12 @@ focus_loop (const char *device_id, const char *iface_ip,
     double score_right = 0.0;
     double raw_score_left = 0.0;
     double raw_score_right = 0.0;
+    double all_left[AG_FOCUS_METRIC_COUNT]  = { 0 };
+    double all_right[AG_FOCUS_METRIC_COUNT] = { 0 };
+    AgFocusGridSummary grid_sum[2];
+    double grid_ms = 0.0;
+    gint64 start_us = g_get_monotonic_time ();
+    memset (grid_sum, 0, sizeof grid_sum);
     double score_history_left[AG_FOCUS_SCORE_AVG_FRAMES] = { 0 };
     double score_history_right[AG_FOCUS_SCORE_AVG_FRAMES] = { 0 };
     double score_sum_left = 0.0;
@@ -226,6 +429,12 @@ focus_loop (const char *device_id, const char *iface_ip,
                 lock_stable_seconds = 0.0;
                 focus_locked = FALSE;
                 printf ("\nSwitched metric: %s\n", ag_focus_metric_name (metric));
+                if (sweep)
+                    ag_focus_sweep_reset (sweep);
+            }
+            if (sweep && ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_r) {
+                ag_focus_sweep_reset (sweep);
+                printf ("\nSweep restarted\n");
             }
         }
         if (g_quit)
@@ -288,16 +497,84 @@ focus_loop (const char *device_id, const char *iface_ip,
             continue;
         }
 
-        extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
-                                 bayer_left, bayer_right);
+        /* In sweep mode only every few frames are shown; the others are
+         * scored and recorded, nothing more. */
+        gint64 frame_us = g_get_monotonic_time ();
+        gboolean show = !sweep ||
+            frame_us - last_display_us >= G_USEC_PER_SEC / AG_FOCUS_SWEEP_DISPLAY_HZ;
+        if (show)
+            last_display_us = frame_us;
+
+        if (show || !green_sites)
+            extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
+                                     bayer_left, bayer_right);
+
+        /* Compute focus scores on raw bayer (before gamma).  All metrics
+         * come out of one pass; the selected one drives lock and audio.
+         * Green sites are read straight from the interleaved frame at
+         * sensor resolution, so the ROI is scaled back by the software
+         * binning factor.  --sweep-decimate scores every n-th sample. */
+        AgFocusPlane plane_left, plane_right;
+        if (green_sites) {
+            int bin = cfg.software_binning;
+            plane_left  = (AgFocusPlane) { data,     (int) w / 2, (int) h,
+                                           2, (int) w };
+            plane_right = (AgFocusPlane) { data + 1, (int) w / 2, (int) h,
+                                           2, (int) w };
+            ag_focus_score_bayer_green_decimated (
+                &plane_left, roi_x * bin, roi_y * bin, roi_w * bin,
+                roi_h * bin, decimate, all_left);
+            ag_focus_score_bayer_green_decimated (
+                &plane_right, roi_x * bin, roi_y * bin, roi_w * bin,
+                roi_h * bin, decimate, all_right);
+        } else {
+            plane_left  = (AgFocusPlane) { bayer_left, (int) proc_sub_w,
+                                           (int) proc_h, 1, (int) proc_sub_w };
+            plane_right = (AgFocusPlane) { bayer_right, (int) proc_sub_w,
+                                           (int) proc_h, 1, (int) proc_sub_w };
+            AgFocusPlane dl = {
+                bayer_left, (int) proc_sub_w / decimate, (int) proc_h / decimate,
+                decimate, (int) proc_sub_w * decimate
+            };
+            AgFocusPlane dr = dl;
+            dr.data = bayer_right;
+            ag_focus_score_plane (&dl, roi_x / decimate, roi_y / decimate,
+                                  roi_w / decimate, roi_h / decimate, all_left);
+            ag_focus_score_plane (&dr, roi_x / decimate, roi_y / decimate,
+                                  roi_w / decimate, roi_h / decimate, all_right);
+        }
+        raw_score_left  = all_left[metric];
+        raw_score_right = all_right[metric];
+        score_ms = (g_get_monotonic_time () - frame_us) / 1000.0;
+        frames_scored++;
+
+        if (sweep) {
+            ag_focus_sweep_push (sweep, (frame_us - start_us) / 1e6,
+                                 raw_score_left, raw_score_right);
+            if (sweep_log)
+                ag_focus_sweep_write_csv_row (
+                    sweep_log, arv_buffer_get_frame_id (buffer), sweep);
+            sweep_cue = ag_focus_sweep_cue (sweep);
+            if (enable_audio)
+                focus_audio_update_delta (sweep_cue);
+        }
 
-        /* Compute focus scores on raw bayer (before gamma). */
-        raw_score_left = ag_focus_score (metric, bayer_left,
-                         (int) proc_sub_w, (int) proc_h,
-                         roi_x, roi_y, roi_w, roi_h);
-        raw_score_right = ag_focus_score (metric, bayer_right,
-                          (int) proc_sub_w, (int) proc_h,
-                          roi_x, roi_y, roi_w, roi_h);
+        if (grid) {
+            gint64 t0 = g_get_monotonic_time ();
+            ag_focus_grid_score (grid, &plane_left, &plane_right, green_sites);
+            grid_ms = (g_get_monotonic_time () - t0) / 1000.0;
+            for (int e = 0; e < 2; e++) {
+                const double *tiles = ag_focus_grid_tiles (
+                    grid, (AgFocusGridEye) e, metric);
+                ag_focus_grid_summarize (tiles, grid_cols, grid_rows,
+                                         &grid_sum[e]);
+                if (grid_log)
+                    ag_focus_grid_write_csv_row (
+                        grid_log, arv_buffer_get_frame_id (buffer),
+                        (t0 - start_us) / 1e6, (AgFocusGridEye) e, metric,
+                        tiles, grid_cols, grid_rows, &grid_sum[e]);
+            }
+        }
 
         if (score_history_count < AG_FOCUS_SCORE_AVG_FRAMES) {
             score_history_count++;
@@ -315,9 +592,12 @@ focus_loop (const char *device_id, const char *iface_ip,
         score_left = score_sum_left / (double) score_history_count;
         score_right = score_sum_right / (double) score_history_count;
         normalized_delta = focus_normalized_delta (score_left, score_right);
-        if (enable_audio)
+        if (enable_audio && !sweep)
             focus_audio_update_delta (normalized_delta);
 
+        /* Sweep mode locks on the distance to the predicted peak. */
+        float lock_measure = sweep ? sweep_cue : normalized_delta;
+
         {
             gint64 now_us = g_get_monotonic_time ();
             double frame_dt = (double) (now_us - last_frame_time_us) / 1000000.0;
@@ -330,7 +610,7 @@ focus_loop (const char *device_id, const char *iface_ip,
                 /* Both scores too weak — don't treat as locked. */
                 lock_stable_seconds = 0.0;
                 focus_locked = FALSE;
-            } else if (fabsf (normalized_delta) < AG_FOCUS_LOCK_THRESHOLD) {
+            } else if (fabsf (lock_measure) < AG_FOCUS_LOCK_THRESHOLD) {
                 lock_stable_seconds += frame_dt;
                 if (lock_stable_seconds >= AG_FOCUS_LOCK_HOLD_SECONDS)
                     focus_locked = TRUE;
@@ -340,6 +620,12 @@ focus_loop (const char *device_id, const char *iface_ip,
             }
         }
 
+        if (!show) {
+            arv_stream_push_buffer (cfg.stream, buffer);
+            sleep_until_next_trigger (&next_trigger_us, trigger_interval_us);
+            continue;
+        }
+
         /* Gamma + debayer for display. */
         size_t eye_n = (size_t) proc_sub_w * (size_t) proc_h;
         apply_lut_inplace (bayer_left,  eye_n, gamma_lut);
@@ -378,6 +664,25 @@ focus_loop (const char *device_id, const char *iface_ip,
             double sx = (double) out_w / (double) display_w;
             double sy = (double) out_h / (double) display_h;
 
+            if (grid) {
+                const double *tl = ag_focus_grid_tiles (grid, AG_FOCUS_GRID_LEFT,
+                                                        metric);
+                const double *tr = ag_focus_grid_tiles (grid, AG_FOCUS_GRID_RIGHT,
+                                                        metric);
+                double max_score = 0.0;
+                for (int i = 0; i < grid_cols * grid_rows; i++)
+                    max_score = fmax (max_score, fmax (tl[i], tr[i]));
+
+                SDL_SetRenderDrawBlendMode (renderer, SDL_BLENDMODE_BLEND);
+                draw_grid_heat_map (renderer, tl, grid_cols, grid_rows,
+                                    max_score, 0, (int) proc_sub_w,
+                                    (int) proc_h, sx, sy);
+                draw_grid_heat_map (renderer, tr, grid_cols, grid_rows,
+                                    max_score, (int) proc_sub_w,
+                                    (int) proc_sub_w, (int) proc_h, sx, sy);
+                SDL_SetRenderDrawBlendMode (renderer, SDL_BLENDMODE_NONE);
+            }
+
             /* ROI rectangle — left eye. */
             SDL_SetRenderDrawColor (renderer, 0, 255, 0, 255);
             SDL_Rect roi_left = {
@@ -412,8 +717,10 @@ focus_loop (const char *device_id, const char *iface_ip,
             snprintf (buf, sizeof buf, "right: %.2f", score_right);
             ag_font_render (renderer, buf, 8, 8 + line_h * 2, font_scale, 0, 255, 0);
 
-            double delta_pct = fabs ((double) normalized_delta) * 100.0;
-            snprintf (buf, sizeof buf, "delta: %.1f%%", delta_pct);
+            double delta_pct = fabs ((double) lock_measure) * 100.0;
+            snprintf (buf, sizeof buf, "%s: %.1f%%%s",
+                      sweep ? "to peak" : "delta", delta_pct,
+                      sweep && sweep_cue < 0.0f ? " (past)" : "");
             ag_font_render (renderer, buf, 8, 8 + line_h * 3, font_scale,
                             delta_pct > (AG_FOCUS_LOCK_THRESHOLD * 100.0) ? 255 : 0,
                             delta_pct > (AG_FOCUS_LOCK_THRESHOLD * 100.0) ? 100 : 255,
@@ -427,6 +734,47 @@ focus_loop (const char *device_id, const char *iface_ip,
                             low_detail  ? 255 : focus_locked ? 0 : 255,
                             low_detail  ? 100 : focus_locked ? 255 : 200,
                             0);
+
+            /* Every metric for this frame, unsmoothed; the selected one
+             * is bright. */
+            for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++) {
+                guint8 level = m == (int) metric ? 255 : 140;
+                snprintf (buf, sizeof buf, "%s: %.1f  %.1f",
+                          ag_focus_metric_name ((AgFocusMetric) m),
+                          all_left[m], all_right[m]);
+                ag_font_render (renderer, buf, 8, 8 + line_h * (6 + m),
+                                font_scale, level, level, level);
+            }
+
+            /* Corner / centre ratios and tilt per eye. */
+            for (int e = 0; grid && e < 2; e++) {
+                const AgFocusGridSummary *gs = &grid_sum[e];
+                snprintf (buf, sizeof buf,
+                          "%s corners %.2f %.2f %.2f %.2f  tilt x %.2f y %.2f",
+                          e ? "right" : "left",
+                          gs->ratio[AG_FOCUS_GRID_TL], gs->ratio[AG_FOCUS_GRID_TR],
+                          gs->ratio[AG_FOCUS_GRID_BL], gs->ratio[AG_FOCUS_GRID_BR],
+                          gs->tilt_x, gs->tilt_y);
+                ag_font_render (renderer, buf, 8,
+                                8 + line_h * (7 + AG_FOCUS_METRIC_COUNT + e),
+                                font_scale, 255, 255, 0);
+            }
+
+            /* Predicted peak per eye and the recorded curve. */
+            for (int e = 0; sweep && e < 2; e++) {
+                AgFocusPeak pk;
+                if (ag_focus_sweep_peak (sweep, (AgFocusSweepEye) e, &pk))
+                    snprintf (buf, sizeof buf, "%s peak %.1f at %.2f s",
+                              e ? "right" : "left", pk.score, pk.t);
+                else
+                    snprintf (buf, sizeof buf, "%s peak: not passed yet",
+                              e ? "right" : "left");
+                ag_font_render (renderer, buf, 8,
+                                8 + line_h * (10 + AG_FOCUS_METRIC_COUNT + e),
+                                font_scale, 0, 255, e ? 255 : 0);
+            }
+            if (sweep)
+                draw_sweep_curve (renderer, sweep, out_w, out_h);
         }
 
         SDL_RenderPresent (renderer);
@@ -437,7 +785,9 @@ focus_loop (const char *device_id, const char *iface_ip,
         double elapsed = g_timer_elapsed (stats_timer, NULL);
         if (elapsed >= 5.0) {
             current_fps = frames_displayed / elapsed;
+            scored_fps  = frames_scored / elapsed;
             frames_displayed = 0;
+            frames_scored = 0;
             frames_dropped = 0;
             g_timer_start (stats_timer);
         }
@@ -453,11 +803,21 @@ focus_loop (const char *device_id, const char *iface_ip,
                     ag_focus_metric_name (metric),
                     score_left, score_right, delta, state,
                     current_fps);
+            if (grid)
+                printf ("  grid %.1f ms  tilt L %+.2f/%+.2f R %+.2f/%+.2f",
+                        grid_ms, grid_sum[0].tilt_x, grid_sum[0].tilt_y,
+                        grid_sum[1].tilt_x, grid_sum[1].tilt_y);
+            if (sweep)
+                printf ("  sweep %.0f Hz score %.2f ms to peak %+.1f%%",
+                        scored_fps, score_ms, sweep_cue * 100.0);
             fflush (stdout);
             g_timer_start (stdout_timer);
         }
 
-        g_usleep ((gulong) trigger_interval_us);
+        if (sweep)
+            sleep_until_next_trigger (&next_trigger_us, trigger_interval_us);
+        else
+            g_usleep ((gulong) trigger_interval_us);
     }
 
     g_timer_destroy (stats_timer);
@@ -466,17 +826,20 @@ focus_loop (const char *device_id, const char *iface_ip,
     arv_camera_stop_acquisition (camera, NULL);
 
 cleanup:
-    g_free (bayer_left);
-    g_free (bayer_right);
-    g_free (rgb_left);
-    g_free (rgb_right);
+    ag_focus_sweep_free (sweep);
+    if (sweep_log)
+        fclose (sweep_log);
+    ag_focus_grid_free (grid);
+    if (grid_log)
+        fclose (grid_log);
+    ag_frame_arena_free (scratch);
     if (enable_audio)
         focus_audio_shutdown ();
     SDL_DestroyTexture (texture);
     SDL_DestroyRenderer (renderer);
     SDL_DestroyWindow (window);
     SDL_Quit ();
-    g_object_unref (cfg.stream);
+    camera_config_cleanup (&cfg);
     g_object_unref (camera);
     arv_shutdown ();
     return EXIT_SUCCESS;
@@ -502,6 +865,8 @@ cmd_focus (int argc, char *argv[], arg_dstr_t res, void *ctx)
                                           "sensor gain in dB (0-48)");
     struct arg_lit *auto_exp  = arg_lit0 ("A", "auto-expose",
                                           "auto-expose then lock");
+    struct arg_str *ae_mode_a = arg_str0 (NULL, "ae-mode", "<host|camera>",
+                                          "-A metering: host histogram (default) or camera AE");
     struct arg_int *binning_a = arg_int0 ("b", "binning",   "<1|2>",
                                           "sensor binning factor (default: 1)");
     struct arg_int *pkt_size  = arg_int0 ("p", "packet-size", "<bytes>",
@@ -511,14 +876,33 @@ cmd_focus (int argc, char *argv[], arg_dstr_t res, void *ctx)
     struct arg_str *metric_a  = arg_str0 ("m", "metric",
                                           "<laplacian|tenengrad|brenner>",
                                           "focus metric (default: laplacian)");
+    struct arg_str *sites_a   = arg_str0 (NULL, "sites", "<green|all>",
+                                          "pixels scored (default: green on Bayer sensors)");
     struct arg_int *roi_a     = arg_intn (NULL, "roi", "<x y w h>", 0, 4,
                                           "region of interest (default: center 50%%)");
+    struct arg_lit *grid_a    = arg_lit0 (NULL, "grid",
+                                          "per-tile sharpness heat map");
+    struct arg_str *grid_size = arg_str0 (NULL, "grid-size", "<cols>x<rows>",
+                                          "--grid tiles per eye (default: 8x6)");
+    struct arg_file *grid_log = arg_file0 (NULL, "grid-log", "<file.csv>",
+                                           "write per-tile scores and corner ratios");
+    struct arg_lit *sweep_a   = arg_lit0 (NULL, "sweep",
+                                          "record the focus curve and predict its peak");
+    struct arg_str *sweep_fit = arg_str0 (NULL, "sweep-fit", "<gaussian|parabola>",
+                                          "--sweep peak model (default: gaussian)");
+    struct arg_int *sweep_dec = arg_int0 (NULL, "sweep-decimate", "<1-4>",
+                                          "score every n-th sample (default: 1)");
+    struct arg_file *sweep_log = arg_file0 (NULL, "sweep-log", "<file.csv>",
+                                            "write every frame's scores and peak fit");
     struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
     struct arg_end *end       = arg_end (10);
 
     void *argtable[] = { cmd, serial, address, interface, fps_a, exposure,
-                         gain, auto_exp, binning_a, pkt_size, quiet_audio,
-                         metric_a, roi_a, help, end };
+                         gain, auto_exp, ae_mode_a,
+                         binning_a, pkt_size, quiet_audio,
+                         metric_a, sites_a, roi_a, grid_a, grid_size, grid_log,
+                         sweep_a, sweep_fit, sweep_dec, sweep_log,
+                         help, end };
 
     int exitcode = EXIT_SUCCESS;
     if (arg_nullcheck (argtable) != 0) {
@@ -569,8 +953,20 @@ cmd_focus (int argc, char *argv[], arg_dstr_t res, void *ctx)
         }
     }
 
-    gboolean do_auto_expose = auto_exp->count > 0;
-    if (do_auto_expose && (exposure->count || gain->count)) {
+    AgAeMode ae_mode = auto_exp->count ? AG_AE_HOST : AG_AE_OFF;
+    if (ae_mode_a->count) {
+        if (!auto_exp->count) {
+            arg_dstr_catf (res, "error: --ae-mode requires --auto-expose\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ag_parse_ae_mode (ae_mode_a->sval[0], &ae_mode) != 0) {
+            arg_dstr_catf (res, "error: --ae-mode must be host or camera\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (ae_mode != AG_AE_OFF && (exposure->count || gain->count)) {
         arg_dstr_catf (res, "error: --auto-expose and --exposure/--gain are mutually exclusive\n");
         exitcode = EXIT_FAILURE;
         goto done;
@@ -596,6 +992,19 @@ cmd_focus (int argc, char *argv[], arg_dstr_t res, void *ctx)
         metric = (AgFocusMetric) m;
     }
 
+    FocusSites sites = FOCUS_SITES_AUTO;
+    if (sites_a->count) {
+        if (strcmp (sites_a->sval[0], "green") == 0) {
+            sites = FOCUS_SITES_GREEN;
+        } else if (strcmp (sites_a->sval[0], "all") == 0) {
+            sites = FOCUS_SITES_ALL;
+        } else {
+            arg_dstr_catf (res, "error: --sites must be green or all\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
     int roi_specified = 0;
     int uroi_x = 0, uroi_y = 0, uroi_w = 0, uroi_h = 0;
     if (roi_a->count == 4) {
@@ -615,6 +1024,50 @@ cmd_focus (int argc, char *argv[], arg_dstr_t res, void *ctx)
         goto done;
     }
 
+    int grid_cols = 0, grid_rows = 0;
+    if ((grid_size->count || grid_log->count) && !grid_a->count) {
+        arg_dstr_catf (res, "error: --grid-size and --grid-log require --grid\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    if (grid_a->count) {
+        grid_cols = AG_FOCUS_GRID_COLS_DEFAULT;
+        grid_rows = AG_FOCUS_GRID_ROWS_DEFAULT;
+        if (grid_size->count &&
+            ag_focus_grid_parse_size (grid_size->sval[0],
+                                      &grid_cols, &grid_rows) != 0) {
+            arg_dstr_catf (res, "error: --grid-size must be <cols>x<rows>, "
+                           "each 1-%d\n", AG_FOCUS_GRID_MAX);
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
+    if ((sweep_fit->count || sweep_dec->count || sweep_log->count) &&
+        !sweep_a->count) {
+        arg_dstr_catf (res, "error: --sweep-fit, --sweep-decimate and "
+                       "--sweep-log require --sweep\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    AgFocusFit fit = AG_FOCUS_FIT_GAUSSIAN;
+    if (sweep_fit->count) {
+        int f = ag_focus_fit_from_string (sweep_fit->sval[0]);
+        if (f < 0) {
+            arg_dstr_catf (res, "error: --sweep-fit must be gaussian or parabola\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        fit = (AgFocusFit) f;
+    }
+    int decimate = sweep_dec->count ? sweep_dec->ival[0] : 1;
+    if (decimate < 1 || decimate > AG_FOCUS_SWEEP_DECIMATE_MAX) {
+        arg_dstr_catf (res, "error: --sweep-decimate must be between 1 and %d\n",
+                       AG_FOCUS_SWEEP_DECIMATE_MAX);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
     const char *opt_serial    = serial->count    ? serial->sval[0]    : NULL;
     const char *opt_address   = address->count   ? address->sval[0]   : NULL;
     const char *opt_interface = interface->count  ? interface->sval[0] : NULL;
@@ -632,9 +1085,13 @@ cmd_focus (int argc, char *argv[], arg_dstr_t res, void *ctx)
     int pkt_sz = pkt_size->count ? pkt_size->ival[0] : 0;
 
     exitcode = focus_loop (device_id, iface_ip, fps, exposure_us, gain_db,
-                           do_auto_expose, pkt_sz, binning,
+                           ae_mode, pkt_sz, binning,
                            uroi_x, uroi_y, uroi_w, uroi_h, roi_specified,
-                           quiet_audio->count == 0, metric);
+                           quiet_audio->count == 0, metric, sites,
+                           grid_cols, grid_rows,
+                           grid_log->count ? grid_log->filename[0] : NULL,
+                           sweep_a->count > 0, fit, decimate,
+                           sweep_log->count ? sweep_log->filename[0] : NULL);
     g_free (device_id);
 
 done:
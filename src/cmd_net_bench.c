@@ -0,0 +1,438 @@
+/*
+ * cmd_net_bench.c — "ag-cam-tools net-bench" subcommand
+ *
+ * Streams for a fixed time under each combination of receive-path
+ * settings (packet socket on/off x socket buffer sizes) and reports
+ * sustained throughput and GVSP packet loss, so the fastest setting can
+ * be picked per host.  Frames are only counted, never processed, so the
+ * numbers reflect the network path alone.
+ */
+
+#include "common.h"
+#include "../vendor/argtable3.h"
+#include "../vendor/cJSON.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NET_BENCH_MAX_VALUES  8
+
+/* IPv4 (20) + UDP (8) + GVSP (8) header bytes per packet. */
+#define GVSP_PACKET_OVERHEAD  36
+
+static volatile sig_atomic_t g_quit = 0;
+
+static void
+sigint_handler (int sig)
+{
+    (void) sig;
+    g_quit = 1;
+}
+
+typedef struct {
+    AgPacketSocket packet_socket;   /* as requested */
+    gboolean       packet_socket_used;
+    guint          socket_buffer;
+    guint          packet_size;
+    size_t         payload;
+    guint64        triggered;
+    guint64        completed;
+    guint64        failed;
+    guint64        resent;
+    guint64        missing;
+    double         elapsed_s;
+} NetBenchResult;
+
+static double
+result_mb_per_s (const NetBenchResult *r)
+{
+    return r->elapsed_s > 0.0
+           ? (double) r->completed * (double) r->payload / r->elapsed_s / 1e6
+           : 0.0;
+}
+
+/* Missing packets as a percentage of the packets the camera was asked
+ * to send (payload split over packets of packet_size). */
+static double
+result_loss_pct (const NetBenchResult *r)
+{
+    if (r->packet_size <= GVSP_PACKET_OVERHEAD || r->triggered == 0)
+        return 0.0;
+    guint per_packet = r->packet_size - GVSP_PACKET_OVERHEAD;
+    double per_frame = (double) ((r->payload + per_packet - 1) / per_packet);
+    return 100.0 * (double) r->missing / (per_frame * (double) r->triggered);
+}
+
+static int
+bench_one (ArvCamera *camera, const char *iface_ip, int binning,
+           int packet_size, double fps, double duration_s,
+           const AgTransportOptions *transport, const AgRoi *roi,
+           NetBenchResult *r)
+{
+    AgCameraConfig cfg;
+    if (camera_configure (camera, AG_MODE_CONTINUOUS, binning, 0.0, -1.0,
+                          FALSE, packet_size, transport, roi, iface_ip,
+                          FALSE, &cfg) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    r->payload     = cfg.payload;
+    r->packet_size = arv_camera_gv_get_packet_size (camera, NULL);
+    r->packet_socket_used = ag_packet_socket_resolve (transport->packet_socket,
+                                                      NULL);
+
+    AgBurstStats st;
+    int rc = ag_trigger_burst (camera, &cfg, fps, duration_s,
+                               transport->frame_retention_us, &g_quit, &st);
+    camera_config_cleanup (&cfg);
+    if (rc != EXIT_SUCCESS)
+        return rc;
+
+    r->triggered = st.triggered;
+    r->completed = st.completed;
+    r->failed    = st.failed;
+    r->resent    = st.resent;
+    r->missing   = st.missing;
+    r->elapsed_s = st.elapsed_s;
+    return EXIT_SUCCESS;
+}
+
+static void
+print_results (const NetBenchResult *results, int n)
+{
+    printf ("\n%-14s %-8s %8s %9s %8s %8s %8s %8s %8s\n",
+            "packet-socket", "sockbuf", "frames", "MB/s", "fps",
+            "failed", "resent", "missing", "loss%");
+
+    int best = -1;
+    for (int i = 0; i < n; i++) {
+        const NetBenchResult *r = &results[i];
+        char psock[16], sockbuf[16];
+        snprintf (psock, sizeof psock, "%s%s",
+                  ag_packet_socket_name (r->packet_socket),
+                  (r->packet_socket == AG_PACKET_SOCKET_AUTO)
+                  ? (r->packet_socket_used ? "(on)" : "(off)") : "");
+        ag_format_socket_buffer (r->socket_buffer, sockbuf, sizeof sockbuf);
+
+        printf ("%-14s %-8s %8" G_GUINT64_FORMAT " %9.1f %8.2f %8"
+                G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %8"
+                G_GUINT64_FORMAT " %8.4f\n",
+                psock, sockbuf, r->completed, result_mb_per_s (r),
+                r->elapsed_s > 0.0 ? (double) r->completed / r->elapsed_s : 0.0,
+                r->failed, r->resent, r->missing, result_loss_pct (r));
+
+        /* Fastest lossless run wins; ties go to the earlier (simpler) row. */
+        if (r->failed == 0 && r->missing == 0 &&
+            (best < 0 || result_mb_per_s (r) > result_mb_per_s (&results[best])))
+            best = i;
+    }
+
+    if (best >= 0) {
+        char sockbuf[16];
+        ag_format_socket_buffer (results[best].socket_buffer, sockbuf,
+                                 sizeof sockbuf);
+        printf ("\nBest: --packet-socket %s --socket-buffer %s (%.1f MB/s)\n",
+                ag_packet_socket_name (results[best].packet_socket), sockbuf,
+                result_mb_per_s (&results[best]));
+    } else if (n > 0) {
+        printf ("\nNo setting ran without loss.\n");
+    }
+}
+
+static int
+write_results_json (const char *path, const NetBenchResult *results, int n,
+                    double fps, double duration_s)
+{
+    cJSON *root = cJSON_CreateObject ();
+    cJSON_AddNumberToObject (root, "fps", fps);
+    cJSON_AddNumberToObject (root, "duration_s", duration_s);
+    cJSON *arr = cJSON_AddArrayToObject (root, "results");
+
+    for (int i = 0; i < n; i++) {
+        const NetBenchResult *r = &results[i];
+        cJSON *o = cJSON_CreateObject ();
+        char sockbuf[16];
+        ag_format_socket_buffer (r->socket_buffer, sockbuf, sizeof sockbuf);
+        cJSON_AddStringToObject (o, "packet_socket",
+                                 ag_packet_socket_name (r->packet_socket));
+        cJSON_AddBoolToObject   (o, "packet_socket_used", r->packet_socket_used);
+        cJSON_AddStringToObject (o, "socket_buffer", sockbuf);
+        cJSON_AddNumberToObject (o, "packet_size", r->packet_size);
+        cJSON_AddNumberToObject (o, "payload", (double) r->payload);
+        cJSON_AddNumberToObject (o, "triggered", (double) r->triggered);
+        cJSON_AddNumberToObject (o, "completed", (double) r->completed);
+        cJSON_AddNumberToObject (o, "failed", (double) r->failed);
+        cJSON_AddNumberToObject (o, "resent", (double) r->resent);
+        cJSON_AddNumberToObject (o, "missing", (double) r->missing);
+        cJSON_AddNumberToObject (o, "elapsed_s", r->elapsed_s);
+        cJSON_AddNumberToObject (o, "mb_per_s", result_mb_per_s (r));
+        cJSON_AddNumberToObject (o, "loss_pct", result_loss_pct (r));
+        cJSON_AddItemToArray (arr, o);
+    }
+
+    char *text = cJSON_Print (root);
+    cJSON_Delete (root);
+
+    GError *error = NULL;
+    int rc = EXIT_SUCCESS;
+    if (!g_file_set_contents (path, text, -1, &error)) {
+        fprintf (stderr, "error: cannot write '%s': %s\n", path, error->message);
+        g_clear_error (&error);
+        rc = EXIT_FAILURE;
+    } else {
+        printf ("Results: %s\n", path);
+    }
+    cJSON_free (text);
+    return rc;
+}
+
+int
+cmd_net_bench (int argc, char *argv[], arg_dstr_t res, void *ctx)
+{
+    (void) ctx;
+
+    struct arg_str *cmd       = arg_str1 (NULL, NULL, "net-bench", NULL);
+    struct arg_str *serial    = arg_str0 ("s", "serial",    "<serial>",
+                                          "match by serial number");
+    struct arg_str *address   = arg_str0 ("a", "address",   "<address>",
+                                          "connect by camera IP");
+    struct arg_str *interface = arg_str0 ("i", "interface",  "<iface>",
+                                          "force NIC selection");
+    struct arg_dbl *fps_a     = arg_dbl0 ("f", "fps",       "<rate>",
+                                          "trigger rate in Hz, 0 = as fast as the camera re-arms (default: 30)");
+    struct arg_dbl *duration_a = arg_dbl0 ("d", "duration", "<seconds>",
+                                           "run time per setting (default: 5)");
+    struct arg_int *binning_a = arg_int0 ("b", "binning",   "<1|2>",
+                                          "sensor binning factor (default: 1)");
+    struct arg_int *pkt_size  = arg_int0 ("p", "packet-size", "<bytes>",
+                                          "GigE packet size (default: auto-negotiate)");
+    struct arg_str *roi_a     = arg_str0 (NULL, "roi", "<y0:h[:x0:w]>",
+                                          "acquire only this per-eye window (default: full frame)");
+    struct arg_str *psock_a   = arg_str0 (NULL, "packet-socket", "<list>",
+                                          "packet socket modes to try (default: off,on)");
+    struct arg_str *sockbuf_a = arg_str0 (NULL, "socket-buffer", "<list>",
+                                          "socket buffer sizes to try (default: auto,1M,8M,32M)");
+    struct arg_int *buffers_a = arg_int0 (NULL, "stream-buffers", "<n>",
+                                          "Aravis stream buffers (default: 16)");
+    struct arg_int *ptimeout_a = arg_int0 (NULL, "packet-timeout", "<us>",
+                                           "wait before requesting a resend (default: 20000)");
+    struct arg_int *fretain_a = arg_int0 (NULL, "frame-retention", "<us>",
+                                          "give up on an incomplete frame after (default: 200000)");
+    struct arg_str *resend_a  = arg_str0 (NULL, "packet-resend", "<always|never>",
+                                          "GVSP packet resend policy (default: always)");
+    struct arg_str *json_a    = arg_str0 (NULL, "json", "<out.json>",
+                                          "also write the results as JSON");
+    struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
+    struct arg_end *end       = arg_end (10);
+
+    void *argtable[] = { cmd, serial, address, interface, fps_a, duration_a,
+                         binning_a, pkt_size, roi_a, psock_a, sockbuf_a, buffers_a,
+                         ptimeout_a, fretain_a, resend_a, json_a,
+                         help, end };
+
+    int exitcode = EXIT_SUCCESS;
+    gchar **psock_list = NULL;
+    gchar **sockbuf_list = NULL;
+    NetBenchResult *results = NULL;
+
+    if (arg_nullcheck (argtable) != 0) {
+        arg_dstr_catf (res, "error: insufficient memory\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    /* Defaults. */
+    fps_a->dval[0]      = 30.0;
+    duration_a->dval[0] = 5.0;
+    binning_a->ival[0]  = 1;
+
+    int nerrors = arg_parse (argc, argv, argtable);
+    if (arg_make_syntax_err_help_msg (res, "net-bench", help->count, nerrors,
+                                       argtable, end, &exitcode))
+        goto done;
+
+    if (serial->count && address->count) {
+        arg_dstr_catf (res, "error: --serial and --address are mutually exclusive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    double fps = fps_a->dval[0];
+    if (fps < 0.0 || fps > 120.0) {
+        arg_dstr_catf (res, "error: --fps must be between 0 and 120\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    double duration_s = duration_a->dval[0];
+    if (duration_s <= 0.0) {
+        arg_dstr_catf (res, "error: --duration must be positive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    int binning = binning_a->ival[0];
+    if (binning != 1 && binning != 2) {
+        arg_dstr_catf (res, "error: --binning must be 1 or 2\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    AgRoi roi = { 0 };
+    if (roi_a->count) {
+        const char *rerr = "--roi must be y0:height or y0:height:x0:width";
+        if (ag_parse_roi (roi_a->sval[0], &roi) == 0)
+            rerr = ag_roi_resolve (&roi, AG_SENSOR_WIDTH / 2 / (guint) binning,
+                                   AG_SENSOR_HEIGHT / (guint) binning);
+        if (rerr) {
+            arg_dstr_catf (res, "error: %s\n", rerr);
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
+    if (buffers_a->count &&
+        (buffers_a->ival[0] < AG_STREAM_BUFFERS_MIN ||
+         buffers_a->ival[0] > AG_STREAM_BUFFERS_MAX)) {
+        arg_dstr_catf (res, "error: --stream-buffers must be between %d and %d\n",
+                       AG_STREAM_BUFFERS_MIN, AG_STREAM_BUFFERS_MAX);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    /* Settings held fixed across the sweep. */
+    AgTransportOptions base = {
+        .stream_buffers = buffers_a->count ? (guint) buffers_a->ival[0] : 0,
+    };
+    const char *terr = ag_transport_options_set (
+        &base, NULL, NULL,
+        ptimeout_a->count ? ptimeout_a->ival[0] : -1,
+        fretain_a->count  ? fretain_a->ival[0]  : -1,
+        resend_a->count   ? resend_a->sval[0]   : NULL);
+    if (terr) {
+        arg_dstr_catf (res, "error: %s\n", terr);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    /* Swept settings. */
+    const char *psock_default = ag_packet_socket_supported () ? "off,on" : "off";
+    psock_list   = g_strsplit (psock_a->count ? psock_a->sval[0] : psock_default,
+                               ",", -1);
+    sockbuf_list = g_strsplit (sockbuf_a->count ? sockbuf_a->sval[0]
+                                                : "auto,1M,8M,32M", ",", -1);
+
+    guint n_psock = g_strv_length (psock_list);
+    guint n_sockbuf = g_strv_length (sockbuf_list);
+    if (n_psock == 0 || n_psock > NET_BENCH_MAX_VALUES ||
+        n_sockbuf == 0 || n_sockbuf > NET_BENCH_MAX_VALUES) {
+        arg_dstr_catf (res, "error: --packet-socket and --socket-buffer take "
+                       "1 to %d comma-separated values\n", NET_BENCH_MAX_VALUES);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    AgPacketSocket psock_vals[NET_BENCH_MAX_VALUES];
+    guint sockbuf_vals[NET_BENCH_MAX_VALUES];
+    for (guint i = 0; i < n_psock; i++) {
+        AgTransportOptions probe = { 0 };
+        terr = ag_transport_options_set (&probe, psock_list[i], NULL, -1, -1, NULL);
+        if (terr) {
+            arg_dstr_catf (res, "error: %s (got '%s')\n", terr, psock_list[i]);
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        psock_vals[i] = probe.packet_socket;
+    }
+    for (guint i = 0; i < n_sockbuf; i++) {
+        if (ag_parse_socket_buffer (sockbuf_list[i], &sockbuf_vals[i]) != 0) {
+            arg_dstr_catf (res, "error: --socket-buffer must be auto or "
+                           "64K..256M bytes (got '%s')\n", sockbuf_list[i]);
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
+    const char *opt_serial    = serial->count    ? serial->sval[0]    : NULL;
+    const char *opt_address   = address->count   ? address->sval[0]   : NULL;
+    const char *opt_interface = interface->count  ? interface->sval[0] : NULL;
+
+    const char *iface_ip = NULL;
+    if (opt_interface) {
+        iface_ip = setup_interface (opt_interface);
+        if (!iface_ip) { exitcode = EXIT_FAILURE; goto done; }
+    }
+
+    char *device_id = resolve_device (opt_serial, opt_address,
+                                      opt_interface, TRUE);
+    if (!device_id) { exitcode = EXIT_FAILURE; goto done; }
+
+    GError *error = NULL;
+    ArvCamera *camera = arv_camera_new (device_id, &error);
+    g_free (device_id);
+    if (!camera) {
+        fprintf (stderr, "error: %s\n",
+                 error ? error->message : "failed to open device");
+        g_clear_error (&error);
+        arv_shutdown ();
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (ag_packet_socket_supported () && !ag_packet_socket_permitted ())
+        fprintf (stderr, "warn: no CAP_NET_RAW: 'on' rows measure Aravis's UDP "
+                 "fallback (sudo setcap cap_net_raw+ep $(which ag-cam-tools))\n");
+
+    int n_runs = (int) (n_psock * n_sockbuf);
+    results = g_new0 (NetBenchResult, n_runs);
+    int done_runs = 0;
+
+    signal (SIGINT, sigint_handler);
+
+    for (guint p = 0; p < n_psock && !g_quit; p++) {
+        for (guint b = 0; b < n_sockbuf && !g_quit; b++) {
+            AgTransportOptions transport = base;
+            transport.packet_socket = psock_vals[p];
+            transport.socket_buffer = sockbuf_vals[b];
+
+            NetBenchResult *r = &results[done_runs];
+            r->packet_socket = psock_vals[p];
+            r->socket_buffer = sockbuf_vals[b];
+
+            char rate[32];
+            if (fps > 0.0)
+                snprintf (rate, sizeof rate, "%.1f Hz", fps);
+            else
+                g_strlcpy (rate, "max rate", sizeof rate);
+            printf ("\n=== Run %d/%d: --packet-socket %s --socket-buffer %s "
+                    "(%.0f s at %s) ===\n", done_runs + 1, n_runs,
+                    psock_list[p], sockbuf_list[b], duration_s, rate);
+            if (bench_one (camera, iface_ip, binning,
+                           pkt_size->count ? pkt_size->ival[0] : 0,
+                           fps, duration_s, &transport, &roi, r) != EXIT_SUCCESS) {
+                exitcode = EXIT_FAILURE;
+                break;
+            }
+            done_runs++;
+        }
+        if (exitcode != EXIT_SUCCESS)
+            break;
+    }
+
+    print_results (results, done_runs);
+    if (json_a->count && done_runs > 0 &&
+        write_results_json (json_a->sval[0], results, done_runs,
+                            fps, duration_s) != EXIT_SUCCESS)
+        exitcode = EXIT_FAILURE;
+
+    g_object_unref (camera);
+    arv_shutdown ();
+
+done:
+    g_free (results);
+    g_strfreev (psock_list);
+    g_strfreev (sockbuf_list);
+    arg_freetable (argtable, sizeof argtable / sizeof argtable[0]);
+    return exitcode;
+}
@@ -3,14 +3,24 @@
  *
  * Continuously captures DualBayerRG8 frames, debayers each eye,
  * and displays them side-by-side in an SDL2 window.
- * Optionally detects AprilTags and estimates their pose.
+ * Optionally detects AprilTags and estimates their pose, and streams the
+ * displayed frames as Y4M or MJPEG to a file or stdout (--video-out).
  */
 
 #include "common.h"
+#include "arena.h"
 #include "calib_load.h"
+#include "detector_stage.h"
+#include "font.h"
 #include "remap.h"
+#include "tag_detect.h"
+#include "tag_stereo.h"
+#include "tag_track.h"
+#include "trace.h"
+#include "video_out.h"
 #include "../vendor/argtable3.h"
 
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,13 +28,6 @@
 
 #include <SDL2/SDL.h>
 
-#ifdef HAVE_APRILTAG
-#include <apriltag.h>
-#include <apriltag_pose.h>
-#include <tagStandard52h13.h>
-#include <common/image_u8.h>
-#endif
-
 static volatile sig_atomic_t g_quit = 0;
 
 static void
@@ -39,46 +42,12 @@ sigint_handler (int sig)
 #define AG_PIXEL_PITCH_UM  3.45
 #define AG_LENS_FL_UM      3000.0  /* 3 mm */
 
-/* Corners of one detected tag (pixel coords within a single eye). */
-typedef struct {
-    double p[4][2];   /* corner points, counter-clockwise */
-} TagOverlay;
-
-#define MAX_TAG_OVERLAYS  32
-
-static int
-detect_tags_and_pose (apriltag_detector_t *detector, const guint8 *gray,
-                      guint width, guint height, double tag_size_m,
-                      double fx, double fy, double cx, double cy,
-                      guint64 frame_num, const char *eye_label,
-                      TagOverlay *overlays, int max_overlays)
+static void
+print_tag_results (const AgTagResult *tags, guint n,
+                   guint64 frame_num, const char *eye_label)
 {
-    image_u8_t im = {
-        .width  = (int32_t) width,
-        .height = (int32_t) height,
-        .stride = (int32_t) width,
-        .buf    = (uint8_t *) gray
-    };
-
-    zarray_t *detections = apriltag_detector_detect (detector, &im);
-    int n_overlays = 0;
-
-    for (int i = 0; i < zarray_size (detections); i++) {
-        apriltag_detection_t *det;
-        zarray_get (detections, i, &det);
-
-        apriltag_detection_info_t info = {
-            .det     = det,
-            .tagsize = tag_size_m,
-            .fx      = fx,
-            .fy      = fy,
-            .cx      = cx,
-            .cy      = cy
-        };
-
-        apriltag_pose_t pose;
-        double pose_err = estimate_tag_pose (&info, &pose);
-
+    for (guint i = 0; i < n; i++) {
+        const AgTagResult *r = &tags[i];
         printf ("apriltag frame=%" G_GUINT64_FORMAT
                 " eye=%s id=%d hamming=%d margin=%.1f"
                 " center=(%.1f,%.1f)"
@@ -86,41 +55,159 @@ detect_tags_and_pose (apriltag_detector_t *detector, const guint8 *gray,
                 " R=[%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f]"
                 " t=[%.4f,%.4f,%.4f]\n",
                 frame_num, eye_label,
-                det->id, det->hamming, det->decision_margin,
-                det->c[0], det->c[1],
-                pose_err,
-                matd_get (pose.R, 0, 0), matd_get (pose.R, 0, 1),
-                matd_get (pose.R, 0, 2), matd_get (pose.R, 1, 0),
-                matd_get (pose.R, 1, 1), matd_get (pose.R, 1, 2),
-                matd_get (pose.R, 2, 0), matd_get (pose.R, 2, 1),
-                matd_get (pose.R, 2, 2),
-                matd_get (pose.t, 0, 0), matd_get (pose.t, 1, 0),
-                matd_get (pose.t, 2, 0));
-
-        /* Store corner points for overlay rendering. */
-        if (n_overlays < max_overlays) {
-            for (int c = 0; c < 4; c++) {
-                overlays[n_overlays].p[c][0] = det->p[c][0];
-                overlays[n_overlays].p[c][1] = det->p[c][1];
-            }
-            n_overlays++;
+                r->id, r->hamming, r->margin,
+                r->c[0], r->c[1],
+                r->pose_err,
+                r->R[0], r->R[1], r->R[2],
+                r->R[3], r->R[4], r->R[5],
+                r->R[6], r->R[7], r->R[8],
+                r->t[0], r->t[1], r->t[2]);
+    }
+}
+
+/* Pair the eyes' detections by id, triangulate, and write one record
+ * per fused tag.  Returns the number written; *rejected counts pairs
+ * that failed the epipolar/disparity check. */
+static guint
+write_stereo_tags (FILE *out, const AgStereoRig *rig, double tag_size_m,
+                   const AgTagResult *left, guint n_left,
+                   const AgTagResult *right, guint n_right,
+                   guint64 frame_id, gint64 time_us, guint *rejected)
+{
+    int ids_left[AG_TAG_MAX_RESULTS], ids_right[AG_TAG_MAX_RESULTS];
+    guint pairs[AG_TAG_MAX_RESULTS][2];
+    for (guint i = 0; i < n_left; i++)
+        ids_left[i] = left[i].id;
+    for (guint i = 0; i < n_right; i++)
+        ids_right[i] = right[i].id;
+
+    guint n = ag_tag_stereo_match (ids_left, n_left, ids_right, n_right,
+                                   pairs, AG_TAG_MAX_RESULTS);
+    guint written = 0;
+    for (guint k = 0; k < n; k++) {
+        const AgTagResult *l = &left[pairs[k][0]];
+        const AgTagResult *r = &right[pairs[k][1]];
+        AgTagStereoPose pose;
+        if (ag_tag_triangulate (rig, l->p, r->p, tag_size_m,
+                                AG_TAG_STEREO_MAX_EPIPOLAR_PX, &pose) != 0) {
+            (*rejected)++;
+            continue;
         }
+        ag_tag_stereo_write_ndjson (out, frame_id, time_us, l->id, &pose);
+        written++;
+    }
+    return written;
+}
 
-        matd_destroy (pose.R);
-        matd_destroy (pose.t);
+/* AprilTag detector stage: everything its thread touches. */
+typedef struct {
+    AgStereoTags       *tags;
+    gboolean            stereo;
+    const AgRemapTable *remap_left;    /* stereo: rectify before detection */
+    const AgRemapTable *remap_right;
+    gboolean            bayer;         /* stereo: eyes are CFA mosaics */
+    guint8             *gray_left;
+    guint8             *gray_right;
+    guint8             *rect_left;
+    guint8             *rect_right;
+    AgStereoRig         rig;
+    double              tag_size_m;
+    FILE               *log;           /* stereo records */
+} TagStage;
+
+/* One frame's detections, as handed back to the render loop. */
+typedef struct {
+    AgTagResult left[AG_TAG_MAX_RESULTS];
+    AgTagResult right[AG_TAG_MAX_RESULTS];
+    guint       n_left;
+    guint       n_right;
+    double      ms[2];
+    gboolean    tracked[2];
+    guint       fused;
+    guint       rejected;
+} TagFrame;
+
+/* Stage thread: detect, then print or write the records for the frame
+ * the detections belong to. */
+static gpointer
+tag_stage_process (gpointer user, const AgDetectorFrame *frame)
+{
+    TagStage *ts = user;
+    const guint8 *left  = frame->left;
+    const guint8 *right = frame->right;
+    if (ts->stereo) {
+        /* Interpolating between raw CFA sites would blend colours, so
+         * demosaic to luma first and rectify that. */
+        if (ts->bayer) {
+            debayer_rg8_to_gray (left,  ts->gray_left,  frame->width,
+                                 frame->height);
+            debayer_rg8_to_gray (right, ts->gray_right, frame->width,
+                                 frame->height);
+            left  = ts->gray_left;
+            right = ts->gray_right;
+        }
+        ag_remap_gray (ts->remap_left,  left,  ts->rect_left);
+        ag_remap_gray (ts->remap_right, right, ts->rect_right);
+        left  = ts->rect_left;
+        right = ts->rect_right;
+    }
+    ag_stereo_tags_detect (ts->tags, left, right, frame->width, frame->height);
+
+    TagFrame *tf = g_new0 (TagFrame, 1);
+    const AgTagResult *res;
+    tf->n_left = ag_stereo_tags_results (ts->tags, AG_TAG_EYE_LEFT, &res);
+    memcpy (tf->left, res, tf->n_left * sizeof *res);
+    tf->n_right = ag_stereo_tags_results (ts->tags, AG_TAG_EYE_RIGHT, &res);
+    memcpy (tf->right, res, tf->n_right * sizeof *res);
+    ag_stereo_tags_timing (ts->tags, AG_TAG_EYE_LEFT,
+                           &tf->ms[0], &tf->tracked[0]);
+    ag_stereo_tags_timing (ts->tags, AG_TAG_EYE_RIGHT,
+                           &tf->ms[1], &tf->tracked[1]);
+
+    if (ts->stereo) {
+        tf->fused = write_stereo_tags (ts->log, &ts->rig, ts->tag_size_m,
+                                       tf->left, tf->n_left,
+                                       tf->right, tf->n_right,
+                                       frame->frame_id, frame->capture_us,
+                                       &tf->rejected);
+    } else {
+        print_tag_results (tf->left, tf->n_left, frame->frame_id, "left");
+        print_tag_results (tf->right, tf->n_right, frame->frame_id, "right");
     }
+    return tf;
+}
 
-    apriltag_detections_destroy (detections);
-    return n_overlays;
+/* Corner outlines of one eye's tags, x-offset into the side-by-side view. */
+static void
+draw_tag_outlines (SDL_Renderer *renderer, const AgTagResult *tags, guint n,
+                   double x_off, double sx, double sy)
+{
+    for (guint t = 0; t < n; t++) {
+        for (int c = 0; c < 4; c++) {
+            int nc = (c + 1) % 4;
+            SDL_RenderDrawLine (renderer,
+                (int) ((tags[t].p[c][0]  + x_off) * sx),
+                (int) ( tags[t].p[c][1]           * sy),
+                (int) ((tags[t].p[nc][0] + x_off) * sx),
+                (int) ( tags[t].p[nc][1]          * sy));
+        }
+    }
 }
 #endif /* HAVE_APRILTAG */
 
 static int
 stream_loop (const char *device_id, const char *iface_ip,
              double fps, double exposure_us, double gain_db,
-             gboolean auto_expose, int packet_size, int binning,
-             double tag_size_m, const AgCalibSource *calib_src)
+             AgAeMode ae_mode, AgAeMetering ae_metering,
+             int packet_size, int binning,
+             double tag_size_m, int tag_threads, float tag_decimate,
+             guint tag_refresh, gboolean tag_stereo, const char *tag_log_path,
+             const AgCalibSource *calib_src,
+             const AgTransportOptions *transport, const AgRoi *roi,
+             const char *trace_path, const char *metrics_addr,
+             AgVideoOut *video, gboolean headless, double duration_s)
 {
+    int exitcode = EXIT_FAILURE;
     GError *error = NULL;
     ArvCamera *camera = arv_camera_new (device_id, &error);
     if (!camera) {
@@ -132,11 +219,12 @@ stream_loop (const char *device_id, const char *iface_ip,
     }
 
     printf ("Connected.\n");
+    ag_startup_mark ("open camera");
 
     AgCameraConfig cfg;
     if (camera_configure (camera, AG_MODE_CONTINUOUS,
-                          binning, exposure_us, gain_db, auto_expose,
-                          packet_size, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
+                          binning, exposure_us, gain_db, ae_mode == AG_AE_CAMERA,
+                          packet_size, transport, roi, iface_ip, FALSE, &cfg) != EXIT_SUCCESS) {
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -153,40 +241,56 @@ stream_loop (const char *device_id, const char *iface_ip,
     guint display_h  = proc_h;
 
 #ifdef HAVE_APRILTAG
-    /* AprilTag detector setup. */
-    apriltag_detector_t *at_detector = NULL;
-    apriltag_family_t   *at_family   = NULL;
-    double at_fx = 0, at_fy = 0, at_cx = 0, at_cy = 0;
+    /* AprilTag detector setup: one detector per eye, run concurrently. */
+    AgStereoTags *at_tags = NULL;
 
     if (tag_size_m > 0.0) {
-        at_family   = tagStandard52h13_create ();
-        at_detector = apriltag_detector_create ();
-        apriltag_detector_add_family (at_detector, at_family);
-
-        at_detector->quad_decimate   = 1.5f;
-        at_detector->quad_sigma      = 0.0f;
-        at_detector->nthreads        = 1;
-        at_detector->refine_edges    = 1;
-        at_detector->decode_sharpening = 0.25;
-
-        double total_bin = (double) (AG_SENSOR_WIDTH / 2) / (double) proc_sub_w;
-        at_fx = AG_LENS_FL_UM / (AG_PIXEL_PITCH_UM * total_bin);
-        at_fy = at_fx;
-        at_cx = (double) proc_sub_w / 2.0;
-        at_cy = (double) proc_h / 2.0;
-
-        printf ("AprilTag: tagStandard52h13, tag_size=%.3f m, "
-                "fx=%.1f fy=%.1f cx=%.1f cy=%.1f\n",
-                tag_size_m, at_fx, at_fy, at_cx, at_cy);
+        /* Principal point stays at the full-frame centre; an ROI only
+         * shifts it into window coordinates. */
+        double total_bin = (double) binning;
+        AgTagParams tp = {
+            .threads    = tag_threads,
+            .decimate   = tag_decimate,
+            .refresh    = tag_refresh,
+            .pose       = !tag_stereo,
+            .tag_size_m = tag_size_m,
+            .fx = AG_LENS_FL_UM / (AG_PIXEL_PITCH_UM * total_bin),
+            .cx = (double) (AG_SENSOR_WIDTH / 2 / binning) / 2.0 - cfg.roi.x,
+            .cy = (double) (AG_SENSOR_HEIGHT / binning) / 2.0 - cfg.roi.y,
+        };
+        tp.fy = tp.fx;
+        at_tags = ag_stereo_tags_new (&tp);
+
+        if (tag_stereo)
+            printf ("AprilTag: tagStandard52h13, tag_size=%.3f m, "
+                    "stereo (rectified, triangulated)\n", tag_size_m);
+        else
+            printf ("AprilTag: tagStandard52h13, tag_size=%.3f m, "
+                    "fx=%.1f fy=%.1f cx=%.1f cy=%.1f\n",
+                    tag_size_m, tp.fx, tp.fy, tp.cx, tp.cy);
+        printf ("AprilTag: both eyes in parallel, %d thread%s each, "
+                "decimate %.2f, ", tag_threads, tag_threads == 1 ? "" : "s",
+                tag_decimate);
+        if (tag_refresh)
+            printf ("tracking (full search every %u frames)\n", tag_refresh);
+        else
+            printf ("full-frame search every frame\n");
     }
 #else
     (void) tag_size_m;
+    (void) tag_threads;
+    (void) tag_decimate;
+    (void) tag_refresh;
+    (void) tag_stereo;
+    (void) tag_log_path;
 #endif
 
     /* SDL2 setup. */
+    if (headless)
+        g_setenv ("SDL_VIDEODRIVER", "dummy", TRUE);
     if (SDL_Init (SDL_INIT_VIDEO) != 0) {
         fprintf (stderr, "error: SDL_Init: %s\n", SDL_GetError ());
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -200,7 +304,7 @@ stream_loop (const char *device_id, const char *iface_ip,
     if (!window) {
         fprintf (stderr, "error: SDL_CreateWindow: %s\n", SDL_GetError ());
         SDL_Quit ();
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -214,7 +318,7 @@ stream_loop (const char *device_id, const char *iface_ip,
         fprintf (stderr, "error: SDL_CreateRenderer: %s\n", SDL_GetError ());
         SDL_DestroyWindow (window);
         SDL_Quit ();
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
@@ -228,27 +332,52 @@ stream_loop (const char *device_id, const char *iface_ip,
         SDL_DestroyRenderer (renderer);
         SDL_DestroyWindow (window);
         SDL_Quit ();
-        g_object_unref (cfg.stream);
+        camera_config_cleanup (&cfg);
         g_object_unref (camera);
         arv_shutdown ();
         return EXIT_FAILURE;
     }
 
-    /* Scratch buffers. */
-    guint8 *rgb_left        = g_malloc ((size_t) proc_sub_w * proc_h * 3);
-    guint8 *rgb_right       = g_malloc ((size_t) proc_sub_w * proc_h * 3);
-    guint8 *bayer_left      = g_malloc ((size_t) proc_sub_w * proc_h);
-    guint8 *bayer_right     = g_malloc ((size_t) proc_sub_w * proc_h);
+    /* Scratch buffers, carved from one aligned arena reused every frame.
+     * Room for the rectified planes is reserved up front. */
+    size_t eye_pixels = (size_t) proc_sub_w * proc_h;
+    AgFrameArena *scratch = ag_frame_arena_new (
+        AG_ARENA_ROUND (eye_pixels) * (tag_stereo ? 6 : 2) +
+        AG_ARENA_ROUND (eye_pixels * 3) * 4,
+        AG_ARENA_HUGEPAGES);
+    guint8 *rgb_left        = ag_frame_arena_alloc (scratch, eye_pixels * 3);
+    guint8 *rgb_right       = ag_frame_arena_alloc (scratch, eye_pixels * 3);
+    guint8 *bayer_left      = ag_frame_arena_alloc (scratch, eye_pixels);
+    guint8 *bayer_right     = ag_frame_arena_alloc (scratch, eye_pixels);
+    printf ("Scratch arena: %.1f MB (%s)\n",
+            ag_frame_arena_capacity (scratch) / (1024.0 * 1024.0),
+            ag_frame_arena_backing_name (scratch));
 
     /* Load rectification remap tables (optional). */
     AgRemapTable *remap_left  = NULL;
     AgRemapTable *remap_right = NULL;
+    AgAeMeter    *ae_meter    = NULL;
     guint8 *rect_left  = NULL;
     guint8 *rect_right = NULL;
+    AgCalibMeta calib_meta = { 0 };
+#ifdef HAVE_APRILTAG
+    TagStage         tag_ctx    = { 0 };
+    AgDetectorStage *tag_stage  = NULL;
+    TagFrame        *tag_latest = NULL;    /* newest result, drawn each frame */
+    guint64          tag_latest_id = 0;
+    /* Stats since the last stats line. */
+    double  tag_ms_sum[2] = { 0, 0 }, tag_latency_sum = 0;
+    guint   tag_results = 0, tag_tracked = 0, tag_fused = 0, tag_rejected = 0;
+    guint64 tag_skipped_prev = 0;
+#endif
 
     if (calib_src->local_path || calib_src->slot >= 0) {
         if (ag_calib_load (device, calib_src,
-                            &remap_left, &remap_right, NULL) != 0)
+                            &remap_left, &remap_right, &calib_meta) != 0)
+            goto cleanup;
+        if (ag_calib_crop_to_roi (&remap_left, &remap_right, &cfg.roi,
+                                  AG_SENSOR_WIDTH / 2 / (guint) binning,
+                                  AG_SENSOR_HEIGHT / (guint) binning) != 0)
             goto cleanup;
 
         if (remap_left->width != proc_sub_w || remap_left->height != proc_h) {
@@ -259,16 +388,89 @@ stream_loop (const char *device_id, const char *iface_ip,
             goto cleanup;
         }
 
-        rect_left  = g_malloc ((size_t) proc_sub_w * proc_h * 3);
-        rect_right = g_malloc ((size_t) proc_sub_w * proc_h * 3);
+        rect_left  = ag_frame_arena_alloc (scratch, eye_pixels * 3);
+        rect_right = ag_frame_arena_alloc (scratch, eye_pixels * 3);
         printf ("Rectification enabled (%ux%u maps loaded).\n",
                 proc_sub_w, proc_h);
+
+        /* Host AE meters only what both rectified eyes see. */
+        if (ae_mode == AG_AE_HOST && ae_metering == AG_AE_METER_OVERLAP) {
+            ae_meter = ag_ae_meter_new_overlap (
+                remap_left, remap_right, cfg.frame_w, cfg.frame_h,
+                cfg.software_binning, AG_AE_SAMPLE_STEP, NULL, 1);
+            if (!ae_meter)
+                goto cleanup;
+        }
+    }
+
+#ifdef HAVE_APRILTAG
+    /* Stereo tags: detect on rectified luma planes, triangulate with the
+     * calibration's own projection pair (shifted into the ROI). */
+    if (at_tags && tag_stereo) {
+        if (!calib_meta.has_projection || calib_meta.focal_length_px <= 0.0 ||
+            calib_meta.baseline_cm <= 0.0) {
+            fprintf (stderr, "error: --tag-stereo needs focal_length_px, "
+                     "baseline_cm and both principal points in the "
+                     "calibration (re-export the session)\n");
+            goto cleanup;
+        }
+        AgStereoRig *rig = &tag_ctx.rig;
+        rig->f          = calib_meta.focal_length_px;
+        rig->cx_left    = calib_meta.cx_left  - cfg.roi.x;
+        rig->cx_right   = calib_meta.cx_right - cfg.roi.x;
+        rig->cy         = calib_meta.cy       - cfg.roi.y;
+        rig->baseline_m = calib_meta.baseline_cm / 100.0;
+        printf ("AprilTag stereo: f=%.1f cx=%.1f/%.1f cy=%.1f baseline=%.4f m\n",
+                rig->f, rig->cx_left, rig->cx_right, rig->cy, rig->baseline_m);
+
+        tag_ctx.stereo      = TRUE;
+        tag_ctx.remap_left  = remap_left;
+        tag_ctx.remap_right = remap_right;
+        tag_ctx.bayer       = cfg.data_is_bayer;
+        tag_ctx.gray_left   = ag_frame_arena_alloc (scratch, eye_pixels);
+        tag_ctx.gray_right  = ag_frame_arena_alloc (scratch, eye_pixels);
+        tag_ctx.rect_left   = ag_frame_arena_alloc (scratch, eye_pixels);
+        tag_ctx.rect_right  = ag_frame_arena_alloc (scratch, eye_pixels);
+
+        tag_ctx.log = stdout;
+        if (tag_log_path) {
+            tag_ctx.log = fopen (tag_log_path, "w");
+            if (!tag_ctx.log) {
+                fprintf (stderr, "error: cannot open '%s' for write: %s\n",
+                         tag_log_path, g_strerror (errno));
+                goto cleanup;
+            }
+        }
     }
+    if (at_tags) {
+        static const AgDetectorOps tag_ops = {
+            "apriltag", tag_stage_process, g_free
+        };
+        tag_ctx.tags       = at_tags;
+        tag_ctx.tag_size_m = tag_size_m;
+        tag_stage = ag_detector_stage_new (&tag_ops, &tag_ctx,
+                                           proc_sub_w, proc_h);
+    }
+#endif
 
     /* Pointers used for SDL upload — either raw or rectified. */
     const guint8 *display_left  = remap_left ? rect_left  : rgb_left;
     const guint8 *display_right = remap_left ? rect_right : rgb_right;
 
+    ag_startup_mark ("display + calibration");
+
+    /* Bind the metrics endpoint before streaming: a taken port fails the
+     * command up front instead of after acquisition and AE settle. */
+    AgStreamMetrics metrics = { 0 };
+    if (metrics_addr) {
+        ag_stream_metrics_init (&metrics);
+        if (ag_metrics_serve (metrics_addr) != 0) {
+            ag_metrics_reset ();
+            goto cleanup;
+        }
+    }
+    ag_stream_metrics_set_pool (&metrics, ag_stream_pool_n_buffers (cfg.pool));
+
     /* Start acquisition. */
     printf ("Starting acquisition at %.1f Hz...\n", fps);
     arv_camera_start_acquisition (camera, &error);
@@ -283,13 +485,28 @@ stream_loop (const char *device_id, const char *iface_ip,
 
     guint64 trigger_interval_us = (guint64) (1000000.0 / fps);
 
-    if (auto_expose)
-        auto_expose_settle (camera, &cfg, (double) trigger_interval_us);
+    ag_startup_mark ("start acquisition");
+
+    AgAeController ae;
+    if (ae_mode != AG_AE_OFF) {
+        auto_expose_settle (camera, &cfg, ae_mode,
+                            (double) trigger_interval_us, ae_meter, &ae);
+        ag_startup_mark ("auto-expose settle");
+    }
 
     guint64 frames_displayed = 0;
     guint64 frames_dropped   = 0;
+    guint64 frame_seq        = 0;
     const guint8 *gamma_lut  = gamma_lut_2p5 ();
     GTimer *stats_timer = g_timer_new ();
+    GTimer *run_timer   = g_timer_new ();
+    gint64  next_trigger_us = 0;
+
+    if (trace_path)
+        ag_trace_start ("acquisition");
+
+    if (metrics_addr)
+        ag_metrics_observe_trace_stages ();
 
     while (!g_quit) {
         SDL_Event ev;
@@ -302,6 +519,11 @@ stream_loop (const char *device_id, const char *iface_ip,
         }
         if (g_quit)
             break;
+        if (duration_s > 0.0 && g_timer_elapsed (run_timer, NULL) >= duration_s)
+            break;
+
+        ag_trace_set_frame (frame_seq++);
+        uint64_t t_stage = ag_trace_begin ();
 
         /* Wait for TriggerArmed. */
         {
@@ -333,16 +555,21 @@ stream_loop (const char *device_id, const char *iface_ip,
                 continue;
             }
         }
+        ag_trace_end (AG_STAGE_TRIGGER, t_stage);
 
+        t_stage = ag_trace_begin ();
         ArvBuffer *buffer = arv_stream_timeout_pop_buffer (cfg.stream, 500000);
+        ag_trace_end (AG_STAGE_POP, t_stage);
         if (!buffer) {
             frames_dropped++;
+            ag_stream_metrics_drop (&metrics, AG_DROP_TIMEOUT);
             continue;
         }
 
         ArvBufferStatus st = arv_buffer_get_status (buffer);
         if (st != ARV_BUFFER_STATUS_SUCCESS) {
             frames_dropped++;
+            ag_stream_metrics_drop (&metrics, AG_DROP_STATUS);
             arv_stream_push_buffer (cfg.stream, buffer);
             continue;
         }
@@ -356,34 +583,49 @@ stream_loop (const char *device_id, const char *iface_ip,
         if (!data || data_size < needed || w % 2 != 0 ||
             w != cfg.frame_w || h != cfg.frame_h) {
             frames_dropped++;
+            ag_stream_metrics_drop (&metrics, AG_DROP_SIZE);
             arv_stream_push_buffer (cfg.stream, buffer);
             continue;
         }
 
-        extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
-                                 bayer_left, bayer_right);
+        /* Host AE keeps tracking; writes only leave the deadband. */
+        if (ae_mode == AG_AE_HOST)
+            auto_expose_track (device, &ae, ae_meter, data, w, h);
+
+        t_stage = ag_trace_begin ();
+        extract_dual_bayer_eyes (data, w, h, cfg.software_binning,
+                                 bayer_left, bayer_right);
+        ag_trace_end (AG_STAGE_EXTRACT, t_stage);
 
 #ifdef HAVE_APRILTAG
-        /* Detect tags on raw grayscale (before gamma), both eyes. */
-        int n_left_tags = 0, n_right_tags = 0;
-        TagOverlay left_tags[MAX_TAG_OVERLAYS], right_tags[MAX_TAG_OVERLAYS];
-        if (at_detector) {
-            n_left_tags = detect_tags_and_pose (
-                at_detector, bayer_left,
-                proc_sub_w, proc_h, tag_size_m,
-                at_fx, at_fy, at_cx, at_cy,
-                frames_displayed, "left",
-                left_tags, MAX_TAG_OVERLAYS);
-            n_right_tags = detect_tags_and_pose (
-                at_detector, bayer_right,
-                proc_sub_w, proc_h, tag_size_m,
-                at_fx, at_fy, at_cx, at_cy,
-                frames_displayed, "right",
-                right_tags, MAX_TAG_OVERLAYS);
+        /* Hand the raw (pre-gamma) planes to the detector stage and pick
+         * up whatever it finished since the last frame; overlays are
+         * drawn from the newest result, however old. */
+        guint64 frame_id = arv_buffer_get_frame_id (buffer);
+        if (tag_stage) {
+            ag_detector_stage_submit (
+                tag_stage, frame_id,
+                (gint64) (arv_buffer_get_system_timestamp (buffer) / 1000),
+                bayer_left, bayer_right);
+
+            AgDetectorResult dr;
+            if (ag_detector_stage_poll (tag_stage, &dr)) {
+                g_free (tag_latest);
+                tag_latest    = dr.result;
+                tag_latest_id = dr.frame_id;
+                tag_ms_sum[0]   += tag_latest->ms[0];
+                tag_ms_sum[1]   += tag_latest->ms[1];
+                tag_tracked     += tag_latest->tracked[0] + tag_latest->tracked[1];
+                tag_fused       += tag_latest->fused;
+                tag_rejected    += tag_latest->rejected;
+                tag_latency_sum += dr.latency_us / 1000.0;
+                tag_results++;
+            }
         }
 #endif
 
         size_t eye_n = (size_t) proc_sub_w * (size_t) proc_h;
+        t_stage = ag_trace_begin ();
         apply_lut_inplace (bayer_left,  eye_n, gamma_lut);
         apply_lut_inplace (bayer_right, eye_n, gamma_lut);
 
@@ -394,13 +636,36 @@ stream_loop (const char *device_id, const char *iface_ip,
             gray_to_rgb_replicate (bayer_left,  rgb_left,  (uint32_t) eye_n);
             gray_to_rgb_replicate (bayer_right, rgb_right, (uint32_t) eye_n);
         }
+        ag_trace_end (AG_STAGE_DEBAYER, t_stage);
 
         if (remap_left) {
+            t_stage = ag_trace_begin ();
             ag_remap_rgb (remap_left,  rgb_left,  rect_left);
             ag_remap_rgb (remap_right, rgb_right, rect_right);
+            ag_trace_end (AG_STAGE_REMAP, t_stage);
+        }
+
+        /* Hand the displayed frame to the video sink.  A failed write
+         * (reader gone, disk full) ends the session. */
+        if (video) {
+            t_stage = ag_trace_begin ();
+            AgVideoFrame vf = {
+                .eye          = { display_left, display_right },
+                .channels     = 3,
+                .width        = proc_sub_w,
+                .height       = proc_h,
+                .stride       = (size_t) proc_sub_w * 3,
+                .frame_id     = arv_buffer_get_frame_id (buffer),
+                .timestamp_ns = arv_buffer_get_timestamp (buffer),
+                .system_ns    = arv_buffer_get_system_timestamp (buffer),
+            };
+            if (ag_video_out_write (video, &vf) != 0)
+                g_quit = 1;
+            ag_trace_end (AG_STAGE_VIDEO, t_stage);
         }
 
         /* Upload to SDL texture. */
+        t_stage = ag_trace_begin ();
         void *tex_pixels;
         int tex_pitch;
         if (SDL_LockTexture (texture, NULL, &tex_pixels, &tex_pitch) == 0) {
@@ -415,95 +680,136 @@ stream_loop (const char *device_id, const char *iface_ip,
             }
             SDL_UnlockTexture (texture);
         }
+        ag_trace_end (AG_STAGE_UPLOAD, t_stage);
 
         arv_stream_push_buffer (cfg.stream, buffer);
 
+        t_stage = ag_trace_begin ();
         SDL_RenderClear (renderer);
         SDL_RenderCopy (renderer, texture, NULL, NULL);
 
 #ifdef HAVE_APRILTAG
-        /* Draw detected tag outlines as quadrilaterals.
+        /* Draw the newest detected tag outlines as quadrilaterals, with
+         * how many frames old they are.
          * Tag corner coords are in per-eye pixel space; we must map them
          * to the renderer's logical output which may be scaled by the
          * window size.  SDL_RenderCopy stretches the texture to fill the
          * output, so we apply the same scale. */
-        if (n_left_tags || n_right_tags) {
+        if (tag_latest) {
             int out_w, out_h;
             SDL_GetRendererOutputSize (renderer, &out_w, &out_h);
             double sx = (double) out_w / (double) display_w;
             double sy = (double) out_h / (double) display_h;
 
             SDL_SetRenderDrawColor (renderer, 0, 255, 0, 255);
-
-            for (int t = 0; t < n_left_tags; t++) {
-                for (int c = 0; c < 4; c++) {
-                    int nc = (c + 1) % 4;
-                    SDL_RenderDrawLine (renderer,
-                        (int) (left_tags[t].p[c][0]  * sx),
-                        (int) (left_tags[t].p[c][1]  * sy),
-                        (int) (left_tags[t].p[nc][0] * sx),
-                        (int) (left_tags[t].p[nc][1] * sy));
-                }
-            }
-
-            for (int t = 0; t < n_right_tags; t++) {
-                double x_off = (double) proc_sub_w;
-                for (int c = 0; c < 4; c++) {
-                    int nc = (c + 1) % 4;
-                    SDL_RenderDrawLine (renderer,
-                        (int) ((right_tags[t].p[c][0]  + x_off) * sx),
-                        (int) ( right_tags[t].p[c][1]           * sy),
-                        (int) ((right_tags[t].p[nc][0] + x_off) * sx),
-                        (int) ( right_tags[t].p[nc][1]          * sy));
-                }
-            }
+            draw_tag_outlines (renderer, tag_latest->left,
+                               tag_latest->n_left, 0.0, sx, sy);
+            draw_tag_outlines (renderer, tag_latest->right,
+                               tag_latest->n_right, (double) proc_sub_w,
+                               sx, sy);
+
+            char label[64];
+            g_snprintf (label, sizeof label,
+                        "tags L%u R%u age %" G_GUINT64_FORMAT,
+                        tag_latest->n_left, tag_latest->n_right,
+                        frame_id >= tag_latest_id ? frame_id - tag_latest_id : 0);
+            ag_font_render (renderer, label, 8, 8, out_w > 1200 ? 3 : 2,
+                            0, 255, 0);
         }
 #endif
 
         SDL_RenderPresent (renderer);
+        ag_trace_end (AG_STAGE_PRESENT, t_stage);
 
         frames_displayed++;
+        if (frames_displayed == 1) {
+            ag_startup_mark ("first frame");
+            ag_startup_report (stdout);
+        }
+        ag_stream_metrics_frame (&metrics);
+        ag_stream_metrics_update (&metrics, cfg.stream);
 
         double elapsed = g_timer_elapsed (stats_timer, NULL);
         if (elapsed >= 5.0) {
             printf ("  %.1f fps (displayed=%" G_GUINT64_FORMAT
                     " dropped=%" G_GUINT64_FORMAT ")\n",
                     frames_displayed / elapsed, frames_displayed, frames_dropped);
+            if (ae_mode == AG_AE_HOST)
+                printf ("  AE level %.0f  L/R %.2f  ExposureTime = %.1f us  "
+                        "Gain = %.1f dB\n", ae.brightness, ae.balance,
+                        ae.exposure_us, ae.gain_db);
+#ifdef HAVE_APRILTAG
+            if (tag_stage) {
+                guint64 processed, skipped;
+                ag_detector_stage_counts (tag_stage, &processed, &skipped);
+                if (tag_results)
+                    printf ("  AprilTag detect: left %.1f ms  right %.1f ms  "
+                            "(%.0f%% tracked)  latency %.1f ms  "
+                            "skipped %" G_GUINT64_FORMAT "\n",
+                            tag_ms_sum[0] / tag_results,
+                            tag_ms_sum[1] / tag_results,
+                            50.0 * tag_tracked / tag_results,
+                            tag_latency_sum / tag_results,
+                            skipped - tag_skipped_prev);
+                if (tag_stereo)
+                    printf ("  AprilTag stereo: %u poses, %u rejected\n",
+                            tag_fused, tag_rejected);
+                tag_skipped_prev = skipped;
+                tag_ms_sum[0] = tag_ms_sum[1] = tag_latency_sum = 0.0;
+                tag_results = tag_tracked = tag_fused = tag_rejected = 0;
+            }
+#endif
+            ag_gauge_set (metrics.fps, frames_displayed / elapsed);
+            ag_trace_print_summary ();
             frames_displayed = 0;
             frames_dropped = 0;
             g_timer_start (stats_timer);
         }
 
-        g_usleep ((gulong) trigger_interval_us);
+        ag_pace_trigger (&next_trigger_us, trigger_interval_us);
     }
 
     g_timer_destroy (stats_timer);
     printf ("\nStopping...\n");
     arv_camera_stop_acquisition (camera, NULL);
+    ag_stream_metrics_print_summary (&metrics, g_timer_elapsed (run_timer, NULL));
+    g_timer_destroy (run_timer);
+    if (video)
+        printf ("Video: %" G_GUINT64_FORMAT " frames, %.1f MB written.\n",
+                ag_video_out_frames (video),
+                ag_video_out_bytes (video) / (1024.0 * 1024.0));
+
+    if (trace_path)
+        ag_trace_write_chrome (trace_path);
+    if (trace_path || metrics_addr)
+        ag_trace_stop ();
+    if (metrics_addr)
+        ag_metrics_reset ();
+    exitcode = EXIT_SUCCESS;
 
 cleanup:
-    g_free (rect_left);
-    g_free (rect_right);
+#ifdef HAVE_APRILTAG
+    /* The stage reads the remap tables and arena; stop it first. */
+    ag_detector_stage_free (tag_stage);
+    g_free (tag_latest);
+#endif
     ag_remap_table_free (remap_left);
     ag_remap_table_free (remap_right);
-    g_free (bayer_left);
-    g_free (bayer_right);
-    g_free (rgb_left);
-    g_free (rgb_right);
+    ag_ae_meter_free (ae_meter);
+    ag_frame_arena_free (scratch);
     SDL_DestroyTexture (texture);
     SDL_DestroyRenderer (renderer);
     SDL_DestroyWindow (window);
     SDL_Quit ();
 #ifdef HAVE_APRILTAG
-    if (at_detector) {
-        apriltag_detector_destroy (at_detector);
-        tagStandard52h13_destroy (at_family);
-    }
+    ag_stereo_tags_free (at_tags);
+    if (tag_ctx.log && tag_ctx.log != stdout)
+        fclose (tag_ctx.log);
 #endif
-    g_object_unref (cfg.stream);
+    camera_config_cleanup (&cfg);
     g_object_unref (camera);
     arv_shutdown ();
-    return EXIT_SUCCESS;
+    return exitcode;
 }
 
 int
@@ -526,10 +832,28 @@ cmd_stream (int argc, char *argv[], arg_dstr_t res, void *ctx)
                                           "sensor gain in dB (0-48)");
     struct arg_lit *auto_exp  = arg_lit0 ("A", "auto-expose",
                                           "auto-expose then lock");
+    struct arg_str *ae_mode_a = arg_str0 (NULL, "ae-mode", "<host|camera>",
+                                          "-A metering: host histogram (default) or camera AE");
+    struct arg_str *ae_meter_a = arg_str0 (NULL, "ae-metering", "<frame|overlap>",
+                                           "host AE samples (default: overlap when rectifying)");
     struct arg_int *binning_a = arg_int0 ("b", "binning",   "<1|2>",
                                           "sensor binning factor (default: 1)");
     struct arg_int *pkt_size  = arg_int0 ("p", "packet-size", "<bytes>",
                                           "GigE packet size (default: auto-negotiate)");
+    struct arg_str *roi_a     = arg_str0 (NULL, "roi", "<y0:h[:x0:w]>",
+                                          "acquire only this per-eye window (default: full frame)");
+    struct arg_int *buffers_a = arg_int0 (NULL, "stream-buffers", "<n>",
+                                          "Aravis stream buffers (default: 16)");
+    struct arg_str *psock_a   = arg_str0 (NULL, "packet-socket", "<auto|on|off>",
+                                          "PF_PACKET receive path (default: auto)");
+    struct arg_str *sockbuf_a = arg_str0 (NULL, "socket-buffer", "<bytes|auto>",
+                                          "GVSP socket receive buffer, e.g. 8M (default: auto)");
+    struct arg_int *ptimeout_a = arg_int0 (NULL, "packet-timeout", "<us>",
+                                           "wait before requesting a resend (default: 20000)");
+    struct arg_int *fretain_a = arg_int0 (NULL, "frame-retention", "<us>",
+                                          "give up on an incomplete frame after (default: 200000)");
+    struct arg_str *resend_a  = arg_str0 (NULL, "packet-resend", "<always|never>",
+                                          "GVSP packet resend policy (default: always)");
     struct arg_str *calib_local = arg_str0 (NULL, "calibration-local", "<path>",
                                             "rectify using local calibration session");
     struct arg_int *calib_slot  = arg_int0 (NULL, "calibration-slot", "<0-2>",
@@ -537,23 +861,65 @@ cmd_stream (int argc, char *argv[], arg_dstr_t res, void *ctx)
 #ifdef HAVE_APRILTAG
     struct arg_dbl *tag_size  = arg_dbl0 ("t", "tag-size",  "<meters>",
                                           "AprilTag size in meters (enables detection)");
+    struct arg_int *tag_threads_a = arg_int0 (NULL, "tag-threads", "<n>",
+                                              "AprilTag worker threads per eye (default: 1)");
+    struct arg_dbl *tag_decimate_a = arg_dbl0 (NULL, "tag-decimate", "<f>",
+                                               "AprilTag quad decimation (default: 1.5)");
+    struct arg_int *tag_refresh_a = arg_int0 (NULL, "tag-refresh", "<N>",
+                                              "track tags, full-frame search every N frames (default: 10, 0: off)");
+    struct arg_lit *tag_stereo_a = arg_lit0 (NULL, "tag-stereo",
+                                             "triangulate tags from both rectified eyes (needs calibration)");
+    struct arg_str *tag_log_a = arg_str0 (NULL, "tag-log", "<out.ndjson>",
+                                          "write --tag-stereo poses here instead of stdout");
 #endif
+    struct arg_str *trace_a   = arg_str0 (NULL, "trace", "<out.json>",
+                                          "record per-stage latency (Chrome trace format)");
+    struct arg_str *metrics_a = arg_str0 (NULL, "metrics", "<addr>",
+                                          "serve Prometheus metrics on unix:<path> or [127.0.0.1:]<port>");
+    struct arg_str *video_a   = arg_str0 (NULL, "video-out", "<-|path>",
+                                          "stream frames as video to a file or stdout (-)");
+    struct arg_str *vformat_a = arg_str0 (NULL, "video-format", "<y4m|mjpeg>",
+                                          "video container (default: y4m)");
+    struct arg_str *vcolor_a  = arg_str0 (NULL, "video-color", "<gray|420>",
+                                          "video pixels: luma only or YCbCr 4:2:0 (default: gray)");
+    struct arg_str *vlayout_a = arg_str0 (NULL, "video-layout", "<sbs|left|right|split>",
+                                          "eyes side by side, one eye, or one file per eye (default: sbs)");
+    struct arg_int *vquality_a = arg_int0 (NULL, "video-quality", "<1-100>",
+                                           "MJPEG quality (default: 90)");
+    struct arg_str *vts_a     = arg_str0 (NULL, "video-timestamps", "<path>",
+                                          "per-frame timestamp CSV (default: <path>.timestamps.csv)");
+    struct arg_lit *headless_a = arg_lit0 (NULL, "headless",
+                                           "render offscreen (no window; for tests and benchmarks)");
+    struct arg_dbl *duration_a = arg_dbl0 (NULL, "duration", "<seconds>",
+                                           "stop after this many seconds");
+    struct arg_lit *profile_a = arg_lit0 (NULL, "startup-profile",
+                                          "print time spent in each startup phase");
     struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
     struct arg_end *end       = arg_end (10);
 
 #ifdef HAVE_APRILTAG
     void *argtable[] = { cmd, serial, address, interface, fps_a, exposure,
-                         gain, auto_exp, binning_a, pkt_size,
+                         gain, auto_exp, ae_mode_a, ae_meter_a,
+                         binning_a, pkt_size, roi_a, buffers_a,
+                         psock_a, sockbuf_a, ptimeout_a, fretain_a, resend_a,
                          calib_local, calib_slot,
-                         tag_size, help, end };
+                         tag_size, tag_threads_a, tag_decimate_a,
+                         tag_refresh_a, tag_stereo_a, tag_log_a, trace_a, metrics_a,
+                         video_a, vformat_a, vcolor_a, vlayout_a, vquality_a, vts_a,
+                         headless_a, duration_a, profile_a, help, end };
 #else
     void *argtable[] = { cmd, serial, address, interface, fps_a, exposure,
-                         gain, auto_exp, binning_a, pkt_size,
+                         gain, auto_exp, ae_mode_a, ae_meter_a,
+                         binning_a, pkt_size, roi_a, buffers_a,
+                         psock_a, sockbuf_a, ptimeout_a, fretain_a, resend_a,
                          calib_local, calib_slot,
-                         help, end };
+                         trace_a, metrics_a,
+                         video_a, vformat_a, vcolor_a, vlayout_a, vquality_a, vts_a,
+                         headless_a, duration_a, profile_a, help, end };
 #endif
 
     int exitcode = EXIT_SUCCESS;
+    AgVideoOut *video = NULL;
     if (arg_nullcheck (argtable) != 0) {
         arg_dstr_catf (res, "error: insufficient memory\n");
         exitcode = EXIT_FAILURE;
@@ -602,8 +968,42 @@ cmd_stream (int argc, char *argv[], arg_dstr_t res, void *ctx)
         }
     }
 
-    gboolean do_auto_expose = auto_exp->count > 0;
-    if (do_auto_expose && (exposure->count || gain->count)) {
+    AgAeMode ae_mode = auto_exp->count ? AG_AE_HOST : AG_AE_OFF;
+    if (ae_mode_a->count) {
+        if (!auto_exp->count) {
+            arg_dstr_catf (res, "error: --ae-mode requires --auto-expose\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ag_parse_ae_mode (ae_mode_a->sval[0], &ae_mode) != 0) {
+            arg_dstr_catf (res, "error: --ae-mode must be host or camera\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    AgAeMetering ae_metering = (calib_local->count || calib_slot->count)
+                               ? AG_AE_METER_OVERLAP : AG_AE_METER_FRAME;
+    if (ae_meter_a->count) {
+        if (ae_mode != AG_AE_HOST) {
+            arg_dstr_catf (res, "error: --ae-metering requires --auto-expose "
+                           "with --ae-mode host\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ag_parse_ae_metering (ae_meter_a->sval[0], &ae_metering) != 0) {
+            arg_dstr_catf (res, "error: --ae-metering must be frame or overlap\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        if (ae_metering == AG_AE_METER_OVERLAP &&
+            !calib_local->count && !calib_slot->count) {
+            arg_dstr_catf (res, "error: --ae-metering overlap needs "
+                           "--calibration-local or --calibration-slot\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (ae_mode != AG_AE_OFF && (exposure->count || gain->count)) {
         arg_dstr_catf (res, "error: --auto-expose and --exposure/--gain are mutually exclusive\n");
         exitcode = EXIT_FAILURE;
         goto done;
@@ -616,6 +1016,19 @@ cmd_stream (int argc, char *argv[], arg_dstr_t res, void *ctx)
         goto done;
     }
 
+    AgRoi roi = { 0 };
+    if (roi_a->count) {
+        const char *rerr = "--roi must be y0:height or y0:height:x0:width";
+        if (ag_parse_roi (roi_a->sval[0], &roi) == 0)
+            rerr = ag_roi_resolve (&roi, AG_SENSOR_WIDTH / 2 / (guint) binning,
+                                   AG_SENSOR_HEIGHT / (guint) binning);
+        if (rerr) {
+            arg_dstr_catf (res, "error: %s\n", rerr);
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
     /* Validate calibration args (mutually exclusive). */
     if (calib_local->count && calib_slot->count) {
         arg_dstr_catf (res, "error: --calibration-local and --calibration-slot "
@@ -638,14 +1051,12 @@ cmd_stream (int argc, char *argv[], arg_dstr_t res, void *ctx)
     else if (calib_slot->count)
         calib_src.slot = calib_slot->ival[0];
 
-    if (calib_src.local_path)
-        printf ("Rectification enabled (calibration from %s).\n",
-                calib_src.local_path);
-    else if (calib_src.slot >= 0)
-        printf ("Rectification enabled (calibration from camera slot %d).\n",
-                calib_src.slot);
-
     double tag_size_m = 0.0;
+    int    tag_threads = AG_TAG_THREADS_DEFAULT;
+    float  tag_decimate = AG_TAG_DECIMATE_DEFAULT;
+    guint  tag_refresh = AG_TAG_TRACK_REFRESH_DEFAULT;
+    gboolean tag_stereo = FALSE;
+    const char *tag_log_path = NULL;
 #ifdef HAVE_APRILTAG
     if (tag_size->count) {
         tag_size_m = tag_size->dval[0];
@@ -655,8 +1066,136 @@ cmd_stream (int argc, char *argv[], arg_dstr_t res, void *ctx)
             goto done;
         }
     }
+    if (tag_threads_a->count) {
+        tag_threads = tag_threads_a->ival[0];
+        if (tag_threads < 1 || tag_threads > 64) {
+            arg_dstr_catf (res, "error: --tag-threads must be between 1 and 64\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (tag_decimate_a->count) {
+        tag_decimate = (float) tag_decimate_a->dval[0];
+        if (tag_decimate < 1.0f || tag_decimate > 8.0f) {
+            arg_dstr_catf (res, "error: --tag-decimate must be between 1 and 8\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+    }
+    if (tag_refresh_a->count) {
+        if (tag_refresh_a->ival[0] < 0) {
+            arg_dstr_catf (res, "error: --tag-refresh must be >= 0\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        tag_refresh = (guint) tag_refresh_a->ival[0];
+    }
+    if ((tag_threads_a->count || tag_decimate_a->count ||
+         tag_refresh_a->count) && !tag_size->count) {
+        arg_dstr_catf (res, "error: --tag-threads/--tag-decimate/--tag-refresh "
+                       "require --tag-size\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    tag_stereo = tag_stereo_a->count > 0;
+    if (tag_stereo && (!tag_size->count ||
+                       (!calib_local->count && !calib_slot->count))) {
+        arg_dstr_catf (res, "error: --tag-stereo requires --tag-size and "
+                       "--calibration-local or --calibration-slot\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    if (tag_log_a->count) {
+        if (!tag_stereo) {
+            arg_dstr_catf (res, "error: --tag-log requires --tag-stereo\n");
+            exitcode = EXIT_FAILURE;
+            goto done;
+        }
+        tag_log_path = tag_log_a->sval[0];
+    }
 #endif
 
+    if (buffers_a->count &&
+        (buffers_a->ival[0] < AG_STREAM_BUFFERS_MIN ||
+         buffers_a->ival[0] > AG_STREAM_BUFFERS_MAX)) {
+        arg_dstr_catf (res, "error: --stream-buffers must be between %d and %d\n",
+                       AG_STREAM_BUFFERS_MIN, AG_STREAM_BUFFERS_MAX);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    AgTransportOptions transport = {
+        .stream_buffers = buffers_a->count ? (guint) buffers_a->ival[0] : 0,
+    };
+    const char *terr = ag_transport_options_set (
+        &transport,
+        psock_a->count    ? psock_a->sval[0]    : NULL,
+        sockbuf_a->count  ? sockbuf_a->sval[0]  : NULL,
+        ptimeout_a->count ? ptimeout_a->ival[0] : -1,
+        fretain_a->count  ? fretain_a->ival[0]  : -1,
+        resend_a->count   ? resend_a->sval[0]   : NULL);
+    if (terr) {
+        arg_dstr_catf (res, "error: %s\n", terr);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (duration_a->count && duration_a->dval[0] <= 0.0) {
+        arg_dstr_catf (res, "error: --duration must be positive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (metrics_a->count && !ag_metrics_listen_valid (metrics_a->sval[0])) {
+        arg_dstr_catf (res, "error: --metrics must be unix:<path> or "
+                       "[127.0.0.1:]<port>\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    AgVideoOptions video_opts;
+    ag_video_options_defaults (&video_opts);
+    video_opts.fps = fps;
+    if ((vformat_a->count || vcolor_a->count || vlayout_a->count ||
+         vquality_a->count || vts_a->count) && !video_a->count) {
+        arg_dstr_catf (res, "error: --video-format/--video-color/--video-layout/"
+                       "--video-quality/--video-timestamps require --video-out\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    const char *verr = ag_video_options_set (
+        &video_opts,
+        vformat_a->count  ? vformat_a->sval[0]  : NULL,
+        vcolor_a->count   ? vcolor_a->sval[0]   : NULL,
+        vlayout_a->count  ? vlayout_a->sval[0]  : NULL,
+        vquality_a->count ? vquality_a->ival[0] : -1);
+    if (verr) {
+        arg_dstr_catf (res, "error: %s\n", verr);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    /* Claim stdout for the video before anything is printed. */
+    if (video_a->count) {
+        const char *vpath = video_a->sval[0];
+        char *video_ts = NULL;
+        if (vts_a->count)
+            video_ts = g_strdup (vts_a->sval[0]);
+        else if (strcmp (vpath, "-") != 0)
+            video_ts = g_strdup_printf ("%s.timestamps.csv", vpath);
+        video_opts.timestamps_path = video_ts;
+        video = ag_video_out_open (vpath, &video_opts);
+        g_free (video_ts);
+        if (!video) { exitcode = EXIT_FAILURE; goto done; }
+    }
+
+    if (calib_src.local_path)
+        printf ("Rectification enabled (calibration from %s).\n",
+                calib_src.local_path);
+    else if (calib_src.slot >= 0)
+        printf ("Rectification enabled (calibration from camera slot %d).\n",
+                calib_src.slot);
+
     const char *opt_serial    = serial->count    ? serial->sval[0]    : NULL;
     const char *opt_address   = address->count   ? address->sval[0]   : NULL;
     const char *opt_interface = interface->count  ? interface->sval[0] : NULL;
@@ -667,18 +1206,26 @@ cmd_stream (int argc, char *argv[], arg_dstr_t res, void *ctx)
         if (!iface_ip) { exitcode = EXIT_FAILURE; goto done; }
     }
 
+    ag_startup_begin (profile_a->count > 0);
     char *device_id = resolve_device (opt_serial, opt_address,
                                        opt_interface, TRUE);
     if (!device_id) { exitcode = EXIT_FAILURE; goto done; }
+    ag_startup_mark ("resolve device");
 
     int pkt_sz = pkt_size->count ? pkt_size->ival[0] : 0;
 
     exitcode = stream_loop (device_id, iface_ip, fps, exposure_us, gain_db,
-                            do_auto_expose, pkt_sz, binning, tag_size_m,
-                            &calib_src);
+                            ae_mode, ae_metering, pkt_sz, binning, tag_size_m,
+                            tag_threads, tag_decimate, tag_refresh,
+                            tag_stereo, tag_log_path, &calib_src, &transport, &roi,
+                            trace_a->count ? trace_a->sval[0] : NULL,
+                            metrics_a->count ? metrics_a->sval[0] : NULL,
+                            video, headless_a->count > 0,
+                            duration_a->count ? duration_a->dval[0] : 0.0);
     g_free (device_id);
 
 done:
+    ag_video_out_close (video);
     arg_freetable (argtable, sizeof argtable / sizeof argtable[0]);
     return exitcode;
 }
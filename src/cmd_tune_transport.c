@@ -0,0 +1,395 @@
+/*
+ * cmd_tune_transport.c — "ag-cam-tools tune-transport" subcommand
+ *
+ * Sweeps GevSCPSPacketSize x GevSCPD (inter-packet delay), running a
+ * short back-to-back trigger burst at each point, and reports delivered
+ * fps, resends and missing packets from the GVSP statistics.  The point
+ * with the highest drop-free throughput can be saved per camera serial;
+ * camera_configure() then applies it whenever -p is not given.
+ */
+
+#include "common.h"
+#include "transport_profile.h"
+#include "../vendor/argtable3.h"
+#include "../vendor/cJSON.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TUNE_DEFAULT_SIZES   "1500,3000,6000,8000,9000"
+#define TUNE_DEFAULT_DELAYS  "0,2000,5000,10000,20000"
+
+static volatile sig_atomic_t g_quit = 0;
+
+static void
+sigint_handler (int sig)
+{
+    (void) sig;
+    g_quit = 1;
+}
+
+static void
+print_points (const AgTunePoint *points, int n, int best)
+{
+    printf ("\n%8s %9s %8s %9s %8s %8s %8s %8s\n",
+            "size", "delay_ns", "frames", "MB/s", "fps",
+            "failed", "resent", "missing");
+    for (int i = 0; i < n; i++) {
+        const AgTunePoint *p = &points[i];
+        printf ("%8u %9u %8" G_GUINT64_FORMAT " %9.1f %8.2f %8"
+                G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %8"
+                G_GUINT64_FORMAT "%s\n",
+                p->packet_size, p->packet_delay_ns, p->completed,
+                ag_tune_point_mb_per_s (p),
+                p->elapsed_s > 0.0 ? (double) p->completed / p->elapsed_s : 0.0,
+                p->failed, p->resent, p->missing,
+                (i == best) ? "  <- best" : "");
+    }
+}
+
+static int
+write_points_json (const char *path, const char *serial,
+                   const AgTunePoint *points, int n, int best)
+{
+    cJSON *root = cJSON_CreateObject ();
+    cJSON_AddStringToObject (root, "serial", serial);
+    cJSON_AddNumberToObject (root, "best", best);
+    cJSON *arr = cJSON_AddArrayToObject (root, "points");
+
+    for (int i = 0; i < n; i++) {
+        const AgTunePoint *p = &points[i];
+        cJSON *o = cJSON_CreateObject ();
+        cJSON_AddNumberToObject (o, "packet_size", p->packet_size);
+        cJSON_AddNumberToObject (o, "packet_delay_ns", p->packet_delay_ns);
+        cJSON_AddNumberToObject (o, "payload", (double) p->payload);
+        cJSON_AddNumberToObject (o, "completed", (double) p->completed);
+        cJSON_AddNumberToObject (o, "failed", (double) p->failed);
+        cJSON_AddNumberToObject (o, "resent", (double) p->resent);
+        cJSON_AddNumberToObject (o, "missing", (double) p->missing);
+        cJSON_AddNumberToObject (o, "elapsed_s", p->elapsed_s);
+        cJSON_AddNumberToObject (o, "mb_per_s", ag_tune_point_mb_per_s (p));
+        cJSON_AddItemToArray (arr, o);
+    }
+
+    char *text = cJSON_Print (root);
+    cJSON_Delete (root);
+
+    GError *error = NULL;
+    int rc = EXIT_SUCCESS;
+    if (!g_file_set_contents (path, text, -1, &error)) {
+        fprintf (stderr, "error: cannot write '%s': %s\n", path, error->message);
+        g_clear_error (&error);
+        rc = EXIT_FAILURE;
+    } else {
+        printf ("Results: %s\n", path);
+    }
+    cJSON_free (text);
+    return rc;
+}
+
+/* Configure at one sweep point and measure a burst. */
+static int
+tune_one (ArvCamera *camera, const char *iface_ip, int binning,
+          double fps, double duration_s, AgTunePoint *p)
+{
+    GError *error = NULL;
+    AgCameraConfig cfg;
+    if (camera_configure (camera, AG_MODE_CONTINUOUS, binning, 0.0, -1.0,
+                          FALSE, (int) p->packet_size, NULL, NULL, iface_ip,
+                          FALSE, &cfg) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    arv_camera_gv_set_packet_delay (camera, (gint64) p->packet_delay_ns, &error);
+    if (error) {
+        fprintf (stderr, "error: set_packet_delay(%u ns) failed: %s\n",
+                 p->packet_delay_ns, error->message);
+        g_clear_error (&error);
+        camera_config_cleanup (&cfg);
+        return EXIT_FAILURE;
+    }
+
+    p->payload = cfg.payload;
+    AgBurstStats st;
+    int rc = ag_trigger_burst (camera, &cfg, fps, duration_s, 0, &g_quit, &st);
+    camera_config_cleanup (&cfg);
+    if (rc != EXIT_SUCCESS)
+        return rc;
+
+    p->completed = st.completed;
+    p->failed    = st.failed;
+    p->resent    = st.resent;
+    p->missing   = st.missing;
+    p->elapsed_s = st.elapsed_s;
+    return EXIT_SUCCESS;
+}
+
+int
+cmd_tune_transport (int argc, char *argv[], arg_dstr_t res, void *ctx)
+{
+    (void) ctx;
+
+    struct arg_str *cmd       = arg_str1 (NULL, NULL, "tune-transport", NULL);
+    struct arg_str *serial    = arg_str0 ("s", "serial",    "<serial>",
+                                          "match by serial number");
+    struct arg_str *address   = arg_str0 ("a", "address",   "<address>",
+                                          "connect by camera IP");
+    struct arg_str *interface = arg_str0 ("i", "interface",  "<iface>",
+                                          "force NIC selection");
+    struct arg_int *binning_a = arg_int0 ("b", "binning",   "<1|2>",
+                                          "sensor binning factor (default: 1)");
+    struct arg_dbl *fps_a     = arg_dbl0 ("f", "fps",       "<rate>",
+                                          "trigger rate in Hz (default: 0 = as fast as the camera re-arms)");
+    struct arg_dbl *duration_a = arg_dbl0 ("d", "duration", "<seconds>",
+                                           "burst length per point (default: 2)");
+    struct arg_str *sizes_a   = arg_str0 (NULL, "sizes",    "<list>",
+                                          "packet sizes to try (default: " TUNE_DEFAULT_SIZES ")");
+    struct arg_str *delays_a  = arg_str0 (NULL, "delays",   "<list>",
+                                          "inter-packet delays in ns (default: " TUNE_DEFAULT_DELAYS ")");
+    struct arg_lit *save_a    = arg_lit0 (NULL, "save",
+                                          "save the best point for this camera");
+    struct arg_lit *show_a    = arg_lit0 (NULL, "show",
+                                          "print the saved profile and exit");
+    struct arg_lit *forget_a  = arg_lit0 (NULL, "forget",
+                                          "delete the saved profile and exit");
+    struct arg_str *json_a    = arg_str0 (NULL, "json", "<out.json>",
+                                          "also write the sweep as JSON");
+    struct arg_lit *help      = arg_lit0 ("h", "help", "print this help");
+    struct arg_end *end       = arg_end (10);
+
+    void *argtable[] = { cmd, serial, address, interface, binning_a, fps_a,
+                         duration_a, sizes_a, delays_a, save_a, show_a,
+                         forget_a, json_a, help, end };
+
+    int exitcode = EXIT_SUCCESS;
+    AgTunePoint *points = NULL;
+    gchar *profile_path = NULL;
+
+    if (arg_nullcheck (argtable) != 0) {
+        arg_dstr_catf (res, "error: insufficient memory\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    /* Defaults. */
+    binning_a->ival[0]  = 1;
+    fps_a->dval[0]      = 0.0;
+    duration_a->dval[0] = 2.0;
+
+    int nerrors = arg_parse (argc, argv, argtable);
+    if (arg_make_syntax_err_help_msg (res, "tune-transport", help->count, nerrors,
+                                       argtable, end, &exitcode))
+        goto done;
+
+    if (serial->count && address->count) {
+        arg_dstr_catf (res, "error: --serial and --address are mutually exclusive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (show_a->count + forget_a->count + save_a->count > 1) {
+        arg_dstr_catf (res, "error: --save, --show and --forget are mutually exclusive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    int binning = binning_a->ival[0];
+    if (binning != 1 && binning != 2) {
+        arg_dstr_catf (res, "error: --binning must be 1 or 2\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    double fps = fps_a->dval[0];
+    if (fps < 0.0 || fps > 120.0) {
+        arg_dstr_catf (res, "error: --fps must be between 0 and 120\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    double duration_s = duration_a->dval[0];
+    if (duration_s <= 0.0) {
+        arg_dstr_catf (res, "error: --duration must be positive\n");
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    guint sizes[AG_TUNE_MAX_VALUES], delays[AG_TUNE_MAX_VALUES];
+    int n_sizes = ag_tune_parse_list (sizes_a->count ? sizes_a->sval[0]
+                                                     : TUNE_DEFAULT_SIZES,
+                                      AG_PACKET_SIZE_MIN, AG_PACKET_SIZE_MAX,
+                                      sizes, AG_TUNE_MAX_VALUES);
+    if (n_sizes < 0) {
+        arg_dstr_catf (res, "error: --sizes takes 1 to %d comma-separated "
+                       "values in %d..%d\n", AG_TUNE_MAX_VALUES,
+                       AG_PACKET_SIZE_MIN, AG_PACKET_SIZE_MAX);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+    int n_delays = ag_tune_parse_list (delays_a->count ? delays_a->sval[0]
+                                                       : TUNE_DEFAULT_DELAYS,
+                                       0, AG_PACKET_DELAY_MAX_NS,
+                                       delays, AG_TUNE_MAX_VALUES);
+    if (n_delays < 0) {
+        arg_dstr_catf (res, "error: --delays takes 1 to %d comma-separated "
+                       "values in 0..%d ns\n", AG_TUNE_MAX_VALUES,
+                       AG_PACKET_DELAY_MAX_NS);
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    const char *opt_serial    = serial->count    ? serial->sval[0]    : NULL;
+    const char *opt_address   = address->count   ? address->sval[0]   : NULL;
+    const char *opt_interface = interface->count  ? interface->sval[0] : NULL;
+
+    const char *iface_ip = NULL;
+    if (opt_interface) {
+        iface_ip = setup_interface (opt_interface);
+        if (!iface_ip) { exitcode = EXIT_FAILURE; goto done; }
+    }
+
+    char *device_id = resolve_device (opt_serial, opt_address,
+                                      opt_interface, TRUE);
+    if (!device_id) { exitcode = EXIT_FAILURE; goto done; }
+
+    GError *error = NULL;
+    ArvCamera *camera = arv_camera_new (device_id, &error);
+    g_free (device_id);
+    if (!camera) {
+        fprintf (stderr, "error: %s\n",
+                 error ? error->message : "failed to open device");
+        g_clear_error (&error);
+        arv_shutdown ();
+        exitcode = EXIT_FAILURE;
+        goto done;
+    }
+
+    const char *cam_serial = arv_camera_get_device_serial_number (camera, NULL);
+    if (!cam_serial || !*cam_serial) {
+        fprintf (stderr, "error: camera reports no serial number\n");
+        exitcode = EXIT_FAILURE;
+        goto out;
+    }
+    profile_path = ag_transport_profile_path (NULL, cam_serial);
+
+    if (show_a->count) {
+        AgTransportProfile prof;
+        if (ag_transport_profile_load (profile_path, &prof) != 0) {
+            printf ("No transport profile for %s (%s)\n", cam_serial,
+                    profile_path);
+        } else {
+            printf ("%s: GevSCPSPacketSize = %u, GevSCPD = %u ns "
+                    "(%.1f MB/s when tuned)\n  %s\n", cam_serial,
+                    prof.packet_size, prof.packet_delay_ns, prof.mb_per_s,
+                    profile_path);
+        }
+        goto out;
+    }
+
+    if (forget_a->count) {
+        if (ag_transport_profile_remove (profile_path) != 0)
+            exitcode = EXIT_FAILURE;
+        else
+            printf ("Removed transport profile for %s\n", cam_serial);
+        goto out;
+    }
+
+    /* Sizes above what the path carries only produce missing packets. */
+    guint path_max = arv_camera_gv_auto_packet_size (camera, &error);
+    if (error) {
+        fprintf (stderr, "warn: auto_packet_size failed: %s; trying every size\n",
+                 error->message);
+        g_clear_error (&error);
+        path_max = AG_PACKET_SIZE_MAX;
+    } else {
+        printf ("Largest packet size the path carries: %u\n", path_max);
+    }
+    gint64 orig_delay = arv_camera_gv_get_packet_delay (camera, NULL);
+
+    points = g_new0 (AgTunePoint, n_sizes * n_delays);
+    int n_points = 0;
+    int n_total = 0;
+    for (int s = 0; s < n_sizes; s++)
+        if (sizes[s] <= path_max)
+            n_total += n_delays;
+    if (n_total == 0) {
+        fprintf (stderr, "error: every --sizes value exceeds %u; "
+                 "enable jumbo frames on the NIC or pick smaller sizes\n",
+                 path_max);
+        exitcode = EXIT_FAILURE;
+        goto out;
+    }
+
+    signal (SIGINT, sigint_handler);
+
+    for (int s = 0; s < n_sizes && !g_quit && exitcode == EXIT_SUCCESS; s++) {
+        if (sizes[s] > path_max) {
+            printf ("\nSkipping packet size %u (> %u)\n", sizes[s], path_max);
+            continue;
+        }
+        for (int d = 0; d < n_delays && !g_quit; d++) {
+            AgTunePoint *p = &points[n_points];
+            p->packet_size     = sizes[s];
+            p->packet_delay_ns = delays[d];
+
+            printf ("\n=== Point %d/%d: packet size %u, delay %u ns "
+                    "(%.0f s) ===\n", n_points + 1, n_total,
+                    sizes[s], delays[d], duration_s);
+            if (tune_one (camera, iface_ip, binning, fps, duration_s,
+                          p) != EXIT_SUCCESS) {
+                exitcode = EXIT_FAILURE;
+                break;
+            }
+            n_points++;
+        }
+    }
+
+    /* The sweep leaves the last point programmed: put the delay back. */
+    arv_camera_gv_set_packet_delay (camera, orig_delay, NULL);
+
+    int best = ag_tune_pick_best (points, n_points);
+    print_points (points, n_points, best);
+
+    if (best < 0) {
+        if (n_points > 0)
+            printf ("\nNo point ran without loss; nothing to save.\n");
+    } else {
+        const AgTunePoint *b = &points[best];
+        printf ("\nBest: packet size %u, delay %u ns (%.1f MB/s)\n",
+                b->packet_size, b->packet_delay_ns, ag_tune_point_mb_per_s (b));
+
+        if (save_a->count) {
+            AgTransportProfile prof = {
+                .packet_size     = b->packet_size,
+                .packet_delay_ns = b->packet_delay_ns,
+                .mb_per_s        = ag_tune_point_mb_per_s (b),
+                .fps             = b->elapsed_s > 0.0
+                                   ? (double) b->completed / b->elapsed_s : 0.0,
+            };
+            if (ag_transport_profile_save (profile_path, cam_serial, &prof) != 0)
+                exitcode = EXIT_FAILURE;
+            else
+                printf ("Saved: %s\n"
+                        "Applied automatically when -p/--packet-size is not given.\n",
+                        profile_path);
+        } else {
+            printf ("Re-run with --save to apply it automatically.\n");
+        }
+    }
+
+    if (json_a->count && n_points > 0 &&
+        write_points_json (json_a->sval[0], cam_serial, points, n_points,
+                           best) != EXIT_SUCCESS)
+        exitcode = EXIT_FAILURE;
+
+out:
+    g_object_unref (camera);
+    arv_shutdown ();
+
+done:
+    g_free (points);
+    g_free (profile_path);
+    arg_freetable (argtable, sizeof argtable / sizeof argtable[0]);
+    return exitcode;
+}
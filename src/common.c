@@ -4,6 +4,7 @@
 
 #include "common.h"
 #include "imgproc.h"
+#include "transport_profile.h"
 
 #include <ifaddrs.h>
 #include <netinet/in.h>
@@ -126,8 +127,17 @@ char *
 resolve_device (const char *serial, const char *address,
                 const char *interface_name, gboolean interactive)
 {
-    /* Direct address path. */
+    /* Direct address path.  A literal IPv4 address needs no discovery
+     * broadcast (the slowest step of a cold start). */
     if (address) {
+        struct in_addr literal;
+        if (inet_pton (AF_INET, address, &literal) == 1) {
+            if (interface_name && !device_on_interface (address, interface_name))
+                fprintf (stderr, "warn: %s is not on interface %s's subnet\n",
+                         address, interface_name);
+            printf ("Connecting to %s directly (discovery skipped).\n", address);
+            return g_strdup (address);
+        }
         char *id = resolve_device_id_by_address (address, interface_name);
         if (id) {
             printf ("Using discovered device id: %s\n", id);
@@ -232,10 +242,25 @@ resolve_device (const char *serial, const char *address,
 /*  Aravis feature helpers                                            */
 /* ================================================================== */
 
+/* Writes issued / skipped as already set, since the last
+ * camera_configure(). */
+static guint feature_writes_sent;
+static guint feature_writes_skipped;
+
 void
 try_set_string_feature (ArvDevice *device, const char *name, const char *value)
 {
     GError *error = NULL;
+    const char *current = arv_device_get_string_feature_value (device, name,
+                                                               &error);
+    if (!error && current && strcmp (current, value) == 0) {
+        feature_writes_skipped++;
+        printf ("  %s = %s (unchanged)\n", name, value);
+        return;
+    }
+    g_clear_error (&error);
+
+    feature_writes_sent++;
     arv_device_set_string_feature_value (device, name, value, &error);
     if (error) {
         fprintf (stderr, "warn: failed to set %s=%s: %s\n",
@@ -250,6 +275,15 @@ void
 try_set_integer_feature (ArvDevice *device, const char *name, gint64 value)
 {
     GError *error = NULL;
+    gint64 current = arv_device_get_integer_feature_value (device, name, &error);
+    if (!error && current == value) {
+        feature_writes_skipped++;
+        printf ("  %s = %" G_GINT64_FORMAT " (unchanged)\n", name, value);
+        return;
+    }
+    g_clear_error (&error);
+
+    feature_writes_sent++;
     arv_device_set_integer_feature_value (device, name, value, &error);
     if (error) {
         fprintf (stderr, "warn: failed to set %s=%" G_GINT64_FORMAT ": %s\n",
@@ -264,6 +298,15 @@ void
 try_set_float_feature (ArvDevice *device, const char *name, double value)
 {
     GError *error = NULL;
+    double current = arv_device_get_float_feature_value (device, name, &error);
+    if (!error && fabs (current - value) <= 1e-9 * fmax (1.0, fabs (value))) {
+        feature_writes_skipped++;
+        printf ("  %s = %g (unchanged)\n", name, value);
+        return;
+    }
+    g_clear_error (&error);
+
+    feature_writes_sent++;
     arv_device_set_float_feature_value (device, name, value, &error);
     if (error) {
         fprintf (stderr, "warn: failed to set %s=%g: %s\n",
@@ -341,24 +384,76 @@ try_execute_optional_command (ArvDevice *device, const char *name)
 /*  Unified camera configuration                                      */
 /* ================================================================== */
 
+/*
+ * Wait up to timeout_us for a stopped camera to report
+ * AcquisitionStatus = false.  An idle camera answers on the first read;
+ * cameras without the feature get the full timeout as a fixed settle.
+ */
+static void
+wait_acquisition_idle (ArvDevice *device, guint timeout_us)
+{
+    GError *error = NULL;
+    gint64 deadline = g_get_monotonic_time () + timeout_us;
+
+    gboolean available = arv_device_is_feature_available (device,
+                                                          "AcquisitionStatus",
+                                                          &error);
+    if (error || !available) {
+        g_clear_error (&error);
+        g_usleep (timeout_us);
+        return;
+    }
+    arv_device_set_string_feature_value (device, "AcquisitionStatusSelector",
+                                         "AcquisitionActive", &error);
+    g_clear_error (&error);
+
+    for (;;) {
+        gboolean active = arv_device_get_boolean_feature_value (
+            device, "AcquisitionStatus", &error);
+        gint64 remaining = deadline - g_get_monotonic_time ();
+        if (error) {
+            g_clear_error (&error);
+            if (remaining > 0)
+                g_usleep ((gulong) remaining);
+            return;
+        }
+        if (!active)
+            return;
+        if (remaining <= 0) {
+            fprintf (stderr, "warn: camera still reports AcquisitionActive "
+                     "after %u ms\n", timeout_us / 1000);
+            return;
+        }
+        g_usleep (2000);
+    }
+}
+
 int
 camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
                   int binning, double exposure_us, double gain_db,
                   gboolean auto_expose, int packet_size,
+                  const AgTransportOptions *transport,
+                  const AgRoi *roi,
                   const char *iface_ip, gboolean verbose,
                   AgCameraConfig *out)
 {
     GError *error = NULL;
     ArvDevice *device = arv_camera_get_device (camera);
+    static const AgTransportOptions default_transport = { 0 };
+    if (!transport)
+        transport = &default_transport;
 
     memset (out, 0, sizeof *out);
     out->software_binning = 1;
+    feature_writes_sent    = 0;
+    feature_writes_skipped = 0;
 
     /* Stop any stale acquisition. */
     printf ("Stopping any stale acquisition...\n");
     arv_camera_stop_acquisition (camera, NULL);
     try_execute_optional_command (device, "TransferStop");
-    g_usleep (100000);
+    wait_acquisition_idle (device, 100000);
+    ag_startup_mark ("stop acquisition");
 
     printf ("Configuring...\n");
 
@@ -394,17 +489,49 @@ camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
                  eff_bin_h, eff_bin_v, out->software_binning);
     }
 
-    /* Geometry. */
+    /* Geometry.  Offsets go to zero first so any window size is legal,
+     * then back up once the size is set. */
     try_set_integer_feature (device, "OffsetX", 0);
     try_set_integer_feature (device, "OffsetY", 0);
     gint64 target_w = (eff_bin_h > 0) ? (AG_SENSOR_WIDTH  / eff_bin_h) : AG_SENSOR_WIDTH;
     gint64 target_h = (eff_bin_v > 0) ? (AG_SENSOR_HEIGHT / eff_bin_v) : AG_SENSOR_HEIGHT;
+    gint64 off_x = 0, off_y = 0;
+    if (ag_roi_active (roi)) {
+        /* ROI is per eye in processed pixels: eyes are byte-interleaved
+         * across the row, and software binning halves both axes later. */
+        gint64 sb = out->software_binning;
+        target_w = 2 * (gint64) roi->width  * sb;
+        target_h =     (gint64) roi->height * sb;
+        off_x    = 2 * (gint64) roi->x      * sb;
+        off_y    =     (gint64) roi->y      * sb;
+    }
     try_set_integer_feature (device, "Width",  target_w);
     try_set_integer_feature (device, "Height", target_h);
+    if (off_x) try_set_integer_feature (device, "OffsetX", off_x);
+    if (off_y) try_set_integer_feature (device, "OffsetY", off_y);
 
     gint64 width_rb  = read_integer_feature_or_default (device, "Width",  target_w);
     gint64 height_rb = read_integer_feature_or_default (device, "Height", target_h);
-    if (width_rb != target_w || height_rb != target_h) {
+    if (ag_roi_active (roi)) {
+        gint64 off_x_rb = read_integer_feature_or_default (device, "OffsetX", off_x);
+        gint64 off_y_rb = read_integer_feature_or_default (device, "OffsetY", off_y);
+        if (width_rb != target_w || height_rb != target_h ||
+            off_x_rb != off_x || off_y_rb != off_y) {
+            fprintf (stderr,
+                     "error: camera set ROI %" G_GINT64_FORMAT "x%" G_GINT64_FORMAT
+                     "+%" G_GINT64_FORMAT "+%" G_GINT64_FORMAT " (requested %"
+                     G_GINT64_FORMAT "x%" G_GINT64_FORMAT "+%" G_GINT64_FORMAT
+                     "+%" G_GINT64_FORMAT "); check its Width/Offset increments\n",
+                     width_rb, height_rb, off_x_rb, off_y_rb,
+                     target_w, target_h, off_x, off_y);
+            return EXIT_FAILURE;
+        }
+        out->roi = *roi;
+        printf ("  ROI = rows %u..%u, cols %u..%u per eye "
+                "(%" G_GINT64_FORMAT "x%" G_GINT64_FORMAT " on the wire)\n",
+                roi->y, roi->y + roi->height - 1,
+                roi->x, roi->x + roi->width - 1, target_w, target_h);
+    } else if (width_rb != target_w || height_rb != target_h) {
         fprintf (stderr,
                  "warn: geometry readback is %" G_GINT64_FORMAT "x%" G_GINT64_FORMAT
                  " (requested %" G_GINT64_FORMAT "x%" G_GINT64_FORMAT ")\n",
@@ -465,12 +592,57 @@ camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
     try_set_integer_feature (device, "TransferSelector", 0);
     try_set_string_feature  (device, "TransferControlMode", "Automatic");
     try_set_string_feature  (device, "TransferQueueMode", "FirstInFirstOut");
-    /* macOS: disable PF_PACKET sockets. */
+    printf ("  feature writes: %u sent, %u unchanged\n",
+            feature_writes_sent, feature_writes_skipped);
+    ag_startup_mark ("configure features");
+
+    /* PF_PACKET receive (Linux): Aravis reads GVSP from an mmap'd ring
+     * instead of one recvmsg per packet.  Unavailable on macOS. */
+    const char *psock_reason = NULL;
+    gboolean psock = ag_packet_socket_resolve (transport->packet_socket,
+                                               &psock_reason);
     arv_camera_gv_set_stream_options (camera,
-                                       ARV_GV_STREAM_OPTION_PACKET_SOCKET_DISABLED);
+        psock ? ARV_GV_STREAM_OPTION_NONE
+              : ARV_GV_STREAM_OPTION_PACKET_SOCKET_DISABLED);
+    if (psock && !ag_packet_socket_permitted ())
+        fprintf (stderr, "warn: packet socket %s\n", psock_reason);
+    printf ("  packet socket = %s (%s)\n", psock ? "on" : "off", psock_reason);
+
+    /* Packet size: explicit value, the tuned profile for this serial, or
+     * auto-negotiation. */
+    gboolean tuned = FALSE;
+    if (packet_size <= 0) {
+        const char *serial = arv_camera_get_device_serial_number (camera, NULL);
+        AgTransportProfile profile;
+        gchar *path = serial ? ag_transport_profile_path (NULL, serial) : NULL;
+        if (path && ag_transport_profile_load (path, &profile) == 0) {
+            arv_camera_gv_set_packet_size (camera, (gint) profile.packet_size,
+                                           &error);
+            if (error) {
+                fprintf (stderr, "warn: tuned packet size %u rejected: %s; "
+                         "re-run tune-transport\n",
+                         profile.packet_size, error->message);
+                g_clear_error (&error);
+            } else {
+                arv_camera_gv_set_packet_delay (camera,
+                                                (gint64) profile.packet_delay_ns,
+                                                &error);
+                if (error) {
+                    fprintf (stderr, "warn: set_packet_delay(%u ns) failed: %s\n",
+                             profile.packet_delay_ns, error->message);
+                    g_clear_error (&error);
+                }
+                printf ("  GevSCPSPacketSize = %u, GevSCPD = %u ns (tuned, %s)\n",
+                        profile.packet_size, profile.packet_delay_ns, path);
+                tuned = TRUE;
+            }
+        }
+        g_free (path);
+    }
 
-    /* Packet size: auto-negotiate (0) or explicit value. */
-    if (packet_size > 0) {
+    if (tuned) {
+        /* Applied above. */
+    } else if (packet_size > 0) {
         try_set_integer_feature (device, "GevSCPSPacketSize", (gint64) packet_size);
         arv_camera_gv_set_packet_size (camera, packet_size, &error);
         if (error) {
@@ -493,6 +665,8 @@ camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
         }
     }
 
+    ag_startup_mark ("packet size");
+
     /* Create stream. */
     ArvStream *stream = arv_camera_create_stream (camera, NULL, NULL, &error);
     if (!stream) {
@@ -505,11 +679,32 @@ camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
     /* Tight timeouts: fail fast on packet loss rather than stalling the
      * pipeline.  Dropped frames are preferable to multi-second hangs. */
     if (ARV_IS_GV_STREAM (stream)) {
+        guint packet_timeout = transport->packet_timeout_us
+                               ? transport->packet_timeout_us
+                               : AG_PACKET_TIMEOUT_DEFAULT_US;
+        guint frame_retention = transport->frame_retention_us
+                                ? transport->frame_retention_us
+                                : AG_FRAME_RETENTION_DEFAULT_US;
+        ArvGvStreamPacketResend resend =
+            (transport->packet_resend == AG_RESEND_NEVER)
+            ? ARV_GV_STREAM_PACKET_RESEND_NEVER
+            : ARV_GV_STREAM_PACKET_RESEND_ALWAYS;
         g_object_set (stream,
-                      "packet-resend",   ARV_GV_STREAM_PACKET_RESEND_ALWAYS,
-                      "packet-timeout",  (guint) 20000,     /* 20 ms  */
-                      "frame-retention", (guint) 200000,    /* 200 ms */
+                      "packet-resend",   resend,
+                      "packet-timeout",  packet_timeout,
+                      "frame-retention", frame_retention,
                       NULL);
+
+        /* Receive buffer: Aravis sizes it from the payload by default;
+         * a fixed size helps hosts with small net.core.rmem_max. */
+        if (transport->socket_buffer > 0) {
+            g_object_set (stream,
+                          "socket-buffer",      ARV_GV_STREAM_SOCKET_BUFFER_FIXED,
+                          "socket-buffer-size", (gint) transport->socket_buffer,
+                          NULL);
+            printf ("  socket buffer = %u bytes (fixed)\n",
+                    transport->socket_buffer);
+        }
         if (verbose) {
             guint pt = 0, fr = 0;
             g_object_get (stream, "packet-timeout", &pt, "frame-retention", &fr, NULL);
@@ -554,9 +749,21 @@ camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
     printf ("  payload = %zu bytes\n", payload);
     out->payload = payload;
 
-    int nbuf = (mode == AG_MODE_SINGLE_FRAME) ? 8 : 16;
-    for (int i = 0; i < nbuf; i++)
-        arv_stream_push_buffer (stream, arv_buffer_new_allocate (payload));
+    /* One contiguous, locked region backs every buffer, so a receive
+     * burst never waits on the allocator or a page fault. */
+    guint nbuf = (mode == AG_MODE_SINGLE_FRAME) ? 8 : 16;
+    if (transport && transport->stream_buffers > 0)
+        nbuf = transport->stream_buffers;
+    out->pool = ag_stream_pool_new (nbuf, payload);
+    for (guint i = 0; i < nbuf; i++)
+        arv_stream_push_buffer (stream,
+            arv_buffer_new (payload, ag_stream_pool_slot (out->pool, i)));
+    printf ("  stream buffers = %u x %zu bytes (%.1f MB, %s%s)\n",
+            nbuf, payload,
+            ag_stream_pool_bytes (out->pool) / (1024.0 * 1024.0),
+            ag_stream_pool_backing_name (out->pool),
+            ag_stream_pool_locked (out->pool) ? ", locked" : "");
+    ag_startup_mark ("create stream");
 
     /* Verbose diagnostic readback. */
     if (verbose) {
@@ -617,8 +824,126 @@ camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
     return EXIT_SUCCESS;
 }
 
+void
+camera_config_cleanup (AgCameraConfig *cfg)
+{
+    /* The stream's receive thread writes into the pool: stop it first. */
+    if (cfg->stream) {
+        g_object_unref (cfg->stream);
+        cfg->stream = NULL;
+    }
+    ag_stream_pool_free (cfg->pool);
+    cfg->pool = NULL;
+}
+
+/* ================================================================== */
+/*  Trigger pacing                                                    */
+/* ================================================================== */
+
+void
+ag_pace_trigger (gint64 *next_us, guint64 interval_us)
+{
+    gint64 now = g_get_monotonic_time ();
+    if (*next_us == 0)
+        *next_us = now;
+
+    *next_us += (gint64) interval_us;
+    if (*next_us > now)
+        g_usleep ((gulong) (*next_us - now));
+    else
+        *next_us = now;
+}
+
+/* ================================================================== */
+/*  Trigger bursts (throughput measurement)                           */
+/* ================================================================== */
+
+static void
+burst_tally (ArvBuffer *buffer, AgBurstStats *out)
+{
+    if (arv_buffer_get_status (buffer) == ARV_BUFFER_STATUS_SUCCESS)
+        out->completed++;
+    else
+        out->failed++;
+}
+
+int
+ag_trigger_burst (ArvCamera *camera, AgCameraConfig *cfg,
+                  double fps, double duration_s,
+                  guint frame_retention_us,
+                  const volatile sig_atomic_t *quit,
+                  AgBurstStats *out)
+{
+    GError *error = NULL;
+    ArvDevice *device = arv_camera_get_device (camera);
+    memset (out, 0, sizeof *out);
+
+    arv_camera_start_acquisition (camera, &error);
+    if (error) {
+        fprintf (stderr, "error: failed to start acquisition: %s\n",
+                 error->message);
+        g_clear_error (&error);
+        return EXIT_FAILURE;
+    }
+
+    guint64 trigger_interval_us = (fps > 0.0) ? (guint64) (1000000.0 / fps) : 0;
+    gint64  next_trigger_us = 0;
+    GTimer *timer = g_timer_new ();
+
+    while (!(quit && *quit) && g_timer_elapsed (timer, NULL) < duration_s) {
+        gboolean armed = FALSE;
+        for (int polls = 0; polls < 50 && !armed; polls++) {
+            GError *e = NULL;
+            armed = arv_device_get_boolean_feature_value (device,
+                                                          "TriggerArmed", &e);
+            g_clear_error (&e);
+            if (!armed)
+                g_usleep (1000);
+        }
+
+        if (armed) {
+            GError *e = NULL;
+            arv_device_execute_command (device, "TriggerSoftware", &e);
+            if (e)
+                g_clear_error (&e);
+            else
+                out->triggered++;
+        }
+
+        ArvBuffer *buffer;
+        while ((buffer = arv_stream_try_pop_buffer (cfg->stream)) != NULL) {
+            burst_tally (buffer, out);
+            arv_stream_push_buffer (cfg->stream, buffer);
+        }
+        if (trigger_interval_us > 0)
+            ag_pace_trigger (&next_trigger_us, trigger_interval_us);
+    }
+
+    /* Collect frames still in flight, up to one frame-retention period. */
+    guint retention_us = frame_retention_us ? frame_retention_us
+                                            : AG_FRAME_RETENTION_DEFAULT_US;
+    gint64 deadline = g_get_monotonic_time () + retention_us + 100000;
+    while (out->completed + out->failed < out->triggered &&
+           g_get_monotonic_time () < deadline) {
+        ArvBuffer *buffer = arv_stream_timeout_pop_buffer (cfg->stream, 10000);
+        if (!buffer)
+            continue;
+        burst_tally (buffer, out);
+        arv_stream_push_buffer (cfg->stream, buffer);
+    }
+    out->elapsed_s = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    if (ARV_IS_GV_STREAM (cfg->stream))
+        arv_gv_stream_get_statistics (ARV_GV_STREAM (cfg->stream),
+                                      &out->resent, &out->missing);
+
+    arv_camera_stop_acquisition (camera, NULL);
+    return EXIT_SUCCESS;
+}
+
 /* ================================================================== */
-/*  Auto-exposure settle-and-lock                                      */
+/*  Auto-exposure                                                      */
 /* ================================================================== */
 
 #define AE_MAX_FRAMES    50
@@ -626,13 +951,21 @@ camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
 #define AE_MIN_FRAMES     8   /* warm-up: let the algorithm run before checking */
 #define AE_TOLERANCE      0.02   /* 2 % */
 
+#define AE_HOST_MAX_FRAMES  16
+#define AE_HOST_SETTLED      2   /* consecutive frames inside the deadband */
+#define AE_HOST_GAIN_MAX    24.0 /* dB, as GainAutoUpperLimit in camera mode */
+#define AE_BALANCE_WARN      0.10 /* left/right mean mismatch worth a warning */
+
 /*
- * Fire one software trigger and pop the resulting buffer (discarded).
+ * Fire one software trigger and pop the resulting buffer.  With ae
+ * non-NULL the frame is metered (auto_expose_track, through meter)
+ * before it is returned to the stream; otherwise it is discarded.
  * Returns TRUE if a buffer was successfully received.
  */
 static gboolean
 ae_trigger_and_discard (ArvDevice *device, AgCameraConfig *cfg,
-                        double trigger_interval_us)
+                        double trigger_interval_us,
+                        const AgAeMeter *meter, AgAeController *ae)
 {
     /* Wait for TriggerArmed. */
     gboolean armed = FALSE;
@@ -658,18 +991,133 @@ ae_trigger_and_discard (ArvDevice *device, AgCameraConfig *cfg,
         return FALSE;
     }
 
-    /* Pop and discard the frame. */
+    /* Pop, meter if asked, and requeue the frame. */
     ArvBuffer *buf = arv_stream_timeout_pop_buffer (cfg->stream, 2000000);
-    if (buf) {
-        arv_stream_push_buffer (cfg->stream, buf);
-        return TRUE;
+    if (!buf)
+        return FALSE;
+
+    gboolean ok = TRUE;
+    if (ae) {
+        size_t size = 0;
+        const guint8 *data = arv_buffer_get_data (buf, &size);
+        ok = arv_buffer_get_status (buf) == ARV_BUFFER_STATUS_SUCCESS &&
+             data && size >= (size_t) cfg->frame_w * cfg->frame_h;
+        if (ok)
+            auto_expose_track (device, ae, meter, data,
+                               cfg->frame_w, cfg->frame_h);
     }
-    return FALSE;
+    arv_stream_push_buffer (cfg->stream, buf);
+    return ok;
 }
 
-int
-auto_expose_settle (ArvCamera *camera, AgCameraConfig *cfg,
-                    double trigger_interval_us)
+/* Write the controller's command; FALSE (after a warning) on failure. */
+static gboolean
+ae_write (ArvDevice *device, const AgAeController *ae)
+{
+    GError *error = NULL;
+    arv_device_set_float_feature_value (device, "ExposureTime",
+                                        ae->exposure_us, &error);
+    if (!error)
+        arv_device_set_float_feature_value (device, "Gain", ae->gain_db,
+                                            &error);
+    if (error) {
+        fprintf (stderr, "warn: auto-exposure write failed: %s\n",
+                 error->message);
+        g_clear_error (&error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean
+auto_expose_track (ArvDevice *device, AgAeController *ae,
+                   const AgAeMeter *meter,
+                   const guint8 *data, guint width, guint height)
+{
+    AgAeHistogram hist;
+    if (meter && meter->frame_w == width)
+        ag_ae_meter_histogram (meter, data, &hist);
+    else
+        ag_ae_histogram (data, width, height, AG_AE_SAMPLE_STEP, &hist);
+    if (!ag_ae_controller_update (ae, &hist))
+        return FALSE;
+    return ae_write (device, ae);
+}
+
+static int
+ae_settle_host (ArvCamera *camera, AgCameraConfig *cfg,
+                double trigger_interval_us, const AgAeMeter *meter,
+                AgAeController *ae)
+{
+    ArvDevice *device = arv_camera_get_device (camera);
+    GError *error = NULL;
+
+    try_set_string_feature (device, "ExposureAuto", "Off");
+    try_set_string_feature (device, "GainAuto",     "Off");
+
+    double exp_us = 10000.0, gain_db = 0.0;
+    try_get_float_feature (device, "ExposureTime", &exp_us);
+    try_get_float_feature (device, "Gain",         &gain_db);
+
+    double exp_min = 20.0, exp_max = 1000000.0;
+    arv_device_get_float_feature_bounds (device, "ExposureTime",
+                                         &exp_min, &exp_max, &error);
+    g_clear_error (&error);
+    double gain_min = 0.0, gain_max = AE_HOST_GAIN_MAX;
+    arv_device_get_float_feature_bounds (device, "Gain",
+                                         &gain_min, &gain_max, &error);
+    g_clear_error (&error);
+
+    /* Keep the exposure inside the trigger period so AE never lowers
+     * the frame rate. */
+    if (trigger_interval_us > 0.0)
+        exp_max = MIN (exp_max, 0.9 * trigger_interval_us);
+    gain_max = MIN (gain_max, AE_HOST_GAIN_MAX);
+
+    ag_ae_controller_init (ae, exp_us, gain_db, exp_min, exp_max,
+                           gain_min, gain_max);
+    printf ("Auto-exposure (host): target level %.0f, "
+            "exposure %.0f..%.0f us, gain %.1f..%.1f dB\n",
+            ae->target, ae->exposure_min_us, ae->exposure_max_us,
+            ae->gain_min_db, ae->gain_max_db);
+    if (meter)
+        printf ("  metering: rectified stereo overlap (%u samples per eye)\n",
+                meter->n);
+    else
+        printf ("  metering: whole frame\n");
+
+    int frames = 0;
+    for (int i = 0; i < AE_HOST_MAX_FRAMES && ae->settled < AE_HOST_SETTLED;
+         i++) {
+        if (!ae_trigger_and_discard (device, cfg, trigger_interval_us,
+                                     meter, ae))
+            continue;
+        frames++;
+        printf ("  frame %d  level %.0f  L/R %.2f  ExposureTime = %.1f us  "
+                "Gain = %.1f dB\n",
+                frames, ae->brightness, ae->balance, ae->exposure_us,
+                ae->gain_db);
+    }
+
+    if (ae->settled >= AE_HOST_SETTLED)
+        printf ("Auto-exposure: settled after %d frames\n", frames);
+    else
+        fprintf (stderr, "warn: auto-exposure did not settle within %d "
+                 "frames (level %.0f)\n", AE_HOST_MAX_FRAMES, ae->brightness);
+
+    /* One exposure drives both heads, so a persistent mismatch is in
+     * the optics or sensors, not the controller. */
+    if (fabs (ae->balance - 1.0) > AE_BALANCE_WARN)
+        fprintf (stderr, "warn: left eye is %.0f%% %s than right at equal "
+                 "exposure; check apertures and lens caps\n",
+                 fabs (ae->balance - 1.0) * 100.0,
+                 ae->balance > 1.0 ? "brighter" : "darker");
+    return EXIT_SUCCESS;
+}
+
+static int
+ae_settle_camera (ArvCamera *camera, AgCameraConfig *cfg,
+                  double trigger_interval_us)
 {
     ArvDevice *device = arv_camera_get_device (camera);
     double history[AE_HISTORY] = {0};
@@ -679,7 +1127,8 @@ auto_expose_settle (ArvCamera *camera, AgCameraConfig *cfg,
 
     for (int i = 0; i < AE_MAX_FRAMES; i++) {
 
-        if (!ae_trigger_and_discard (device, cfg, trigger_interval_us))
+        if (!ae_trigger_and_discard (device, cfg, trigger_interval_us,
+                                     NULL, NULL))
             continue;
 
         /* Read back current exposure time and gain. */
@@ -736,7 +1185,150 @@ lock:
     g_usleep (200000);   /* 200 ms */
 
     for (int d = 0; d < 3; d++)
-        ae_trigger_and_discard (device, cfg, trigger_interval_us);
+        ae_trigger_and_discard (device, cfg, trigger_interval_us, NULL, NULL);
 
     return EXIT_SUCCESS;
 }
+
+int
+auto_expose_settle (ArvCamera *camera, AgCameraConfig *cfg,
+                    AgAeMode mode, double trigger_interval_us,
+                    const AgAeMeter *meter, AgAeController *ae)
+{
+    if (mode == AG_AE_CAMERA)
+        return ae_settle_camera (camera, cfg, trigger_interval_us);
+
+    AgAeController local;
+    return ae_settle_host (camera, cfg, trigger_interval_us, meter,
+                           ae ? ae : &local);
+}
+
+/* ================================================================== */
+/*  Stream metrics                                                    */
+/* ================================================================== */
+
+void
+ag_stream_metrics_init (AgStreamMetrics *m)
+{
+    static const char *const reasons[AG_DROP_COUNT] = {
+        [AG_DROP_TIMEOUT] = "timeout",
+        [AG_DROP_STATUS]  = "status",
+        [AG_DROP_SIZE]    = "size",
+    };
+
+    m->frames = ag_metrics_counter ("ag_frames_total", NULL,
+                                    "Frames processed and displayed.");
+    for (int r = 0; r < AG_DROP_COUNT; r++) {
+        char labels[32];
+        snprintf (labels, sizeof labels, "reason=\"%s\"", reasons[r]);
+        m->drops[r] = ag_metrics_counter ("ag_frames_dropped_total", labels,
+                                          "Triggered frames not displayed, by reason.");
+    }
+    m->arv_completed = ag_metrics_counter ("ag_arv_buffers_completed_total", NULL,
+                                           "Aravis stream: completed buffers.");
+    m->arv_failures  = ag_metrics_counter ("ag_arv_buffers_failed_total", NULL,
+                                           "Aravis stream: failed buffers.");
+    m->arv_underruns = ag_metrics_counter ("ag_arv_buffer_underruns_total", NULL,
+                                           "Aravis stream: frames lost to an empty input queue.");
+    m->gv_resent     = ag_metrics_counter ("ag_gv_packets_resent_total", NULL,
+                                           "GigE Vision stream: packets resent.");
+    m->gv_missing    = ag_metrics_counter ("ag_gv_packets_missing_total", NULL,
+                                           "GigE Vision stream: packets missing.");
+    m->fps = ag_metrics_gauge ("ag_fps", NULL,
+                               "Displayed frame rate over the last stats interval.");
+    m->buffers          = ag_metrics_gauge ("ag_stream_buffers", NULL,
+                                            "Stream buffers in the preallocated pool.");
+    m->buffers_free     = ag_metrics_gauge ("ag_stream_buffers_free", NULL,
+                                            "Stream buffers queued for the receiver at the last frame.");
+    m->buffers_free_min = ag_metrics_gauge ("ag_stream_buffers_free_min", NULL,
+                                            "Lowest ag_stream_buffers_free seen this run.");
+    m->pool_empty       = ag_metrics_counter ("ag_stream_pool_empty_total", NULL,
+                                              "Frames at which no stream buffer was free.");
+}
+
+void
+ag_stream_metrics_set_pool (AgStreamMetrics *m, guint n_buffers)
+{
+    m->n_buffers        = n_buffers;
+    m->min_free_buffers = n_buffers;
+    ag_gauge_set (m->buffers, n_buffers);
+    ag_gauge_set (m->buffers_free_min, n_buffers);
+}
+
+void
+ag_stream_metrics_frame (AgStreamMetrics *m)
+{
+    m->total_frames++;
+    ag_counter_inc (m->frames);
+}
+
+void
+ag_stream_metrics_drop (AgStreamMetrics *m, AgDropReason reason)
+{
+    if ((unsigned) reason < AG_DROP_COUNT) {
+        m->total_drops[reason]++;
+        ag_counter_inc (m->drops[reason]);
+    }
+}
+
+void
+ag_stream_metrics_update (AgStreamMetrics *m, ArvStream *stream)
+{
+    if (!stream)
+        return;
+
+    guint64 completed = 0, failures = 0, underruns = 0;
+    arv_stream_get_statistics (stream, &completed, &failures, &underruns);
+    m->total_arv_underruns = underruns;
+
+    if (m->n_buffers > 0) {
+        gint n_input = 0, n_output = 0;
+        arv_stream_get_n_buffers (stream, &n_input, &n_output);
+        guint n_free = (n_input > 0) ? (guint) n_input : 0;
+        if (n_free < m->min_free_buffers)
+            m->min_free_buffers = n_free;
+        if (n_free == 0) {
+            m->total_pool_empty++;
+            ag_counter_inc (m->pool_empty);
+        }
+        ag_gauge_set (m->buffers_free, n_free);
+        ag_gauge_set (m->buffers_free_min, m->min_free_buffers);
+    }
+
+    if (!m->frames)
+        return;
+
+    ag_counter_set (m->arv_completed, completed);
+    ag_counter_set (m->arv_failures,  failures);
+    ag_counter_set (m->arv_underruns, underruns);
+
+    if (ARV_IS_GV_STREAM (stream)) {
+        guint64 resent = 0, missing = 0;
+        arv_gv_stream_get_statistics (ARV_GV_STREAM (stream), &resent, &missing);
+        ag_counter_set (m->gv_resent,  resent);
+        ag_counter_set (m->gv_missing, missing);
+    }
+}
+
+void
+ag_stream_metrics_print_summary (const AgStreamMetrics *m, double elapsed_s)
+{
+    guint64 dropped = 0;
+    for (int r = 0; r < AG_DROP_COUNT; r++)
+        dropped += m->total_drops[r];
+
+    printf ("Summary: %" G_GUINT64_FORMAT " frames in %.1f s (%.2f fps), "
+            "dropped %" G_GUINT64_FORMAT " (timeout %" G_GUINT64_FORMAT
+            ", status %" G_GUINT64_FORMAT ", size %" G_GUINT64_FORMAT ")\n",
+            m->total_frames, elapsed_s,
+            elapsed_s > 0.0 ? (double) m->total_frames / elapsed_s : 0.0,
+            dropped, m->total_drops[AG_DROP_TIMEOUT],
+            m->total_drops[AG_DROP_STATUS], m->total_drops[AG_DROP_SIZE]);
+
+    if (m->n_buffers > 0)
+        printf ("Buffers: %u in pool, min free %u, empty %" G_GUINT64_FORMAT
+                " of %" G_GUINT64_FORMAT " samples, %" G_GUINT64_FORMAT
+                " underruns\n",
+                m->n_buffers, m->min_free_buffers, m->total_pool_empty,
+                m->total_frames, m->total_arv_underruns);
+}
@@ -7,8 +7,15 @@
 
 #include <arv.h>
 #include <glib.h>
+#include <signal.h>
 
+#include "autoexpose.h"
 #include "imgproc.h"
+#include "metrics.h"
+#include "roi.h"
+#include "startup.h"
+#include "stream_pool.h"
+#include "transport.h"
 
 /* Calibration metadata (shared by calib_archive, depth-preview, etc.). */
 typedef struct {
@@ -16,6 +23,13 @@ typedef struct {
     int    num_disparities;
     double focal_length_px;
     double baseline_cm;
+    /* Rectified principal points (P1/P2), full-frame pixels.  FALSE
+     * when the session carries neither principal_point_right_px nor
+     * proj_mats_*.npy. */
+    gboolean has_projection;
+    double   cx_left;
+    double   cx_right;
+    double   cy;
 } AgCalibMeta;
 
 /* Sensor geometry for the PDH016S (DualBayerRG8). */
@@ -36,6 +50,8 @@ typedef struct {
     int        software_binning; /* >1 if HW binning unavailable */
     size_t     payload;
     gboolean   data_is_bayer;    /* FALSE when eff. binning > 1 */
+    AgStreamPool *pool;          /* backing store of the stream buffers */
+    AgRoi      roi;              /* per-eye processed px; height 0 = full */
 } AgCameraConfig;
 
 /* --- Network helpers --- */
@@ -50,6 +66,8 @@ char       *resolve_device_id_by_address (const char *address,
  * Resolve a camera from --serial, --address, or interactive picker.
  * Pass NULL for serial/address if unused.  When interactive is TRUE and
  * neither serial nor address is given, presents a numbered menu.
+ * A dotted IPv4 address is returned as-is without a discovery broadcast;
+ * Aravis opens the camera by unicast.
  * Returns g_strdup'd device ID; caller must g_free.
  */
 char *resolve_device (const char *serial, const char *address,
@@ -63,6 +81,12 @@ const char *setup_interface (const char *interface_name);
 
 /* --- Aravis feature helpers --- */
 
+/*
+ * The try_set_* helpers read the feature first and skip the write when
+ * the camera already holds the value, so reconfiguring a warm camera
+ * costs reads only.  Failures are reported as warnings.
+ */
+
 void     try_set_string_feature  (ArvDevice *dev, const char *name,
                                   const char *value);
 void     try_set_integer_feature (ArvDevice *dev, const char *name,
@@ -84,22 +108,164 @@ void     try_execute_optional_command (ArvDevice *dev, const char *name);
  * transport/stream, push buffers.  On success fills *out and returns 0.
  * On failure prints an error and returns EXIT_FAILURE.
  *
+ * The stream buffers are preallocated from one locked AgStreamPool.
+ * transport (see transport.h) tunes the pool depth and GVSP receive
+ * path; pass NULL for the defaults.
+ *
+ * packet_size > 0 forces GevSCPSPacketSize.  With 0, a profile saved by
+ * tune-transport for this camera's serial (transport_profile.h) sets the
+ * packet size and inter-packet delay; without one the size is
+ * auto-negotiated.
+ *
+ * roi (may be NULL) selects a sensor window, already checked with
+ * ag_roi_resolve(); frame_w/frame_h then describe the window.  Fails if
+ * the camera does not accept the exact geometry.
+ *
  * The caller still owns camera; this function does NOT unref it.
- * The caller must g_object_unref(out->stream) when done.
+ * The caller must camera_config_cleanup(out) when done.
  */
 int camera_configure (ArvCamera *camera, AgAcquisitionMode mode,
                       int binning, double exposure_us, double gain_db,
                       gboolean auto_expose, int packet_size,
+                      const AgTransportOptions *transport,
+                      const AgRoi *roi,
                       const char *iface_ip, gboolean verbose,
                       AgCameraConfig *out);
 
 /*
- * Run a settle-and-lock loop for auto-exposure.  Fires software triggers,
- * discards frames, and monitors ExposureTime until stable (3 consecutive
- * readings within 2%).  Then locks ExposureAuto and GainAuto to "Off".
+ * Release the stream, then the buffer pool it was reading into.
+ * Safe to call on a zeroed or already-cleaned config.
+ */
+void camera_config_cleanup (AgCameraConfig *cfg);
+
+/* Counters from ag_trigger_burst(). */
+typedef struct {
+    guint64 triggered;
+    guint64 completed;
+    guint64 failed;
+    guint64 resent;    /* GVSP packets recovered by resend */
+    guint64 missing;   /* GVSP packets never received      */
+    double  elapsed_s;
+} AgBurstStats;
+
+/*
+ * Start acquisition and fire software triggers for duration_s, each as
+ * soon as TriggerArmed is set, paced to fps (fps <= 0: as fast as the
+ * camera re-arms).  Buffers are only counted, never processed.  Frames
+ * still in flight are collected for one frame-retention period
+ * (0 = AG_FRAME_RETENTION_DEFAULT_US), then the GVSP statistics are
+ * read and acquisition is stopped.  A non-zero *quit (may be NULL) ends
+ * the burst early.  Returns EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int ag_trigger_burst (ArvCamera *camera, AgCameraConfig *cfg,
+                      double fps, double duration_s,
+                      guint frame_retention_us,
+                      const volatile sig_atomic_t *quit,
+                      AgBurstStats *out);
+
+/*
+ * Sleep until the next trigger slot of a fixed-rate schedule, so that
+ * per-frame processing time does not stretch the frame period.  Start
+ * with *next_us = 0.  A frame that overruns its slot starts the next one
+ * immediately rather than bursting to catch up.
+ */
+void ag_pace_trigger (gint64 *next_us, guint64 interval_us);
+
+/*
+ * Bring exposure to target before the first kept frame (-A).
+ *
+ * AG_AE_HOST turns the camera's ExposureAuto/GainAuto off and runs the
+ * autoexpose.h controller on the triggered frames until two in a row
+ * land inside the deadband (a handful of frames).  meter selects
+ * overlap metering (NULL = whole frame).  If ae is non-NULL it is left
+ * primed for auto_expose_track().  A left/right brightness mismatch of
+ * more than 10% at the shared exposure is reported as a warning.
+ *
+ * AG_AE_CAMERA is the camera's own AE: fire triggers and poll
+ * ExposureTime until 3 consecutive readings agree within 2%, then lock
+ * ExposureAuto and GainAuto to "Off".
+ *
  * Returns 0 on success.
  */
 int auto_expose_settle (ArvCamera *camera, AgCameraConfig *cfg,
-                        double trigger_interval_us);
+                        AgAeMode mode, double trigger_interval_us,
+                        const AgAeMeter *meter, AgAeController *ae);
+
+/*
+ * Meter one received width x height DualBayer frame (through meter, or
+ * the whole frame when NULL) and write ExposureTime/Gain when the
+ * controller leaves its deadband.  Both heads share the one
+ * ExposureTime/Gain pair.  Keeps --ae-mode host tracking after
+ * auto_expose_settle().  Returns TRUE when registers were written.
+ */
+gboolean auto_expose_track (ArvDevice *device, AgAeController *ae,
+                            const AgAeMeter *meter,
+                            const guint8 *data, guint width, guint height);
+
+/* --- Stream metrics --- */
+
+/* Why a triggered frame was not displayed. */
+typedef enum {
+    AG_DROP_TIMEOUT = 0,   /* no buffer within the pop timeout          */
+    AG_DROP_STATUS,        /* buffer status != ARV_BUFFER_STATUS_SUCCESS */
+    AG_DROP_SIZE,          /* payload smaller than the expected frame   */
+    AG_DROP_COUNT
+} AgDropReason;
+
+/*
+ * Acquisition-loop metrics.  The registry pointers are NULL (and their
+ * updates no-ops) unless ag_stream_metrics_init() was called, so the
+ * loop can update unconditionally.  The plain totals are always kept
+ * for the exit summary.
+ */
+typedef struct {
+    guint64    total_frames;
+    guint64    total_drops[AG_DROP_COUNT];
+    guint64    total_arv_underruns;
+    guint      n_buffers;          /* stream pool depth (0 = not tracked) */
+    guint      min_free_buffers;   /* low-water mark of the input queue  */
+    guint64    total_pool_empty;   /* samples that found no free buffer  */
+    AgCounter *frames;
+    AgCounter *drops[AG_DROP_COUNT];
+    AgCounter *arv_completed;
+    AgCounter *arv_failures;
+    AgCounter *arv_underruns;
+    AgCounter *gv_resent;
+    AgCounter *gv_missing;
+    AgGauge   *fps;
+    AgGauge   *buffers;
+    AgGauge   *buffers_free;
+    AgGauge   *buffers_free_min;
+    AgCounter *pool_empty;
+} AgStreamMetrics;
+
+/* Register the ag_frames_* / ag_arv_* series with the metrics registry. */
+void ag_stream_metrics_init (AgStreamMetrics *m);
+
+/*
+ * Start tracking free stream buffers against a pool of n_buffers.
+ * Call after ag_stream_metrics_init() (if any).
+ */
+void ag_stream_metrics_set_pool (AgStreamMetrics *m, guint n_buffers);
+
+void ag_stream_metrics_frame (AgStreamMetrics *m);
+void ag_stream_metrics_drop  (AgStreamMetrics *m, AgDropReason reason);
+
+/*
+ * Mirror arv_stream_get_statistics() and (for GigE Vision streams)
+ * arv_gv_stream_get_statistics() into the registered counters, and
+ * sample the number of free buffers in the input queue.
+ * Cheap enough to call once per frame.
+ */
+void ag_stream_metrics_update (AgStreamMetrics *m, ArvStream *stream);
+
+/*
+ * Print the whole-run line parsed by tests/test_fake_camera.sh:
+ *   Summary: 600 frames in 60.0 s (10.00 fps), dropped 0 (timeout 0, status 0, size 0)
+ * followed, when a pool is tracked, by
+ *   Buffers: 16 in pool, min free 13, empty 0 of 600 samples, 0 underruns
+ */
+void ag_stream_metrics_print_summary (const AgStreamMetrics *m,
+                                      double elapsed_s);
 
 #endif /* AG_COMMON_H */
@@ -0,0 +1,174 @@
+/*
+ * detector_stage.c — asynchronous per-frame detector stage for `stream`
+ */
+
+#include "detector_stage.h"
+
+#include <string.h>
+
+typedef struct {
+    guint8 *planes;              /* left then right */
+    guint64 frame_id;
+    gint64  capture_us;
+    gint64  submit_us;
+} Slot;
+
+struct AgDetectorStage {
+    AgDetectorOps ops;
+    gpointer      user;
+    guint         width;
+    guint         height;
+
+    /* Triple buffer: fill belongs to the submitter, work to the stage
+     * thread, pending to whoever holds the lock. */
+    Slot     slots[3];
+    Slot    *fill;
+    Slot    *pending;
+    Slot    *work;
+    gboolean has_pending;
+
+    AgDetectorResult done;       /* newest unpolled result */
+    gboolean         has_done;
+
+    guint64 processed;
+    guint64 dropped;
+
+    GThread *thread;
+    GMutex   lock;
+    GCond    cond;
+    gboolean quit;
+};
+
+static gpointer
+stage_main (gpointer data)
+{
+    AgDetectorStage *st = data;
+    gsize plane = (gsize) st->width * st->height;
+
+    g_mutex_lock (&st->lock);
+    for (;;) {
+        while (!st->has_pending && !st->quit)
+            g_cond_wait (&st->cond, &st->lock);
+        if (st->quit)
+            break;
+
+        Slot *s = st->pending;
+        st->pending = st->work;
+        st->work = s;
+        st->has_pending = FALSE;
+        g_mutex_unlock (&st->lock);
+
+        AgDetectorFrame frame = {
+            .frame_id   = s->frame_id,
+            .capture_us = s->capture_us,
+            .submit_us  = s->submit_us,
+            .left      = s->planes,
+            .right     = s->planes + plane,
+            .width     = st->width,
+            .height    = st->height,
+        };
+        gpointer result = st->ops.process (st->user, &frame);
+        gint64 latency = g_get_monotonic_time () - s->submit_us;
+
+        g_mutex_lock (&st->lock);
+        if (st->has_done && st->done.result)
+            st->ops.free_result (st->done.result);
+        st->done.frame_id   = s->frame_id;
+        st->done.latency_us = latency;
+        st->done.result     = result;
+        st->has_done = TRUE;
+        st->processed++;
+    }
+    g_mutex_unlock (&st->lock);
+    return NULL;
+}
+
+AgDetectorStage *
+ag_detector_stage_new (const AgDetectorOps *ops, gpointer user,
+                       guint width, guint height)
+{
+    AgDetectorStage *st = g_new0 (AgDetectorStage, 1);
+    st->ops    = *ops;
+    st->user   = user;
+    st->width  = width;
+    st->height = height;
+
+    for (int i = 0; i < 3; i++)
+        st->slots[i].planes = g_malloc ((gsize) width * height * 2);
+    st->fill    = &st->slots[0];
+    st->pending = &st->slots[1];
+    st->work    = &st->slots[2];
+
+    g_mutex_init (&st->lock);
+    g_cond_init (&st->cond);
+    st->thread = g_thread_new (ops->name, stage_main, st);
+    return st;
+}
+
+void
+ag_detector_stage_free (AgDetectorStage *st)
+{
+    if (!st)
+        return;
+
+    g_mutex_lock (&st->lock);
+    st->quit = TRUE;
+    g_cond_broadcast (&st->cond);
+    g_mutex_unlock (&st->lock);
+    g_thread_join (st->thread);
+
+    if (st->has_done && st->done.result)
+        st->ops.free_result (st->done.result);
+    for (int i = 0; i < 3; i++)
+        g_free (st->slots[i].planes);
+    g_mutex_clear (&st->lock);
+    g_cond_clear (&st->cond);
+    g_free (st);
+}
+
+void
+ag_detector_stage_submit (AgDetectorStage *st,
+                          guint64 frame_id, gint64 capture_us,
+                          const guint8 *left, const guint8 *right)
+{
+    gsize plane = (gsize) st->width * st->height;
+    Slot *s = st->fill;
+    memcpy (s->planes,         left,  plane);
+    memcpy (s->planes + plane, right, plane);
+    s->frame_id   = frame_id;
+    s->capture_us = capture_us;
+    s->submit_us  = g_get_monotonic_time ();
+
+    g_mutex_lock (&st->lock);
+    if (st->has_pending)
+        st->dropped++;
+    st->fill = st->pending;
+    st->pending = s;
+    st->has_pending = TRUE;
+    g_cond_signal (&st->cond);
+    g_mutex_unlock (&st->lock);
+}
+
+gboolean
+ag_detector_stage_poll (AgDetectorStage *st, AgDetectorResult *out)
+{
+    gboolean have;
+    g_mutex_lock (&st->lock);
+    have = st->has_done;
+    if (have) {
+        *out = st->done;
+        st->has_done = FALSE;
+    }
+    g_mutex_unlock (&st->lock);
+    return have;
+}
+
+void
+ag_detector_stage_counts (AgDetectorStage *st,
+                          guint64 *processed, guint64 *dropped)
+{
+    g_mutex_lock (&st->lock);
+    *processed = st->processed;
+    *dropped   = st->dropped;
+    g_mutex_unlock (&st->lock);
+}
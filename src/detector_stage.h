@@ -0,0 +1,79 @@
+/*
+ * detector_stage.h — asynchronous per-frame detector stage for `stream`
+ *
+ * A detector (AprilTag today; ChArUco or checkerboard later) runs on its
+ * own thread instead of inside the acquisition/render loop, so a slow
+ * detection never holds up display.  The loop submits each frame's two
+ * eye planes and keeps going; the stage always works on the newest
+ * frame it has been given and drops the ones it was too slow for.
+ * Results come back tagged with the frame id they belong to.
+ *
+ *   AgDetectorOps ops = { "apriltag", my_process, my_free_result };
+ *   AgDetectorStage *st = ag_detector_stage_new (&ops, ctx, w, h);
+ *   per frame:
+ *       ag_detector_stage_submit (st, frame_id, capture_us, left, right);
+ *       if (ag_detector_stage_poll (st, &res))
+ *           replace the overlay with res (free the old one)
+ *
+ * Eye planes are copied on submit (the loop reuses its buffers), into a
+ * triple buffer: one slot being filled, one pending, one being
+ * processed.  A newer submit replaces a pending frame that the stage
+ * has not started yet.
+ */
+
+#ifndef AG_DETECTOR_STAGE_H
+#define AG_DETECTOR_STAGE_H
+
+#include <glib.h>
+
+/* Input of one detection, owned by the stage for the call's duration. */
+typedef struct {
+    guint64       frame_id;
+    gint64        capture_us;    /* caller's timestamp, passed through */
+    gint64        submit_us;     /* g_get_monotonic_time() at submit */
+    const guint8 *left;
+    const guint8 *right;
+    guint         width;
+    guint         height;
+} AgDetectorFrame;
+
+typedef struct {
+    const char *name;            /* thread name */
+    /* Runs on the stage thread; returns a result (NULL: nothing found). */
+    gpointer  (*process)     (gpointer user, const AgDetectorFrame *frame);
+    void      (*free_result) (gpointer result);
+} AgDetectorOps;
+
+/* One finished detection, handed to the caller by ag_detector_stage_poll(). */
+typedef struct {
+    guint64  frame_id;
+    gint64   latency_us;         /* submit to result */
+    gpointer result;             /* caller frees with ops->free_result */
+} AgDetectorResult;
+
+typedef struct AgDetectorStage AgDetectorStage;
+
+AgDetectorStage *ag_detector_stage_new (const AgDetectorOps *ops,
+                                        gpointer user,
+                                        guint width, guint height);
+
+/* Stops the thread after its current frame and frees unpolled results. */
+void ag_detector_stage_free (AgDetectorStage *st);
+
+/* Copy both width x height planes in and wake the stage.  Never blocks
+ * on detection. */
+void ag_detector_stage_submit (AgDetectorStage *st,
+                               guint64 frame_id, gint64 capture_us,
+                               const guint8 *left, const guint8 *right);
+
+/*
+ * TRUE when a detection finished since the last call; *out then owns
+ * its result.  Only the newest finished result is kept.
+ */
+gboolean ag_detector_stage_poll (AgDetectorStage *st, AgDetectorResult *out);
+
+/* Frames processed and frames dropped (replaced while pending). */
+void ag_detector_stage_counts (AgDetectorStage *st,
+                               guint64 *processed, guint64 *dropped);
+
+#endif /* AG_DETECTOR_STAGE_H */
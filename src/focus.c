@@ -17,12 +17,38 @@
  *
  * All metrics use integer math in the inner loop with 64-bit accumulators;
  * floating-point only for the final result.
+ *
+ * ag_focus_score_all() computes all three in one pass.  Each 3x3
+ * neighbourhood is loaded once: the centre-row difference I(x+1) - I(x-1)
+ * that Sobel X needs is also the Brenner difference at x-1.  On x86-64
+ * with AVX2 (checked at run time) and on aarch64 (NEON) the row pass
+ * works on 16-bit lanes with 32-bit lane accumulators, flushed into the
+ * 64-bit totals at least every FOCUS_FLUSH_PIXELS.  The result is exact,
+ * so it equals the per-metric functions bit for bit.
+ *
+ * ag_focus_score_plane() runs the same pass over a strided view, e.g.
+ * one eye of an interleaved DualBayer frame.  Strided rows are gathered
+ * into a three-line ring as the pass reaches them, so only the ROI's
+ * own pixels are read and the frame is never copied.
+ * ag_focus_score_bayer_green() uses that to score the two green planes
+ * of an RGGB mosaic (G at odd columns of even rows, and even columns
+ * of odd rows) and averages them, so R and B never enter a gradient.
  */
 
 #include "focus.h"
 
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define AG_FOCUS_AVX2 1
+#include <immintrin.h>
+#endif
+#ifdef __aarch64__
+#include <arm_neon.h>
+#endif
+
 static const char *metric_names[AG_FOCUS_METRIC_COUNT] = {
     "laplacian",
     "tenengrad",
@@ -190,6 +216,429 @@ focus_brenner (const uint8_t *image, int width, int height,
     return (double) sum_sq / (double) count;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Single-pass engine (all metrics)                                   */
+/* ------------------------------------------------------------------ */
+
+/* Pixels between 32-bit lane flushes.  At most 2048 / 4 = 512 pixels
+ * land in one lane (NEON has 4, AVX2 8), each adding at most
+ * Gx^2 + Gy^2 = 2 * 1020^2, so no lane passes INT32_MAX. */
+#define FOCUS_FLUSH_PIXELS 2048
+
+typedef struct {
+    int64_t lap_sum;
+    int64_t lap_sq;
+    int64_t ten;
+    int64_t bren;      /* Brenner at x-1 for every x scored */
+} FocusAcc;
+
+typedef void (*FocusRowFn) (const uint8_t *rp, const uint8_t *rc,
+                            const uint8_t *rn, int x0, int x1,
+                            FocusAcc *acc);
+
+static void
+focus_row_scalar (const uint8_t *rp, const uint8_t *rc, const uint8_t *rn,
+                  int x0, int x1, FocusAcc *acc)
+{
+    for (int x = x0; x < x1; x++) {
+        int dh  = (int) rc[x + 1] - (int) rc[x - 1];
+        int lap = 4 * (int) rc[x] - (int) rc[x - 1] - (int) rc[x + 1]
+                    - (int) rp[x] - (int) rn[x];
+        int gx  = (int) rp[x + 1] - (int) rp[x - 1] + 2 * dh
+                + (int) rn[x + 1] - (int) rn[x - 1];
+        int gy  = (int) rn[x - 1] + 2 * (int) rn[x] + (int) rn[x + 1]
+                - (int) rp[x - 1] - 2 * (int) rp[x] - (int) rp[x + 1];
+
+        acc->lap_sum += lap;
+        acc->lap_sq  += (int64_t) lap * lap;
+        acc->ten     += (int64_t) gx * gx + (int64_t) gy * gy;
+        acc->bren    += (int64_t) dh * dh;
+    }
+}
+
+#ifdef AG_FOCUS_AVX2
+
+__attribute__ ((target ("avx2")))
+static int64_t
+hsum_epi32_avx2 (__m256i v)
+{
+    int32_t lane[8];
+    _mm256_storeu_si256 ((__m256i *) lane, v);
+    int64_t s = 0;
+    for (int i = 0; i < 8; i++)
+        s += lane[i];
+    return s;
+}
+
+/* 16 pixels per step: bytes widened to 16-bit lanes, squares and sums
+ * reduced pairwise into 32-bit lanes with vpmaddwd. */
+__attribute__ ((target ("avx2")))
+static void
+focus_row_avx2 (const uint8_t *rp, const uint8_t *rc, const uint8_t *rn,
+                int x0, int x1, FocusAcc *acc)
+{
+#define LOAD16(p) _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (p)))
+    const __m256i ones = _mm256_set1_epi16 (1);
+    int x = x0;
+
+    while (x + 16 <= x1) {
+        int end = x + FOCUS_FLUSH_PIXELS < x1 ? x + FOCUS_FLUSH_PIXELS : x1;
+        __m256i s_lap  = _mm256_setzero_si256 ();
+        __m256i s_lap2 = _mm256_setzero_si256 ();
+        __m256i s_ten  = _mm256_setzero_si256 ();
+        __m256i s_bren = _mm256_setzero_si256 ();
+
+        for (; x + 16 <= end; x += 16) {
+            __m256i pl = LOAD16 (rp + x - 1), pc = LOAD16 (rp + x),
+                    pr = LOAD16 (rp + x + 1);
+            __m256i cl = LOAD16 (rc + x - 1), cc = LOAD16 (rc + x),
+                    cr = LOAD16 (rc + x + 1);
+            __m256i nl = LOAD16 (rn + x - 1), nc = LOAD16 (rn + x),
+                    nr = LOAD16 (rn + x + 1);
+
+            __m256i dh  = _mm256_sub_epi16 (cr, cl);
+            __m256i lap = _mm256_sub_epi16 (
+                _mm256_slli_epi16 (cc, 2),
+                _mm256_add_epi16 (_mm256_add_epi16 (cl, cr),
+                                  _mm256_add_epi16 (pc, nc)));
+            __m256i gx  = _mm256_add_epi16 (
+                _mm256_add_epi16 (_mm256_sub_epi16 (pr, pl),
+                                  _mm256_sub_epi16 (nr, nl)),
+                _mm256_slli_epi16 (dh, 1));
+            __m256i gy  = _mm256_sub_epi16 (
+                _mm256_add_epi16 (_mm256_add_epi16 (nl, nr),
+                                  _mm256_slli_epi16 (nc, 1)),
+                _mm256_add_epi16 (_mm256_add_epi16 (pl, pr),
+                                  _mm256_slli_epi16 (pc, 1)));
+
+            s_lap  = _mm256_add_epi32 (s_lap,  _mm256_madd_epi16 (lap, ones));
+            s_lap2 = _mm256_add_epi32 (s_lap2, _mm256_madd_epi16 (lap, lap));
+            s_ten  = _mm256_add_epi32 (s_ten,
+                         _mm256_add_epi32 (_mm256_madd_epi16 (gx, gx),
+                                           _mm256_madd_epi16 (gy, gy)));
+            s_bren = _mm256_add_epi32 (s_bren, _mm256_madd_epi16 (dh, dh));
+        }
+
+        acc->lap_sum += hsum_epi32_avx2 (s_lap);
+        acc->lap_sq  += hsum_epi32_avx2 (s_lap2);
+        acc->ten     += hsum_epi32_avx2 (s_ten);
+        acc->bren    += hsum_epi32_avx2 (s_bren);
+    }
+#undef LOAD16
+
+    focus_row_scalar (rp, rc, rn, x, x1, acc);
+}
+
+#endif /* AG_FOCUS_AVX2 */
+
+#ifdef __aarch64__
+
+/* 8 pixels per step, same lane layout as the AVX2 path. */
+static void
+focus_row_neon (const uint8_t *rp, const uint8_t *rc, const uint8_t *rn,
+                int x0, int x1, FocusAcc *acc)
+{
+#define LOAD8(p) vreinterpretq_s16_u16 (vmovl_u8 (vld1_u8 (p)))
+    int x = x0;
+
+    while (x + 8 <= x1) {
+        int end = x + FOCUS_FLUSH_PIXELS < x1 ? x + FOCUS_FLUSH_PIXELS : x1;
+        int32x4_t s_lap  = vdupq_n_s32 (0);
+        int32x4_t s_lap2 = vdupq_n_s32 (0);
+        int32x4_t s_ten  = vdupq_n_s32 (0);
+        int32x4_t s_bren = vdupq_n_s32 (0);
+
+        for (; x + 8 <= end; x += 8) {
+            int16x8_t pl = LOAD8 (rp + x - 1), pc = LOAD8 (rp + x),
+                      pr = LOAD8 (rp + x + 1);
+            int16x8_t cl = LOAD8 (rc + x - 1), cc = LOAD8 (rc + x),
+                      cr = LOAD8 (rc + x + 1);
+            int16x8_t nl = LOAD8 (rn + x - 1), nc = LOAD8 (rn + x),
+                      nr = LOAD8 (rn + x + 1);
+
+            int16x8_t dh  = vsubq_s16 (cr, cl);
+            int16x8_t lap = vsubq_s16 (vshlq_n_s16 (cc, 2),
+                                       vaddq_s16 (vaddq_s16 (cl, cr),
+                                                  vaddq_s16 (pc, nc)));
+            int16x8_t gx  = vaddq_s16 (vaddq_s16 (vsubq_s16 (pr, pl),
+                                                  vsubq_s16 (nr, nl)),
+                                       vshlq_n_s16 (dh, 1));
+            int16x8_t gy  = vsubq_s16 (
+                vaddq_s16 (vaddq_s16 (nl, nr), vshlq_n_s16 (nc, 1)),
+                vaddq_s16 (vaddq_s16 (pl, pr), vshlq_n_s16 (pc, 1)));
+
+            s_lap  = vpadalq_s16 (s_lap, lap);
+            s_lap2 = vmlal_s16 (s_lap2, vget_low_s16 (lap), vget_low_s16 (lap));
+            s_lap2 = vmlal_high_s16 (s_lap2, lap, lap);
+            s_ten  = vmlal_s16 (s_ten, vget_low_s16 (gx), vget_low_s16 (gx));
+            s_ten  = vmlal_high_s16 (s_ten, gx, gx);
+            s_ten  = vmlal_s16 (s_ten, vget_low_s16 (gy), vget_low_s16 (gy));
+            s_ten  = vmlal_high_s16 (s_ten, gy, gy);
+            s_bren = vmlal_s16 (s_bren, vget_low_s16 (dh), vget_low_s16 (dh));
+            s_bren = vmlal_high_s16 (s_bren, dh, dh);
+        }
+
+        acc->lap_sum += vaddlvq_s32 (s_lap);
+        acc->lap_sq  += vaddlvq_s32 (s_lap2);
+        acc->ten     += vaddlvq_s32 (s_ten);
+        acc->bren    += vaddlvq_s32 (s_bren);
+    }
+#undef LOAD8
+
+    focus_row_scalar (rp, rc, rn, x, x1, acc);
+}
+
+#endif /* __aarch64__ */
+
+static int focus_force_scalar = 0;
+
+static FocusRowFn
+focus_row_fn (const char **name)
+{
+    FocusRowFn fn = focus_row_scalar;
+    const char *n = "scalar";
+    if (!focus_force_scalar) {
+#if defined(AG_FOCUS_AVX2)
+        if (__builtin_cpu_supports ("avx2")) {
+            fn = focus_row_avx2;
+            n  = "avx2";
+        }
+#elif defined(__aarch64__)
+        fn = focus_row_neon;
+        n  = "neon";
+#endif
+    }
+    if (name)
+        *name = n;
+    return fn;
+}
+
+const char *
+ag_focus_engine (void)
+{
+    const char *name;
+    focus_row_fn (&name);
+    return name;
+}
+
+void
+ag_focus_engine_force_scalar (int force)
+{
+    focus_force_scalar = force != 0;
+}
+
+/* Sum of Brenner terms at x in [a, b) of one row. */
+static int64_t
+brenner_span (const uint8_t *row, int a, int b)
+{
+    int64_t s = 0;
+    for (int x = a; x < b; x++) {
+        int d = (int) row[x + 2] - (int) row[x];
+        s += (int64_t) d * d;
+    }
+    return s;
+}
+
+static inline int imin (int a, int b) { return a < b ? a : b; }
+static inline int imax (int a, int b) { return a > b ? a : b; }
+
+/* dst[i] = src[i * step].  Steps 2 and 4 (an eye of a DualBayer frame,
+ * a green plane of it) are deinterleaved 16 bytes at a time; the vector
+ * loop stops while its last load is still inside the row's span. */
+static void
+gather_row (uint8_t *dst, const uint8_t *src, int n, int step)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    if (step == 2) {
+        const __m128i lo = _mm_set1_epi16 (0x00ff);
+        for (; i + 17 <= n; i += 16) {
+            __m128i a = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (src + 2 * i)), lo);
+            __m128i b = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (src + 2 * i + 16)), lo);
+            _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (a, b));
+        }
+    } else if (step == 4) {
+        const __m128i lo = _mm_set1_epi32 (0xff);
+        for (; i + 17 <= n; i += 16) {
+            const __m128i *p = (const __m128i *) (src + 4 * i);
+            __m128i a = _mm_and_si128 (_mm_loadu_si128 (p),     lo);
+            __m128i b = _mm_and_si128 (_mm_loadu_si128 (p + 1), lo);
+            __m128i c = _mm_and_si128 (_mm_loadu_si128 (p + 2), lo);
+            __m128i d = _mm_and_si128 (_mm_loadu_si128 (p + 3), lo);
+            _mm_storeu_si128 ((__m128i *) (dst + i),
+                              _mm_packus_epi16 (_mm_packs_epi32 (a, b),
+                                                _mm_packs_epi32 (c, d)));
+        }
+    }
+#elif defined(__aarch64__)
+    if (step == 2) {
+        for (; i + 17 <= n; i += 16)
+            vst1q_u8 (dst + i, vld2q_u8 (src + 2 * i).val[0]);
+    } else if (step == 4) {
+        for (; i + 17 <= n; i += 16)
+            vst1q_u8 (dst + i, vld4q_u8 (src + 4 * i).val[0]);
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = src[(ptrdiff_t) i * step];
+}
+
+/* Rows [xa, xa + n) of a plane as contiguous bytes.  Unit-step planes
+ * are read in place; strided ones go through a 4-line ring: the y-1,
+ * y, y+1 a kernel row needs, plus y+2 gathered one row early so the
+ * kernel's unaligned loads never wait on the gather's stores. */
+#define FOCUS_RING_LINES 4
+
+typedef struct {
+    const AgFocusPlane *p;
+    int      xa;
+    int      n;
+    uint8_t *ring;         /* FOCUS_RING_LINES * n bytes; NULL for unit step */
+    int      ring_y[FOCUS_RING_LINES];
+} RowSource;
+
+static const uint8_t *
+row_at (RowSource *rs, int y)
+{
+    const AgFocusPlane *p = rs->p;
+    const uint8_t *src = p->data + (ptrdiff_t) y * p->row_stride
+                                 + (ptrdiff_t) rs->xa * p->step;
+    if (!rs->ring)
+        return src;
+
+    int slot = y % FOCUS_RING_LINES;
+    uint8_t *dst = rs->ring + (size_t) slot * (size_t) rs->n;
+    if (rs->ring_y[slot] != y) {
+        gather_row (dst, src, rs->n, p->step);
+        rs->ring_y[slot] = y;
+    }
+    return dst;
+}
+
+void
+ag_focus_score_plane (const AgFocusPlane *plane,
+                      int roi_x, int roi_y, int roi_w, int roi_h,
+                      double scores[AG_FOCUS_METRIC_COUNT])
+{
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        scores[m] = 0.0;
+
+    int width  = plane->width;
+    int height = plane->height;
+
+    /* Same clamping as the per-metric functions: a 1-pixel border for
+     * the 3x3 kernels, x+2 inside the image for Brenner. */
+    int x0 = imax (roi_x, 1);
+    int y0 = imax (roi_y, 1);
+    int x1 = imin (roi_x + roi_w, width  - 1);
+    int y1 = imin (roi_y + roi_h, height - 1);
+    int bx0 = imax (roi_x, 0);
+    int by0 = imax (roi_y, 0);
+    int bx1 = imin (roi_x + roi_w, width - 2);
+    int by1 = imin (roi_y + roi_h, height);
+
+    int kernel = x1 - x0 >= 2 && y1 - y0 >= 2;
+    if (bx1 - bx0 < 1 || by1 - by0 < 1)
+        return;   /* the kernel region is empty too */
+
+    /* Columns either pass reads, and the pass in those coordinates. */
+    int xa = imax (roi_x - 1, 0);
+    int xb = imin (roi_x + roi_w + 2, width);
+    x0 -= xa;  x1 -= xa;
+    bx0 -= xa; bx1 -= xa;
+
+    RowSource rs = { plane, xa, xb - xa, NULL, { -1, -1, -1, -1 } };
+    if (plane->step != 1) {
+        rs.ring = malloc ((size_t) FOCUS_RING_LINES * (size_t) rs.n);
+        if (!rs.ring)
+            return;
+    }
+
+    FocusRowFn row_fn = focus_row_fn (NULL);
+    FocusAcc acc = { 0, 0, 0, 0 };
+
+    /* Kernel rows are a subset of the Brenner rows. */
+    for (int y = by0; y < by1; y++) {
+        if (!kernel || y < y0 || y >= y1) {
+            acc.bren += brenner_span (row_at (&rs, y), bx0, bx1);
+            continue;
+        }
+        const uint8_t *rp = row_at (&rs, y - 1);
+        const uint8_t *rc = row_at (&rs, y);
+        const uint8_t *rn = row_at (&rs, y + 1);
+        row_fn (rp, rc, rn, x0, x1, &acc);
+        if (rs.ring && y + 1 < y1)
+            row_at (&rs, y + 2);
+
+        /* The row pass scored Brenner at [x0-1, x1-1); trim or extend
+         * that to [bx0, bx1). */
+        acc.bren -= brenner_span (rc, x0 - 1, imin (bx0, x1 - 1));
+        acc.bren -= brenner_span (rc, imax (bx1, x0 - 1), x1 - 1);
+        acc.bren += brenner_span (rc, bx0, imin (bx1, x0 - 1));
+        acc.bren += brenner_span (rc, imax (bx0, x1 - 1), bx1);
+    }
+    free (rs.ring);
+
+    if (kernel) {
+        double count   = (double) ((int64_t) (x1 - x0) * (y1 - y0));
+        double mean    = (double) acc.lap_sum / count;
+        double mean_sq = (double) acc.lap_sq  / count;
+        scores[AG_FOCUS_METRIC_LAPLACIAN] = mean_sq - mean * mean;
+        scores[AG_FOCUS_METRIC_TENENGRAD] = (double) acc.ten / count;
+    }
+    scores[AG_FOCUS_METRIC_BRENNER] =
+        (double) acc.bren / (double) ((int64_t) (bx1 - bx0) * (by1 - by0));
+}
+
+void
+ag_focus_score_all (const uint8_t *image, int width, int height,
+                    int roi_x, int roi_y, int roi_w, int roi_h,
+                    double scores[AG_FOCUS_METRIC_COUNT])
+{
+    AgFocusPlane plane = { image, width, height, 1, width };
+    ag_focus_score_plane (&plane, roi_x, roi_y, roi_w, roi_h, scores);
+}
+
+void
+ag_focus_score_bayer_green (const AgFocusPlane *mosaic,
+                            int roi_x, int roi_y, int roi_w, int roi_h,
+                            double scores[AG_FOCUS_METRIC_COUNT])
+{
+    ag_focus_score_bayer_green_decimated (mosaic, roi_x, roi_y, roi_w, roi_h,
+                                          1, scores);
+}
+
+void
+ag_focus_score_bayer_green_decimated (const AgFocusPlane *mosaic,
+                                      int roi_x, int roi_y,
+                                      int roi_w, int roi_h, int factor,
+                                      double scores[AG_FOCUS_METRIC_COUNT])
+{
+    if (factor < 1)
+        factor = 1;
+
+    /* G1 at (2i+1, 2j), G2 at (2i, 2j+1); both are w/2 x h/2, then
+     * every factor-th sample of those. */
+    int span = 2 * factor;
+    AgFocusPlane g1 = {
+        mosaic->data + mosaic->step,
+        (mosaic->width / 2) / factor, (mosaic->height / 2) / factor,
+        mosaic->step * span, mosaic->row_stride * span
+    };
+    AgFocusPlane g2 = g1;
+    g2.data = mosaic->data + mosaic->row_stride;
+
+    int gx = roi_x / span, gy = roi_y / span;
+    int gw = (roi_x + roi_w) / span - gx;
+    int gh = (roi_y + roi_h) / span - gy;
+
+    double s1[AG_FOCUS_METRIC_COUNT], s2[AG_FOCUS_METRIC_COUNT];
+    ag_focus_score_plane (&g1, gx, gy, gw, gh, s1);
+    ag_focus_score_plane (&g2, gx, gy, gw, gh, s2);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        scores[m] = 0.5 * (s1[m] + s2[m]);
+}
+
 /* ------------------------------------------------------------------ */
 /*  Dispatch                                                           */
 /* ------------------------------------------------------------------ */
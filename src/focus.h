@@ -40,6 +40,68 @@ double ag_focus_score (AgFocusMetric metric,
                        const uint8_t *image, int width, int height,
                        int roi_x, int roi_y, int roi_w, int roi_h);
 
+/*
+ * Compute every metric in one pass over the ROI.  scores[] is indexed
+ * by AgFocusMetric; each entry equals what ag_focus_score() returns for
+ * that metric, including the per-metric ROI clamping.  Uses AVX2 or
+ * NEON where available.
+ */
+void ag_focus_score_all (const uint8_t *image, int width, int height,
+                         int roi_x, int roi_y, int roi_w, int roi_h,
+                         double scores[AG_FOCUS_METRIC_COUNT]);
+
+/*
+ * Strided 8-bit view: pixel (x, y) is data[y * row_stride + x * step].
+ * One eye of a DualBayer frame of width W is { base + eye, W / 2, H, 2, W }.
+ */
+typedef struct {
+    const uint8_t *data;
+    int            width;
+    int            height;
+    int            step;          /* bytes between horizontal neighbours */
+    int            row_stride;    /* bytes between rows */
+} AgFocusPlane;
+
+/*
+ * ag_focus_score_all() on a strided plane, read in place.
+ */
+void ag_focus_score_plane (const AgFocusPlane *plane,
+                           int roi_x, int roi_y, int roi_w, int roi_h,
+                           double scores[AG_FOCUS_METRIC_COUNT]);
+
+/*
+ * Every metric on the green sites of an RGGB mosaic only: the two
+ * green planes (w/2 x h/2 each) are scored separately and averaged.
+ * The ROI is in mosaic pixels.  Touches half the ROI's pixels, and
+ * scores are those of a half-resolution image, so they are not on the
+ * same scale as full-mosaic scores.
+ */
+void ag_focus_score_bayer_green (const AgFocusPlane *mosaic,
+                                 int roi_x, int roi_y, int roi_w, int roi_h,
+                                 double scores[AG_FOCUS_METRIC_COUNT]);
+
+/*
+ * ag_focus_score_bayer_green() on every factor-th green sample of each
+ * plane in both directions, for factor^2 less work.  Scores are on the
+ * scale of the decimated image.  factor 1 is the full green planes.
+ */
+void ag_focus_score_bayer_green_decimated (const AgFocusPlane *mosaic,
+                                           int roi_x, int roi_y,
+                                           int roi_w, int roi_h, int factor,
+                                           double scores[AG_FOCUS_METRIC_COUNT]);
+
+/*
+ * Name of the row kernel ag_focus_score_all() uses on this machine:
+ * "avx2", "neon" or "scalar".
+ */
+const char *ag_focus_engine (void);
+
+/*
+ * Make ag_focus_score_all() use the scalar row kernel (tests, A/B
+ * benchmarking).  Not thread-safe; set it before scoring starts.
+ */
+void ag_focus_engine_force_scalar (int force);
+
 /*
  * Legacy API — equivalent to ag_focus_score(AG_FOCUS_METRIC_LAPLACIAN, ...).
  */
@@ -0,0 +1,258 @@
+/*
+ * focus_grid.c — per-tile focus scores for tilt and field-curvature checks
+ *
+ * Work is split by tile row: one job per (eye, row), so an 8x6 grid is
+ * 12 jobs of 8 tiles each.  Tiles are scored in place on the full plane,
+ * so the 3x3 kernels see the neighbouring tile's pixels at inner edges
+ * and only the image border is clamped.
+ */
+
+#include "focus_grid.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    AgFocusGrid   *grid;
+    AgFocusGridEye eye;
+    int            row;
+} GridJob;
+
+struct AgFocusGrid {
+    int          cols;
+    int          rows;
+    GThreadPool *pool;             /* NULL: score on the caller */
+    GridJob     *jobs;             /* 2 * rows */
+
+    /* Current frame, set before jobs are pushed. */
+    AgFocusPlane planes[2];
+    gboolean     bayer_green;
+
+    /* [eye][metric][row * cols + col] */
+    double      *scores[2][AG_FOCUS_METRIC_COUNT];
+
+    GMutex lock;
+    GCond  done;
+    int    pending;
+};
+
+int
+ag_focus_grid_parse_size (const char *s, int *cols, int *rows)
+{
+    if (!s)
+        return -1;
+    char *end;
+    long c = strtol (s, &end, 10);
+    if (end == s || (*end != 'x' && *end != 'X'))
+        return -1;
+    const char *r_str = end + 1;
+    long r = strtol (r_str, &end, 10);
+    if (end == r_str || *end != '\0')
+        return -1;
+    if (c < 1 || c > AG_FOCUS_GRID_MAX || r < 1 || r > AG_FOCUS_GRID_MAX)
+        return -1;
+    *cols = (int) c;
+    *rows = (int) r;
+    return 0;
+}
+
+void
+ag_focus_grid_tile_rect (int cols, int rows, int width, int height,
+                         int col, int row, int *x, int *y, int *w, int *h)
+{
+    int x0 = (int) ((gint64) col       * width  / cols);
+    int x1 = (int) ((gint64) (col + 1) * width  / cols);
+    int y0 = (int) ((gint64) row       * height / rows);
+    int y1 = (int) ((gint64) (row + 1) * height / rows);
+    *x = x0;
+    *y = y0;
+    *w = x1 - x0;
+    *h = y1 - y0;
+}
+
+static double
+mean_of (const double *tiles, int cols, int c0, int c1, int r0, int r1)
+{
+    double sum = 0.0;
+    int n = 0;
+    for (int r = r0; r <= r1; r++)
+        for (int c = c0; c <= c1; c++) {
+            sum += tiles[r * cols + c];
+            n++;
+        }
+    return n ? sum / n : 0.0;
+}
+
+/* (b - a) relative to their mean; 0 when both are 0. */
+static double
+relative_diff (double a, double b)
+{
+    double m = 0.5 * (a + b);
+    return m > 0.0 ? (b - a) / m : 0.0;
+}
+
+void
+ag_focus_grid_summarize (const double *tiles, int cols, int rows,
+                         AgFocusGridSummary *out)
+{
+    memset (out, 0, sizeof *out);
+    if (cols < 1 || rows < 1)
+        return;
+
+    out->centre = mean_of (tiles, cols, (cols - 1) / 2, cols / 2,
+                           (rows - 1) / 2, rows / 2);
+    out->corner[AG_FOCUS_GRID_TL] = tiles[0];
+    out->corner[AG_FOCUS_GRID_TR] = tiles[cols - 1];
+    out->corner[AG_FOCUS_GRID_BL] = tiles[(rows - 1) * cols];
+    out->corner[AG_FOCUS_GRID_BR] = tiles[(rows - 1) * cols + cols - 1];
+    for (int i = 0; i < 4; i++)
+        out->ratio[i] = out->centre > 0.0 ? out->corner[i] / out->centre : 0.0;
+
+    out->tilt_x = relative_diff (
+        mean_of (tiles, cols, 0, 0, 0, rows - 1),
+        mean_of (tiles, cols, cols - 1, cols - 1, 0, rows - 1));
+    out->tilt_y = relative_diff (
+        mean_of (tiles, cols, 0, cols - 1, 0, 0),
+        mean_of (tiles, cols, 0, cols - 1, rows - 1, rows - 1));
+}
+
+static void
+score_row (AgFocusGrid *g, AgFocusGridEye eye, int row)
+{
+    for (int col = 0; col < g->cols; col++) {
+        const AgFocusPlane *p = &g->planes[eye];
+        int x, y, w, h;
+        ag_focus_grid_tile_rect (g->cols, g->rows, p->width, p->height,
+                                 col, row, &x, &y, &w, &h);
+        double all[AG_FOCUS_METRIC_COUNT];
+        if (g->bayer_green)
+            ag_focus_score_bayer_green (p, x, y, w, h, all);
+        else
+            ag_focus_score_plane (p, x, y, w, h, all);
+        for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+            g->scores[eye][m][row * g->cols + col] = all[m];
+    }
+}
+
+static void
+job_main (gpointer data, gpointer user)
+{
+    GridJob *job = data;
+    AgFocusGrid *g = user;
+
+    score_row (g, job->eye, job->row);
+
+    g_mutex_lock (&g->lock);
+    if (--g->pending == 0)
+        g_cond_signal (&g->done);
+    g_mutex_unlock (&g->lock);
+}
+
+AgFocusGrid *
+ag_focus_grid_new (int cols, int rows, int threads)
+{
+    if (cols < 1 || rows < 1 ||
+        cols > AG_FOCUS_GRID_MAX || rows > AG_FOCUS_GRID_MAX)
+        return NULL;
+
+    AgFocusGrid *g = g_new0 (AgFocusGrid, 1);
+    g->cols = cols;
+    g->rows = rows;
+    for (int e = 0; e < 2; e++)
+        for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+            g->scores[e][m] = g_new0 (double, (gsize) cols * rows);
+
+    g->jobs = g_new (GridJob, 2 * rows);
+    for (int e = 0; e < 2; e++)
+        for (int r = 0; r < rows; r++)
+            g->jobs[e * rows + r] = (GridJob) { g, (AgFocusGridEye) e, r };
+
+    g_mutex_init (&g->lock);
+    g_cond_init (&g->done);
+    if (threads > 1)
+        g->pool = g_thread_pool_new (job_main, g, threads, TRUE, NULL);
+    return g;
+}
+
+void
+ag_focus_grid_free (AgFocusGrid *g)
+{
+    if (!g)
+        return;
+    if (g->pool)
+        g_thread_pool_free (g->pool, FALSE, TRUE);
+    g_mutex_clear (&g->lock);
+    g_cond_clear (&g->done);
+    for (int e = 0; e < 2; e++)
+        for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+            g_free (g->scores[e][m]);
+    g_free (g->jobs);
+    g_free (g);
+}
+
+void
+ag_focus_grid_score (AgFocusGrid *g,
+                     const AgFocusPlane *left, const AgFocusPlane *right,
+                     gboolean bayer_green)
+{
+    g->planes[AG_FOCUS_GRID_LEFT]  = *left;
+    g->planes[AG_FOCUS_GRID_RIGHT] = *right;
+    g->bayer_green = bayer_green;
+
+    if (!g->pool) {
+        for (int e = 0; e < 2; e++)
+            for (int r = 0; r < g->rows; r++)
+                score_row (g, (AgFocusGridEye) e, r);
+        return;
+    }
+
+    int n_jobs = 2 * g->rows;
+    g_mutex_lock (&g->lock);
+    g->pending = n_jobs;
+    g_mutex_unlock (&g->lock);
+
+    for (int j = 0; j < n_jobs; j++)
+        g_thread_pool_push (g->pool, &g->jobs[j], NULL);
+
+    g_mutex_lock (&g->lock);
+    while (g->pending > 0)
+        g_cond_wait (&g->done, &g->lock);
+    g_mutex_unlock (&g->lock);
+}
+
+const double *
+ag_focus_grid_tiles (const AgFocusGrid *g, AgFocusGridEye eye,
+                     AgFocusMetric metric)
+{
+    return g->scores[eye][metric];
+}
+
+void
+ag_focus_grid_write_csv_header (FILE *f, int cols, int rows)
+{
+    fputs ("frame,time_s,eye,metric,centre,tl,tr,bl,br,"
+           "ratio_tl,ratio_tr,ratio_bl,ratio_br,tilt_x,tilt_y", f);
+    for (int r = 0; r < rows; r++)
+        for (int c = 0; c < cols; c++)
+            fprintf (f, ",r%dc%d", r, c);
+    fputc ('\n', f);
+}
+
+void
+ag_focus_grid_write_csv_row (FILE *f, guint64 frame, double time_s,
+                             AgFocusGridEye eye, AgFocusMetric metric,
+                             const double *tiles, int cols, int rows,
+                             const AgFocusGridSummary *s)
+{
+    fprintf (f, "%" G_GUINT64_FORMAT ",%.6f,%s,%s,%.3f",
+             frame, time_s, eye == AG_FOCUS_GRID_LEFT ? "left" : "right",
+             ag_focus_metric_name (metric), s->centre);
+    for (int i = 0; i < 4; i++)
+        fprintf (f, ",%.3f", s->corner[i]);
+    for (int i = 0; i < 4; i++)
+        fprintf (f, ",%.4f", s->ratio[i]);
+    fprintf (f, ",%.4f,%.4f", s->tilt_x, s->tilt_y);
+    for (int i = 0; i < cols * rows; i++)
+        fprintf (f, ",%.3f", tiles[i]);
+    fputc ('\n', f);
+}
@@ -0,0 +1,104 @@
+/*
+ * focus_grid.h — per-tile focus scores for tilt and field-curvature checks
+ *
+ * Splits each eye into a grid of tiles (8x6 by default) and scores every
+ * tile with the single-pass engine (ag_focus_score_all), spreading the
+ * tile rows of both eyes over a small thread pool.  A sensor or lens
+ * that is tilted shows up as one side or corner scoring lower than the
+ * opposite one; field curvature as all corners scoring low against the
+ * centre.
+ *
+ *   AgFocusGrid *g = ag_focus_grid_new (8, 6, 4);
+ *   per frame:
+ *       ag_focus_grid_score (g, &left_plane, &right_plane, green);
+ *       tiles = ag_focus_grid_tiles (g, AG_FOCUS_GRID_LEFT, metric);
+ *       ag_focus_grid_summarize (tiles, 8, 6, &summary);
+ */
+
+#ifndef AG_FOCUS_GRID_H
+#define AG_FOCUS_GRID_H
+
+#include "focus.h"
+
+#include <stdio.h>
+#include <glib.h>
+
+#define AG_FOCUS_GRID_COLS_DEFAULT  8
+#define AG_FOCUS_GRID_ROWS_DEFAULT  6
+#define AG_FOCUS_GRID_MAX          32    /* tiles per axis */
+
+typedef enum {
+    AG_FOCUS_GRID_LEFT = 0,
+    AG_FOCUS_GRID_RIGHT,
+} AgFocusGridEye;
+
+/* Corner order used by AgFocusGridSummary. */
+enum { AG_FOCUS_GRID_TL = 0, AG_FOCUS_GRID_TR, AG_FOCUS_GRID_BL,
+       AG_FOCUS_GRID_BR };
+
+typedef struct {
+    double centre;        /* mean of the 1, 2 or 4 middle tiles */
+    double corner[4];     /* TL, TR, BL, BR tile scores */
+    double ratio[4];      /* corner / centre; 0 when centre is 0 */
+    double tilt_x;        /* (right column - left column) / their mean */
+    double tilt_y;        /* (bottom row - top row) / their mean */
+} AgFocusGridSummary;
+
+typedef struct AgFocusGrid AgFocusGrid;
+
+/*
+ * Parse "<cols>x<rows>" (e.g. "8x6").  Each side must be 1 to
+ * AG_FOCUS_GRID_MAX.  Returns 0 on success, -1 otherwise.
+ */
+int ag_focus_grid_parse_size (const char *s, int *cols, int *rows);
+
+/*
+ * Pixel rectangle of tile (col, row).  Tiles partition the image; edges
+ * are rounded down, so sizes differ by at most one pixel.
+ */
+void ag_focus_grid_tile_rect (int cols, int rows, int width, int height,
+                              int col, int row,
+                              int *x, int *y, int *w, int *h);
+
+/*
+ * Centre, corner ratios and edge tilt of one eye's tile scores
+ * (row-major, cols * rows).
+ */
+void ag_focus_grid_summarize (const double *tiles, int cols, int rows,
+                              AgFocusGridSummary *out);
+
+/*
+ * Create a grid scorer.  threads <= 1 scores on the caller's thread.
+ */
+AgFocusGrid *ag_focus_grid_new (int cols, int rows, int threads);
+void         ag_focus_grid_free (AgFocusGrid *g);
+
+/*
+ * Score every tile of both eyes.  Tiles are laid out over each plane's
+ * own width x height.  With bayer_green the planes are RGGB mosaics and
+ * only their green sites are scored (ag_focus_score_bayer_green), so
+ * the eyes of a DualBayer frame can be scored in place.  Blocks until
+ * all tiles are done.
+ */
+void ag_focus_grid_score (AgFocusGrid *g,
+                          const AgFocusPlane *left, const AgFocusPlane *right,
+                          gboolean bayer_green);
+
+/*
+ * Tile scores of one eye and metric from the last ag_focus_grid_score(),
+ * row-major.  Valid until the next call.
+ */
+const double *ag_focus_grid_tiles (const AgFocusGrid *g, AgFocusGridEye eye,
+                                   AgFocusMetric metric);
+
+/*
+ * CSV log: one line per eye per frame with the summary and every tile
+ * score of the chosen metric (columns r<row>c<col>).
+ */
+void ag_focus_grid_write_csv_header (FILE *f, int cols, int rows);
+void ag_focus_grid_write_csv_row (FILE *f, guint64 frame, double time_s,
+                                  AgFocusGridEye eye, AgFocusMetric metric,
+                                  const double *tiles, int cols, int rows,
+                                  const AgFocusGridSummary *s);
+
+#endif /* AG_FOCUS_GRID_H */
@@ -0,0 +1,310 @@
+/*
+ * focus_sweep.c — focus curve recording and peak prediction
+ *
+ * The peak is re-estimated on every push.  The best sample is found on a
+ * short moving average so one noisy frame cannot claim it, and the fit
+ * window grows outwards from there while the scores stay above
+ * AG_FOCUS_SWEEP_FIT_LEVEL of the maximum.  A fit only becomes the
+ * prediction once a later sample has dropped AG_FOCUS_SWEEP_DROP below
+ * the maximum; until the next confirmed fit the previous prediction is
+ * kept, raised to any higher score seen since.
+ */
+
+#include "focus_sweep.h"
+
+#include <math.h>
+#include <string.h>
+
+#define AG_FOCUS_SWEEP_DROP       0.1   /* confirm once 10% below the max */
+#define AG_FOCUS_SWEEP_MIN_SIDE   2     /* fit samples needed past the max */
+
+struct AgFocusSweep {
+    AgFocusFit fit;
+    guint      capacity;
+    guint      head;                /* next slot written */
+    guint      len;
+    double    *t;
+    double    *score[2];
+
+    gboolean    have_peak[2];
+    AgFocusPeak peak[2];
+};
+
+static const char *fit_names[] = { "parabola", "gaussian" };
+
+int
+ag_focus_fit_from_string (const char *name)
+{
+    if (!name)
+        return -1;
+    for (int i = 0; i < (int) G_N_ELEMENTS (fit_names); i++)
+        if (strcmp (name, fit_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+const char *
+ag_focus_fit_name (AgFocusFit fit)
+{
+    if (fit >= 0 && (int) fit < (int) G_N_ELEMENTS (fit_names))
+        return fit_names[fit];
+    return "unknown";
+}
+
+static double
+det3 (double a, double b, double c,
+      double d, double e, double f,
+      double g, double h, double i)
+{
+    return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+}
+
+gboolean
+ag_focus_fit_peak (const double *t, const double *y, int n,
+                   AgFocusFit fit, AgFocusPeak *out)
+{
+    if (n < 3)
+        return FALSE;
+
+    /* Weighted least squares for z = a x^2 + b x + c, x centred on the
+     * middle sample to keep the normal equations well conditioned. */
+    double tc = t[n / 2];
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+    double r0 = 0, r1 = 0, r2 = 0;
+    for (int i = 0; i < n; i++) {
+        double x = t[i] - tc, z = y[i], w = 1.0;
+        if (fit == AG_FOCUS_FIT_GAUSSIAN) {
+            if (y[i] <= 0.0)
+                return FALSE;
+            z = log (y[i]);
+            w = y[i] * y[i];
+        }
+        double x2 = x * x;
+        s0 += w;           s1 += w * x;       s2 += w * x2;
+        s3 += w * x2 * x;  s4 += w * x2 * x2;
+        r0 += w * z;       r1 += w * x * z;   r2 += w * x2 * z;
+    }
+
+    double d = det3 (s4, s3, s2, s3, s2, s1, s2, s1, s0);
+    if (fabs (d) < 1e-300)
+        return FALSE;
+    double a = det3 (r2, s3, s2, r1, s2, s1, r0, s1, s0) / d;
+    double b = det3 (s4, r2, s2, s3, r1, s1, s2, r0, s0) / d;
+    double c = det3 (s4, s3, r2, s3, s2, r1, s2, s1, r0) / d;
+    if (!(a < 0.0))
+        return FALSE;
+
+    double xv = -b / (2.0 * a);
+    if (xv < t[0] - tc || xv > t[n - 1] - tc)
+        return FALSE;
+
+    double zv = c - b * b / (4.0 * a);
+    out->t     = tc + xv;
+    out->score = fit == AG_FOCUS_FIT_GAUSSIAN ? exp (zv) : zv;
+    out->n     = n;
+    return TRUE;
+}
+
+AgFocusSweep *
+ag_focus_sweep_new (guint capacity, AgFocusFit fit)
+{
+    if (capacity < AG_FOCUS_SWEEP_SMOOTH)
+        capacity = AG_FOCUS_SWEEP_SMOOTH;
+    AgFocusSweep *s = g_new0 (AgFocusSweep, 1);
+    s->fit      = fit;
+    s->capacity = capacity;
+    s->t        = g_new (double, capacity);
+    s->score[0] = g_new (double, capacity);
+    s->score[1] = g_new (double, capacity);
+    return s;
+}
+
+void
+ag_focus_sweep_free (AgFocusSweep *s)
+{
+    if (!s)
+        return;
+    g_free (s->t);
+    g_free (s->score[0]);
+    g_free (s->score[1]);
+    g_free (s);
+}
+
+void
+ag_focus_sweep_reset (AgFocusSweep *s)
+{
+    s->head = 0;
+    s->len  = 0;
+    s->have_peak[0] = s->have_peak[1] = FALSE;
+}
+
+guint
+ag_focus_sweep_len (const AgFocusSweep *s)
+{
+    return s->len;
+}
+
+static inline guint
+slot (const AgFocusSweep *s, guint i)
+{
+    return (s->head + s->capacity - s->len + i) % s->capacity;
+}
+
+void
+ag_focus_sweep_get (const AgFocusSweep *s, guint i, double *t,
+                    double *left, double *right)
+{
+    guint k = slot (s, i);
+    if (t)
+        *t = s->t[k];
+    if (left)
+        *left = s->score[0][k];
+    if (right)
+        *right = s->score[1][k];
+}
+
+/* Mean of samples [i, i + n) of one eye. */
+static double
+mean_span (const AgFocusSweep *s, int eye, guint i, guint n)
+{
+    double sum = 0.0;
+    for (guint j = 0; j < n; j++)
+        sum += s->score[eye][slot (s, i + j)];
+    return sum / n;
+}
+
+static void
+update_peak (AgFocusSweep *s, int eye)
+{
+    if (s->len < AG_FOCUS_SWEEP_SMOOTH)
+        return;
+
+    /* Best sample on the moving average. */
+    const guint win = AG_FOCUS_SWEEP_SMOOTH;
+    double sum = 0.0, best = -1.0;
+    guint m = 0;
+    for (guint i = 0; i < s->len; i++) {
+        sum += s->score[eye][slot (s, i)];
+        if (i >= win)
+            sum -= s->score[eye][slot (s, i - win)];
+        if (i + 1 >= win && sum > best) {
+            best = sum;
+            m = i - win / 2;              /* window centre */
+        }
+    }
+    best /= win;
+
+    /* The fit only counts once the scores have fallen well past it. */
+    double floor_ = (1.0 - AG_FOCUS_SWEEP_DROP) * best;
+    gboolean dropped = FALSE;
+    for (guint i = m + 1; i < s->len && !dropped; i++)
+        dropped = s->score[eye][slot (s, i)] < floor_;
+
+    AgFocusPeak p;
+    gboolean fitted = FALSE;
+    if (dropped) {
+        double level = AG_FOCUS_SWEEP_FIT_LEVEL * best;
+        guint lo = m, hi = m;
+        while (lo > 0 && m - (lo - 1) <= AG_FOCUS_SWEEP_FIT_HALF &&
+               s->score[eye][slot (s, lo - 1)] >= level)
+            lo--;
+        while (hi + 1 < s->len && hi + 1 - m <= AG_FOCUS_SWEEP_FIT_HALF &&
+               s->score[eye][slot (s, hi + 1)] >= level)
+            hi++;
+
+        if (m - lo >= AG_FOCUS_SWEEP_MIN_SIDE &&
+            hi - m >= AG_FOCUS_SWEEP_MIN_SIDE) {
+            double t[2 * AG_FOCUS_SWEEP_FIT_HALF + 1];
+            double y[2 * AG_FOCUS_SWEEP_FIT_HALF + 1];
+            int n = 0;
+            for (guint i = lo; i <= hi; i++, n++) {
+                t[n] = s->t[slot (s, i)];
+                y[n] = s->score[eye][slot (s, i)];
+            }
+            fitted = ag_focus_fit_peak (t, y, n, s->fit, &p);
+        }
+    }
+
+    if (fitted) {
+        s->peak[eye] = p;
+        s->have_peak[eye] = TRUE;
+    } else if (s->have_peak[eye] && best > s->peak[eye].score) {
+        s->peak[eye].score = best;
+        s->peak[eye].t = s->t[slot (s, m)];
+    }
+}
+
+void
+ag_focus_sweep_push (AgFocusSweep *s, double t, double left, double right)
+{
+    s->t[s->head]        = t;
+    s->score[0][s->head] = left;
+    s->score[1][s->head] = right;
+    s->head = (s->head + 1) % s->capacity;
+    if (s->len < s->capacity)
+        s->len++;
+
+    update_peak (s, AG_FOCUS_SWEEP_LEFT);
+    update_peak (s, AG_FOCUS_SWEEP_RIGHT);
+}
+
+gboolean
+ag_focus_sweep_peak (const AgFocusSweep *s, AgFocusSweepEye eye,
+                     AgFocusPeak *out)
+{
+    if (!s->have_peak[eye])
+        return FALSE;
+    *out = s->peak[eye];
+    return TRUE;
+}
+
+float
+ag_focus_sweep_cue (const AgFocusSweep *s)
+{
+    float cue = 1.0f;
+    gboolean any = FALSE;
+    guint win = MIN (s->len, (guint) AG_FOCUS_SWEEP_SMOOTH);
+
+    for (int e = 0; e < 2; e++) {
+        if (!s->have_peak[e] || s->peak[e].score <= 0.0 || win == 0)
+            continue;
+        double now = mean_span (s, e, s->len - win, win);
+        double dist = (s->peak[e].score - now) / s->peak[e].score;
+        dist = CLAMP (dist, 0.0, 1.0);
+
+        /* Rising or falling: this window against the one before it. */
+        gboolean rising = TRUE;
+        if (s->len >= 2 * win)
+            rising = now >= mean_span (s, e, s->len - 2 * win, win);
+
+        if (!any || dist > fabsf (cue)) {
+            cue = (float) (rising ? dist : -dist);
+            any = TRUE;
+        }
+    }
+    return cue;
+}
+
+void
+ag_focus_sweep_write_csv_header (FILE *f)
+{
+    fputs ("frame,time_s,left,right,"
+           "peak_left_t,peak_left,peak_right_t,peak_right\n", f);
+}
+
+void
+ag_focus_sweep_write_csv_row (FILE *f, guint64 frame, const AgFocusSweep *s)
+{
+    if (s->len == 0)
+        return;
+    double t, l, r;
+    ag_focus_sweep_get (s, s->len - 1, &t, &l, &r);
+    fprintf (f, "%" G_GUINT64_FORMAT ",%.6f,%.3f,%.3f", frame, t, l, r);
+    for (int e = 0; e < 2; e++) {
+        if (s->have_peak[e])
+            fprintf (f, ",%.6f,%.3f", s->peak[e].t, s->peak[e].score);
+        else
+            fputs (",,", f);
+    }
+    fputc ('\n', f);
+}
@@ -0,0 +1,100 @@
+/*
+ * focus_sweep.h — focus curve recording and peak prediction
+ *
+ * While the operator turns a lens through focus, every frame's score for
+ * both eyes goes into a fixed-size ring of timestamped samples.  Around
+ * the best sample seen so far, a parabola (or a Gaussian, i.e. a
+ * parabola in log score) is fitted by least squares; its vertex is the
+ * predicted peak.  The peak only counts once the sweep has passed it,
+ * so there are samples on both sides of the maximum.
+ *
+ *   AgFocusSweep *s = ag_focus_sweep_new (4096, AG_FOCUS_FIT_GAUSSIAN);
+ *   per frame:
+ *       ag_focus_sweep_push (s, t, left, right);
+ *       if (ag_focus_sweep_peak (s, AG_FOCUS_SWEEP_LEFT, &peak)) ...
+ *       cue = ag_focus_sweep_cue (s);
+ */
+
+#ifndef AG_FOCUS_SWEEP_H
+#define AG_FOCUS_SWEEP_H
+
+#include <stdio.h>
+#include <glib.h>
+
+#define AG_FOCUS_SWEEP_CAPACITY_DEFAULT  4096  /* samples, ~34 s at 120 Hz */
+#define AG_FOCUS_SWEEP_FIT_HALF           256  /* fit samples each side, at most */
+#define AG_FOCUS_SWEEP_FIT_LEVEL          0.5  /* fit samples above this * max */
+#define AG_FOCUS_SWEEP_SMOOTH               5  /* moving average for the max */
+
+typedef enum {
+    AG_FOCUS_SWEEP_LEFT = 0,
+    AG_FOCUS_SWEEP_RIGHT,
+} AgFocusSweepEye;
+
+typedef enum {
+    AG_FOCUS_FIT_PARABOLA = 0,
+    AG_FOCUS_FIT_GAUSSIAN,
+} AgFocusFit;
+
+typedef struct {
+    double t;        /* time of the peak, seconds */
+    double score;    /* predicted peak score */
+    int    n;        /* samples in the fit */
+} AgFocusPeak;
+
+typedef struct AgFocusSweep AgFocusSweep;
+
+/* "parabola" / "gaussian"; -1 if unknown. */
+int         ag_focus_fit_from_string (const char *name);
+const char *ag_focus_fit_name (AgFocusFit fit);
+
+/*
+ * Fit y(t) around its maximum and return its vertex.  Gaussian fits use
+ * ln y weighted by y^2 and need every y > 0.  Returns TRUE when the
+ * curve opens downwards and the vertex lies within [t[0], t[n-1]] (t
+ * ascending); needs n >= 3.
+ */
+gboolean ag_focus_fit_peak (const double *t, const double *y, int n,
+                            AgFocusFit fit, AgFocusPeak *out);
+
+/* capacity is clamped to at least AG_FOCUS_SWEEP_SMOOTH. */
+AgFocusSweep *ag_focus_sweep_new (guint capacity, AgFocusFit fit);
+void          ag_focus_sweep_free (AgFocusSweep *s);
+
+/* Drop every sample, e.g. to start a new sweep. */
+void  ag_focus_sweep_reset (AgFocusSweep *s);
+
+/* Append one frame; the oldest sample is overwritten when full. */
+void  ag_focus_sweep_push (AgFocusSweep *s, double t,
+                           double left, double right);
+
+guint ag_focus_sweep_len (const AgFocusSweep *s);
+
+/* Sample i, 0 being the oldest still held. */
+void  ag_focus_sweep_get (const AgFocusSweep *s, guint i, double *t,
+                          double *left, double *right);
+
+/*
+ * Predicted peak of one eye from the samples held.  FALSE until the
+ * sweep has gone past the maximum far enough to fit both flanks.
+ */
+gboolean ag_focus_sweep_peak (const AgFocusSweep *s, AgFocusSweepEye eye,
+                              AgFocusPeak *out);
+
+/*
+ * Audio cue in [-1, 1]: the distance of the latest score below the
+ * predicted peak, as a fraction of the peak, for whichever eye is
+ * further off.  Positive while that eye's score is rising, negative
+ * once it falls (the lens has gone past).  1 before any peak is known.
+ */
+float ag_focus_sweep_cue (const AgFocusSweep *s);
+
+/*
+ * CSV log: one line per frame with both scores and the current peak
+ * predictions (empty fields while no peak is known).
+ */
+void ag_focus_sweep_write_csv_header (FILE *f);
+void ag_focus_sweep_write_csv_row (FILE *f, guint64 frame,
+                                   const AgFocusSweep *s);
+
+#endif /* AG_FOCUS_SWEEP_H */
@@ -1,11 +1,11 @@
 /*
  * image.c — image encoding for ag-cam-tools
  *
- * This is the single compilation unit that defines the stb_image_write
- * implementation.
+ * PNG goes through png_fast.c and JPEG through jpeg_enc.c.
  */
 
 #include "image.h"
+#include "arena.h"
 #include "common.h"
 
 #include <errno.h>
@@ -13,11 +13,99 @@
 #include <stdlib.h>
 #include <string.h>
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-function"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "../vendor/stb_image_write.h"
-#pragma GCC diagnostic pop
+/* ------------------------------------------------------------------ */
+/*  Per-thread scratch arena                                           */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Encode scratch (gamma copies, debayered RGB, rectified planes) lives in
+ * one aligned arena per thread, grown to the largest frame seen and then
+ * reused, so repeated saves do no heap work.  Nested helpers carve from
+ * the same arena between a mark/release pair; the outermost caller
+ * reserves room for them.
+ */
+static GPrivate image_scratch_key =
+    G_PRIVATE_INIT ((GDestroyNotify) ag_frame_arena_free);
+
+static AgFrameArena *
+image_scratch (size_t need)
+{
+    AgFrameArena *arena = g_private_get (&image_scratch_key);
+    if (arena && ag_frame_arena_available (arena) >= need)
+        return arena;
+
+    /* Only grow when idle — live sub-buffers must not move. */
+    if (arena && ag_frame_arena_used (arena) != 0)
+        return arena;
+
+    arena = ag_frame_arena_new (need, AG_ARENA_HUGEPAGES);
+    g_private_replace (&image_scratch_key, arena);
+    return arena;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Encoder settings                                                   */
+/* ------------------------------------------------------------------ */
+
+static AgPngOptions png_options;
+static gboolean     png_options_set;
+
+void
+image_set_png_options (const AgPngOptions *opts)
+{
+    png_options = *opts;
+    png_options_set = TRUE;
+}
+
+static const AgPngOptions *
+image_png_options (void)
+{
+    if (!png_options_set) {
+        ag_png_options_defaults (&png_options);
+        png_options_set = TRUE;
+    }
+    return &png_options;
+}
+
+static AgJpegOptions jpeg_options;
+static gboolean      jpeg_options_set;
+
+void
+image_set_jpeg_options (const AgJpegOptions *opts)
+{
+    jpeg_options = *opts;
+    jpeg_options_set = TRUE;
+}
+
+static const AgJpegOptions *
+image_jpeg_options (void)
+{
+    if (!jpeg_options_set) {
+        ag_jpeg_options_defaults (&jpeg_options);
+        jpeg_options_set = TRUE;
+    }
+    return &jpeg_options;
+}
+
+/* Encode tightly packed gray (channels = 1) or RGB pixels. */
+static int
+encode_pixels (AgEncFormat enc, const char *path, const guint8 *pixels,
+               guint width, guint height, int channels)
+{
+    if (enc == AG_ENC_PNG)
+        return ag_png_write (path, pixels, width, height, channels,
+                             (size_t) width * (size_t) channels,
+                             image_png_options ());
+
+    AgJpegImage img = {
+        .source  = channels == 3 ? AG_JPEG_RGB : AG_JPEG_GRAY,
+        .width   = width,
+        .height  = height,
+        .planes  = { pixels },
+        .strides = { (size_t) width * (size_t) channels },
+    };
+    return ag_jpeg_write (path, &img, image_jpeg_options ());
+}
 
 int
 parse_enc_format (const char *str, AgEncFormat *out)
@@ -58,34 +146,19 @@ write_color_image (AgEncFormat enc, const char *path,
                    const guint8 *bayer, guint width, guint height)
 {
     size_t bayer_n = (size_t) width * (size_t) height;
-    guint8 *gamma_bayer = g_malloc (bayer_n);
-    guint8 *rgb = g_malloc (bayer_n * 3);
-    if (!gamma_bayer || !rgb) {
-        g_free (gamma_bayer);
-        g_free (rgb);
-        fprintf (stderr, "error: out of memory for debayer buffer\n");
-        return EXIT_FAILURE;
-    }
+    AgFrameArena *arena = image_scratch (AG_ARENA_ROUND (bayer_n) +
+                                         AG_ARENA_ROUND (bayer_n * 3));
+    size_t mark = ag_frame_arena_mark (arena);
+    guint8 *gamma_bayer = ag_frame_arena_alloc (arena, bayer_n);
+    guint8 *rgb = ag_frame_arena_alloc (arena, bayer_n * 3);
 
     memcpy (gamma_bayer, bayer, bayer_n);
     apply_lut_inplace (gamma_bayer, bayer_n, gamma_lut_2p5 ());
     debayer_rg8_to_rgb (gamma_bayer, rgb, width, height);
 
-    int ok;
-    if (enc == AG_ENC_PNG)
-        ok = stbi_write_png (path, (int) width, (int) height, 3, rgb,
-                             (int) width * 3);
-    else
-        ok = stbi_write_jpg (path, (int) width, (int) height, 3, rgb, 90);
-
-    g_free (gamma_bayer);
-    g_free (rgb);
-
-    if (!ok) {
-        fprintf (stderr, "error: failed to write '%s'\n", path);
-        return EXIT_FAILURE;
-    }
-    return EXIT_SUCCESS;
+    int rc = encode_pixels (enc, path, rgb, width, height, 3);
+    ag_frame_arena_release (arena, mark);
+    return rc;
 }
 
 int
@@ -93,51 +166,16 @@ write_gray_image (AgEncFormat enc, const char *path,
                   const guint8 *gray, guint width, guint height)
 {
     size_t n = (size_t) width * (size_t) height;
-    guint8 *gamma_gray = g_malloc (n);
-    if (!gamma_gray) {
-        fprintf (stderr, "error: out of memory for gamma buffer\n");
-        return EXIT_FAILURE;
-    }
+    AgFrameArena *arena = image_scratch (AG_ARENA_ROUND (n));
+    size_t mark = ag_frame_arena_mark (arena);
+    guint8 *gamma_gray = ag_frame_arena_alloc (arena, n);
 
     memcpy (gamma_gray, gray, n);
     apply_lut_inplace (gamma_gray, n, gamma_lut_2p5 ());
 
-    int ok;
-    if (enc == AG_ENC_PNG)
-        ok = stbi_write_png (path, (int) width, (int) height, 1, gamma_gray,
-                             (int) width);
-    else
-        ok = stbi_write_jpg (path, (int) width, (int) height, 1, gamma_gray, 90);
-
-    g_free (gamma_gray);
-
-    if (!ok) {
-        fprintf (stderr, "error: failed to write '%s'\n", path);
-        return EXIT_FAILURE;
-    }
-    return EXIT_SUCCESS;
-}
-
-/*
- * Write a single rectified image (RGB24 data already gamma-corrected,
- * debayered, and remapped).
- */
-static int
-write_rgb_image_raw (AgEncFormat enc, const char *path,
-                     const guint8 *rgb, guint width, guint height)
-{
-    int ok;
-    if (enc == AG_ENC_PNG)
-        ok = stbi_write_png (path, (int) width, (int) height, 3, rgb,
-                             (int) width * 3);
-    else
-        ok = stbi_write_jpg (path, (int) width, (int) height, 3, rgb, 90);
-
-    if (!ok) {
-        fprintf (stderr, "error: failed to write '%s'\n", path);
-        return EXIT_FAILURE;
-    }
-    return EXIT_SUCCESS;
+    int rc = encode_pixels (enc, path, gamma_gray, width, height, 1);
+    ag_frame_arena_release (arena, mark);
+    return rc;
 }
 
 int
@@ -167,14 +205,14 @@ write_dual_bayer_pair (const char *output_dir,
     }
 
     size_t eye_n = (size_t) dst_w * (size_t) dst_h;
-    guint8 *left  = g_malloc (eye_n);
-    guint8 *right = g_malloc (eye_n);
-    if (!left || !right) {
-        g_free (left);
-        g_free (right);
-        fprintf (stderr, "error: out of memory while extracting DualBayer frame\n");
-        return EXIT_FAILURE;
-    }
+
+    /* Worst case: both eyes plus four RGB planes on the rectified path
+     * (this also covers write_color_image's gamma + RGB scratch). */
+    AgFrameArena *arena = image_scratch (AG_ARENA_ROUND (eye_n) * 2 +
+                                         AG_ARENA_ROUND (eye_n * 3) * 4);
+    size_t mark = ag_frame_arena_mark (arena);
+    guint8 *left  = ag_frame_arena_alloc (arena, eye_n);
+    guint8 *right = ag_frame_arena_alloc (arena, eye_n);
 
     extract_dual_bayer_eyes (interleaved, width, height, software_binning,
                              left, right);
@@ -195,20 +233,18 @@ write_dual_bayer_pair (const char *output_dir,
 
         if (enc == AG_ENC_PGM) {
             /* PGM: remap grayscale, then write. */
-            guint8 *rect_l = g_malloc (eye_n);
-            guint8 *rect_r = g_malloc (eye_n);
+            guint8 *rect_l = ag_frame_arena_alloc (arena, eye_n);
+            guint8 *rect_r = ag_frame_arena_alloc (arena, eye_n);
 
             if (data_is_bayer) {
-                guint8 *gray_l  = g_malloc (eye_n);
-                guint8 *gray_r  = g_malloc (eye_n);
+                guint8 *gray_l  = ag_frame_arena_alloc (arena, eye_n);
+                guint8 *gray_r  = ag_frame_arena_alloc (arena, eye_n);
 
                 debayer_rg8_to_gray (left,  gray_l, dst_w, dst_h);
                 debayer_rg8_to_gray (right, gray_r, dst_w, dst_h);
 
                 ag_remap_gray (remap_left,  gray_l, rect_l);
                 ag_remap_gray (remap_right, gray_r, rect_r);
-                g_free (gray_l);
-                g_free (gray_r);
             } else {
                 ag_remap_gray (remap_left,  left,  rect_l);
                 ag_remap_gray (remap_right, right, rect_r);
@@ -216,33 +252,31 @@ write_dual_bayer_pair (const char *output_dir,
 
             rc_left  = write_pgm (left_path,  rect_l, dst_w, dst_h);
             rc_right = write_pgm (right_path, rect_r, dst_w, dst_h);
-            g_free (rect_l);
-            g_free (rect_r);
+        } else if (!data_is_bayer) {
+            /* PNG/JPG from gray: remap and encode one channel. */
+            guint8 *rect_l = ag_frame_arena_alloc (arena, eye_n);
+            guint8 *rect_r = ag_frame_arena_alloc (arena, eye_n);
+
+            ag_remap_gray (remap_left,  left,  rect_l);
+            ag_remap_gray (remap_right, right, rect_r);
+
+            rc_left  = encode_pixels (enc, left_path,  rect_l, dst_w, dst_h, 1);
+            rc_right = encode_pixels (enc, right_path, rect_r, dst_w, dst_h, 1);
         } else {
-            /* PNG/JPG: debayer/expand to RGB, remap RGB, encode. */
-            guint8 *rgb_l = g_malloc (eye_n * 3);
-            guint8 *rgb_r = g_malloc (eye_n * 3);
-            guint8 *rect_l = g_malloc (eye_n * 3);
-            guint8 *rect_r = g_malloc (eye_n * 3);
-
-            if (data_is_bayer) {
-                debayer_rg8_to_rgb (left,  rgb_l, dst_w, dst_h);
-                debayer_rg8_to_rgb (right, rgb_r, dst_w, dst_h);
-            } else {
-                gray_to_rgb_replicate (left,  rgb_l, (uint32_t) eye_n);
-                gray_to_rgb_replicate (right, rgb_r, (uint32_t) eye_n);
-            }
+            /* PNG/JPG: debayer to RGB, remap RGB, encode. */
+            guint8 *rgb_l  = ag_frame_arena_alloc (arena, eye_n * 3);
+            guint8 *rgb_r  = ag_frame_arena_alloc (arena, eye_n * 3);
+            guint8 *rect_l = ag_frame_arena_alloc (arena, eye_n * 3);
+            guint8 *rect_r = ag_frame_arena_alloc (arena, eye_n * 3);
+
+            debayer_rg8_to_rgb (left,  rgb_l, dst_w, dst_h);
+            debayer_rg8_to_rgb (right, rgb_r, dst_w, dst_h);
 
             ag_remap_rgb (remap_left,  rgb_l, rect_l);
             ag_remap_rgb (remap_right, rgb_r, rect_r);
 
-            rc_left  = write_rgb_image_raw (enc, left_path,  rect_l, dst_w, dst_h);
-            rc_right = write_rgb_image_raw (enc, right_path, rect_r, dst_w, dst_h);
-
-            g_free (rgb_l);
-            g_free (rgb_r);
-            g_free (rect_l);
-            g_free (rect_r);
+            rc_left  = encode_pixels (enc, left_path,  rect_l, dst_w, dst_h, 3);
+            rc_right = encode_pixels (enc, right_path, rect_r, dst_w, dst_h, 3);
         }
     } else if (enc == AG_ENC_PGM) {
         rc_left  = write_pgm (left_path,  left,  dst_w, dst_h);
@@ -266,8 +300,7 @@ write_dual_bayer_pair (const char *output_dir,
     g_free (right_name);
     g_free (left_path);
     g_free (right_path);
-    g_free (left);
-    g_free (right);
+    ag_frame_arena_release (arena, mark);
 
     return (rc_left == EXIT_SUCCESS && rc_right == EXIT_SUCCESS)
            ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -7,6 +7,8 @@
 
 #include <glib.h>
 
+#include "jpeg_enc.h"
+#include "png_fast.h"
 #include "remap.h"
 
 typedef enum { AG_ENC_PGM, AG_ENC_PNG, AG_ENC_JPG } AgEncFormat;
@@ -15,6 +17,17 @@ typedef enum { AG_ENC_PGM, AG_ENC_PNG, AG_ENC_JPG } AgEncFormat;
  * success, -1 on unrecognised format. */
 int parse_enc_format (const char *str, AgEncFormat *out);
 
+/*
+ * PNG compression level, filter and threads used by every writer below
+ * (defaults: ag_png_options_defaults).  Set once, before any writer
+ * thread starts.
+ */
+void image_set_png_options (const AgPngOptions *opts);
+
+/* JPEG quality and chroma subsampling, likewise (defaults:
+ * ag_jpeg_options_defaults). */
+void image_set_jpeg_options (const AgJpegOptions *opts);
+
 /* Write a single-channel 8-bit PGM. */
 int write_pgm (const char *path, const guint8 *data, guint width, guint height);
 
@@ -34,7 +47,8 @@ int write_gray_image (AgEncFormat enc, const char *path,
  * as grayscale instead of incorrectly debayering.
  *
  * When remap_left/remap_right are non-NULL, rectification is applied
- * after debayering (or gray expansion) and before encoding.
+ * after debayering and before encoding; gray data is remapped and encoded
+ * as one channel.
  * Pass NULL for both to skip rectification (backward compatible).
  */
 int write_dual_bayer_pair (const char *output_dir,
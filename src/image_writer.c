@@ -0,0 +1,188 @@
+/*
+ * image_writer.c — asynchronous image encoding and writing
+ *
+ * One mutex guards both queues.  Writers take jobs from the head of
+ * `queue` and put them, with their status, on `finished`; the
+ * dispatching thread drains `finished` outside the lock.  `space` wakes
+ * blocked submitters, `idle` wakes flush() once nothing is queued or
+ * being written.
+ */
+
+#include "image_writer.h"
+
+#include <stdlib.h>
+
+typedef struct {
+    AgImageJob job;
+    int        status;
+} Entry;
+
+struct AgImageWriter {
+    GThread **threads;
+    int       n_threads;
+    guint     queue_max;
+
+    GMutex    lock;
+    GCond     work;               /* queue non-empty or quit */
+    GCond     space;              /* queue below queue_max */
+    GCond     idle;               /* nothing queued or active */
+    GQueue    queue;              /* Entry *, waiting for a writer */
+    GQueue    finished;           /* Entry *, waiting for dispatch */
+    gboolean  quit;
+
+    AgImageWriterStats stats;
+};
+
+static gpointer
+writer_main (gpointer data)
+{
+    AgImageWriter *w = data;
+
+    g_mutex_lock (&w->lock);
+    for (;;) {
+        while (g_queue_is_empty (&w->queue) && !w->quit)
+            g_cond_wait (&w->work, &w->lock);
+        if (g_queue_is_empty (&w->queue))
+            break;
+
+        Entry *e = g_queue_pop_head (&w->queue);
+        w->stats.queued--;
+        w->stats.active++;
+        g_cond_signal (&w->space);
+        g_mutex_unlock (&w->lock);
+
+        e->status = e->job.write (e->job.frame);
+        if (e->job.free_frame)
+            e->job.free_frame (e->job.frame);
+        e->job.frame = NULL;
+
+        g_mutex_lock (&w->lock);
+        w->stats.active--;
+        if (e->status == EXIT_SUCCESS)
+            w->stats.written++;
+        else
+            w->stats.failed++;
+        g_queue_push_tail (&w->finished, e);
+        if (w->stats.queued == 0 && w->stats.active == 0)
+            g_cond_broadcast (&w->idle);
+    }
+    g_mutex_unlock (&w->lock);
+    return NULL;
+}
+
+AgImageWriter *
+ag_image_writer_new (int threads, guint queue_max)
+{
+    AgImageWriter *w = g_new0 (AgImageWriter, 1);
+    w->n_threads = CLAMP (threads, 1, AG_IMAGE_WRITER_THREADS_MAX);
+    w->queue_max = MAX (queue_max, 1);
+    g_mutex_init (&w->lock);
+    g_cond_init (&w->work);
+    g_cond_init (&w->space);
+    g_cond_init (&w->idle);
+    g_queue_init (&w->queue);
+    g_queue_init (&w->finished);
+
+    w->threads = g_new (GThread *, w->n_threads);
+    for (int i = 0; i < w->n_threads; i++)
+        w->threads[i] = g_thread_new ("image-writer", writer_main, w);
+    return w;
+}
+
+void
+ag_image_writer_free (AgImageWriter *w)
+{
+    if (!w)
+        return;
+    ag_image_writer_flush (w);
+
+    g_mutex_lock (&w->lock);
+    w->quit = TRUE;
+    g_cond_broadcast (&w->work);
+    g_mutex_unlock (&w->lock);
+    for (int i = 0; i < w->n_threads; i++)
+        g_thread_join (w->threads[i]);
+
+    ag_image_writer_dispatch (w);
+    g_free (w->threads);
+    g_mutex_clear (&w->lock);
+    g_cond_clear (&w->work);
+    g_cond_clear (&w->space);
+    g_cond_clear (&w->idle);
+    g_free (w);
+}
+
+gboolean
+ag_image_writer_submit (AgImageWriter *w, const AgImageJob *job,
+                        gboolean block)
+{
+    g_mutex_lock (&w->lock);
+    if (w->stats.queued >= w->queue_max) {
+        if (!block) {
+            w->stats.rejected++;
+            g_mutex_unlock (&w->lock);
+            return FALSE;
+        }
+        w->stats.blocked++;
+        while (w->stats.queued >= w->queue_max)
+            g_cond_wait (&w->space, &w->lock);
+    }
+
+    Entry *e = g_new (Entry, 1);
+    e->job = *job;
+    e->status = EXIT_FAILURE;
+    g_queue_push_tail (&w->queue, e);
+    w->stats.submitted++;
+    w->stats.queued++;
+    w->stats.high_water = MAX (w->stats.high_water, w->stats.queued);
+    g_cond_signal (&w->work);
+    g_mutex_unlock (&w->lock);
+    return TRUE;
+}
+
+guint
+ag_image_writer_dispatch (AgImageWriter *w)
+{
+    g_mutex_lock (&w->lock);
+    GQueue done = w->finished;
+    g_queue_init (&w->finished);
+    g_mutex_unlock (&w->lock);
+
+    guint n = 0;
+    Entry *e;
+    while ((e = g_queue_pop_head (&done))) {
+        if (e->job.done)
+            e->job.done (e->job.user_data, e->status);
+        g_free (e);
+        n++;
+    }
+    return n;
+}
+
+void
+ag_image_writer_flush (AgImageWriter *w)
+{
+    g_mutex_lock (&w->lock);
+    while (w->stats.queued > 0 || w->stats.active > 0)
+        g_cond_wait (&w->idle, &w->lock);
+    g_mutex_unlock (&w->lock);
+    ag_image_writer_dispatch (w);
+}
+
+guint
+ag_image_writer_pending (AgImageWriter *w)
+{
+    g_mutex_lock (&w->lock);
+    guint n = w->stats.queued + w->stats.active +
+              g_queue_get_length (&w->finished);
+    g_mutex_unlock (&w->lock);
+    return n;
+}
+
+void
+ag_image_writer_stats (AgImageWriter *w, AgImageWriterStats *out)
+{
+    g_mutex_lock (&w->lock);
+    *out = w->stats;
+    g_mutex_unlock (&w->lock);
+}
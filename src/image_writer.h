@@ -0,0 +1,87 @@
+/*
+ * image_writer.h — asynchronous image encoding and writing
+ *
+ * Encoding a full-resolution PNG takes far longer than a frame period,
+ * so callers that save while they stream hand the work to a pool of
+ * writer threads instead.  A job carries a frame the caller gives up
+ * (no copy is made), the function that writes it and an optional
+ * completion callback:
+ *
+ *   AgImageWriter *w = ag_image_writer_new (2, 4);
+ *   AgImageJob job = { write_pair, pair, free_pair, pair_saved, ui };
+ *   if (!ag_image_writer_submit (w, &job, FALSE))
+ *       the queue is full: job.frame still belongs to the caller
+ *   per frame:
+ *       ag_image_writer_dispatch (w);    runs pair_saved() for finished jobs
+ *   on exit (also after SIGINT):
+ *       ag_image_writer_free (w);        writes everything still queued
+ *
+ * At most queue_max jobs wait for a writer.  A full queue either blocks
+ * the submitter or rejects the job, and both are counted, so callers
+ * can report when saving cannot keep up.  Completion callbacks always
+ * run on the thread that calls ag_image_writer_dispatch(), flush() or
+ * free(), never on a writer, so they may touch UI state.
+ */
+
+#ifndef AG_IMAGE_WRITER_H
+#define AG_IMAGE_WRITER_H
+
+#include <glib.h>
+
+#define AG_IMAGE_WRITER_THREADS_MAX  16
+
+/* Runs on a writer thread.  Returns EXIT_SUCCESS or EXIT_FAILURE. */
+typedef int  (*AgImageWriteFunc) (gpointer frame);
+
+/* Runs on the dispatching thread once the job is written and freed. */
+typedef void (*AgImageDoneFunc)  (gpointer user_data, int status);
+
+typedef struct {
+    AgImageWriteFunc write;
+    gpointer         frame;       /* owned by the writer once submitted */
+    GDestroyNotify   free_frame;  /* called after write; may be NULL */
+    AgImageDoneFunc  done;        /* may be NULL */
+    gpointer         user_data;   /* passed to done */
+} AgImageJob;
+
+typedef struct {
+    guint64 submitted;
+    guint64 written;
+    guint64 failed;
+    guint64 rejected;     /* non-blocking submits refused: queue full */
+    guint64 blocked;      /* blocking submits that had to wait */
+    guint   queued;       /* waiting for a writer now */
+    guint   active;       /* being written now */
+    guint   high_water;   /* most jobs ever waiting at once */
+} AgImageWriterStats;
+
+typedef struct AgImageWriter AgImageWriter;
+
+/* threads is clamped to [1, AG_IMAGE_WRITER_THREADS_MAX], queue_max to
+ * at least 1. */
+AgImageWriter *ag_image_writer_new (int threads, guint queue_max);
+
+/* Flush (running the remaining callbacks), then stop the threads. */
+void ag_image_writer_free (AgImageWriter *w);
+
+/*
+ * Queue one job.  With a full queue, block = TRUE waits for room and
+ * block = FALSE returns FALSE at once, leaving job->frame with the
+ * caller.  TRUE: the writer owns job->frame.
+ */
+gboolean ag_image_writer_submit (AgImageWriter *w, const AgImageJob *job,
+                                 gboolean block);
+
+/* Run the callbacks of jobs finished since the last call; returns how
+ * many ran.  Never waits. */
+guint ag_image_writer_dispatch (AgImageWriter *w);
+
+/* Wait until every submitted job is written, then dispatch. */
+void ag_image_writer_flush (AgImageWriter *w);
+
+/* Jobs submitted but not yet dispatched. */
+guint ag_image_writer_pending (AgImageWriter *w);
+
+void ag_image_writer_stats (AgImageWriter *w, AgImageWriterStats *out);
+
+#endif /* AG_IMAGE_WRITER_H */
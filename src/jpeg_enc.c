@@ -0,0 +1,347 @@
+/*
+ * jpeg_enc.c — JPEG encoding, libjpeg-turbo when available
+ *
+ * Without HAVE_LIBJPEG this is the single compilation unit that defines
+ * the stb_image_write implementation.
+ */
+
+#include "jpeg_enc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+#else
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../vendor/stb_image_write.h"
+#pragma GCC diagnostic pop
+#endif
+
+void
+ag_jpeg_options_defaults (AgJpegOptions *opts)
+{
+    opts->quality   = AG_JPEG_QUALITY_DEFAULT;
+    opts->subsample = AG_JPEG_SUBSAMPLE_420;
+}
+
+int
+ag_jpeg_parse_subsample (const char *str, AgJpegSubsample *out)
+{
+    if (strcmp (str, "420") == 0)
+        { *out = AG_JPEG_SUBSAMPLE_420; return 0; }
+    if (strcmp (str, "444") == 0)
+        { *out = AG_JPEG_SUBSAMPLE_444; return 0; }
+    return -1;
+}
+
+const char *
+ag_jpeg_backend_name (void)
+{
+#if defined(HAVE_LIBJPEG) && defined(LIBJPEG_TURBO_VERSION)
+    return "libjpeg-turbo";
+#elif defined(HAVE_LIBJPEG)
+    return "libjpeg";
+#else
+    return "stb";
+#endif
+}
+
+/* Plane dimensions, as the encoder reads them. */
+static void
+plane_size (const AgJpegImage *img, AgJpegSubsample subsample, int plane,
+            guint *w, guint *h)
+{
+    *w = img->width;
+    *h = img->height;
+    if (img->source == AG_JPEG_YCBCR && plane > 0 &&
+        subsample == AG_JPEG_SUBSAMPLE_420) {
+        *w = (img->width + 1) / 2;
+        *h = (img->height + 1) / 2;
+    }
+}
+
+static gboolean
+check_image (const AgJpegImage *img, AgJpegSubsample subsample)
+{
+    if (img->width == 0 || img->height == 0 ||
+        img->width > 65500 || img->height > 65500)
+        return FALSE;
+    int n = img->source == AG_JPEG_YCBCR ? 3 : 1;
+    size_t bpp = img->source == AG_JPEG_RGB ? 3 : 1;
+    for (int p = 0; p < n; p++) {
+        guint w, h;
+        plane_size (img, subsample, p, &w, &h);
+        if (!img->planes[p] || img->strides[p] < (size_t) w * bpp)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+#ifdef HAVE_LIBJPEG
+
+/* ------------------------------------------------------------------ */
+/*  libjpeg                                                            */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf               env;
+} JpegError;
+
+/* State that must survive a longjmp out of the library. */
+typedef struct {
+    unsigned char *mem;
+    unsigned long  mem_len;
+    guint8        *pad[3];          /* block-padded rows, when needed */
+} EncodeState;
+
+static void
+jpeg_error_exit (j_common_ptr cinfo)
+{
+    JpegError *err = (JpegError *) cinfo->err;
+    char msg[JMSG_LENGTH_MAX];
+    cinfo->err->format_message (cinfo, msg);
+    fprintf (stderr, "error: JPEG encode: %s\n", msg);
+    longjmp (err->env, 1);
+}
+
+/*
+ * Feed planes as raw downsampled data, one iMCU row per call.  The
+ * library reads whole 8x8 blocks: rows past the plane repeat its last
+ * row, and planes whose width is not a multiple of 8 are copied into a
+ * padded row buffer with the last column repeated.
+ */
+static void
+write_raw (struct jpeg_compress_struct *cinfo, const AgJpegImage *img,
+           AgJpegSubsample subsample, EncodeState *st)
+{
+    int lines = cinfo->max_v_samp_factor * DCTSIZE;
+    JSAMPROW rows[3][2 * DCTSIZE];
+    JSAMPARRAY arrays[3] = { rows[0], rows[1], rows[2] };
+    guint pw[3], ph[3];
+    size_t padded_w[3];
+
+    for (int c = 0; c < 3; c++) {
+        plane_size (img, subsample, c, &pw[c], &ph[c]);
+        padded_w[c] = (pw[c] + DCTSIZE - 1) / DCTSIZE * DCTSIZE;
+        if (padded_w[c] != pw[c])
+            st->pad[c] = g_malloc (padded_w[c] * 2 * DCTSIZE);
+    }
+
+    for (guint y = 0; y < img->height; y += (guint) lines) {
+        for (int c = 0; c < 3; c++) {
+            int n = cinfo->comp_info[c].v_samp_factor * DCTSIZE;
+            guint y0 = y * (guint) cinfo->comp_info[c].v_samp_factor /
+                       (guint) cinfo->max_v_samp_factor;
+            for (int r = 0; r < n; r++) {
+                guint sy = MIN (y0 + (guint) r, ph[c] - 1);
+                const guint8 *src = img->planes[c] + (size_t) sy * img->strides[c];
+                if (st->pad[c]) {
+                    guint8 *dst = st->pad[c] + (size_t) r * padded_w[c];
+                    memcpy (dst, src, pw[c]);
+                    memset (dst + pw[c], src[pw[c] - 1], padded_w[c] - pw[c]);
+                    src = dst;
+                }
+                rows[c][r] = (JSAMPROW) src;
+            }
+        }
+        jpeg_write_raw_data (cinfo, arrays, (JDIMENSION) lines);
+    }
+}
+
+static void
+write_scanlines (struct jpeg_compress_struct *cinfo, const AgJpegImage *img)
+{
+    JSAMPROW rows[16];
+    for (guint y = 0; y < img->height; ) {
+        guint n = MIN (16u, img->height - y);
+        for (guint r = 0; r < n; r++)
+            rows[r] = (JSAMPROW) (img->planes[0] + (size_t) (y + r) * img->strides[0]);
+        y += jpeg_write_scanlines (cinfo, rows, n);
+    }
+}
+
+static guint8 *
+encode_backend (const AgJpegImage *img, const AgJpegOptions *opts,
+                size_t *out_len)
+{
+    struct jpeg_compress_struct cinfo;
+    JpegError jerr;
+    EncodeState *st = g_new0 (EncodeState, 1);
+    guint8 *out = NULL;
+
+    cinfo.err = jpeg_std_error (&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp (jerr.env))
+        goto done;
+
+    jpeg_create_compress (&cinfo);
+    jpeg_mem_dest (&cinfo, &st->mem, &st->mem_len);
+
+    cinfo.image_width  = img->width;
+    cinfo.image_height = img->height;
+    switch (img->source) {
+    case AG_JPEG_GRAY:
+        cinfo.input_components = 1;
+        cinfo.in_color_space   = JCS_GRAYSCALE;
+        break;
+    case AG_JPEG_RGB:
+        cinfo.input_components = 3;
+        cinfo.in_color_space   = JCS_RGB;
+        break;
+    case AG_JPEG_YCBCR:
+        cinfo.input_components = 3;
+        cinfo.in_color_space   = JCS_YCbCr;
+        break;
+    }
+    jpeg_set_defaults (&cinfo);
+    jpeg_set_quality (&cinfo, CLAMP (opts->quality, 1, 100), TRUE);
+    if (img->source != AG_JPEG_GRAY) {
+        int f = opts->subsample == AG_JPEG_SUBSAMPLE_420 ? 2 : 1;
+        cinfo.comp_info[0].h_samp_factor = f;
+        cinfo.comp_info[0].v_samp_factor = f;
+        for (int c = 1; c < 3; c++) {
+            cinfo.comp_info[c].h_samp_factor = 1;
+            cinfo.comp_info[c].v_samp_factor = 1;
+        }
+    }
+    cinfo.raw_data_in = img->source == AG_JPEG_YCBCR;
+
+    jpeg_start_compress (&cinfo, TRUE);
+    if (cinfo.raw_data_in)
+        write_raw (&cinfo, img, opts->subsample, st);
+    else
+        write_scanlines (&cinfo, img);
+    jpeg_finish_compress (&cinfo);
+
+    out = g_malloc (st->mem_len);
+    memcpy (out, st->mem, st->mem_len);
+    *out_len = st->mem_len;
+
+done:
+    jpeg_destroy_compress (&cinfo);
+    free (st->mem);
+    for (int c = 0; c < 3; c++)
+        g_free (st->pad[c]);
+    g_free (st);
+    return out;
+}
+
+#else /* !HAVE_LIBJPEG */
+
+/* ------------------------------------------------------------------ */
+/*  stb_image_write fallback                                           */
+/* ------------------------------------------------------------------ */
+
+static void
+append_bytes (void *ctx, void *data, int size)
+{
+    g_byte_array_append (ctx, data, (guint) size);
+}
+
+/* Repack (or, for YCbCr, convert) into the tight gray/RGB stb wants. */
+static guint8 *
+packed_pixels (const AgJpegImage *img, AgJpegSubsample subsample, int *comp)
+{
+    guint w = img->width, h = img->height;
+    if (img->source != AG_JPEG_YCBCR) {
+        *comp = img->source == AG_JPEG_RGB ? 3 : 1;
+        size_t row = (size_t) w * (size_t) *comp;
+        guint8 *out = g_malloc (row * h);
+        for (guint y = 0; y < h; y++)
+            memcpy (out + row * y, img->planes[0] + img->strides[0] * y, row);
+        return out;
+    }
+
+    *comp = 3;
+    int shift = subsample == AG_JPEG_SUBSAMPLE_420 ? 1 : 0;
+    guint8 *out = g_malloc ((size_t) w * h * 3);
+    for (guint y = 0; y < h; y++) {
+        const guint8 *py = img->planes[0] + img->strides[0] * y;
+        const guint8 *pb = img->planes[1] + img->strides[1] * (y >> shift);
+        const guint8 *pr = img->planes[2] + img->strides[2] * (y >> shift);
+        guint8 *d = out + (size_t) w * 3 * y;
+        for (guint x = 0; x < w; x++) {
+            int yy = py[x];
+            int cb = pb[x >> shift] - 128;
+            int cr = pr[x >> shift] - 128;
+            int r = yy + ((91881 * cr) >> 16);
+            int g = yy - ((22554 * cb + 46802 * cr) >> 16);
+            int b = yy + ((116130 * cb) >> 16);
+            d[3 * x]     = (guint8) CLAMP (r, 0, 255);
+            d[3 * x + 1] = (guint8) CLAMP (g, 0, 255);
+            d[3 * x + 2] = (guint8) CLAMP (b, 0, 255);
+        }
+    }
+    return out;
+}
+
+static guint8 *
+encode_backend (const AgJpegImage *img, const AgJpegOptions *opts,
+                size_t *out_len)
+{
+    int comp;
+    guint8 *pixels = packed_pixels (img, opts->subsample, &comp);
+    GByteArray *buf = g_byte_array_new ();
+    int ok = stbi_write_jpg_to_func (append_bytes, buf,
+                                     (int) img->width, (int) img->height,
+                                     comp, pixels,
+                                     CLAMP (opts->quality, 1, 100));
+    g_free (pixels);
+    if (!ok || buf->len == 0) {
+        g_byte_array_free (buf, TRUE);
+        return NULL;
+    }
+    *out_len = buf->len;
+    return g_byte_array_free (buf, FALSE);
+}
+
+#endif /* HAVE_LIBJPEG */
+
+guint8 *
+ag_jpeg_encode (const AgJpegImage *img, const AgJpegOptions *opts,
+                size_t *out_len)
+{
+    if (!check_image (img, opts->subsample)) {
+        fprintf (stderr, "error: cannot encode a %ux%u JPEG from these planes\n",
+                 img->width, img->height);
+        return NULL;
+    }
+    return encode_backend (img, opts, out_len);
+}
+
+int
+ag_jpeg_write (const char *path, const AgJpegImage *img,
+               const AgJpegOptions *opts)
+{
+    size_t len = 0;
+    guint8 *jpeg = ag_jpeg_encode (img, opts, &len);
+    if (!jpeg) {
+        fprintf (stderr, "error: failed to write '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+
+    FILE *f = fopen (path, "wb");
+    if (!f) {
+        fprintf (stderr, "error: cannot open '%s' for write: %s\n",
+                 path, strerror (errno));
+        g_free (jpeg);
+        return EXIT_FAILURE;
+    }
+    size_t written = fwrite (jpeg, 1, len, f);
+    int closed = fclose (f);
+    g_free (jpeg);
+
+    if (written != len || closed != 0) {
+        fprintf (stderr, "error: failed to write '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
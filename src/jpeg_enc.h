@@ -0,0 +1,73 @@
+/*
+ * jpeg_enc.h — JPEG encoding, libjpeg-turbo when available
+ *
+ * Built with HAVE_LIBJPEG (the Makefile defines it when pkg-config finds
+ * libjpeg, normally libjpeg-turbo's SIMD build), encoding goes through
+ * the libjpeg API:
+ *
+ *   gray   single-component JPEG, no colour conversion at all;
+ *   RGB    converted to YCbCr by the library's SIMD routines;
+ *   YCbCr  planes handed over as raw data: no conversion and no
+ *          downsampling, so planar sources skip RGB24 entirely.
+ *
+ * Without it, stb_image_write is the fallback: gray and RGB as before,
+ * YCbCr converted to RGB first, and the chroma subsampling chosen by stb
+ * (4:2:0 up to quality 90, 4:4:4 above).
+ */
+
+#ifndef AG_JPEG_ENC_H
+#define AG_JPEG_ENC_H
+
+#include <glib.h>
+#include <stddef.h>
+
+#define AG_JPEG_QUALITY_DEFAULT  90
+
+typedef enum {
+    AG_JPEG_SUBSAMPLE_420,      /* chroma halved both ways */
+    AG_JPEG_SUBSAMPLE_444,      /* full-resolution chroma */
+} AgJpegSubsample;
+
+typedef struct {
+    int             quality;    /* 1..100 */
+    AgJpegSubsample subsample;  /* ignored for gray */
+} AgJpegOptions;
+
+typedef enum {
+    AG_JPEG_GRAY,               /* planes[0]: 8-bit luma */
+    AG_JPEG_RGB,                /* planes[0]: packed RGB24 */
+    AG_JPEG_YCBCR,              /* planes[0..2]: Y, Cb, Cr (JFIF, full range) */
+} AgJpegSource;
+
+/*
+ * One image to encode.  For AG_JPEG_YCBCR the chroma planes are
+ * (width + 1) / 2 x (height + 1) / 2 with AG_JPEG_SUBSAMPLE_420 and
+ * width x height with AG_JPEG_SUBSAMPLE_444.
+ */
+typedef struct {
+    AgJpegSource  source;
+    guint         width;
+    guint         height;
+    const guint8 *planes[3];
+    size_t        strides[3];   /* bytes between rows of each plane */
+} AgJpegImage;
+
+/* Quality 90, 4:2:0. */
+void ag_jpeg_options_defaults (AgJpegOptions *opts);
+
+/* Parse "420" or "444".  Returns 0 on success, -1 otherwise. */
+int ag_jpeg_parse_subsample (const char *str, AgJpegSubsample *out);
+
+/* "libjpeg-turbo", "libjpeg" or "stb". */
+const char *ag_jpeg_backend_name (void);
+
+/* Encode into a g_malloc'd buffer of *out_len bytes; NULL on failure
+ * (with a diagnostic on stderr). */
+guint8 *ag_jpeg_encode (const AgJpegImage *img, const AgJpegOptions *opts,
+                        size_t *out_len);
+
+/* Encode to path.  Returns EXIT_SUCCESS or EXIT_FAILURE. */
+int ag_jpeg_write (const char *path, const AgJpegImage *img,
+                   const AgJpegOptions *opts);
+
+#endif /* AG_JPEG_ENC_H */
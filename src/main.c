@@ -19,6 +19,8 @@ int cmd_depth_preview_classical (int argc, char *argv[], arg_dstr_t res, void *c
 int cmd_depth_preview_neural (int argc, char *argv[], arg_dstr_t res, void *ctx);
 int cmd_calibration_stash (int argc, char *argv[], arg_dstr_t res, void *ctx);
 int cmd_bounce (int argc, char *argv[], arg_dstr_t res, void *ctx);
+int cmd_net_bench (int argc, char *argv[], arg_dstr_t res, void *ctx);
+int cmd_tune_transport (int argc, char *argv[], arg_dstr_t res, void *ctx);
 
 static void
 print_usage (void)
@@ -43,6 +45,9 @@ print_usage (void)
             "  calibration-stash\n"
             "            Upload/list/delete calibration data on camera\n"
             "  bounce    Reset (power-cycle) the camera over GigE\n"
+            "  net-bench Measure GigE throughput per receive-path setting\n"
+            "  tune-transport\n"
+            "            Sweep packet size and inter-packet delay; save the best\n"
             "\n"
             "Run 'ag-cam-tools <command> --help' for command-specific options.\n");
 }
@@ -74,6 +79,10 @@ main (int argc, char *argv[])
                       "Upload/list/delete calibration data on camera", NULL);
     arg_cmd_register ("bounce", cmd_bounce,
                       "Reset (power-cycle) the camera over GigE", NULL);
+    arg_cmd_register ("net-bench", cmd_net_bench,
+                      "Measure GigE throughput per receive-path setting", NULL);
+    arg_cmd_register ("tune-transport", cmd_tune_transport,
+                      "Sweep packet size and inter-packet delay; save the best", NULL);
 
     if (argc < 2 ||
         strcmp (argv[1], "--help") == 0 ||
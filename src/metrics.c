@@ -0,0 +1,630 @@
+/*
+ * metrics.c — metrics registry, Prometheus rendering and local endpoint
+ */
+
+#include "metrics.h"
+#include "trace.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* ================================================================== */
+/*  Metric storage                                                     */
+/* ================================================================== */
+
+/*
+ * Histogram layout: bucket 0 holds everything below 2^HIST_MIN_OCT ns
+ * (~1 µs); then HIST_SUB linear sub-buckets per power of two up to
+ * 2^(HIST_MAX_OCT+1) ns (~137 s); the last bucket is overflow.
+ */
+#define HIST_MIN_OCT  10
+#define HIST_MAX_OCT  36
+#define HIST_SUB_BITS 3
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((HIST_MAX_OCT - HIST_MIN_OCT + 1) * HIST_SUB + 2)
+
+struct AgCounter {
+    guint64 value;
+};
+
+struct AgGauge {
+    guint64 bits;                 /* IEEE-754 double, stored atomically */
+};
+
+struct AgHistogram {
+    guint64 buckets[HIST_BUCKETS];
+    guint64 count;
+    guint64 sum_ns;
+};
+
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} MetricKind;
+
+typedef struct {
+    MetricKind kind;
+    char      *name;
+    char      *labels;            /* may be NULL */
+    char      *help;
+    gpointer   metric;
+} Series;
+
+static GMutex     registry_lock;
+static GPtrArray *registry;       /* Series*, registration order */
+
+static gpointer
+register_series (MetricKind kind, const char *name, const char *labels,
+                 const char *help, gsize metric_size)
+{
+    gpointer metric = NULL;
+
+    g_mutex_lock (&registry_lock);
+    if (!registry)
+        registry = g_ptr_array_new ();
+
+    for (guint i = 0; i < registry->len; i++) {
+        Series *s = g_ptr_array_index (registry, i);
+        if (strcmp (s->name, name) == 0 &&
+            g_strcmp0 (s->labels, labels) == 0) {
+            metric = s->kind == kind ? s->metric : NULL;
+            if (!metric)
+                fprintf (stderr, "warn: metric %s registered with two types\n",
+                         name);
+            g_mutex_unlock (&registry_lock);
+            return metric;
+        }
+    }
+
+    Series *s = g_new0 (Series, 1);
+    s->kind   = kind;
+    s->name   = g_strdup (name);
+    s->labels = labels ? g_strdup (labels) : NULL;
+    s->help   = g_strdup (help ? help : "");
+    s->metric = g_malloc0 (metric_size);
+    g_ptr_array_add (registry, s);
+    metric = s->metric;
+    g_mutex_unlock (&registry_lock);
+    return metric;
+}
+
+AgCounter *
+ag_metrics_counter (const char *name, const char *labels, const char *help)
+{
+    return register_series (METRIC_COUNTER, name, labels, help,
+                            sizeof (AgCounter));
+}
+
+AgGauge *
+ag_metrics_gauge (const char *name, const char *labels, const char *help)
+{
+    return register_series (METRIC_GAUGE, name, labels, help,
+                            sizeof (AgGauge));
+}
+
+AgHistogram *
+ag_metrics_histogram (const char *name, const char *labels, const char *help)
+{
+    return register_series (METRIC_HISTOGRAM, name, labels, help,
+                            sizeof (AgHistogram));
+}
+
+/* ------------------------------------------------------------------ */
+/*  Updates (lock-free)                                                */
+/* ------------------------------------------------------------------ */
+
+void
+ag_counter_inc (AgCounter *c)
+{
+    if (c)
+        __atomic_fetch_add (&c->value, 1, __ATOMIC_RELAXED);
+}
+
+void
+ag_counter_add (AgCounter *c, guint64 n)
+{
+    if (c)
+        __atomic_fetch_add (&c->value, n, __ATOMIC_RELAXED);
+}
+
+void
+ag_counter_set (AgCounter *c, guint64 total)
+{
+    if (c)
+        __atomic_store_n (&c->value, total, __ATOMIC_RELAXED);
+}
+
+guint64
+ag_counter_get (const AgCounter *c)
+{
+    return c ? __atomic_load_n (&c->value, __ATOMIC_RELAXED) : 0;
+}
+
+void
+ag_gauge_set (AgGauge *g, double value)
+{
+    if (!g)
+        return;
+    guint64 bits;
+    memcpy (&bits, &value, sizeof bits);
+    __atomic_store_n (&g->bits, bits, __ATOMIC_RELAXED);
+}
+
+double
+ag_gauge_get (const AgGauge *g)
+{
+    if (!g)
+        return 0.0;
+    guint64 bits = __atomic_load_n (&g->bits, __ATOMIC_RELAXED);
+    double value;
+    memcpy (&value, &bits, sizeof value);
+    return value;
+}
+
+static int
+hist_bucket (uint64_t ns)
+{
+    if (ns < (1ull << HIST_MIN_OCT))
+        return 0;
+    int oct = 63 - __builtin_clzll (ns);
+    if (oct > HIST_MAX_OCT)
+        return HIST_BUCKETS - 1;
+    int sub = (int) ((ns >> (oct - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return 1 + (oct - HIST_MIN_OCT) * HIST_SUB + sub;
+}
+
+/* Exclusive upper bound of bucket i in ns (overflow: UINT64_MAX). */
+static uint64_t
+hist_bucket_upper (int i)
+{
+    if (i == 0)
+        return 1ull << HIST_MIN_OCT;
+    if (i >= HIST_BUCKETS - 1)
+        return G_MAXUINT64;
+    int oct = HIST_MIN_OCT + (i - 1) / HIST_SUB;
+    int sub = (i - 1) % HIST_SUB;
+    return (uint64_t) (HIST_SUB + sub + 1) << (oct - HIST_SUB_BITS);
+}
+
+static uint64_t
+hist_bucket_lower (int i)
+{
+    if (i == 0)
+        return 0;
+    if (i >= HIST_BUCKETS - 1)
+        return 1ull << (HIST_MAX_OCT + 1);
+    int oct = HIST_MIN_OCT + (i - 1) / HIST_SUB;
+    int sub = (i - 1) % HIST_SUB;
+    return (uint64_t) (HIST_SUB + sub) << (oct - HIST_SUB_BITS);
+}
+
+void
+ag_histogram_observe_ns (AgHistogram *h, uint64_t ns)
+{
+    if (!h)
+        return;
+    __atomic_fetch_add (&h->buckets[hist_bucket (ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&h->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&h->count, 1, __ATOMIC_RELAXED);
+}
+
+guint64
+ag_histogram_count (const AgHistogram *h)
+{
+    return h ? __atomic_load_n (&h->count, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t
+ag_histogram_quantile_ns (const AgHistogram *h, double q)
+{
+    if (!h)
+        return 0;
+
+    guint64 counts[HIST_BUCKETS];
+    guint64 total = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        counts[i] = __atomic_load_n (&h->buckets[i], __ATOMIC_RELAXED);
+        total += counts[i];
+    }
+    if (total == 0)
+        return 0;
+
+    q = CLAMP (q, 0.0, 1.0);
+    guint64 rank = (guint64) (q * (double) (total - 1));
+    guint64 seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > rank) {
+            if (i == HIST_BUCKETS - 1)
+                return hist_bucket_lower (i);
+            return (hist_bucket_lower (i) + hist_bucket_upper (i)) / 2;
+        }
+    }
+    return hist_bucket_lower (HIST_BUCKETS - 1);
+}
+
+/* ================================================================== */
+/*  Prometheus text exposition                                         */
+/* ================================================================== */
+
+static const char *
+kind_name (MetricKind kind)
+{
+    switch (kind) {
+    case METRIC_COUNTER:   return "counter";
+    case METRIC_GAUGE:     return "gauge";
+    case METRIC_HISTOGRAM: return "histogram";
+    }
+    return "untyped";
+}
+
+/* Append name{labels[,extra]} to out. */
+static void
+append_series_name (GString *out, const char *name, const char *suffix,
+                    const char *labels, const char *extra)
+{
+    g_string_append (out, name);
+    if (suffix)
+        g_string_append (out, suffix);
+    if (labels || extra) {
+        g_string_append_c (out, '{');
+        if (labels)
+            g_string_append (out, labels);
+        if (labels && extra)
+            g_string_append_c (out, ',');
+        if (extra)
+            g_string_append (out, extra);
+        g_string_append_c (out, '}');
+    }
+    g_string_append_c (out, ' ');
+}
+
+static void
+render_histogram (GString *out, const Series *s)
+{
+    const AgHistogram *h = s->metric;
+    guint64 cumulative = 0;
+    int bucket = 0;
+
+    /* Expose one cumulative bucket per power of two. */
+    for (int oct = HIST_MIN_OCT; oct <= HIST_MAX_OCT + 1; oct++) {
+        uint64_t edge = 1ull << oct;
+        while (bucket < HIST_BUCKETS - 1 && hist_bucket_upper (bucket) <= edge)
+            cumulative += __atomic_load_n (&h->buckets[bucket++], __ATOMIC_RELAXED);
+
+        char le[48];
+        snprintf (le, sizeof le, "le=\"%.9g\"", (double) edge / 1e9);
+        append_series_name (out, s->name, "_bucket", s->labels, le);
+        g_string_append_printf (out, "%" G_GUINT64_FORMAT "\n", cumulative);
+    }
+
+    guint64 count = __atomic_load_n (&h->count, __ATOMIC_RELAXED);
+    append_series_name (out, s->name, "_bucket", s->labels, "le=\"+Inf\"");
+    g_string_append_printf (out, "%" G_GUINT64_FORMAT "\n", count);
+
+    append_series_name (out, s->name, "_sum", s->labels, NULL);
+    g_string_append_printf (out, "%.9f\n",
+        (double) __atomic_load_n (&h->sum_ns, __ATOMIC_RELAXED) / 1e9);
+
+    append_series_name (out, s->name, "_count", s->labels, NULL);
+    g_string_append_printf (out, "%" G_GUINT64_FORMAT "\n", count);
+}
+
+char *
+ag_metrics_render (void)
+{
+    GString *out = g_string_new (NULL);
+
+    g_mutex_lock (&registry_lock);
+    guint n = registry ? registry->len : 0;
+    gboolean *done = g_new0 (gboolean, n ? n : 1);
+
+    /* Group series by name, keeping first-registration order. */
+    for (guint i = 0; i < n; i++) {
+        if (done[i])
+            continue;
+        const Series *first = g_ptr_array_index (registry, i);
+        g_string_append_printf (out, "# HELP %s %s\n", first->name, first->help);
+        g_string_append_printf (out, "# TYPE %s %s\n", first->name,
+                                kind_name (first->kind));
+
+        for (guint j = i; j < n; j++) {
+            const Series *s = g_ptr_array_index (registry, j);
+            if (done[j] || strcmp (s->name, first->name) != 0)
+                continue;
+            done[j] = TRUE;
+
+            switch (s->kind) {
+            case METRIC_COUNTER:
+                append_series_name (out, s->name, NULL, s->labels, NULL);
+                g_string_append_printf (out, "%" G_GUINT64_FORMAT "\n",
+                                        ag_counter_get (s->metric));
+                break;
+            case METRIC_GAUGE:
+                append_series_name (out, s->name, NULL, s->labels, NULL);
+                g_string_append_printf (out, "%.17g\n", ag_gauge_get (s->metric));
+                break;
+            case METRIC_HISTOGRAM:
+                render_histogram (out, s);
+                break;
+            }
+        }
+    }
+
+    g_free (done);
+    g_mutex_unlock (&registry_lock);
+    return g_string_free (out, FALSE);
+}
+
+/* ================================================================== */
+/*  Trace stage bridge                                                 */
+/* ================================================================== */
+
+static AgHistogram *stage_hist[AG_STAGE_COUNT];
+
+static void
+observe_stage (AgTraceStage stage, uint64_t dur_ns, void *user_data)
+{
+    (void) user_data;
+    if ((unsigned) stage < AG_STAGE_COUNT)
+        ag_histogram_observe_ns (stage_hist[stage], dur_ns);
+}
+
+void
+ag_metrics_observe_trace_stages (void)
+{
+    for (int s = 0; s < AG_STAGE_COUNT; s++) {
+        char labels[64];
+        snprintf (labels, sizeof labels, "stage=\"%s\"",
+                  ag_trace_stage_name ((AgTraceStage) s));
+        stage_hist[s] = ag_metrics_histogram (
+            "ag_stage_latency_seconds", labels,
+            "Per-frame pipeline stage latency.");
+    }
+    ag_trace_set_observer (observe_stage, NULL);
+}
+
+/* ================================================================== */
+/*  HTTP endpoint                                                      */
+/* ================================================================== */
+
+static int      server_fd = -1;
+static int      wake_pipe[2] = { -1, -1 };
+static GThread *server_thread;
+static char    *server_unix_path;
+
+#ifdef MSG_NOSIGNAL
+#define AG_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define AG_SEND_FLAGS 0
+#endif
+
+static void
+send_all (int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send (fd, buf, len, AG_SEND_FLAGS);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= (size_t) n;
+    }
+}
+
+static void
+handle_client (int fd)
+{
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 500000 };
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+
+    /* Read the request head; anything but GET /metrics (or /) is a 404. */
+    char req[2048];
+    size_t got = 0;
+    while (got < sizeof req - 1) {
+        ssize_t n = recv (fd, req + got, sizeof req - 1 - got, 0);
+        if (n <= 0)
+            break;
+        got += (size_t) n;
+        req[got] = '\0';
+        if (strstr (req, "\r\n\r\n") || strstr (req, "\n\n"))
+            break;
+    }
+    req[got] = '\0';
+
+    gboolean ok = got == 0 ||
+                  g_str_has_prefix (req, "GET /metrics") ||
+                  g_str_has_prefix (req, "GET / ");
+
+    if (!ok) {
+        static const char not_found[] =
+            "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n"
+            "Content-Length: 10\r\nConnection: close\r\n\r\nnot found\n";
+        send_all (fd, not_found, sizeof not_found - 1);
+        return;
+    }
+
+    char *body = ag_metrics_render ();
+    size_t body_len = strlen (body);
+    char head[160];
+    int head_len = snprintf (head, sizeof head,
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n", body_len);
+    send_all (fd, head, (size_t) head_len);
+    send_all (fd, body, body_len);
+    g_free (body);
+}
+
+static gpointer
+server_main (gpointer data)
+{
+    (void) data;
+    ag_trace_name_thread ("metrics");
+
+    for (;;) {
+        struct pollfd fds[2] = {
+            { .fd = server_fd,    .events = POLLIN },
+            { .fd = wake_pipe[0], .events = POLLIN },
+        };
+        if (poll (fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (fds[0].revents & POLLIN) {
+            int client = accept (server_fd, NULL, NULL);
+            if (client >= 0) {
+                handle_client (client);
+                close (client);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Parse "[127.0.0.1:|localhost:]port".  Returns port or -1. */
+static int
+parse_loopback_port (const char *addr)
+{
+    const char *colon = strrchr (addr, ':');
+    const char *port_str = addr;
+    if (colon) {
+        size_t host_len = (size_t) (colon - addr);
+        if (!((host_len == 9 && strncmp (addr, "127.0.0.1", 9) == 0) ||
+              (host_len == 9 && strncmp (addr, "localhost", 9) == 0)))
+            return -1;
+        port_str = colon + 1;
+    }
+    char *end = NULL;
+    long port = strtol (port_str, &end, 10);
+    if (!*port_str || *end || port < 1 || port > 65535)
+        return -1;
+    return (int) port;
+}
+
+gboolean
+ag_metrics_listen_valid (const char *addr)
+{
+    if (g_str_has_prefix (addr, "unix:"))
+        return addr[5] != '\0' &&
+               strlen (addr + 5) < sizeof ((struct sockaddr_un *) 0)->sun_path;
+    return parse_loopback_port (addr) > 0;
+}
+
+int
+ag_metrics_serve (const char *addr)
+{
+    if (server_thread) {
+        fprintf (stderr, "error: metrics endpoint already running\n");
+        return -1;
+    }
+    if (!ag_metrics_listen_valid (addr)) {
+        fprintf (stderr, "error: invalid metrics address '%s' "
+                 "(use unix:<path> or [127.0.0.1:]<port>)\n", addr);
+        return -1;
+    }
+
+    int fd;
+    if (g_str_has_prefix (addr, "unix:")) {
+        const char *path = addr + 5;
+        struct sockaddr_un sa = { .sun_family = AF_UNIX };
+        g_strlcpy (sa.sun_path, path, sizeof sa.sun_path);
+
+        /* Replace a stale socket left by a previous run, nothing else. */
+        struct stat st;
+        if (lstat (path, &st) == 0 && S_ISSOCK (st.st_mode))
+            unlink (path);
+
+        fd = socket (AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind (fd, (struct sockaddr *) &sa, sizeof sa) != 0) {
+            fprintf (stderr, "error: cannot bind metrics socket %s: %s\n",
+                     path, g_strerror (errno));
+            if (fd >= 0) close (fd);
+            return -1;
+        }
+        server_unix_path = g_strdup (path);
+    } else {
+        struct sockaddr_in sa = {
+            .sin_family = AF_INET,
+            .sin_port   = htons ((uint16_t) parse_loopback_port (addr)),
+            .sin_addr.s_addr = htonl (INADDR_LOOPBACK),
+        };
+        fd = socket (AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if (fd >= 0)
+            setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        if (fd < 0 || bind (fd, (struct sockaddr *) &sa, sizeof sa) != 0) {
+            fprintf (stderr, "error: cannot bind metrics port %s: %s\n",
+                     addr, g_strerror (errno));
+            if (fd >= 0) close (fd);
+            return -1;
+        }
+    }
+
+    if (listen (fd, 8) != 0 || pipe (wake_pipe) != 0) {
+        fprintf (stderr, "error: metrics endpoint: %s\n", g_strerror (errno));
+        close (fd);
+        return -1;
+    }
+
+    server_fd = fd;
+    server_thread = g_thread_new ("metrics", server_main, NULL);
+    printf ("Metrics: serving Prometheus text on %s\n", addr);
+    return 0;
+}
+
+void
+ag_metrics_reset (void)
+{
+    if (server_thread) {
+        ssize_t rc = write (wake_pipe[1], "x", 1);
+        (void) rc;
+        g_thread_join (server_thread);
+        server_thread = NULL;
+        close (server_fd);
+        close (wake_pipe[0]);
+        close (wake_pipe[1]);
+        server_fd = wake_pipe[0] = wake_pipe[1] = -1;
+        if (server_unix_path) {
+            unlink (server_unix_path);
+            g_free (server_unix_path);
+            server_unix_path = NULL;
+        }
+    }
+
+    ag_trace_set_observer (NULL, NULL);
+    memset (stage_hist, 0, sizeof stage_hist);
+
+    g_mutex_lock (&registry_lock);
+    if (registry) {
+        for (guint i = 0; i < registry->len; i++) {
+            Series *s = g_ptr_array_index (registry, i);
+            g_free (s->name);
+            g_free (s->labels);
+            g_free (s->help);
+            g_free (s->metric);
+            g_free (s);
+        }
+        g_ptr_array_free (registry, TRUE);
+        registry = NULL;
+    }
+    g_mutex_unlock (&registry_lock);
+}
@@ -0,0 +1,87 @@
+/*
+ * metrics.h — in-process metrics registry with Prometheus text exposition
+ *
+ * Counters, gauges and log-linear ("HDR") latency histograms that the
+ * long-running commands update from the acquisition loop, served in
+ * Prometheus text format (version 0.0.4) over HTTP on a local Unix
+ * socket or a loopback TCP port.
+ *
+ * Updates are lock-free atomics; only registration and rendering take
+ * the registry lock.  Metrics live until ag_metrics_reset().
+ *
+ * No Aravis dependency — the Aravis glue lives in common.c.
+ */
+
+#ifndef AG_METRICS_H
+#define AG_METRICS_H
+
+#include <glib.h>
+#include <stdint.h>
+
+typedef struct AgCounter   AgCounter;
+typedef struct AgGauge     AgGauge;
+typedef struct AgHistogram AgHistogram;
+
+/*
+ * Register (or look up) a metric.  name must be a valid Prometheus
+ * metric name; labels is either NULL or a preformatted label set such
+ * as "reason=\"timeout\"".  Series sharing a name share one HELP/TYPE
+ * header, taken from the first registration.  Re-registering the same
+ * name+labels returns the existing metric.
+ */
+AgCounter   *ag_metrics_counter   (const char *name, const char *labels,
+                                   const char *help);
+AgGauge     *ag_metrics_gauge     (const char *name, const char *labels,
+                                   const char *help);
+
+/* Histograms observe nanoseconds and are exposed in seconds. */
+AgHistogram *ag_metrics_histogram (const char *name, const char *labels,
+                                   const char *help);
+
+void     ag_counter_inc (AgCounter *c);
+void     ag_counter_add (AgCounter *c, guint64 n);
+/* Mirror an externally maintained monotonic total (e.g. Aravis stats). */
+void     ag_counter_set (AgCounter *c, guint64 total);
+guint64  ag_counter_get (const AgCounter *c);
+
+void     ag_gauge_set (AgGauge *g, double value);
+double   ag_gauge_get (const AgGauge *g);
+
+void     ag_histogram_observe_ns (AgHistogram *h, uint64_t ns);
+guint64  ag_histogram_count (const AgHistogram *h);
+
+/*
+ * Approximate quantile (0..1) in nanoseconds.  Buckets are 8 per
+ * power of two, so the result is within 12.5% of the true value.
+ * Returns 0 for an empty histogram.
+ */
+uint64_t ag_histogram_quantile_ns (const AgHistogram *h, double q);
+
+/*
+ * Render every registered metric in Prometheus text format.
+ * Caller must g_free() the result.
+ */
+char *ag_metrics_render (void);
+
+/*
+ * Record every trace stage (see trace.h) into an
+ * ag_stage_latency_seconds{stage="..."} histogram, one sample per frame.
+ * Enables the probes but not the trace rings, so it costs no memory
+ * and leaves the --trace stats line off.
+ */
+void ag_metrics_observe_trace_stages (void);
+
+/*
+ * Start serving /metrics on a background thread.  addr is either
+ * "unix:<path>" or "[127.0.0.1:]<port>"; TCP is bound to loopback only.
+ * Returns 0 on success, -1 on error (prints its own diagnostic).
+ */
+int  ag_metrics_serve (const char *addr);
+
+/* Parse-only check of a listen address (for CLI validation). */
+gboolean ag_metrics_listen_valid (const char *addr);
+
+/* Stop the server (if any) and drop every registered metric. */
+void ag_metrics_reset (void);
+
+#endif /* AG_METRICS_H */
@@ -0,0 +1,329 @@
+/*
+ * png_fast.c — multi-threaded PNG encoder on system zlib
+ *
+ * Each band filters its rows into a private buffer and deflates it raw
+ * (no zlib wrapper) in one call.  The caller writes the signature, IHDR,
+ * then a single IDAT holding the zlib header, the bands in order and the
+ * combined Adler-32, computing the chunk CRC as the pieces go out.
+ */
+
+#include "png_fast.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef struct {
+    const guint8 *pixels;
+    size_t        stride;
+    size_t        row_bytes;
+    int           bpp;            /* bytes per pixel */
+    AgPngFilter   filter;
+    int           level;
+    guint         y0, y1;         /* rows [y0, y1) */
+    gboolean      last;           /* ends the deflate stream */
+
+    guint8       *out;            /* raw deflate data */
+    size_t        out_len;
+    size_t        raw_len;        /* filtered bytes, for the Adler-32 */
+    uLong         adler;
+    gboolean      ok;
+} Band;
+
+typedef void (*EmitFunc) (void *ctx, const void *data, size_t len);
+
+void
+ag_png_options_defaults (AgPngOptions *opts)
+{
+    opts->level   = AG_PNG_LEVEL_DEFAULT;
+    opts->filter  = AG_PNG_FILTER_UP;
+    opts->threads = 0;
+}
+
+int
+ag_png_parse_filter (const char *str, AgPngFilter *out)
+{
+    for (int f = AG_PNG_FILTER_NONE; f <= AG_PNG_FILTER_UP; f++) {
+        if (strcmp (str, ag_png_filter_name ((AgPngFilter) f)) == 0) {
+            *out = (AgPngFilter) f;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *
+ag_png_filter_name (AgPngFilter filter)
+{
+    switch (filter) {
+    case AG_PNG_FILTER_NONE: return "none";
+    case AG_PNG_FILTER_SUB:  return "sub";
+    case AG_PNG_FILTER_UP:   return "up";
+    }
+    return "?";
+}
+
+/* Plain loops: the compiler vectorises both differences. */
+static void
+filter_row (AgPngFilter filter, const guint8 *row, const guint8 *prev,
+            size_t n, int bpp, guint8 *dst)
+{
+    switch (filter) {
+    case AG_PNG_FILTER_SUB:
+        memcpy (dst, row, (size_t) bpp);
+        for (size_t i = (size_t) bpp; i < n; i++)
+            dst[i] = (guint8) (row[i] - row[i - (size_t) bpp]);
+        break;
+    case AG_PNG_FILTER_UP:
+        if (!prev) {
+            memcpy (dst, row, n);
+            break;
+        }
+        for (size_t i = 0; i < n; i++)
+            dst[i] = (guint8) (row[i] - prev[i]);
+        break;
+    default:
+        memcpy (dst, row, n);
+        break;
+    }
+}
+
+static gpointer
+band_run (gpointer data)
+{
+    Band *b = data;
+    size_t line = b->row_bytes + 1;
+    b->raw_len = line * (b->y1 - b->y0);
+
+    guint8 *filtered = g_malloc (b->raw_len);
+    for (guint y = b->y0; y < b->y1; y++) {
+        const guint8 *row  = b->pixels + (size_t) y * b->stride;
+        const guint8 *prev = y > 0 ? row - b->stride : NULL;
+        guint8 *dst = filtered + (size_t) (y - b->y0) * line;
+        dst[0] = (guint8) b->filter;
+        filter_row (b->filter, row, prev, b->row_bytes, b->bpp, dst + 1);
+    }
+    b->adler = adler32 (adler32 (0L, Z_NULL, 0), filtered, (uInt) b->raw_len);
+
+    z_stream zs;
+    memset (&zs, 0, sizeof zs);
+    int strategy = b->filter == AG_PNG_FILTER_NONE ? Z_DEFAULT_STRATEGY
+                                                   : Z_FILTERED;
+    if (deflateInit2 (&zs, b->level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+        g_free (filtered);
+        return NULL;
+    }
+
+    /* The bound covers Z_FINISH; a sync flush adds one empty stored
+     * block on top. */
+    size_t cap = deflateBound (&zs, (uLong) b->raw_len) + 16;
+    b->out = g_malloc (cap);
+    zs.next_in   = filtered;
+    zs.avail_in  = (uInt) b->raw_len;
+    zs.next_out  = b->out;
+    zs.avail_out = (uInt) cap;
+
+    int rc = deflate (&zs, b->last ? Z_FINISH : Z_SYNC_FLUSH);
+    b->ok = b->last ? rc == Z_STREAM_END
+                    : rc == Z_OK && zs.avail_in == 0 && zs.avail_out > 0;
+    b->out_len = cap - zs.avail_out;
+    deflateEnd (&zs);
+    g_free (filtered);
+    return NULL;
+}
+
+static int
+band_count (const AgPngOptions *opts, guint height)
+{
+    int threads = opts->threads > 0 ? opts->threads
+                                    : (int) g_get_num_processors ();
+    threads = CLAMP (threads, 1, AG_PNG_THREADS_MAX);
+    int by_rows = (int) MAX (1u, height / AG_PNG_BAND_ROWS_MIN);
+    return MIN (threads, by_rows);
+}
+
+static void
+put_be32 (guint8 *p, guint32 v)
+{
+    p[0] = (guint8) (v >> 24);
+    p[1] = (guint8) (v >> 16);
+    p[2] = (guint8) (v >> 8);
+    p[3] = (guint8) v;
+}
+
+/* Write a whole chunk whose data is in one piece. */
+static void
+emit_chunk (EmitFunc emit, void *ctx, const char *type,
+            const guint8 *data, guint32 len)
+{
+    guint8 head[8];
+    put_be32 (head, len);
+    memcpy (head + 4, type, 4);
+    uLong crc = crc32 (crc32 (0L, Z_NULL, 0), head + 4, 4);
+    if (len)
+        crc = crc32 (crc, data, len);
+    guint8 tail[4];
+    put_be32 (tail, (guint32) crc);
+
+    emit (ctx, head, 8);
+    if (len)
+        emit (ctx, data, len);
+    emit (ctx, tail, 4);
+}
+
+static gboolean
+encode (const guint8 *pixels, guint width, guint height, int channels,
+        size_t stride, const AgPngOptions *opts, EmitFunc emit, void *ctx)
+{
+    int level = CLAMP (opts->level, 0, 9);
+    int n = band_count (opts, height);
+    Band *bands = g_new0 (Band, n);
+    GThread *threads[AG_PNG_THREADS_MAX];
+
+    for (int i = 0; i < n; i++) {
+        Band *b = &bands[i];
+        b->pixels    = pixels;
+        b->stride    = stride;
+        b->row_bytes = (size_t) width * (size_t) channels;
+        b->bpp       = channels;
+        b->filter    = opts->filter;
+        b->level     = level;
+        b->y0        = (guint) ((guint64) height * (guint) i / (guint) n);
+        b->y1        = (guint) ((guint64) height * (guint) (i + 1) / (guint) n);
+        b->last      = i == n - 1;
+    }
+    for (int i = 1; i < n; i++)
+        threads[i] = g_thread_new ("png-band", band_run, &bands[i]);
+    band_run (&bands[0]);
+    for (int i = 1; i < n; i++)
+        g_thread_join (threads[i]);
+
+    gboolean ok = TRUE;
+    size_t idat_len = 2 + 4;
+    uLong adler = bands[0].adler;
+    for (int i = 0; i < n; i++) {
+        ok = ok && bands[i].ok;
+        idat_len += bands[i].out_len;
+        if (i > 0)
+            adler = adler32_combine (adler, bands[i].adler,
+                                     (z_off_t) bands[i].raw_len);
+    }
+    if (idat_len > G_MAXINT32)
+        ok = FALSE;
+
+    if (ok) {
+        static const guint8 signature[8] =
+            { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        emit (ctx, signature, sizeof signature);
+
+        guint8 ihdr[13];
+        put_be32 (ihdr, width);
+        put_be32 (ihdr + 4, height);
+        ihdr[8]  = 8;                        /* bit depth */
+        ihdr[9]  = channels == 3 ? 2 : 0;    /* RGB or gray */
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;  /* deflate, adaptive, no interlace */
+        emit_chunk (emit, ctx, "IHDR", ihdr, sizeof ihdr);
+
+        /* IDAT is streamed: header, bands, then the checksum. */
+        static const guint8 zlib_flg[4] = { 0x01, 0x5E, 0x9C, 0xDA };
+        guint8 head[10];
+        put_be32 (head, (guint32) idat_len);
+        memcpy (head + 4, "IDAT", 4);
+        head[8] = 0x78;                      /* deflate, 32K window */
+        head[9] = zlib_flg[level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3];
+        uLong crc = crc32 (crc32 (0L, Z_NULL, 0), head + 4, 6);
+        emit (ctx, head, sizeof head);
+        for (int i = 0; i < n; i++) {
+            crc = crc32 (crc, bands[i].out, (uInt) bands[i].out_len);
+            emit (ctx, bands[i].out, bands[i].out_len);
+        }
+        guint8 tail[8];
+        put_be32 (tail, (guint32) adler);
+        crc = crc32 (crc, tail, 4);
+        put_be32 (tail + 4, (guint32) crc);
+        emit (ctx, tail, sizeof tail);
+
+        emit_chunk (emit, ctx, "IEND", NULL, 0);
+    }
+
+    for (int i = 0; i < n; i++)
+        g_free (bands[i].out);
+    g_free (bands);
+    return ok;
+}
+
+static gboolean
+check_args (guint width, guint height, int channels, size_t stride)
+{
+    return width > 0 && height > 0 && (channels == 1 || channels == 3) &&
+           stride >= (size_t) width * (size_t) channels &&
+           width <= G_MAXINT32 && height <= G_MAXINT32;
+}
+
+static void
+emit_bytes (void *ctx, const void *data, size_t len)
+{
+    g_byte_array_append (ctx, data, (guint) len);
+}
+
+guint8 *
+ag_png_encode (const guint8 *pixels, guint width, guint height,
+               int channels, size_t stride,
+               const AgPngOptions *opts, size_t *out_len)
+{
+    if (!check_args (width, height, channels, stride))
+        return NULL;
+
+    GByteArray *buf = g_byte_array_new ();
+    if (!encode (pixels, width, height, channels, stride, opts,
+                 emit_bytes, buf)) {
+        g_byte_array_free (buf, TRUE);
+        return NULL;
+    }
+    *out_len = buf->len;
+    return g_byte_array_free (buf, FALSE);
+}
+
+typedef struct {
+    FILE    *f;
+    gboolean ok;
+} FileSink;
+
+static void
+emit_file (void *ctx, const void *data, size_t len)
+{
+    FileSink *s = ctx;
+    if (s->ok && fwrite (data, 1, len, s->f) != len)
+        s->ok = FALSE;
+}
+
+int
+ag_png_write (const char *path, const guint8 *pixels,
+              guint width, guint height, int channels, size_t stride,
+              const AgPngOptions *opts)
+{
+    if (!check_args (width, height, channels, stride)) {
+        fprintf (stderr, "error: cannot encode a %ux%u, %d-channel PNG\n",
+                 width, height, channels);
+        return EXIT_FAILURE;
+    }
+
+    FileSink sink = { fopen (path, "wb"), TRUE };
+    if (!sink.f) {
+        fprintf (stderr, "error: cannot open '%s' for write: %s\n",
+                 path, strerror (errno));
+        return EXIT_FAILURE;
+    }
+
+    gboolean encoded = encode (pixels, width, height, channels, stride,
+                               opts, emit_file, &sink);
+    if (fclose (sink.f) != 0)
+        sink.ok = FALSE;
+    if (!encoded || !sink.ok) {
+        fprintf (stderr, "error: failed to write '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
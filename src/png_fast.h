@@ -0,0 +1,67 @@
+/*
+ * png_fast.h — multi-threaded PNG encoder on system zlib
+ *
+ * stb_image_write deflates with its own slow compressor at a fixed
+ * setting.  This encoder uses zlib at a selectable level (0 stores the
+ * rows uncompressed, 1-9 trade speed for size), one fixed filter for
+ * every row (None, Sub or Up; no per-row heuristic search), and splits
+ * the image into bands of rows that are filtered and deflated on
+ * separate threads:
+ *
+ *   band 0:  deflate, Z_SYNC_FLUSH ─┐
+ *   band 1:  deflate, Z_SYNC_FLUSH  ├─ zlib header + bands + Adler-32
+ *   band 2:  deflate, Z_FINISH     ─┘    = one IDAT chunk
+ *
+ * A sync flush ends each band on a byte boundary with no final block,
+ * so the bands concatenate into one valid deflate stream; the Adler-32
+ * checksums of the bands are combined in order.  Bands do not reference
+ * each other's data, which costs well under 1% in size at the band
+ * heights used (at least AG_PNG_BAND_ROWS_MIN rows).
+ */
+
+#ifndef AG_PNG_FAST_H
+#define AG_PNG_FAST_H
+
+#include <glib.h>
+#include <stddef.h>
+
+#define AG_PNG_LEVEL_DEFAULT   1
+#define AG_PNG_THREADS_MAX     16
+#define AG_PNG_BAND_ROWS_MIN   32
+
+/* Values are the PNG filter type bytes. */
+typedef enum {
+    AG_PNG_FILTER_NONE = 0,
+    AG_PNG_FILTER_SUB  = 1,
+    AG_PNG_FILTER_UP   = 2,
+} AgPngFilter;
+
+typedef struct {
+    int         level;      /* zlib level, 0 (stored) .. 9 */
+    AgPngFilter filter;
+    int         threads;    /* bands deflated in parallel; 0 = one per core */
+} AgPngOptions;
+
+/* Level AG_PNG_LEVEL_DEFAULT, Up filter, one thread per core. */
+void ag_png_options_defaults (AgPngOptions *opts);
+
+/* Parse "none", "sub" or "up".  Returns 0 on success, -1 otherwise. */
+int ag_png_parse_filter (const char *str, AgPngFilter *out);
+const char *ag_png_filter_name (AgPngFilter filter);
+
+/*
+ * Encode 8-bit gray (channels = 1) or RGB (channels = 3) pixels, rows
+ * stride bytes apart, into a complete PNG file in memory.  Returns a
+ * g_malloc'd buffer of *out_len bytes, or NULL on bad arguments.
+ */
+guint8 *ag_png_encode (const guint8 *pixels, guint width, guint height,
+                       int channels, size_t stride,
+                       const AgPngOptions *opts, size_t *out_len);
+
+/* Same, written to path.  Returns EXIT_SUCCESS or EXIT_FAILURE with a
+ * diagnostic on stderr. */
+int ag_png_write (const char *path, const guint8 *pixels,
+                  guint width, guint height, int channels, size_t stride,
+                  const AgPngOptions *opts);
+
+#endif /* AG_PNG_FAST_H */
@@ -0,0 +1,523 @@
+/*
+ * rect_monitor.c — sparse row-alignment check of a rectified stereo pair
+ *
+ * Each corner is found on the right image in two steps.  The coarse
+ * step runs along the whole disparity range on a signature that does
+ * not care about the vertical error: the 16 column means of a window
+ * 2 * band + 8 rows tall, so a shift within the band changes only a few
+ * of the rows averaged.  One 16-byte SAD per disparity (psadbw on
+ * x86-64, vabdq on aarch64) keeps that cheap even at 256 disparities.
+ * The fine step is an 8x8 SAD over every row of the band at the coarse
+ * disparity +-1; it must beat the patch's own one-pixel self-difference,
+ * so a coarse match in the wrong place is dropped rather than counted.
+ * The corner search scores a fixed 5x5 lattice per grid cell.
+ */
+
+#include "rect_monitor.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define RECT_PATCH          8       /* SAD patch side; centre at (4, 4) */
+#define RECT_SIG            16      /* signature columns; centre at 8 */
+#define RECT_LATTICE        5       /* corner candidates per cell axis */
+#define RECT_MIN_EIGEN      400.0   /* 3x3 Shi-Tomasi floor (gradient^2) */
+#define RECT_UNIQUENESS     0.9     /* best SAD below this * runner-up */
+#define RECT_INLIER_PX      2.0     /* fit only |dy - median| below this */
+#define RECT_MIN_MATCHES    16      /* fewer: no statistics this check */
+#define RECT_SMOOTHING      0.3     /* weight of the newest check */
+#define RECT_CLEAR_RATIO    0.8     /* alarm clears below this * threshold */
+
+struct AgRectMonitor {
+    AgRectMonitorConfig cfg;
+    AgRectMonitorState  state;
+    gboolean            primed;       /* state holds a measurement */
+
+    AgGauge     *g_median;
+    AgGauge     *g_p95;
+    AgGauge     *g_rotation;
+    AgGauge     *g_scale;
+    AgGauge     *g_residual;
+    AgGauge     *g_matches;
+    AgGauge     *g_alarm;
+    AgCounter   *c_checks;
+    AgCounter   *c_alarms;
+    AgHistogram *h_check;
+};
+
+typedef struct {
+    double x, y, dy;
+} RectMatch;
+
+void
+ag_rect_monitor_config_defaults (AgRectMonitorConfig *cfg)
+{
+    cfg->every           = AG_RECT_MONITOR_EVERY_DEFAULT;
+    cfg->max_corners     = AG_RECT_MONITOR_CORNERS_DEFAULT;
+    cfg->band            = AG_RECT_MONITOR_BAND_DEFAULT;
+    cfg->min_disparity   = 0;
+    cfg->num_disparities = 128;
+    cfg->alarm_px        = AG_RECT_MONITOR_ALARM_DEFAULT;
+}
+
+/* ------------------------------------------------------------------ */
+/*  8x8 SAD                                                            */
+/* ------------------------------------------------------------------ */
+
+static inline unsigned
+sad8x8 (const uint8_t patch[RECT_PATCH * RECT_PATCH],
+        const uint8_t *b, int stride)
+{
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128 ();
+    for (int r = 0; r < RECT_PATCH; r += 2) {
+        __m128i pa = _mm_loadu_si128 ((const __m128i *) (patch + r * RECT_PATCH));
+        __m128i pb = _mm_unpacklo_epi64 (
+            _mm_loadl_epi64 ((const __m128i *) (b + (size_t) r * stride)),
+            _mm_loadl_epi64 ((const __m128i *) (b + (size_t) (r + 1) * stride)));
+        acc = _mm_add_epi64 (acc, _mm_sad_epu8 (pa, pb));
+    }
+    return (unsigned) (_mm_cvtsi128_si32 (acc) + _mm_extract_epi16 (acc, 4));
+#elif defined(__aarch64__)
+    uint16x8_t acc = vdupq_n_u16 (0);
+    for (int r = 0; r < RECT_PATCH; r++)
+        acc = vabal_u8 (acc, vld1_u8 (patch + r * RECT_PATCH),
+                        vld1_u8 (b + (size_t) r * stride));
+    return vaddvq_u16 (acc);
+#else
+    unsigned sum = 0;
+    for (int r = 0; r < RECT_PATCH; r++)
+        for (int c = 0; c < RECT_PATCH; c++)
+            sum += (unsigned) abs (patch[r * RECT_PATCH + c] -
+                                   b[(size_t) r * stride + c]);
+    return sum;
+#endif
+}
+
+/* SAD of two 16-byte signatures. */
+static inline unsigned
+sad16 (const uint8_t *a, const uint8_t *b)
+{
+#if defined(__SSE2__)
+    __m128i s = _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *) a),
+                              _mm_loadu_si128 ((const __m128i *) b));
+    return (unsigned) (_mm_cvtsi128_si32 (s) + _mm_extract_epi16 (s, 4));
+#elif defined(__aarch64__)
+    return vaddlvq_u8 (vabdq_u8 (vld1q_u8 (a), vld1q_u8 (b)));
+#else
+    unsigned sum = 0;
+    for (int c = 0; c < RECT_SIG; c++)
+        sum += (unsigned) abs (a[c] - b[c]);
+    return sum;
+#endif
+}
+
+/* Column means of rows [y0, y0 + rows) over columns [x0, x0 + n). */
+static void
+column_means (const uint8_t *img, int stride, int x0, int y0, int rows,
+              int n, uint8_t *out)
+{
+    int c = 0;
+#if defined(__SSE2__)
+    /* 16 columns at a time, summed as 16-bit (rows <= 40). */
+    const __m128i zero = _mm_setzero_si128 ();
+    for (; c + 16 <= n; c += 16) {
+        __m128i lo = zero, hi = zero;
+        const uint8_t *p = img + (size_t) y0 * stride + x0 + c;
+        for (int r = 0; r < rows; r++, p += stride) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+            lo = _mm_add_epi16 (lo, _mm_unpacklo_epi8 (v, zero));
+            hi = _mm_add_epi16 (hi, _mm_unpackhi_epi8 (v, zero));
+        }
+        uint16_t sum[16];
+        _mm_storeu_si128 ((__m128i *) sum, lo);
+        _mm_storeu_si128 ((__m128i *) (sum + 8), hi);
+        for (int k = 0; k < 16; k++)
+            out[c + k] = (uint8_t) ((sum[k] + rows / 2) / rows);
+    }
+#endif
+    for (; c < n; c++) {
+        unsigned sum = 0;
+        const uint8_t *p = img + (size_t) y0 * stride + x0 + c;
+        for (int r = 0; r < rows; r++, p += stride)
+            sum += *p;
+        out[c] = (uint8_t) ((sum + rows / 2) / rows);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Corners                                                            */
+/* ------------------------------------------------------------------ */
+
+/* Minimum eigenvalue of the structure tensor over the 3x3 around (x, y). */
+static double
+shi_tomasi (const uint8_t *img, int stride, int x, int y)
+{
+    int sxx = 0, syy = 0, sxy = 0;
+    for (int dy = -1; dy <= 1; dy++) {
+        const uint8_t *p = img + (size_t) (y + dy) * stride + x;
+        for (int dx = -1; dx <= 1; dx++) {
+            int gx = p[dx + 1] - p[dx - 1];
+            int gy = p[dx + stride] - p[dx - stride];
+            sxx += gx * gx;
+            syy += gy * gy;
+            sxy += gx * gy;
+        }
+    }
+    double half_tr = 0.5 * (sxx + syy);
+    double half_df = 0.5 * (sxx - syy);
+    return half_tr - sqrt (half_df * half_df + (double) sxy * sxy);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Matching                                                           */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Find the left corner (x, y) on the right image.  Returns TRUE with the
+ * sub-pixel vertical offset in *dy when the match is unique and inside
+ * the search range.
+ */
+static gboolean
+match_corner (const AgRectMonitorConfig *cfg, const uint8_t *left,
+              const uint8_t *right, int width, int stride, int x, int y,
+              double *dy)
+{
+    const int half = RECT_PATCH / 2, sig_half = RECT_SIG / 2;
+    const int band = cfg->band;
+
+    /* Disparities that keep the signature inside the right image. */
+    int d0 = MAX (cfg->min_disparity, x + sig_half - width);
+    int d1 = MIN (cfg->min_disparity + cfg->num_disparities - 1, x - sig_half);
+    if (d1 - d0 < 2)
+        return FALSE;
+
+    /* Coarse: column-mean signatures, right x = left x - d. */
+    uint8_t sig[RECT_SIG];
+    uint8_t profile[AG_RECT_MONITOR_DISPARITIES_MAX + RECT_SIG];
+    int sig_y0 = y - band - half, sig_rows = 2 * band + RECT_PATCH;
+    column_means (left, stride, x - sig_half, sig_y0, sig_rows, RECT_SIG, sig);
+    int px0 = x - d1 - sig_half;
+    column_means (right, stride, px0, sig_y0, sig_rows,
+                  d1 - d0 + RECT_SIG, profile);
+
+    unsigned best = G_MAXUINT, second = G_MAXUINT;
+    int best_d = d0;
+    for (int d = d1; d >= d0; d--) {
+        unsigned s = sad16 (sig, profile + (d1 - d));
+        if (s < best) {
+            if (abs (d - best_d) > 1)
+                second = best;
+            best = s;
+            best_d = d;
+        } else if (s < second && abs (d - best_d) > 1) {
+            second = s;
+        }
+    }
+    if (best_d == d0 || best_d == d1 ||
+        (double) best >= RECT_UNIQUENESS * second)
+        return FALSE;
+
+    /* Fine: 8x8 SAD on every row of the band, one column either side. */
+    uint8_t patch[RECT_PATCH * RECT_PATCH];
+    for (int r = 0; r < RECT_PATCH; r++)
+        memcpy (patch + r * RECT_PATCH,
+                left + (size_t) (y - half + r) * stride + x - half, RECT_PATCH);
+
+    int coarse_d = best_d, best_r = 0;
+    best = G_MAXUINT;
+    for (int d = coarse_d - 1; d <= coarse_d + 1; d++) {
+        for (int r = -band; r <= band; r++) {
+            unsigned s = sad8x8 (patch,
+                                 right + (size_t) (y + r - half) * stride
+                                 + x - d - half, stride);
+            if (s < best) {
+                best = s;
+                best_r = r;
+                best_d = d;
+            }
+        }
+    }
+    if (best_r == -band || best_r == band)
+        return FALSE;
+
+    /* A true match, even half a pixel off, beats the patch against
+     * itself moved a whole pixel. */
+    const uint8_t *lp = left + (size_t) (y - half) * stride + x - half;
+    unsigned self = MIN (sad8x8 (patch, lp + 1, stride),
+                         sad8x8 (patch, lp + stride, stride));
+    if (best >= self)
+        return FALSE;
+
+    /* Sub-pixel row from the SADs above, at and below the best. */
+    unsigned fine[3];
+    for (int k = 0; k < 3; k++)
+        fine[k] = sad8x8 (patch,
+                          right + (size_t) (y + best_r - 1 + k - half) * stride
+                          + x - best_d - half, stride);
+    double sm = fine[0], s0 = fine[1], sp = fine[2];
+    double denom = sm - 2.0 * s0 + sp;
+    double off = denom > 0.0 ? 0.5 * (sm - sp) / denom : 0.0;
+    *dy = best_r + CLAMP (off, -0.5, 0.5);
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Statistics                                                         */
+/* ------------------------------------------------------------------ */
+
+static int
+cmp_double (const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double
+det3 (double a, double b, double c,
+      double d, double e, double f,
+      double g, double h, double i)
+{
+    return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+}
+
+/* Least squares dy = offset + rotation * x + scale * y on the inliers
+ * (x and y already centred); residual is the inliers' RMS about it. */
+static void
+fit_plane (const RectMatch *m, int n, double median, AgRectCheck *out)
+{
+    double s[3][3] = { { 0 } }, r[3] = { 0 };
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        if (fabs (m[i].dy - median) > RECT_INLIER_PX)
+            continue;
+        double v[3] = { 1.0, m[i].x, m[i].y };
+        for (int a = 0; a < 3; a++) {
+            for (int b = 0; b < 3; b++)
+                s[a][b] += v[a] * v[b];
+            r[a] += v[a] * m[i].dy;
+        }
+        used++;
+    }
+    double d = det3 (s[0][0], s[0][1], s[0][2], s[1][0], s[1][1], s[1][2],
+                     s[2][0], s[2][1], s[2][2]);
+    if (used < 3 || fabs (d) < 1e-9) {
+        out->offset = median;
+        return;
+    }
+    out->offset   = det3 (r[0], s[0][1], s[0][2], r[1], s[1][1], s[1][2],
+                          r[2], s[2][1], s[2][2]) / d;
+    out->rotation = det3 (s[0][0], r[0], s[0][2], s[1][0], r[1], s[1][2],
+                          s[2][0], r[2], s[2][2]) / d;
+    out->scale    = det3 (s[0][0], s[0][1], r[0], s[1][0], s[1][1], r[1],
+                          s[2][0], s[2][1], r[2]) / d;
+
+    double sq = 0.0;
+    for (int i = 0; i < n; i++) {
+        if (fabs (m[i].dy - median) > RECT_INLIER_PX)
+            continue;
+        double e = m[i].dy - (out->offset + out->rotation * m[i].x +
+                              out->scale * m[i].y);
+        sq += e * e;
+    }
+    out->residual = sqrt (sq / used);
+}
+
+void
+ag_rect_measure (const AgRectMonitorConfig *cfg,
+                 const uint8_t *left, const uint8_t *right,
+                 int width, int height, int stride, AgRectCheck *out)
+{
+    uint64_t t0 = ag_trace_now_ns ();
+    memset (out, 0, sizeof *out);
+
+    /* Keep the 3x3 gradients, the patch and the band inside the image. */
+    int margin_x = RECT_SIG / 2 + 1;
+    int margin_y = RECT_PATCH / 2 + cfg->band + 2;
+    if (cfg->num_disparities > AG_RECT_MONITOR_DISPARITIES_MAX)
+        goto done;
+    int area_w = width - 2 * margin_x;
+    int area_h = height - 2 * margin_y;
+    if (area_w < RECT_LATTICE || area_h < RECT_LATTICE)
+        goto done;
+
+    /* Grid of about max_corners cells, shaped like the image. */
+    int cols = (int) lround (sqrt ((double) cfg->max_corners * area_w / area_h));
+    cols = CLAMP (cols, 1, cfg->max_corners);
+    int rows = MAX (cfg->max_corners / cols, 1);
+    cols = MIN (cols, area_w / RECT_LATTICE);
+    rows = MIN (rows, area_h / RECT_LATTICE);
+
+    RectMatch matches[AG_RECT_MONITOR_CORNERS_MAX];
+    double cx = 0.5 * (width - 1), cy = 0.5 * (height - 1);
+    for (int gy = 0; gy < rows; gy++) {
+        int y0 = margin_y + gy * area_h / rows;
+        int ch = (gy + 1) * area_h / rows - gy * area_h / rows;
+        for (int gx = 0; gx < cols; gx++) {
+            int x0 = margin_x + gx * area_w / cols;
+            int cw = (gx + 1) * area_w / cols - gx * area_w / cols;
+
+            double best = RECT_MIN_EIGEN;
+            int bx = -1, by = -1;
+            for (int j = 0; j < RECT_LATTICE; j++) {
+                int y = y0 + (2 * j + 1) * ch / (2 * RECT_LATTICE);
+                for (int i = 0; i < RECT_LATTICE; i++) {
+                    int x = x0 + (2 * i + 1) * cw / (2 * RECT_LATTICE);
+                    double e = shi_tomasi (left, stride, x, y);
+                    if (e > best) {
+                        best = e;
+                        bx = x;
+                        by = y;
+                    }
+                }
+            }
+            if (bx < 0)
+                continue;
+            out->corners++;
+
+            double dy;
+            if (match_corner (cfg, left, right, width, stride, bx, by, &dy))
+                matches[out->matches++] = (RectMatch) { bx - cx, by - cy, dy };
+        }
+    }
+
+    if (out->matches >= RECT_MIN_MATCHES) {
+        double dys[AG_RECT_MONITOR_CORNERS_MAX];
+        int n = out->matches;
+        for (int i = 0; i < n; i++)
+            dys[i] = matches[i].dy;
+        qsort (dys, n, sizeof dys[0], cmp_double);
+        out->median_dy = n % 2 ? dys[n / 2]
+                               : 0.5 * (dys[n / 2 - 1] + dys[n / 2]);
+        for (int i = 0; i < n; i++)
+            dys[i] = fabs (matches[i].dy);
+        qsort (dys, n, sizeof dys[0], cmp_double);
+        out->p95_abs_dy = dys[MIN (n - 1, (int) ceil (0.95 * n) - 1)];
+        fit_plane (matches, n, out->median_dy, out);
+    }
+
+done:
+    out->check_ms = (ag_trace_now_ns () - t0) / 1e6;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Monitor                                                            */
+/* ------------------------------------------------------------------ */
+
+AgRectMonitor *
+ag_rect_monitor_new (const AgRectMonitorConfig *cfg)
+{
+    if (cfg->every < 1 || cfg->max_corners < 1 ||
+        cfg->max_corners > AG_RECT_MONITOR_CORNERS_MAX ||
+        cfg->band < 1 || cfg->band > AG_RECT_MONITOR_BAND_MAX ||
+        cfg->num_disparities < 3 ||
+        cfg->num_disparities > AG_RECT_MONITOR_DISPARITIES_MAX ||
+        cfg->min_disparity < 0 ||
+        !(cfg->alarm_px > 0.0))
+        return NULL;
+
+    AgRectMonitor *m = g_new0 (AgRectMonitor, 1);
+    m->cfg = *cfg;
+    return m;
+}
+
+void
+ag_rect_monitor_free (AgRectMonitor *m)
+{
+    g_free (m);
+}
+
+void
+ag_rect_monitor_enable_metrics (AgRectMonitor *m)
+{
+    m->g_median   = ag_metrics_gauge ("ag_rect_vertical_median_pixels", NULL,
+                                      "Median vertical disparity of the last rectification check.");
+    m->g_p95      = ag_metrics_gauge ("ag_rect_vertical_p95_pixels", NULL,
+                                      "95th percentile of |vertical disparity| of the last check.");
+    m->g_rotation = ag_metrics_gauge ("ag_rect_rotation_radians", NULL,
+                                      "Fitted roll of the right eye relative to the left.");
+    m->g_scale    = ag_metrics_gauge ("ag_rect_scale_ratio", NULL,
+                                      "Fitted vertical scale of the right eye minus 1.");
+    m->g_residual = ag_metrics_gauge ("ag_rect_residual_pixels", NULL,
+                                      "RMS vertical disparity left after the offset/roll/scale fit.");
+    m->g_matches  = ag_metrics_gauge ("ag_rect_matches", NULL,
+                                      "Corners matched in the last rectification check.");
+    m->g_alarm    = ag_metrics_gauge ("ag_rect_alarm", NULL,
+                                      "1 while the smoothed vertical error is above the threshold.");
+    m->c_checks   = ag_metrics_counter ("ag_rect_checks_total", NULL,
+                                        "Rectification checks run.");
+    m->c_alarms   = ag_metrics_counter ("ag_rect_alarms_total", NULL,
+                                        "Times the rectification alarm was raised.");
+    m->h_check    = ag_metrics_histogram ("ag_rect_check_seconds", NULL,
+                                          "CPU time of one rectification check.");
+}
+
+gboolean
+ag_rect_monitor_due (const AgRectMonitor *m, guint64 frame_index)
+{
+    return frame_index % (guint64) m->cfg.every == 0;
+}
+
+gboolean
+ag_rect_monitor_check (AgRectMonitor *m,
+                       const uint8_t *left, const uint8_t *right,
+                       int width, int height, int stride, AgRectCheck *out)
+{
+    ag_rect_measure (&m->cfg, left, right, width, height, stride, out);
+
+    AgRectMonitorState *st = &m->state;
+    gboolean raised = FALSE;
+    st->checks++;
+    ag_counter_inc (m->c_checks);
+    ag_histogram_observe_ns (m->h_check, (uint64_t) (out->check_ms * 1e6));
+    ag_gauge_set (m->g_matches, out->matches);
+
+    /* Too few matches (no texture, covered lens): keep the last state. */
+    if (out->matches < RECT_MIN_MATCHES)
+        return FALSE;
+
+    if (!m->primed) {
+        st->median_dy  = out->median_dy;
+        st->p95_abs_dy = out->p95_abs_dy;
+        m->primed = TRUE;
+    } else {
+        st->median_dy  += RECT_SMOOTHING * (out->median_dy  - st->median_dy);
+        st->p95_abs_dy += RECT_SMOOTHING * (out->p95_abs_dy - st->p95_abs_dy);
+    }
+
+    /* A shift moves the median; a roll or zoom spreads the tail, which
+     * is allowed twice the threshold. */
+    double limit = m->cfg.alarm_px;
+    double level = MAX (fabs (st->median_dy), 0.5 * st->p95_abs_dy);
+    if (!st->alarm && level > limit) {
+        st->alarm = TRUE;
+        st->alarms++;
+        ag_counter_inc (m->c_alarms);
+        raised = TRUE;
+    } else if (st->alarm && level < RECT_CLEAR_RATIO * limit) {
+        st->alarm = FALSE;
+    }
+
+    ag_gauge_set (m->g_median, out->median_dy);
+    ag_gauge_set (m->g_p95, out->p95_abs_dy);
+    ag_gauge_set (m->g_rotation, out->rotation);
+    ag_gauge_set (m->g_scale, out->scale);
+    ag_gauge_set (m->g_residual, out->residual);
+    ag_gauge_set (m->g_alarm, st->alarm ? 1.0 : 0.0);
+    return raised;
+}
+
+void
+ag_rect_monitor_state (const AgRectMonitor *m, AgRectMonitorState *out)
+{
+    *out = m->state;
+}
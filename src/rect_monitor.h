@@ -0,0 +1,111 @@
+/*
+ * rect_monitor.h — sparse row-alignment check of a rectified stereo pair
+ *
+ * After rectification a scene point lies on the same row in both eyes.
+ * Knocks and thermal cycles move the cameras and the calibration goes
+ * stale without any visible failure until depth degrades.  This monitor
+ * measures the vertical disparity directly, on a few hundred corners:
+ *
+ *   1. one corner per cell of a grid over the left image, the best of a
+ *      fixed lattice of candidates by Shi-Tomasi (minimum eigenvalue);
+ *   2. a search for each along the epipolar line on the right image,
+ *      first on column means that tolerate the vertical error, then by
+ *      8x8 SAD on every row of the band around the best column, with a
+ *      sub-pixel parabola on the row;
+ *   3. the median and 95th percentile of the vertical offsets, and a
+ *      least-squares fit dy = offset + rotation * (x - cx) +
+ *      scale * (y - cy) whose slopes are the roll and zoom of the right
+ *      eye relative to the left.
+ *
+ * The work per check is bounded by the corner count, not the image size
+ * (well under 1 ms for 256 corners), and checks run every N frames.
+ * Smoothed results raise an alarm, with hysteresis, when the median or
+ * the 95th percentile exceeds the threshold, and are published through
+ * the metrics registry.
+ *
+ *   AgRectMonitorConfig cfg;
+ *   ag_rect_monitor_config_defaults (&cfg);
+ *   AgRectMonitor *m = ag_rect_monitor_new (&cfg);
+ *   per frame:
+ *       if (ag_rect_monitor_due (m, frame_index))
+ *           ag_rect_monitor_check (m, left, right, w, h, w, &check);
+ */
+
+#ifndef AG_RECT_MONITOR_H
+#define AG_RECT_MONITOR_H
+
+#include <glib.h>
+#include <stdint.h>
+
+#define AG_RECT_MONITOR_EVERY_DEFAULT    30
+#define AG_RECT_MONITOR_CORNERS_DEFAULT  256
+#define AG_RECT_MONITOR_BAND_DEFAULT     4      /* rows searched each way */
+#define AG_RECT_MONITOR_ALARM_DEFAULT    0.5    /* pixels */
+#define AG_RECT_MONITOR_CORNERS_MAX      1024
+#define AG_RECT_MONITOR_BAND_MAX         16
+#define AG_RECT_MONITOR_DISPARITIES_MAX  1024
+
+typedef struct {
+    int    every;           /* check one frame in this many */
+    int    max_corners;     /* grid cells, one corner each */
+    int    band;            /* vertical search range, +-rows */
+    int    min_disparity;   /* horizontal search: right x = left x - d */
+    int    num_disparities;
+    double alarm_px;        /* alarm above this median / p95 |dy| */
+} AgRectMonitorConfig;
+
+typedef struct {
+    int    corners;         /* corners detected on the left image */
+    int    matches;         /* corners matched on the right */
+    double median_dy;       /* signed, pixels (right row - left row) */
+    double p95_abs_dy;      /* 95th percentile of |dy| */
+    double offset;          /* fit: dy at the image centre */
+    double rotation;        /* fit: dy per pixel of x (radians of roll) */
+    double scale;           /* fit: dy per pixel of y (relative zoom) */
+    double residual;        /* RMS of dy about the fit */
+    double check_ms;        /* time taken by this check */
+} AgRectCheck;
+
+typedef struct {
+    double   median_dy;     /* exponentially smoothed over checks */
+    double   p95_abs_dy;
+    gboolean alarm;
+    guint64  checks;
+    guint64  alarms;        /* times the alarm was raised */
+} AgRectMonitorState;
+
+typedef struct AgRectMonitor AgRectMonitor;
+
+void ag_rect_monitor_config_defaults (AgRectMonitorConfig *cfg);
+
+/* NULL if the configuration is out of range. */
+AgRectMonitor *ag_rect_monitor_new (const AgRectMonitorConfig *cfg);
+void           ag_rect_monitor_free (AgRectMonitor *m);
+
+/* Register the ag_rect_* series with the metrics registry. */
+void ag_rect_monitor_enable_metrics (AgRectMonitor *m);
+
+/* TRUE on the frames that should be checked (every cfg.every-th). */
+gboolean ag_rect_monitor_due (const AgRectMonitor *m, guint64 frame_index);
+
+/*
+ * Measure one rectified pair (8-bit, width x height, rows stride bytes
+ * apart), update the smoothed state and alarm and publish the metrics.
+ * Returns TRUE if the alarm was raised by this check.
+ */
+gboolean ag_rect_monitor_check (AgRectMonitor *m,
+                                const uint8_t *left, const uint8_t *right,
+                                int width, int height, int stride,
+                                AgRectCheck *out);
+
+void ag_rect_monitor_state (const AgRectMonitor *m, AgRectMonitorState *out);
+
+/*
+ * The measurement alone, without state: detect corners on left, match
+ * them on right and fill out.  Used by ag_rect_monitor_check().
+ */
+void ag_rect_measure (const AgRectMonitorConfig *cfg,
+                      const uint8_t *left, const uint8_t *right,
+                      int width, int height, int stride, AgRectCheck *out);
+
+#endif /* AG_RECT_MONITOR_H */
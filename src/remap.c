@@ -167,6 +167,47 @@ ag_remap_table_free (AgRemapTable *table)
     g_free (table);
 }
 
+AgRemapTable *
+ag_remap_table_crop (const AgRemapTable *table, uint32_t x0, uint32_t y0,
+                     uint32_t w, uint32_t h)
+{
+    if (!table)
+        return NULL;
+    if (w == 0 || h == 0 ||
+        x0 > table->width  || w > table->width  - x0 ||
+        y0 > table->height || h > table->height - y0) {
+        fprintf (stderr, "remap: crop %ux%u+%u+%u outside %ux%u table\n",
+                 w, h, x0, y0, table->width, table->height);
+        return NULL;
+    }
+
+    AgRemapTable *out = g_malloc (sizeof (AgRemapTable));
+    out->width   = w;
+    out->height  = h;
+    out->offsets = g_malloc ((size_t) w * h * sizeof (uint32_t));
+
+    for (uint32_t y = 0; y < h; y++) {
+        const uint32_t *src_row = table->offsets
+                                  + (size_t) (y0 + y) * table->width + x0;
+        uint32_t *dst_row = out->offsets + (size_t) y * w;
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t off = src_row[x];
+            if (off == AG_REMAP_SENTINEL) {
+                dst_row[x] = AG_REMAP_SENTINEL;
+                continue;
+            }
+            uint32_t sx = off % table->width;
+            uint32_t sy = off / table->width;
+            if (sx < x0 || sx - x0 >= w || sy < y0 || sy - y0 >= h)
+                dst_row[x] = AG_REMAP_SENTINEL;
+            else
+                dst_row[x] = (sy - y0) * w + (sx - x0);
+        }
+    }
+
+    return out;
+}
+
 /* ------------------------------------------------------------------ */
 /*  Scalar remap (portable fallback)                                   */
 /* ------------------------------------------------------------------ */
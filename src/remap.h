@@ -63,6 +63,18 @@ int           ag_remap_table_save (const AgRemapTable *table, const char *path);
 
 void          ag_remap_table_free (AgRemapTable *table);
 
+/*
+ * Crop a full-frame table to the w x h window at (x0, y0), for frames
+ * acquired with a sensor ROI of the same geometry.  Output pixels keep
+ * the rectified coordinates of the window; their offsets are rebased
+ * into the smaller w x h source, and sources falling outside the ROI
+ * become SENTINEL.  Returns NULL if the window does not fit the table.
+ * Caller must ag_remap_table_free() when done.
+ */
+AgRemapTable *ag_remap_table_crop (const AgRemapTable *table,
+                                   uint32_t x0, uint32_t y0,
+                                   uint32_t w, uint32_t h);
+
 /*
  * Apply nearest-neighbour remap on RGB24 data.
  * src and dst must each be width*height*3 bytes.  dst must not alias src.
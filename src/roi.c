@@ -0,0 +1,72 @@
+/*
+ * roi.c — sensor region of interest (--roi)
+ */
+
+#include "roi.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int
+parse_uint_field (const char *str, guint *out)
+{
+    char *end = NULL;
+    if (!g_ascii_isdigit (str[0]))
+        return -1;
+    unsigned long v = strtoul (str, &end, 10);
+    if (*end != '\0' || v > G_MAXUINT)
+        return -1;
+    *out = (guint) v;
+    return 0;
+}
+
+int
+ag_parse_roi (const char *str, AgRoi *out)
+{
+    gchar **parts = g_strsplit (str, ":", -1);
+    guint n = g_strv_length (parts);
+    AgRoi roi = { 0 };
+    int rc = -1;
+
+    if ((n == 2 || n == 4) &&
+        parse_uint_field (parts[0], &roi.y) == 0 &&
+        parse_uint_field (parts[1], &roi.height) == 0 &&
+        roi.height > 0) {
+        rc = 0;
+        if (n == 4 &&
+            (parse_uint_field (parts[2], &roi.x) != 0 ||
+             parse_uint_field (parts[3], &roi.width) != 0 ||
+             roi.width == 0))
+            rc = -1;
+    }
+    g_strfreev (parts);
+
+    if (rc == 0)
+        *out = roi;
+    return rc;
+}
+
+const char *
+ag_roi_resolve (AgRoi *roi, guint eye_w, guint eye_h)
+{
+    if (roi->height == 0)
+        return NULL;
+    if (roi->width == 0) {
+        if (roi->x != 0)
+            return "--roi x offset needs a width";
+        roi->width = eye_w;
+    }
+    if ((roi->x | roi->y | roi->width | roi->height) & 1u)
+        return "--roi offsets and sizes must be even";
+    if (roi->y >= eye_h || roi->height > eye_h - roi->y)
+        return "--roi rows exceed the frame height";
+    if (roi->x >= eye_w || roi->width > eye_w - roi->x)
+        return "--roi columns exceed the frame width";
+    return NULL;
+}
+
+gboolean
+ag_roi_active (const AgRoi *roi)
+{
+    return roi && roi->height > 0;
+}
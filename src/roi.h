@@ -0,0 +1,38 @@
+/*
+ * roi.h — sensor region of interest (--roi)
+ *
+ * An AgRoi is expressed per eye in processed pixels (after binning), the
+ * same coordinates as the rectification remap tables.  camera_configure()
+ * scales it to device OffsetX/OffsetY/Width/Height; commands crop their
+ * remap tables to it with ag_remap_table_crop().
+ */
+
+#ifndef AG_ROI_H
+#define AG_ROI_H
+
+#include <glib.h>
+
+typedef struct {
+    guint x;
+    guint y;
+    guint width;    /* 0 = full eye width (after ag_roi_resolve: set) */
+    guint height;   /* 0 = no ROI, full frame                          */
+} AgRoi;
+
+/*
+ * Parse "y0:height" or "y0:height:x0:width".  Returns 0 on success,
+ * -1 on bad syntax.  Bounds are checked by ag_roi_resolve().
+ */
+int ag_parse_roi (const char *str, AgRoi *out);
+
+/*
+ * Fill a missing width and check *roi against an eye_w x eye_h frame.
+ * Offsets and sizes must be even so the Bayer phase is preserved.
+ * Returns NULL on success or a static message.  A zeroed ROI is valid.
+ */
+const char *ag_roi_resolve (AgRoi *roi, guint eye_w, guint eye_h);
+
+/* TRUE when roi is non-NULL and selects a sub-window. */
+gboolean ag_roi_active (const AgRoi *roi);
+
+#endif /* AG_ROI_H */
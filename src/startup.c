@@ -0,0 +1,85 @@
+/*
+ * startup.c — time-to-first-frame profile (--startup-profile)
+ *
+ * Phases are recorded on the main thread during connect and configure,
+ * before any worker thread exists, so the state is plain statics.
+ */
+
+#include "startup.h"
+
+#include <time.h>
+
+typedef struct {
+    const char *name;
+    guint64     t_ns;
+} StartupMark;
+
+static gboolean    startup_on;
+static guint64     startup_t0_ns;
+static StartupMark marks[AG_STARTUP_MAX_PHASES];
+static guint       n_marks;
+
+static guint64
+now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * 1000000000ull + (guint64) ts.tv_nsec;
+}
+
+void
+ag_startup_begin (gboolean enabled)
+{
+    startup_on    = enabled;
+    startup_t0_ns = now_ns ();
+    n_marks       = 0;
+}
+
+gboolean
+ag_startup_active (void)
+{
+    return startup_on;
+}
+
+void
+ag_startup_mark (const char *phase)
+{
+    if (!startup_on || n_marks >= AG_STARTUP_MAX_PHASES)
+        return;
+    marks[n_marks].name = phase;
+    marks[n_marks].t_ns = now_ns ();
+    n_marks++;
+}
+
+guint
+ag_startup_n_phases (void)
+{
+    return n_marks;
+}
+
+double
+ag_startup_phase_ms (guint i)
+{
+    if (i >= n_marks)
+        return 0.0;
+    guint64 prev = (i == 0) ? startup_t0_ns : marks[i - 1].t_ns;
+    return (double) (marks[i].t_ns - prev) / 1e6;
+}
+
+void
+ag_startup_report (FILE *out)
+{
+    if (!startup_on)
+        return;
+    startup_on = FALSE;
+
+    fprintf (out, "Startup profile:\n");
+    double total = 0.0;
+    for (guint i = 0; i < n_marks; i++) {
+        double ms = ag_startup_phase_ms (i);
+        total += ms;
+        fprintf (out, "  %-24s %8.1f ms  (%8.1f ms)\n",
+                 marks[i].name, ms, total);
+    }
+    fprintf (out, "  %-24s %8.1f ms\n", "total", total);
+}
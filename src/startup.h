@@ -0,0 +1,47 @@
+/*
+ * startup.h — time-to-first-frame profile (--startup-profile)
+ *
+ * A command calls ag_startup_begin() before it resolves the device and
+ * ag_startup_mark() at the end of each connect/configure phase; the
+ * first displayed frame prints the per-phase table.  Marks cost one
+ * branch when profiling is off, so they stay in camera_configure() for
+ * every command.
+ *
+ *   ag_startup_begin (profile_a->count > 0);
+ *   char *id = resolve_device (...);
+ *   ag_startup_mark ("resolve device");
+ *   ...
+ *   ag_startup_report (stdout);
+ */
+
+#ifndef AG_STARTUP_H
+#define AG_STARTUP_H
+
+#include <glib.h>
+#include <stdio.h>
+
+#define AG_STARTUP_MAX_PHASES 32
+
+/* Reset and start the clock.  enabled = FALSE turns every mark into a no-op. */
+void ag_startup_begin (gboolean enabled);
+
+/* TRUE between ag_startup_begin (TRUE) and ag_startup_report(). */
+gboolean ag_startup_active (void);
+
+/*
+ * End the current phase.  phase must outlive the profile (a string
+ * literal).  Marks past AG_STARTUP_MAX_PHASES are dropped.
+ */
+void ag_startup_mark (const char *phase);
+
+/* Number of phases recorded so far, and the duration of phase i in ms. */
+guint  ag_startup_n_phases (void);
+double ag_startup_phase_ms (guint i);
+
+/*
+ * Print one line per phase (duration and cumulative time) and the
+ * total, then stop profiling so later calls are no-ops.
+ */
+void ag_startup_report (FILE *out);
+
+#endif /* AG_STARTUP_H */
@@ -0,0 +1,92 @@
+/*
+ * stream_pool.c — contiguous, locked backing store for Aravis stream buffers
+ */
+
+#include "stream_pool.h"
+#include "arena.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+struct AgStreamPool {
+    AgFrameArena *arena;
+    guint8       *base;
+    guint         n_buffers;
+    size_t        payload;
+    size_t        stride;     /* payload rounded to AG_ARENA_ALIGN */
+    gboolean      locked;
+};
+
+AgStreamPool *
+ag_stream_pool_new (guint n_buffers, size_t payload)
+{
+    AgStreamPool *pool = g_new0 (AgStreamPool, 1);
+    pool->n_buffers = n_buffers;
+    pool->payload   = payload;
+    pool->stride    = AG_ARENA_ROUND (payload);
+
+    size_t bytes = pool->stride * n_buffers;
+    pool->arena = ag_frame_arena_new (bytes, AG_ARENA_HUGEPAGES);
+    pool->base  = ag_frame_arena_alloc (pool->arena, bytes);
+
+    if (mlock (pool->base, bytes) == 0) {
+        pool->locked = TRUE;
+    } else {
+        fprintf (stderr, "warn: cannot lock %.1f MB of stream buffers (%s); "
+                 "raise RLIMIT_MEMLOCK (ulimit -l) to pin them\n",
+                 bytes / (1024.0 * 1024.0), strerror (errno));
+    }
+
+    return pool;
+}
+
+void *
+ag_stream_pool_slot (AgStreamPool *pool, guint i)
+{
+    if (i >= pool->n_buffers)
+        return NULL;
+    return pool->base + (size_t) i * pool->stride;
+}
+
+guint
+ag_stream_pool_n_buffers (const AgStreamPool *pool)
+{
+    return pool->n_buffers;
+}
+
+size_t
+ag_stream_pool_payload (const AgStreamPool *pool)
+{
+    return pool->payload;
+}
+
+size_t
+ag_stream_pool_bytes (const AgStreamPool *pool)
+{
+    return pool->stride * pool->n_buffers;
+}
+
+gboolean
+ag_stream_pool_locked (const AgStreamPool *pool)
+{
+    return pool->locked;
+}
+
+const char *
+ag_stream_pool_backing_name (const AgStreamPool *pool)
+{
+    return ag_frame_arena_backing_name (pool->arena);
+}
+
+void
+ag_stream_pool_free (AgStreamPool *pool)
+{
+    if (!pool)
+        return;
+    if (pool->locked)
+        munlock (pool->base, ag_stream_pool_bytes (pool));
+    ag_frame_arena_free (pool->arena);
+    g_free (pool);
+}
@@ -0,0 +1,45 @@
+/*
+ * stream_pool.h — contiguous, locked backing store for Aravis stream buffers
+ *
+ * All stream buffers of one acquisition are carved from a single
+ * frame arena (see arena.h): 64-byte aligned, 2 MiB pages when the OS
+ * provides them, and mlock()ed so a receive burst never page-faults.
+ * camera_configure() wraps each slot with arv_buffer_new(); a buffer
+ * given caller memory does not own it, so the region must outlive the
+ * ArvStream — camera_config_cleanup() releases both in the right order.
+ *
+ * The pool itself does not depend on Aravis.
+ */
+
+#ifndef AG_STREAM_POOL_H
+#define AG_STREAM_POOL_H
+
+#include <glib.h>
+#include <stddef.h>
+
+/* Bounds for --stream-buffers. */
+#define AG_STREAM_BUFFERS_MIN   2
+#define AG_STREAM_BUFFERS_MAX 256
+
+typedef struct AgStreamPool AgStreamPool;
+
+/*
+ * Allocate n_buffers slots of payload bytes each.  Locking is
+ * best-effort: when RLIMIT_MEMLOCK is too small a warning is printed
+ * and the pool is used unlocked.  Aborts on out-of-memory.
+ */
+AgStreamPool *ag_stream_pool_new (guint n_buffers, size_t payload);
+
+/* Base address of slot i (64-byte aligned, payload bytes long). */
+void *ag_stream_pool_slot (AgStreamPool *pool, guint i);
+
+guint       ag_stream_pool_n_buffers    (const AgStreamPool *pool);
+size_t      ag_stream_pool_payload      (const AgStreamPool *pool);
+size_t      ag_stream_pool_bytes        (const AgStreamPool *pool);
+gboolean    ag_stream_pool_locked       (const AgStreamPool *pool);
+const char *ag_stream_pool_backing_name (const AgStreamPool *pool);
+
+/* Unlock and free the region.  NULL is a no-op. */
+void ag_stream_pool_free (AgStreamPool *pool);
+
+#endif /* AG_STREAM_POOL_H */
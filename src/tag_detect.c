@@ -0,0 +1,266 @@
+/*
+ * tag_detect.c — concurrent two-eye AprilTag detection for `stream`
+ */
+
+#include "tag_detect.h"
+
+#ifdef HAVE_APRILTAG
+
+#include "tag_track.h"
+
+#include <apriltag.h>
+#include <apriltag_pose.h>
+#include <tagStandard52h13.h>
+#include <common/image_u8.h>
+
+#include <string.h>
+
+typedef struct {
+    apriltag_family_t   *family;
+    apriltag_detector_t *detector;
+    AgTagTracker         tracker;
+
+    /* Current job. */
+    const guint8 *gray;
+    guint         width;
+    guint         height;
+
+    AgTagResult results[AG_TAG_MAX_RESULTS];
+    guint       n_results;
+
+    /* Last frame. */
+    gint64   busy_us;
+    gboolean tracked;
+} TagEye;
+
+struct AgStereoTags {
+    AgTagParams params;
+    TagEye      eye[2];
+
+    GThread *worker;        /* runs eye[AG_TAG_EYE_RIGHT] */
+    GMutex   lock;
+    GCond    cond;
+    gboolean job_pending;
+    gboolean quit;
+};
+
+/* Move a detection made in a sub-window back into eye coordinates.
+ * H maps tag space to image space, so the shift is T * H. */
+static void
+translate_detection (apriltag_detection_t *det, double dx, double dy)
+{
+    det->c[0] += dx;
+    det->c[1] += dy;
+    for (int c = 0; c < 4; c++) {
+        det->p[c][0] += dx;
+        det->p[c][1] += dy;
+    }
+    for (int c = 0; c < 3; c++) {
+        MATD_EL (det->H, 0, c) += dx * MATD_EL (det->H, 2, c);
+        MATD_EL (det->H, 1, c) += dy * MATD_EL (det->H, 2, c);
+    }
+}
+
+static void
+eye_add_result (const AgTagParams *params, TagEye *e,
+                apriltag_detection_t *det)
+{
+    if (e->n_results >= AG_TAG_MAX_RESULTS)
+        return;
+
+    AgTagResult *r = &e->results[e->n_results++];
+    r->id       = det->id;
+    r->hamming  = det->hamming;
+    r->margin   = det->decision_margin;
+    r->c[0]     = det->c[0];
+    r->c[1]     = det->c[1];
+    for (int c = 0; c < 4; c++) {
+        r->p[c][0] = det->p[c][0];
+        r->p[c][1] = det->p[c][1];
+    }
+    memset (r->R, 0, sizeof r->R);
+    memset (r->t, 0, sizeof r->t);
+    r->pose_err = 0.0;
+    if (!params->pose)
+        return;
+
+    apriltag_detection_info_t info = {
+        .det     = det,
+        .tagsize = params->tag_size_m,
+        .fx      = params->fx,
+        .fy      = params->fy,
+        .cx      = params->cx,
+        .cy      = params->cy
+    };
+    apriltag_pose_t pose;
+    r->pose_err = estimate_tag_pose (&info, &pose);
+    for (int i = 0; i < 9; i++)
+        r->R[i] = matd_get (pose.R, i / 3, i % 3);
+    for (int i = 0; i < 3; i++)
+        r->t[i] = matd_get (pose.t, i, 0);
+
+    matd_destroy (pose.R);
+    matd_destroy (pose.t);
+}
+
+static void
+eye_detect (const AgTagParams *params, TagEye *e)
+{
+    gint64 t0 = g_get_monotonic_time ();
+
+    gboolean full = ag_tag_tracker_want_full (&e->tracker);
+    AgTagWindow whole = { 0, 0, e->width, e->height };
+    const AgTagWindow *windows = full ? &whole : e->tracker.windows;
+    guint n_windows = full ? 1 : e->tracker.n_windows;
+
+    e->n_results = 0;
+    for (guint w = 0; w < n_windows; w++) {
+        const AgTagWindow *win = &windows[w];
+        image_u8_t im = {
+            .width  = (int32_t) (win->x1 - win->x0),
+            .height = (int32_t) (win->y1 - win->y0),
+            .stride = (int32_t) e->width,
+            .buf    = (uint8_t *) e->gray +
+                      (gsize) win->y0 * e->width + win->x0
+        };
+
+        zarray_t *detections = apriltag_detector_detect (e->detector, &im);
+        for (int i = 0; i < zarray_size (detections); i++) {
+            apriltag_detection_t *det;
+            zarray_get (detections, i, &det);
+            if (win->x0 || win->y0)
+                translate_detection (det, win->x0, win->y0);
+            eye_add_result (params, e, det);
+        }
+        apriltag_detections_destroy (detections);
+    }
+
+    double corners[AG_TAG_MAX_RESULTS][4][2];
+    for (guint i = 0; i < e->n_results; i++)
+        for (int c = 0; c < 4; c++) {
+            corners[i][c][0] = e->results[i].p[c][0];
+            corners[i][c][1] = e->results[i].p[c][1];
+        }
+    ag_tag_tracker_update (&e->tracker, full,
+                           (const double (*)[4][2]) corners, e->n_results,
+                           e->width, e->height);
+
+    e->busy_us = g_get_monotonic_time () - t0;
+    e->tracked = !full;
+}
+
+static gpointer
+worker_main (gpointer data)
+{
+    AgStereoTags *st = data;
+    TagEye *e = &st->eye[AG_TAG_EYE_RIGHT];
+
+    g_mutex_lock (&st->lock);
+    for (;;) {
+        while (!st->job_pending && !st->quit)
+            g_cond_wait (&st->cond, &st->lock);
+        if (st->quit)
+            break;
+        g_mutex_unlock (&st->lock);
+
+        eye_detect (&st->params, e);
+
+        g_mutex_lock (&st->lock);
+        st->job_pending = FALSE;
+        g_cond_broadcast (&st->cond);
+    }
+    g_mutex_unlock (&st->lock);
+    return NULL;
+}
+
+AgStereoTags *
+ag_stereo_tags_new (const AgTagParams *params)
+{
+    AgStereoTags *st = g_new0 (AgStereoTags, 1);
+    st->params = *params;
+
+    for (int i = 0; i < 2; i++) {
+        TagEye *e = &st->eye[i];
+        e->family   = tagStandard52h13_create ();
+        e->detector = apriltag_detector_create ();
+        apriltag_detector_add_family (e->detector, e->family);
+
+        e->detector->quad_decimate     = params->decimate;
+        e->detector->quad_sigma        = 0.0f;
+        e->detector->nthreads          = MAX (params->threads, 1);
+        e->detector->refine_edges      = 1;
+        e->detector->decode_sharpening = 0.25;
+
+        ag_tag_tracker_init (&e->tracker, params->refresh);
+    }
+
+    g_mutex_init (&st->lock);
+    g_cond_init (&st->cond);
+    st->worker = g_thread_new ("apriltag-right", worker_main, st);
+    return st;
+}
+
+void
+ag_stereo_tags_free (AgStereoTags *st)
+{
+    if (!st)
+        return;
+
+    g_mutex_lock (&st->lock);
+    st->quit = TRUE;
+    g_cond_broadcast (&st->cond);
+    g_mutex_unlock (&st->lock);
+    g_thread_join (st->worker);
+
+    g_mutex_clear (&st->lock);
+    g_cond_clear (&st->cond);
+
+    for (int i = 0; i < 2; i++) {
+        apriltag_detector_destroy (st->eye[i].detector);
+        tagStandard52h13_destroy (st->eye[i].family);
+    }
+    g_free (st);
+}
+
+void
+ag_stereo_tags_detect (AgStereoTags *st,
+                       const guint8 *left, const guint8 *right,
+                       guint width, guint height)
+{
+    TagEye *l = &st->eye[AG_TAG_EYE_LEFT];
+    TagEye *r = &st->eye[AG_TAG_EYE_RIGHT];
+    l->gray = left;
+    r->gray = right;
+    l->width = r->width = width;
+    l->height = r->height = height;
+
+    g_mutex_lock (&st->lock);
+    st->job_pending = TRUE;
+    g_cond_broadcast (&st->cond);
+    g_mutex_unlock (&st->lock);
+
+    eye_detect (&st->params, l);
+
+    g_mutex_lock (&st->lock);
+    while (st->job_pending)
+        g_cond_wait (&st->cond, &st->lock);
+    g_mutex_unlock (&st->lock);
+}
+
+guint
+ag_stereo_tags_results (const AgStereoTags *st, AgTagEye eye,
+                        const AgTagResult **out)
+{
+    *out = st->eye[eye].results;
+    return st->eye[eye].n_results;
+}
+
+void
+ag_stereo_tags_timing (const AgStereoTags *st, AgTagEye eye,
+                       double *ms, gboolean *tracked)
+{
+    *ms      = (double) st->eye[eye].busy_us / 1000.0;
+    *tracked = st->eye[eye].tracked;
+}
+
+#endif /* HAVE_APRILTAG */
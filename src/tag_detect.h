@@ -0,0 +1,81 @@
+/*
+ * tag_detect.h — concurrent two-eye AprilTag detection for `stream`
+ *
+ * Each eye owns an apriltag detector (and family instance: adding a
+ * family to a detector builds its decode table in place, so they cannot
+ * be shared).  The right eye runs on a persistent worker thread while
+ * the calling thread does the left, so a frame costs the slower eye
+ * rather than the sum.  --tag-threads additionally sets apriltag's own
+ * worker pool per eye.
+ *
+ * With tracking on (refresh > 0, see tag_track.h) frames after a hit
+ * search only padded windows around the previous corners; results are
+ * translated back to eye coordinates, homography included, before the
+ * pose is estimated.  Stereo mode (tag_stereo.h) turns the per-eye pose
+ * off and triangulates the matched corners instead.
+ *
+ * Only built with HAVE_APRILTAG.
+ */
+
+#ifndef AG_TAG_DETECT_H
+#define AG_TAG_DETECT_H
+
+#define AG_TAG_MAX_RESULTS      32
+#define AG_TAG_THREADS_DEFAULT  1
+#define AG_TAG_DECIMATE_DEFAULT 1.5f
+
+#ifdef HAVE_APRILTAG
+
+#include <glib.h>
+
+typedef enum {
+    AG_TAG_EYE_LEFT  = 0,
+    AG_TAG_EYE_RIGHT = 1,
+} AgTagEye;
+
+/* One detected tag with its pose (camera frame, metres). */
+typedef struct {
+    int    id;
+    int    hamming;
+    float  margin;
+    double c[2];        /* centre, eye pixels */
+    double p[4][2];     /* corners, counter-clockwise */
+    double pose_err;
+    double R[9];        /* row-major; zero without AgTagParams.pose */
+    double t[3];
+} AgTagResult;
+
+typedef struct {
+    int    threads;     /* apriltag nthreads per eye */
+    float  decimate;    /* quad_decimate */
+    guint  refresh;     /* full search every N frames; 0 = no tracking */
+    gboolean pose;      /* per-eye PnP (estimate_tag_pose); FALSE: R, t zero */
+    double tag_size_m;
+    double fx, fy, cx, cy;
+} AgTagParams;
+
+typedef struct AgStereoTags AgStereoTags;
+
+AgStereoTags *ag_stereo_tags_new  (const AgTagParams *params);
+void          ag_stereo_tags_free (AgStereoTags *st);
+
+/*
+ * Detect in both width x height eye images; returns once both are done.
+ * The buffers must stay untouched until then.
+ */
+void ag_stereo_tags_detect (AgStereoTags *st,
+                            const guint8 *left, const guint8 *right,
+                            guint width, guint height);
+
+/* Results of the last ag_stereo_tags_detect() for one eye. */
+guint ag_stereo_tags_results (const AgStereoTags *st, AgTagEye eye,
+                              const AgTagResult **out);
+
+/* Time the last ag_stereo_tags_detect() spent on one eye, and whether
+ * that eye searched tracking windows only. */
+void ag_stereo_tags_timing (const AgStereoTags *st, AgTagEye eye,
+                            double *ms, gboolean *tracked);
+
+#endif /* HAVE_APRILTAG */
+
+#endif /* AG_TAG_DETECT_H */
@@ -0,0 +1,190 @@
+/*
+ * tag_stereo.c — stereo AprilTag pose from rectified corners (--tag-stereo)
+ */
+
+#include "tag_stereo.h"
+
+#include <math.h>
+
+guint
+ag_tag_stereo_match (const int *ids_left, guint n_left,
+                     const int *ids_right, guint n_right,
+                     guint (*pairs)[2], guint max_pairs)
+{
+    guint n = 0;
+    for (guint i = 0; i < n_left && n < max_pairs; i++) {
+        guint hits_left = 0, hits_right = 0, match = 0;
+        for (guint k = 0; k < n_left; k++)
+            if (ids_left[k] == ids_left[i])
+                hits_left++;
+        for (guint k = 0; k < n_right; k++)
+            if (ids_right[k] == ids_left[i]) {
+                hits_right++;
+                match = k;
+            }
+        if (hits_left == 1 && hits_right == 1) {
+            pairs[n][0] = i;
+            pairs[n][1] = match;
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Eigenvector of the largest eigenvalue of a symmetric 4x4 (cyclic
+ * Jacobi; converges in a handful of sweeps at this size). */
+static void
+max_eigenvector4 (double a[4][4], double v_out[4])
+{
+    double v[4][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 },
+                       { 0, 0, 1, 0 }, { 0, 0, 0, 1 } };
+
+    for (int sweep = 0; sweep < 50; sweep++) {
+        double off = 0.0;
+        for (int p = 0; p < 4; p++)
+            for (int q = p + 1; q < 4; q++)
+                off += a[p][q] * a[p][q];
+        if (off < 1e-30)
+            break;
+
+        for (int p = 0; p < 4; p++) {
+            for (int q = p + 1; q < 4; q++) {
+                if (fabs (a[p][q]) < 1e-300)
+                    continue;
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) /
+                           (fabs (theta) + sqrt (theta * theta + 1.0));
+                double c = 1.0 / sqrt (t * t + 1.0);
+                double s = t * c;
+
+                for (int k = 0; k < 4; k++) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 4; k++) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 4; k++) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    int best = 0;
+    for (int i = 1; i < 4; i++)
+        if (a[i][i] > a[best][best])
+            best = i;
+    for (int k = 0; k < 4; k++)
+        v_out[k] = v[k][best];
+}
+
+void
+ag_rigid_fit (const double (*model)[3], const double (*obs)[3],
+              guint n, double R[9], double t[3])
+{
+    double mc[3] = { 0 }, oc[3] = { 0 };
+    for (guint i = 0; i < n; i++)
+        for (int k = 0; k < 3; k++) {
+            mc[k] += model[i][k] / n;
+            oc[k] += obs[i][k] / n;
+        }
+
+    /* S[a][b] = sum (model_a - mc_a) (obs_b - oc_b) */
+    double S[3][3] = { { 0 } };
+    for (guint i = 0; i < n; i++)
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                S[a][b] += (model[i][a] - mc[a]) * (obs[i][b] - oc[b]);
+
+    double N[4][4] = {
+        { S[0][0] + S[1][1] + S[2][2], S[1][2] - S[2][1],
+          S[2][0] - S[0][2],           S[0][1] - S[1][0] },
+        { S[1][2] - S[2][1],           S[0][0] - S[1][1] - S[2][2],
+          S[0][1] + S[1][0],           S[2][0] + S[0][2] },
+        { S[2][0] - S[0][2],           S[0][1] + S[1][0],
+          -S[0][0] + S[1][1] - S[2][2], S[1][2] + S[2][1] },
+        { S[0][1] - S[1][0],           S[2][0] + S[0][2],
+          S[1][2] + S[2][1],           -S[0][0] - S[1][1] + S[2][2] },
+    };
+
+    double q[4];
+    max_eigenvector4 (N, q);
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+
+    R[0] = w*w + x*x - y*y - z*z; R[1] = 2*(x*y - w*z);         R[2] = 2*(x*z + w*y);
+    R[3] = 2*(x*y + w*z);         R[4] = w*w - x*x + y*y - z*z; R[5] = 2*(y*z - w*x);
+    R[6] = 2*(x*z - w*y);         R[7] = 2*(y*z + w*x);         R[8] = w*w - x*x - y*y + z*z;
+
+    for (int k = 0; k < 3; k++)
+        t[k] = oc[k] - (R[3*k] * mc[0] + R[3*k + 1] * mc[1] + R[3*k + 2] * mc[2]);
+}
+
+int
+ag_tag_triangulate (const AgStereoRig *rig,
+                    const double pl[4][2], const double pr[4][2],
+                    double tag_size_m, double max_epipolar_px,
+                    AgTagStereoPose *out)
+{
+    out->epipolar_px  = 0.0;
+    out->disparity_px = 0.0;
+
+    for (int c = 0; c < 4; c++) {
+        double dy = fabs (pl[c][1] - pr[c][1]);
+        double d  = (pl[c][0] - pr[c][0]) - (rig->cx_left - rig->cx_right);
+        out->epipolar_px = MAX (out->epipolar_px, dy);
+        if (dy > max_epipolar_px || d < AG_TAG_STEREO_MIN_DISPARITY_PX)
+            return -1;
+
+        double Z = rig->f * rig->baseline_m / d;
+        double y = 0.5 * (pl[c][1] + pr[c][1]);
+        out->X[c][0] = (pl[c][0] - rig->cx_left) * Z / rig->f;
+        out->X[c][1] = (y - rig->cy) * Z / rig->f;
+        out->X[c][2] = Z;
+        out->disparity_px += d / 4.0;
+    }
+
+    double h = tag_size_m / 2.0;
+    const double model[4][3] = {
+        { -h,  h, 0 }, { h,  h, 0 }, { h, -h, 0 }, { -h, -h, 0 },
+    };
+    ag_rigid_fit (model, (const double (*)[3]) out->X, 4, out->R, out->t);
+
+    double sq = 0.0;
+    out->edge_m = 0.0;
+    for (int c = 0; c < 4; c++) {
+        for (int k = 0; k < 3; k++) {
+            double m = out->R[3*k] * model[c][0] + out->R[3*k + 1] * model[c][1] +
+                       out->R[3*k + 2] * model[c][2] + out->t[k];
+            sq += (m - out->X[c][k]) * (m - out->X[c][k]);
+        }
+        const double *a = out->X[c], *b = out->X[(c + 1) % 4];
+        out->edge_m += sqrt ((a[0] - b[0]) * (a[0] - b[0]) +
+                             (a[1] - b[1]) * (a[1] - b[1]) +
+                             (a[2] - b[2]) * (a[2] - b[2])) / 4.0;
+    }
+    out->rms_m = sqrt (sq / 4.0);
+    return 0;
+}
+
+void
+ag_tag_stereo_write_ndjson (FILE *f, guint64 frame, gint64 time_us,
+                            int id, const AgTagStereoPose *p)
+{
+    fprintf (f, "{\"frame\":%" G_GUINT64_FORMAT ",\"time_us\":%" G_GINT64_FORMAT
+             ",\"id\":%d"
+             ",\"t\":[%.5f,%.5f,%.5f]"
+             ",\"R\":[%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f]"
+             ",\"rms_m\":%.5f,\"edge_m\":%.5f"
+             ",\"disparity_px\":%.2f,\"epipolar_px\":%.2f}\n",
+             frame, time_us, id,
+             p->t[0], p->t[1], p->t[2],
+             p->R[0], p->R[1], p->R[2], p->R[3], p->R[4], p->R[5],
+             p->R[6], p->R[7], p->R[8],
+             p->rms_m, p->edge_m, p->disparity_px, p->epipolar_px);
+}
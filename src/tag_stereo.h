@@ -0,0 +1,84 @@
+/*
+ * tag_stereo.h — stereo AprilTag pose from rectified corners (--tag-stereo)
+ *
+ * With a rectified pair the four corners of a tag seen by both eyes can
+ * be triangulated directly: depth comes from the disparity against a
+ * calibrated baseline instead of from the tag's apparent size, which is
+ * what limits monocular PnP.  A rigid fit of the tag model onto the
+ * triangulated corners then gives one pose per tag.
+ *
+ *   AgStereoRig rig = { f, cx_left, cx_right, cy, baseline_m };
+ *   n = ag_tag_stereo_match (ids_l, n_l, ids_r, n_r, pairs, max);
+ *   if (ag_tag_triangulate (&rig, left_corners, right_corners,
+ *                           tag_size_m, AG_TAG_STEREO_MAX_EPIPOLAR_PX,
+ *                           &pose) == 0)
+ *       ag_tag_stereo_write_ndjson (stdout, frame, time_us, id, &pose);
+ *
+ * Poses are in the rectified left camera frame (OpenCV R1 applied),
+ * metres.  The tag frame is apriltag's: corners at (-s/2, +s/2),
+ * (+s/2, +s/2), (+s/2, -s/2), (-s/2, -s/2), z = 0.
+ *
+ * This file has no apriltag dependency.
+ */
+
+#ifndef AG_TAG_STEREO_H
+#define AG_TAG_STEREO_H
+
+#include <glib.h>
+#include <stdio.h>
+
+#define AG_TAG_STEREO_MAX_EPIPOLAR_PX  3.0   /* |y_left - y_right| per corner */
+#define AG_TAG_STEREO_MIN_DISPARITY_PX 0.5
+
+/* Rectified projection pair (OpenCV P1/P2), in eye image pixels. */
+typedef struct {
+    double f;            /* rectified focal length, px */
+    double cx_left;
+    double cx_right;
+    double cy;           /* shared by both rectified images */
+    double baseline_m;
+} AgStereoRig;
+
+typedef struct {
+    double X[4][3];       /* triangulated corners, metres */
+    double R[9];          /* tag -> camera rotation, row-major */
+    double t[3];          /* tag centre, metres */
+    double rms_m;         /* corner residual of the rigid fit */
+    double edge_m;        /* mean measured edge length */
+    double disparity_px;  /* mean corner disparity */
+    double epipolar_px;   /* worst |y_left - y_right| */
+} AgTagStereoPose;
+
+/*
+ * Pair detections by tag id.  An id seen more than once in either eye
+ * is ambiguous and skipped.  pairs[k] = { left index, right index }.
+ * Returns the number of pairs written (at most max_pairs).
+ */
+guint ag_tag_stereo_match (const int *ids_left, guint n_left,
+                           const int *ids_right, guint n_right,
+                           guint (*pairs)[2], guint max_pairs);
+
+/*
+ * Triangulate the four corners seen at pl (left) and pr (right) and fit
+ * the tag model of side tag_size_m to them.  Returns 0 on success, -1
+ * if any corner pair is off the epipolar line by more than
+ * max_epipolar_px or has no positive disparity.
+ */
+int ag_tag_triangulate (const AgStereoRig *rig,
+                        const double pl[4][2], const double pr[4][2],
+                        double tag_size_m, double max_epipolar_px,
+                        AgTagStereoPose *out);
+
+/*
+ * Least-squares rotation and translation taking model[i] onto obs[i]
+ * (Horn's closed form: unit quaternion from a 4x4 eigenproblem, so the
+ * result is always a proper rotation).  n >= 3, not collinear.
+ */
+void ag_rigid_fit (const double (*model)[3], const double (*obs)[3],
+                   guint n, double R[9], double t[3]);
+
+/* One JSON object per line: frame, time, id and the fused pose. */
+void ag_tag_stereo_write_ndjson (FILE *f, guint64 frame, gint64 time_us,
+                                 int id, const AgTagStereoPose *pose);
+
+#endif /* AG_TAG_STEREO_H */
@@ -0,0 +1,105 @@
+/*
+ * tag_track.c — AprilTag search windows for tracking mode (--tag-refresh)
+ */
+
+#include "tag_track.h"
+
+#include <math.h>
+
+void
+ag_tag_tracker_init (AgTagTracker *t, guint refresh)
+{
+    t->refresh    = refresh;
+    t->since_full = 0;
+    t->n_windows  = 0;
+}
+
+gboolean
+ag_tag_tracker_want_full (const AgTagTracker *t)
+{
+    return t->refresh == 0 || t->n_windows == 0 ||
+           t->since_full >= t->refresh;
+}
+
+/* Padded bounding box of one tag, clamped to the frame, even offsets. */
+static AgTagWindow
+tag_window (const double p[4][2], guint width, guint height)
+{
+    double x_min = p[0][0], x_max = p[0][0];
+    double y_min = p[0][1], y_max = p[0][1];
+    for (int c = 1; c < 4; c++) {
+        x_min = MIN (x_min, p[c][0]);
+        x_max = MAX (x_max, p[c][0]);
+        y_min = MIN (y_min, p[c][1]);
+        y_max = MAX (y_max, p[c][1]);
+    }
+
+    double pad = AG_TAG_TRACK_PAD_FRACTION * MAX (x_max - x_min, y_max - y_min);
+    pad = MAX (pad, (double) AG_TAG_TRACK_PAD_MIN);
+
+    double x0 = CLAMP (floor (x_min - pad), 0.0, (double) width);
+    double y0 = CLAMP (floor (y_min - pad), 0.0, (double) height);
+    double x1 = CLAMP (ceil  (x_max + pad), 0.0, (double) width);
+    double y1 = CLAMP (ceil  (y_max + pad), 0.0, (double) height);
+
+    AgTagWindow w = {
+        .x0 = (guint) x0 & ~1u,
+        .y0 = (guint) y0 & ~1u,
+        .x1 = (guint) x1,
+        .y1 = (guint) y1,
+    };
+    return w;
+}
+
+static gboolean
+windows_overlap (const AgTagWindow *a, const AgTagWindow *b)
+{
+    return a->x0 < b->x1 && b->x0 < a->x1 &&
+           a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+void
+ag_tag_tracker_update (AgTagTracker *t, gboolean full,
+                       const double (*corners)[4][2], guint n,
+                       guint width, guint height)
+{
+    t->since_full = full ? 1 : t->since_full + 1;
+    t->n_windows  = 0;
+    if (t->refresh == 0 || n > AG_TAG_TRACK_MAX_WINDOWS)
+        return;
+
+    for (guint i = 0; i < n; i++) {
+        AgTagWindow w = tag_window (corners[i], width, height);
+        if (w.x1 > w.x0 && w.y1 > w.y0)
+            t->windows[t->n_windows++] = w;
+    }
+
+    /* Merge overlapping windows until none overlap, so no tag is
+     * searched (and reported) twice. */
+    gboolean merged = TRUE;
+    while (merged) {
+        merged = FALSE;
+        for (guint i = 0; i < t->n_windows && !merged; i++) {
+            for (guint j = i + 1; j < t->n_windows; j++) {
+                AgTagWindow *a = &t->windows[i];
+                const AgTagWindow *b = &t->windows[j];
+                if (!windows_overlap (a, b))
+                    continue;
+                a->x0 = MIN (a->x0, b->x0);
+                a->y0 = MIN (a->y0, b->y0);
+                a->x1 = MAX (a->x1, b->x1);
+                a->y1 = MAX (a->y1, b->y1);
+                t->windows[j] = t->windows[--t->n_windows];
+                merged = TRUE;
+                break;
+            }
+        }
+    }
+
+    guint64 area = 0;
+    for (guint i = 0; i < t->n_windows; i++)
+        area += (guint64) (t->windows[i].x1 - t->windows[i].x0) *
+                (guint64) (t->windows[i].y1 - t->windows[i].y0);
+    if ((double) area > AG_TAG_TRACK_MAX_AREA * (double) width * (double) height)
+        t->n_windows = 0;
+}
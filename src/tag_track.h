@@ -0,0 +1,58 @@
+/*
+ * tag_track.h — AprilTag search windows for tracking mode (--tag-refresh)
+ *
+ * Once tags have been found, the next frames only need to look where
+ * they were.  The tracker turns the previous frame's corners into a few
+ * padded, merged search windows; a full-frame search runs every
+ * `refresh` frames (to pick up new tags) and whenever tracking lost
+ * everything.
+ *
+ *   AgTagTracker t;
+ *   ag_tag_tracker_init (&t, 10);
+ *   full = ag_tag_tracker_want_full (&t);
+ *   detect in the whole frame, or in t.windows[0 .. t.n_windows)
+ *   ag_tag_tracker_update (&t, full, corners, n, width, height);
+ *
+ * This file has no apriltag dependency.
+ */
+
+#ifndef AG_TAG_TRACK_H
+#define AG_TAG_TRACK_H
+
+#include <glib.h>
+
+#define AG_TAG_TRACK_REFRESH_DEFAULT  10   /* full search every N frames      */
+#define AG_TAG_TRACK_MAX_WINDOWS      16
+#define AG_TAG_TRACK_PAD_FRACTION     0.5  /* of the tag's bbox, on each side */
+#define AG_TAG_TRACK_PAD_MIN          24   /* px                              */
+#define AG_TAG_TRACK_MAX_AREA         0.5  /* of the frame; above: go full    */
+
+/* Half-open pixel window [x0, x1) x [y0, y1); offsets are even. */
+typedef struct {
+    guint x0, y0;
+    guint x1, y1;
+} AgTagWindow;
+
+typedef struct {
+    guint       refresh;      /* 0 = tracking off, always full-frame */
+    guint       since_full;   /* frames searched since the last full search */
+    guint       n_windows;
+    AgTagWindow windows[AG_TAG_TRACK_MAX_WINDOWS];
+} AgTagTracker;
+
+void ag_tag_tracker_init (AgTagTracker *t, guint refresh);
+
+/* TRUE when the next frame must be searched in full. */
+gboolean ag_tag_tracker_want_full (const AgTagTracker *t);
+
+/*
+ * Record one frame's result: `full` says whether it was a full-frame
+ * search, corners[0 .. n) are the tags found, in frame pixels.  No tags,
+ * too many windows, or windows covering most of the frame leave no
+ * windows, so the next search is full.
+ */
+void ag_tag_tracker_update (AgTagTracker *t, gboolean full,
+                            const double (*corners)[4][2], guint n,
+                            guint width, guint height);
+
+#endif /* AG_TAG_TRACK_H */
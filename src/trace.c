@@ -0,0 +1,339 @@
+/*
+ * trace.c — per-stage latency probes with Chrome trace-event export
+ *
+ * Each recording thread owns a fixed-size ring of events.  The writer
+ * publishes its head index with a release store after filling the slot;
+ * readers (summary, export) load it with acquire semantics and only
+ * look at published slots.  Rings are registered once per thread under
+ * a mutex, never on the per-event path.
+ */
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AG_TRACE_RING_CAP   65536u          /* events per thread (power of 2) */
+#define AG_TRACE_MAX_RINGS  64
+
+typedef struct {
+    uint64_t t_begin_ns;
+    uint32_t dur_ns;
+    uint16_t stage;
+    guint64  frame_id;
+} TraceEvent;
+
+typedef struct {
+    TraceEvent events[AG_TRACE_RING_CAP];
+    guint64    head;              /* total events written (atomic) */
+    int        tid;
+    char       name[32];
+} TraceRing;
+
+int ag_trace_on = 0;
+int ag_trace_observed = 0;
+
+static GMutex     rings_lock;
+static TraceRing *rings[AG_TRACE_MAX_RINGS];
+static int        n_rings;
+static uint64_t   trace_epoch_ns;
+static uint64_t   summary_since_ns;
+static AgTraceObserver observer_fn;
+static void      *observer_data;
+
+static __thread TraceRing *tls_ring;
+
+/* Frame tag of the calling thread, and its stage totals for that frame
+ * not yet handed to the observer (one bit per stage in tls_pending). */
+static __thread guint64  tls_frame_id;
+static __thread gboolean tls_framed;
+static __thread guint32  tls_pending;
+static __thread uint64_t tls_stage_ns[AG_STAGE_COUNT];
+
+static const char *const stage_names[AG_STAGE_COUNT] = {
+    [AG_STAGE_TRIGGER]   = "trigger",
+    [AG_STAGE_POP]       = "pop",
+    [AG_STAGE_EXTRACT]   = "extract",
+    [AG_STAGE_DEBAYER]   = "debayer",
+    [AG_STAGE_REMAP]     = "remap",
+    [AG_STAGE_DISPARITY] = "disparity",
+    [AG_STAGE_COLORIZE]  = "colorize",
+    [AG_STAGE_UPLOAD]    = "upload",
+    [AG_STAGE_PRESENT]   = "present",
+    [AG_STAGE_VIDEO]     = "video",
+};
+
+const char *
+ag_trace_stage_name (AgTraceStage stage)
+{
+    if ((unsigned) stage >= AG_STAGE_COUNT)
+        return "unknown";
+    return stage_names[stage];
+}
+
+/* ------------------------------------------------------------------ */
+/*  Ring registration (once per thread)                                */
+/* ------------------------------------------------------------------ */
+
+static TraceRing *
+ring_for_thread (void)
+{
+    if (G_LIKELY (tls_ring))
+        return tls_ring;
+
+    TraceRing *r = NULL;
+    g_mutex_lock (&rings_lock);
+    if (n_rings < AG_TRACE_MAX_RINGS) {
+        r = g_malloc0 (sizeof *r);
+        r->tid = n_rings + 1;
+        snprintf (r->name, sizeof r->name, "thread-%d", r->tid);
+        rings[n_rings++] = r;
+    }
+    g_mutex_unlock (&rings_lock);
+
+    tls_ring = r;
+    return r;
+}
+
+void
+ag_trace_name_thread (const char *name)
+{
+    if (!ag_trace_on)
+        return;
+    TraceRing *r = ring_for_thread ();
+    if (r)
+        g_strlcpy (r->name, name, sizeof r->name);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Hot path                                                           */
+/* ------------------------------------------------------------------ */
+
+static void
+notify_observer (AgTraceStage stage, uint64_t dur_ns)
+{
+    AgTraceObserver fn = __atomic_load_n (&observer_fn, __ATOMIC_ACQUIRE);
+    if (fn)
+        fn (stage, dur_ns, observer_data);
+}
+
+void
+ag_trace_record (AgTraceStage stage, uint64_t t_begin_ns, uint64_t t_end_ns)
+{
+    uint64_t dur = t_end_ns > t_begin_ns ? t_end_ns - t_begin_ns : 0;
+
+    TraceRing *r = ag_trace_on ? ring_for_thread () : NULL;
+    if (G_LIKELY (r)) {
+        guint64 head = r->head;
+        TraceEvent *ev = &r->events[head & (AG_TRACE_RING_CAP - 1)];
+
+        ev->t_begin_ns = t_begin_ns;
+        ev->dur_ns     = dur > G_MAXUINT32 ? G_MAXUINT32 : (uint32_t) dur;
+        ev->stage      = (uint16_t) stage;
+        ev->frame_id   = tls_frame_id;
+
+        __atomic_store_n (&r->head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    /* On a frame-tagged thread the observer gets each stage's per-frame
+     * total once the thread moves on; untagged threads pass through. */
+    if (tls_framed && (unsigned) stage < AG_STAGE_COUNT) {
+        tls_stage_ns[stage] += dur;
+        tls_pending |= 1u << stage;
+    } else {
+        notify_observer (stage, dur);
+    }
+}
+
+void
+ag_trace_record_frame (guint64 frame_id)
+{
+    for (int s = 0; tls_pending; s++) {
+        if (tls_pending & (1u << s)) {
+            notify_observer ((AgTraceStage) s, tls_stage_ns[s]);
+            tls_stage_ns[s] = 0;
+            tls_pending &= ~(1u << s);
+        }
+    }
+    tls_frame_id = frame_id;
+    tls_framed   = TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Lifecycle                                                          */
+/* ------------------------------------------------------------------ */
+
+void
+ag_trace_start (const char *thread_name)
+{
+    trace_epoch_ns   = ag_trace_now_ns ();
+    summary_since_ns = trace_epoch_ns;
+    __atomic_store_n (&ag_trace_on, 1, __ATOMIC_RELEASE);
+    if (thread_name)
+        ag_trace_name_thread (thread_name);
+}
+
+void
+ag_trace_set_observer (AgTraceObserver fn, void *user_data)
+{
+    observer_data = user_data;
+    __atomic_store_n (&observer_fn, fn, __ATOMIC_RELEASE);
+    __atomic_store_n (&ag_trace_observed, fn != NULL, __ATOMIC_RELEASE);
+}
+
+void
+ag_trace_stop (void)
+{
+    __atomic_store_n (&ag_trace_on, 0, __ATOMIC_RELEASE);
+    ag_trace_set_observer (NULL, NULL);
+
+    g_mutex_lock (&rings_lock);
+    for (int i = 0; i < n_rings; i++) {
+        g_free (rings[i]);
+        rings[i] = NULL;
+    }
+    n_rings = 0;
+    g_mutex_unlock (&rings_lock);
+
+    /* Only the calling thread's cached state can be reset here; other
+     * threads must have finished recording before ag_trace_stop(). */
+    tls_ring     = NULL;
+    tls_frame_id = 0;
+    tls_framed   = FALSE;
+    tls_pending  = 0;
+    memset (tls_stage_ns, 0, sizeof tls_stage_ns);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Rolling summary                                                    */
+/* ------------------------------------------------------------------ */
+
+static int
+cmp_u32 (const void *a, const void *b)
+{
+    uint32_t ua = *(const uint32_t *) a, ub = *(const uint32_t *) b;
+    return (ua > ub) - (ua < ub);
+}
+
+void
+ag_trace_summary (char *buf, size_t len)
+{
+    if (len == 0)
+        return;
+    buf[0] = '\0';
+
+    uint64_t since = summary_since_ns;
+    summary_since_ns = ag_trace_now_ns ();
+
+    GArray *samples[AG_STAGE_COUNT];
+    for (int s = 0; s < AG_STAGE_COUNT; s++)
+        samples[s] = g_array_new (FALSE, FALSE, sizeof (uint32_t));
+
+    /* A stage that runs more than once per frame (e.g. the disparity and
+     * display remaps in depth preview) contributes its per-frame total. */
+    g_mutex_lock (&rings_lock);
+    for (int i = 0; i < n_rings; i++) {
+        TraceRing *r = rings[i];
+        guint64 last_frame[AG_STAGE_COUNT];
+        for (int s = 0; s < AG_STAGE_COUNT; s++)
+            last_frame[s] = G_MAXUINT64;
+
+        guint64 head = __atomic_load_n (&r->head, __ATOMIC_ACQUIRE);
+        guint64 first = head > AG_TRACE_RING_CAP ? head - AG_TRACE_RING_CAP : 0;
+        for (guint64 k = head; k > first; k--) {
+            const TraceEvent *ev = &r->events[(k - 1) & (AG_TRACE_RING_CAP - 1)];
+            if (ev->t_begin_ns < since)
+                break;
+            if (ev->stage >= AG_STAGE_COUNT)
+                continue;
+            GArray *a = samples[ev->stage];
+            if (last_frame[ev->stage] == ev->frame_id) {
+                uint32_t *tot = &g_array_index (a, uint32_t, a->len - 1);
+                *tot = (uint32_t) MIN ((uint64_t) *tot + ev->dur_ns, G_MAXUINT32);
+            } else {
+                g_array_append_val (a, ev->dur_ns);
+                last_frame[ev->stage] = ev->frame_id;
+            }
+        }
+    }
+    g_mutex_unlock (&rings_lock);
+
+    size_t pos = 0;
+    for (int s = 0; s < AG_STAGE_COUNT; s++) {
+        GArray *a = samples[s];
+        if (a->len > 0 && pos < len) {
+            uint32_t *v = (uint32_t *) a->data;
+            qsort (v, a->len, sizeof *v, cmp_u32);
+            double p50 = v[(a->len - 1) * 50 / 100] / 1e6;
+            double p99 = v[(a->len - 1) * 99 / 100] / 1e6;
+            int n = snprintf (buf + pos, len - pos, "%s%s %.2f/%.2f",
+                              pos ? " " : "", stage_names[s], p50, p99);
+            if (n > 0)
+                pos += (size_t) n;
+        }
+        g_array_free (a, TRUE);
+    }
+    if (pos >= len)
+        buf[len - 1] = '\0';
+}
+
+void
+ag_trace_print_summary (void)
+{
+    if (!ag_trace_on)
+        return;
+    char lat[512];
+    ag_trace_summary (lat, sizeof lat);
+    if (lat[0])
+        printf ("    latency p50/p99 ms: %s\n", lat);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Chrome trace-event export                                          */
+/* ------------------------------------------------------------------ */
+
+int
+ag_trace_write_chrome (const char *path)
+{
+    FILE *f = fopen (path, "w");
+    if (!f) {
+        fprintf (stderr, "error: cannot create trace %s\n", path);
+        return -1;
+    }
+
+    fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf (f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                "\"args\":{\"name\":\"ag-cam-tools\"}}");
+
+    guint64 n_events = 0;
+    g_mutex_lock (&rings_lock);
+    for (int i = 0; i < n_rings; i++) {
+        TraceRing *r = rings[i];
+        fprintf (f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", r->tid, r->name);
+
+        guint64 head = __atomic_load_n (&r->head, __ATOMIC_ACQUIRE);
+        guint64 first = head > AG_TRACE_RING_CAP ? head - AG_TRACE_RING_CAP : 0;
+        for (guint64 k = first; k < head; k++) {
+            const TraceEvent *ev = &r->events[k & (AG_TRACE_RING_CAP - 1)];
+            double ts = (double) (int64_t) (ev->t_begin_ns - trace_epoch_ns) / 1e3;
+            fprintf (f, ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\","
+                        "\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                        "\"args\":{\"frame\":%" G_GUINT64_FORMAT "}}",
+                     ag_trace_stage_name ((AgTraceStage) ev->stage), r->tid,
+                     ts, ev->dur_ns / 1e3, ev->frame_id);
+            n_events++;
+        }
+    }
+    g_mutex_unlock (&rings_lock);
+
+    fprintf (f, "\n]}\n");
+    if (fclose (f) != 0) {
+        fprintf (stderr, "error: failed writing trace %s\n", path);
+        return -1;
+    }
+
+    printf ("Wrote %" G_GUINT64_FORMAT " trace events to %s\n", n_events, path);
+    return 0;
+}
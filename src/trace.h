@@ -0,0 +1,136 @@
+/*
+ * trace.h — per-stage latency probes with Chrome trace-event export
+ *
+ * Scoped timing probes for the acquisition/processing pipeline.  Each
+ * thread records into its own ring buffer, so the hot path never takes
+ * a lock.  An observer (e.g. the metrics histograms) can take the stage
+ * durations without the rings.  When neither is on, a probe costs one
+ * predicted branch on two global flags.
+ *
+ *   uint64_t t = ag_trace_begin ();
+ *   debayer_rg8_to_rgb (...);
+ *   ag_trace_end (AG_STAGE_DEBAYER, t);
+ *
+ * The recorded events can be dumped in Chrome trace-event JSON (open in
+ * chrome://tracing or ui.perfetto.dev) and summarised as per-stage
+ * p50/p99 latencies for the periodic stats line.
+ */
+
+#ifndef AG_TRACE_H
+#define AG_TRACE_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+    AG_STAGE_TRIGGER = 0,   /* TriggerArmed poll + TriggerSoftware       */
+    AG_STAGE_POP,           /* arv_stream_timeout_pop_buffer             */
+    AG_STAGE_EXTRACT,       /* extract_dual_bayer_eyes                   */
+    AG_STAGE_DEBAYER,       /* gamma LUT + debayer / gray conversion     */
+    AG_STAGE_REMAP,         /* rectification remap                       */
+    AG_STAGE_DISPARITY,     /* ag_disparity_compute                      */
+    AG_STAGE_COLORIZE,      /* ag_disparity_colorize                     */
+    AG_STAGE_UPLOAD,        /* SDL texture upload                        */
+    AG_STAGE_PRESENT,       /* render + SDL_RenderPresent                */
+    AG_STAGE_VIDEO,         /* --video-out conversion + write            */
+    AG_STAGE_COUNT
+} AgTraceStage;
+
+/* Nonzero while the trace rings record (ag_trace_start), and while an
+ * observer is set.  Read them through the helpers below. */
+extern int ag_trace_on;
+extern int ag_trace_observed;
+
+static inline uint64_t
+ag_trace_now_ns (void)
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime (CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Append one completed stage to the calling thread's ring. */
+void ag_trace_record (AgTraceStage stage, uint64_t t_begin_ns,
+                      uint64_t t_end_ns);
+
+/* Tag subsequent events from the calling thread with a frame number. */
+void ag_trace_record_frame (guint64 frame_id);
+
+static inline uint64_t
+ag_trace_begin (void)
+{
+    return G_UNLIKELY (ag_trace_on | ag_trace_observed)
+           ? ag_trace_now_ns () : 0;
+}
+
+static inline void
+ag_trace_end (AgTraceStage stage, uint64_t t_begin_ns)
+{
+    if (G_UNLIKELY (ag_trace_on | ag_trace_observed))
+        ag_trace_record (stage, t_begin_ns, ag_trace_now_ns ());
+}
+
+static inline void
+ag_trace_set_frame (guint64 frame_id)
+{
+    if (G_UNLIKELY (ag_trace_on | ag_trace_observed))
+        ag_trace_record_frame (frame_id);
+}
+
+/* Short stage name as used in the trace and summary ("remap"). */
+const char *ag_trace_stage_name (AgTraceStage stage);
+
+/*
+ * Enable the probes.  The calling thread is labelled thread_name in the
+ * exported trace (other threads get "thread-N" unless they call
+ * ag_trace_name_thread).
+ */
+void ag_trace_start (const char *thread_name);
+
+/* Label the calling thread in the exported trace (no-op while off). */
+void ag_trace_name_thread (const char *name);
+
+/*
+ * Format "p50/p99" latency in milliseconds for every stage that recorded
+ * events since the previous call, e.g. "pop 12.1/30.4 remap 1.9/2.2".
+ * Events with the same stage and frame number are summed first, so the
+ * figures are per-frame cost.  Writes an empty string when there is
+ * nothing to report.
+ */
+void ag_trace_summary (char *buf, size_t len);
+
+/*
+ * Print the ag_trace_summary() figures as an indented line of the
+ * periodic stats output.  Prints nothing while tracing is off.
+ */
+void ag_trace_print_summary (void);
+
+/*
+ * Write every buffered event as Chrome trace-event JSON.
+ * Call after worker threads have stopped recording.
+ * Returns 0 on success, -1 on error (prints its own diagnostic).
+ */
+int ag_trace_write_chrome (const char *path);
+
+/*
+ * Forward recorded stage durations to fn (e.g. a metrics histogram).
+ * Turns the probes on by itself, without allocating rings.  On a thread
+ * that tags frames (ag_trace_set_frame), fn gets one per-frame total
+ * per stage when the next frame is tagged; other threads report every
+ * event.  fn runs on the recording thread and must not block.
+ * Pass NULL to remove.  Cleared by ag_trace_stop().
+ */
+typedef void (*AgTraceObserver) (AgTraceStage stage, uint64_t dur_ns,
+                                 void *user_data);
+void ag_trace_set_observer (AgTraceObserver fn, void *user_data);
+
+/* Disable the probes and free all ring buffers. */
+void ag_trace_stop (void);
+
+#endif /* AG_TRACE_H */
@@ -0,0 +1,180 @@
+/*
+ * transport.c — GigE Vision stream transport options
+ */
+
+#include "transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <sys/socket.h>
+#endif
+
+int
+ag_parse_packet_socket (const char *str, AgPacketSocket *out)
+{
+    if (strcmp (str, "auto") == 0)
+        { *out = AG_PACKET_SOCKET_AUTO; return 0; }
+    if (strcmp (str, "on") == 0)
+        { *out = AG_PACKET_SOCKET_ON; return 0; }
+    if (strcmp (str, "off") == 0)
+        { *out = AG_PACKET_SOCKET_OFF; return 0; }
+    return -1;
+}
+
+int
+ag_parse_resend_policy (const char *str, AgResendPolicy *out)
+{
+    if (strcmp (str, "always") == 0)
+        { *out = AG_RESEND_ALWAYS; return 0; }
+    if (strcmp (str, "never") == 0)
+        { *out = AG_RESEND_NEVER; return 0; }
+    return -1;
+}
+
+int
+ag_parse_socket_buffer (const char *str, guint *out)
+{
+    if (strcmp (str, "auto") == 0) {
+        *out = 0;
+        return 0;
+    }
+
+    char *end = NULL;
+    unsigned long long v = strtoull (str, &end, 10);
+    if (end == str || str[0] == '-')
+        return -1;
+
+    if (*end == 'K' || *end == 'k') {
+        v *= 1024ull;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        v *= 1024ull * 1024ull;
+        end++;
+    }
+    if (*end != '\0')
+        return -1;
+    if (v < AG_SOCKET_BUFFER_MIN || v > AG_SOCKET_BUFFER_MAX)
+        return -1;
+
+    *out = (guint) v;
+    return 0;
+}
+
+const char *
+ag_transport_options_set (AgTransportOptions *opts,
+                          const char *packet_socket,
+                          const char *socket_buffer,
+                          int packet_timeout_us,
+                          int frame_retention_us,
+                          const char *packet_resend)
+{
+    if (packet_socket &&
+        ag_parse_packet_socket (packet_socket, &opts->packet_socket) != 0)
+        return "--packet-socket must be auto, on, or off";
+    if (packet_socket && opts->packet_socket == AG_PACKET_SOCKET_ON &&
+        !ag_packet_socket_supported ())
+        return "--packet-socket on requires Linux (PF_PACKET)";
+
+    if (socket_buffer &&
+        ag_parse_socket_buffer (socket_buffer, &opts->socket_buffer) != 0)
+        return "--socket-buffer must be auto or 64K..256M bytes";
+
+    if (packet_timeout_us >= 0) {
+        if (packet_timeout_us < 1000 || packet_timeout_us > 1000000)
+            return "--packet-timeout must be between 1000 and 1000000 us";
+        opts->packet_timeout_us = (guint) packet_timeout_us;
+    }
+    if (frame_retention_us >= 0) {
+        if (frame_retention_us < 1000 || frame_retention_us > 10000000)
+            return "--frame-retention must be between 1000 and 10000000 us";
+        opts->frame_retention_us = (guint) frame_retention_us;
+    }
+
+    if (packet_resend &&
+        ag_parse_resend_policy (packet_resend, &opts->packet_resend) != 0)
+        return "--packet-resend must be always or never";
+
+    return NULL;
+}
+
+const char *
+ag_packet_socket_name (AgPacketSocket mode)
+{
+    switch (mode) {
+    case AG_PACKET_SOCKET_ON:   return "on";
+    case AG_PACKET_SOCKET_OFF:  return "off";
+    case AG_PACKET_SOCKET_AUTO: break;
+    }
+    return "auto";
+}
+
+void
+ag_format_socket_buffer (guint bytes, char *buf, size_t len)
+{
+    if (bytes == 0)
+        snprintf (buf, len, "auto");
+    else if (bytes % (1024u * 1024u) == 0)
+        snprintf (buf, len, "%uM", bytes / (1024u * 1024u));
+    else if (bytes % 1024u == 0)
+        snprintf (buf, len, "%uK", bytes / 1024u);
+    else
+        snprintf (buf, len, "%u", bytes);
+}
+
+gboolean
+ag_packet_socket_supported (void)
+{
+#ifdef __linux__
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+gboolean
+ag_packet_socket_permitted (void)
+{
+#ifdef __linux__
+    int fd = socket (AF_PACKET, SOCK_RAW, htons (ETH_P_IP));
+    if (fd < 0)
+        return FALSE;
+    close (fd);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+gboolean
+ag_packet_socket_resolve (AgPacketSocket mode, const char **reason)
+{
+    const char *why;
+    gboolean use;
+
+    if (mode == AG_PACKET_SOCKET_OFF) {
+        why = "disabled";
+        use = FALSE;
+    } else if (!ag_packet_socket_supported ()) {
+        why = "not available on this platform";
+        use = FALSE;
+    } else if (ag_packet_socket_permitted ()) {
+        why = "PF_PACKET";
+        use = TRUE;
+    } else if (mode == AG_PACKET_SOCKET_ON) {
+        why = "requested without CAP_NET_RAW; Aravis will fall back to UDP";
+        use = TRUE;
+    } else {
+        why = "no CAP_NET_RAW";
+        use = FALSE;
+    }
+
+    if (reason)
+        *reason = why;
+    return use;
+}
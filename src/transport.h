@@ -0,0 +1,91 @@
+/*
+ * transport.h — GigE Vision stream transport options
+ *
+ * Parsing and platform resolution for the receive-path knobs shared by
+ * stream, depth-preview and net-bench: PF_PACKET socket use, socket
+ * receive buffer size, packet-timeout / frame-retention and the resend
+ * policy.  camera_configure() applies them to the ArvGvStream; nothing
+ * here depends on Aravis.
+ */
+
+#ifndef AG_TRANSPORT_H
+#define AG_TRANSPORT_H
+
+#include <glib.h>
+
+/* Defaults when the corresponding option is 0. */
+#define AG_PACKET_TIMEOUT_DEFAULT_US    20000   /* 20 ms  */
+#define AG_FRAME_RETENTION_DEFAULT_US  200000   /* 200 ms */
+
+/* Accepted --socket-buffer range (bytes). */
+#define AG_SOCKET_BUFFER_MIN  (64u * 1024u)
+#define AG_SOCKET_BUFFER_MAX  (256u * 1024u * 1024u)
+
+typedef enum {
+    AG_PACKET_SOCKET_AUTO = 0,  /* on when the platform and CAP_NET_RAW allow */
+    AG_PACKET_SOCKET_ON,        /* always ask Aravis for it                  */
+    AG_PACKET_SOCKET_OFF        /* plain UDP socket                          */
+} AgPacketSocket;
+
+typedef enum {
+    AG_RESEND_DEFAULT = 0,      /* always */
+    AG_RESEND_ALWAYS,
+    AG_RESEND_NEVER
+} AgResendPolicy;
+
+/* Optional stream tuning for camera_configure(); zero fields = defaults. */
+typedef struct {
+    guint          stream_buffers;     /* 0: 8 single-frame, 16 continuous */
+    AgPacketSocket packet_socket;
+    guint          socket_buffer;      /* bytes; 0 = Aravis auto sizing    */
+    guint          packet_timeout_us;  /* 0 = AG_PACKET_TIMEOUT_DEFAULT_US */
+    guint          frame_retention_us; /* 0 = AG_FRAME_RETENTION_DEFAULT_US */
+    AgResendPolicy packet_resend;
+} AgTransportOptions;
+
+/* "auto" | "on" | "off".  Returns 0 on success, -1 on bad input. */
+int ag_parse_packet_socket (const char *str, AgPacketSocket *out);
+
+/* "always" | "never".  Returns 0 on success, -1 on bad input. */
+int ag_parse_resend_policy (const char *str, AgResendPolicy *out);
+
+/*
+ * "auto" (-> 0) or a byte count with an optional K/M suffix (binary),
+ * within [AG_SOCKET_BUFFER_MIN, AG_SOCKET_BUFFER_MAX].
+ * Returns 0 on success, -1 on bad input.
+ */
+int ag_parse_socket_buffer (const char *str, guint *out);
+
+/*
+ * Fill *opts from command-line values, leaving other fields untouched.
+ * Pass NULL strings / negative integers for options not given.
+ * Returns NULL on success, or a static message naming the bad option.
+ */
+const char *ag_transport_options_set (AgTransportOptions *opts,
+                                      const char *packet_socket,
+                                      const char *socket_buffer,
+                                      int packet_timeout_us,
+                                      int frame_retention_us,
+                                      const char *packet_resend);
+
+const char *ag_packet_socket_name (AgPacketSocket mode);
+
+/* "auto" or e.g. "4M", "512K", "100000" (for tables and logs). */
+void ag_format_socket_buffer (guint bytes, char *buf, size_t len);
+
+/* TRUE when this build targets a platform with PF_PACKET (Linux). */
+gboolean ag_packet_socket_supported (void);
+
+/* TRUE when this process may open a PF_PACKET socket (CAP_NET_RAW). */
+gboolean ag_packet_socket_permitted (void);
+
+/*
+ * Decide whether to ask Aravis for the packet socket.  *reason (may be
+ * NULL) receives a short static explanation for the startup log.
+ * Opening a PF_PACKET socket needs CAP_NET_RAW: in AUTO mode its absence
+ * selects the plain socket; in ON mode the request is kept (Aravis then
+ * falls back itself) and the reason says so.
+ */
+gboolean ag_packet_socket_resolve (AgPacketSocket mode, const char **reason);
+
+#endif /* AG_TRANSPORT_H */
@@ -0,0 +1,200 @@
+/*
+ * transport_profile.c — per-camera GVSP packet size / delay profiles
+ */
+
+#include "transport_profile.h"
+#include "../vendor/cJSON.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Relative throughput difference treated as a tie when picking. */
+#define TUNE_TIE_FRACTION  0.01
+
+/* ------------------------------------------------------------------ */
+/*  Sweep selection                                                   */
+/* ------------------------------------------------------------------ */
+
+int
+ag_tune_parse_list (const char *str, guint min, guint max,
+                    guint *out, int max_n)
+{
+    gchar **parts = g_strsplit (str, ",", -1);
+    int n = 0;
+    for (gchar **p = parts; *p; p++) {
+        char *end = NULL;
+        unsigned long long v = strtoull (*p, &end, 10);
+        if (end == *p || **p == '-' || *end != '\0' ||
+            v < min || v > max || n >= max_n) {
+            n = -1;
+            break;
+        }
+        out[n++] = (guint) v;
+    }
+    g_strfreev (parts);
+    return (n == 0) ? -1 : n;
+}
+
+double
+ag_tune_point_mb_per_s (const AgTunePoint *p)
+{
+    return p->elapsed_s > 0.0
+           ? (double) p->completed * (double) p->payload / p->elapsed_s / 1e6
+           : 0.0;
+}
+
+int
+ag_tune_pick_best (const AgTunePoint *points, int n)
+{
+    int best = -1;
+    for (int i = 0; i < n; i++) {
+        const AgTunePoint *p = &points[i];
+        if (p->failed != 0 || p->missing != 0 || p->completed == 0)
+            continue;
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+
+        const AgTunePoint *b = &points[best];
+        double mb = ag_tune_point_mb_per_s (p);
+        double mb_best = ag_tune_point_mb_per_s (b);
+        if (mb > mb_best * (1.0 + TUNE_TIE_FRACTION)) {
+            best = i;
+        } else if (mb >= mb_best * (1.0 - TUNE_TIE_FRACTION)) {
+            /* Same throughput: prefer the quieter link, then the setting
+             * that leaves more headroom for the second head. */
+            if (p->resent < b->resent ||
+                (p->resent == b->resent &&
+                 p->packet_delay_ns < b->packet_delay_ns))
+                best = i;
+        }
+    }
+    return best;
+}
+
+/* ------------------------------------------------------------------ */
+/*  JSON                                                              */
+/* ------------------------------------------------------------------ */
+
+gchar *
+ag_transport_profile_to_json (const AgTransportProfile *p, const char *serial)
+{
+    cJSON *root = cJSON_CreateObject ();
+    if (serial)
+        cJSON_AddStringToObject (root, "serial", serial);
+    cJSON_AddNumberToObject (root, "packet_size", p->packet_size);
+    cJSON_AddNumberToObject (root, "packet_delay_ns", p->packet_delay_ns);
+    cJSON_AddNumberToObject (root, "mb_per_s", p->mb_per_s);
+    cJSON_AddNumberToObject (root, "fps", p->fps);
+
+    char *text = cJSON_Print (root);
+    cJSON_Delete (root);
+    gchar *out = g_strdup (text);
+    cJSON_free (text);
+    return out;
+}
+
+int
+ag_transport_profile_from_json (const char *text, AgTransportProfile *out)
+{
+    cJSON *root = cJSON_Parse (text);
+    if (!root)
+        return -1;
+
+    int rc = -1;
+    cJSON *ps = cJSON_GetObjectItemCaseSensitive (root, "packet_size");
+    cJSON *pd = cJSON_GetObjectItemCaseSensitive (root, "packet_delay_ns");
+    if (cJSON_IsNumber (ps) && cJSON_IsNumber (pd) &&
+        ps->valuedouble >= AG_PACKET_SIZE_MIN &&
+        ps->valuedouble <= AG_PACKET_SIZE_MAX &&
+        pd->valuedouble >= 0 && pd->valuedouble <= AG_PACKET_DELAY_MAX_NS) {
+        memset (out, 0, sizeof *out);
+        out->packet_size     = (guint) ps->valuedouble;
+        out->packet_delay_ns = (guint) pd->valuedouble;
+
+        cJSON *mb  = cJSON_GetObjectItemCaseSensitive (root, "mb_per_s");
+        cJSON *fps = cJSON_GetObjectItemCaseSensitive (root, "fps");
+        if (cJSON_IsNumber (mb))  out->mb_per_s = mb->valuedouble;
+        if (cJSON_IsNumber (fps)) out->fps      = fps->valuedouble;
+        rc = 0;
+    }
+    cJSON_Delete (root);
+    return rc;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Files                                                             */
+/* ------------------------------------------------------------------ */
+
+gchar *
+ag_transport_profile_path (const char *config_dir, const char *serial)
+{
+    gchar *name = g_strdup_printf ("%s.json", serial);
+    for (gchar *c = name; *c; c++) {
+        if (!g_ascii_isalnum (*c) && *c != '.' && *c != '-' && *c != '_')
+            *c = '_';
+    }
+    /* A serial of "." or ".." must not escape the directory. */
+    if (name[0] == '.')
+        name[0] = '_';
+
+    gchar *path = g_build_filename (config_dir ? config_dir
+                                               : g_get_user_config_dir (),
+                                    "ag-cam-tools", "transport", name, NULL);
+    g_free (name);
+    return path;
+}
+
+int
+ag_transport_profile_load (const char *path, AgTransportProfile *out)
+{
+    gchar *text = NULL;
+    if (!g_file_get_contents (path, &text, NULL, NULL))
+        return -1;
+
+    int rc = ag_transport_profile_from_json (text, out);
+    if (rc != 0)
+        fprintf (stderr, "warn: ignoring malformed transport profile %s\n", path);
+    g_free (text);
+    return rc;
+}
+
+int
+ag_transport_profile_save (const char *path, const char *serial,
+                           const AgTransportProfile *p)
+{
+    gchar *dir = g_path_get_dirname (path);
+    int mk = g_mkdir_with_parents (dir, 0755);
+    g_free (dir);
+    if (mk != 0) {
+        fprintf (stderr, "error: cannot create directory for %s: %s\n",
+                 path, g_strerror (errno));
+        return -1;
+    }
+
+    gchar *text = ag_transport_profile_to_json (p, serial);
+    GError *error = NULL;
+    int rc = 0;
+    if (!g_file_set_contents (path, text, -1, &error)) {
+        fprintf (stderr, "error: cannot write '%s': %s\n", path, error->message);
+        g_clear_error (&error);
+        rc = -1;
+    }
+    g_free (text);
+    return rc;
+}
+
+int
+ag_transport_profile_remove (const char *path)
+{
+    if (g_remove (path) != 0 && errno != ENOENT) {
+        fprintf (stderr, "error: cannot remove '%s': %s\n",
+                 path, g_strerror (errno));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * transport_profile.h — per-camera GVSP packet size / delay profiles
+ *
+ * tune-transport sweeps GevSCPSPacketSize x GevSCPD and saves the best
+ * drop-free setting as a small JSON file keyed by camera serial under
+ * the user config directory:
+ *
+ *   $XDG_CONFIG_HOME/ag-cam-tools/transport/<serial>.json
+ *
+ * camera_configure() loads it whenever the packet size is left on auto.
+ * Nothing here depends on Aravis.
+ */
+
+#ifndef AG_TRANSPORT_PROFILE_H
+#define AG_TRANSPORT_PROFILE_H
+
+#include <glib.h>
+
+/* Bounds accepted for a saved or swept setting. */
+#define AG_PACKET_SIZE_MIN       576
+#define AG_PACKET_SIZE_MAX      9000
+#define AG_PACKET_DELAY_MAX_NS  1000000   /* 1 ms between packets */
+
+typedef struct {
+    guint  packet_size;      /* GevSCPSPacketSize, bytes      */
+    guint  packet_delay_ns;  /* GevSCPD, via Aravis in ns     */
+    double mb_per_s;         /* throughput measured at tuning */
+    double fps;
+} AgTransportProfile;
+
+/* One point of a tune-transport sweep. */
+typedef struct {
+    guint   packet_size;
+    guint   packet_delay_ns;
+    size_t  payload;
+    guint64 completed;
+    guint64 failed;
+    guint64 resent;
+    guint64 missing;
+    double  elapsed_s;
+} AgTunePoint;
+
+/* Most values accepted per swept list. */
+#define AG_TUNE_MAX_VALUES  12
+
+/*
+ * Parse a comma-separated list of unsigned integers, each within
+ * [min, max], into out[0..max_n).  Returns the count, or -1 on bad input
+ * (empty list, junk, out-of-range value, more than max_n values).
+ */
+int ag_tune_parse_list (const char *str, guint min, guint max,
+                        guint *out, int max_n);
+
+/* Throughput of completed frames in MB/s (0 for an empty run). */
+double ag_tune_point_mb_per_s (const AgTunePoint *p);
+
+/*
+ * Index of the point with the highest drop-free throughput (no failed
+ * frames, no missing packets), or -1 if every point lost data.  Points
+ * within 1% of the best count as a tie, resolved by fewer resends, then
+ * by the smaller inter-packet delay.
+ */
+int ag_tune_pick_best (const AgTunePoint *points, int n);
+
+/*
+ * Profile path for a camera serial.  config_dir NULL means
+ * g_get_user_config_dir().  Characters outside [A-Za-z0-9._-] in the
+ * serial are replaced with '_'.  Caller frees.
+ */
+gchar *ag_transport_profile_path (const char *config_dir, const char *serial);
+
+/* JSON text round trip.  from_json returns 0 on success, -1 on bad input. */
+gchar *ag_transport_profile_to_json (const AgTransportProfile *p,
+                                     const char *serial);
+int    ag_transport_profile_from_json (const char *text,
+                                       AgTransportProfile *out);
+
+/*
+ * Load / save / delete the profile at path.  load returns -1 quietly when
+ * the file does not exist and warns on a malformed one; save creates the
+ * parent directories.  All return 0 on success, -1 on failure.
+ */
+int ag_transport_profile_load   (const char *path, AgTransportProfile *out);
+int ag_transport_profile_save   (const char *path, const char *serial,
+                                 const AgTransportProfile *p);
+int ag_transport_profile_remove (const char *path);
+
+#endif /* AG_TRANSPORT_PROFILE_H */
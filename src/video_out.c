@@ -0,0 +1,507 @@
+/*
+ * video_out.c — raw stereo video sink (Y4M or MJPEG) for external encoders
+ *
+ * Each output owns one set of planes laid out exactly as they are
+ * written: luma of the composed picture, then for 4:2:0 its Cb and Cr.
+ * Side by side, each eye is converted straight into its half, so a
+ * frame is one contiguous plane per component and goes out as a handful
+ * of iovecs.  RGB is converted with the JFIF (full range BT.601)
+ * matrix; 4:2:0 chroma is the average of each 2x2 block.
+ */
+
+#include "video_out.h"
+#include "jpeg_enc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define MJPEG_BOUNDARY "agcamframe"
+
+typedef struct {
+    int      fd;
+    char    *name;          /* for diagnostics */
+    int      eyes[2];       /* eye indices, left to right */
+    int      n_eyes;
+    guint    width, height; /* composed picture */
+    guint    cw, ch;        /* chroma planes, 4:2:0 only */
+    guint8  *y, *cb, *cr;   /* one allocation, y first */
+    gboolean header_done;
+} Output;
+
+struct AgVideoOut {
+    AgVideoOptions opts;
+    Output   out[2];
+    int      n_out;
+    FILE    *timestamps;
+    guint    eye_w, eye_h;  /* fixed by the first frame */
+    int      channels;
+    guint64  frames;
+    guint64  bytes;
+    gboolean failed;
+};
+
+void
+ag_video_options_defaults (AgVideoOptions *opts)
+{
+    opts->format          = AG_VIDEO_Y4M;
+    opts->color           = AG_VIDEO_GRAY;
+    opts->layout          = AG_VIDEO_SIDE_BY_SIDE;
+    opts->fps             = 30.0;
+    opts->jpeg_quality    = AG_JPEG_QUALITY_DEFAULT;
+    opts->timestamps_path = NULL;
+}
+
+int
+ag_video_parse_format (const char *str, AgVideoFormat *out)
+{
+    if (strcmp (str, "y4m") == 0)
+        { *out = AG_VIDEO_Y4M; return 0; }
+    if (strcmp (str, "mjpeg") == 0)
+        { *out = AG_VIDEO_MJPEG; return 0; }
+    return -1;
+}
+
+int
+ag_video_parse_color (const char *str, AgVideoColor *out)
+{
+    if (strcmp (str, "gray") == 0)
+        { *out = AG_VIDEO_GRAY; return 0; }
+    if (strcmp (str, "420") == 0)
+        { *out = AG_VIDEO_YUV420; return 0; }
+    return -1;
+}
+
+int
+ag_video_parse_layout (const char *str, AgVideoLayout *out)
+{
+    static const struct { const char *name; AgVideoLayout layout; } names[] = {
+        { "sbs",   AG_VIDEO_SIDE_BY_SIDE },
+        { "left",  AG_VIDEO_LEFT },
+        { "right", AG_VIDEO_RIGHT },
+        { "split", AG_VIDEO_SPLIT },
+    };
+    for (size_t i = 0; i < G_N_ELEMENTS (names); i++) {
+        if (strcmp (str, names[i].name) == 0) {
+            *out = names[i].layout;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *
+ag_video_options_set (AgVideoOptions *opts,
+                      const char *format,
+                      const char *color,
+                      const char *layout,
+                      int jpeg_quality)
+{
+    if (format && ag_video_parse_format (format, &opts->format) != 0)
+        return "--video-format must be y4m or mjpeg";
+    if (color && ag_video_parse_color (color, &opts->color) != 0)
+        return "--video-color must be gray or 420";
+    if (layout && ag_video_parse_layout (layout, &opts->layout) != 0)
+        return "--video-layout must be sbs, left, right or split";
+    if (jpeg_quality >= 0) {
+        if (opts->format != AG_VIDEO_MJPEG)
+            return "--video-quality requires --video-format mjpeg";
+        if (jpeg_quality < 1 || jpeg_quality > 100)
+            return "--video-quality must be between 1 and 100";
+        opts->jpeg_quality = jpeg_quality;
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Opening                                                            */
+/* ------------------------------------------------------------------ */
+
+/* "rec.y4m" -> "rec_left.y4m"; the extension is the last dot in the
+ * final path component. */
+static char *
+eye_path (const char *path, const char *eye)
+{
+    const char *slash = strrchr (path, '/');
+    const char *dot = strrchr (slash ? slash + 1 : path, '.');
+    if (!dot || dot == (slash ? slash + 1 : path))
+        return g_strdup_printf ("%s_%s", path, eye);
+    return g_strdup_printf ("%.*s_%s%s", (int) (dot - path), path, eye, dot);
+}
+
+static gboolean
+open_file (Output *o, const char *path)
+{
+    o->fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (o->fd < 0) {
+        fprintf (stderr, "error: cannot open '%s' for write: %s\n",
+                 path, strerror (errno));
+        return FALSE;
+    }
+    o->name = g_strdup (path);
+    return TRUE;
+}
+
+AgVideoOut *
+ag_video_out_open (const char *path, const AgVideoOptions *opts)
+{
+    AgVideoOut *vo = g_new0 (AgVideoOut, 1);
+    vo->opts = *opts;
+    vo->opts.timestamps_path = NULL;
+    vo->opts.jpeg_quality = CLAMP (opts->jpeg_quality, 1, 100);
+    vo->out[0].fd = vo->out[1].fd = -1;
+
+    switch (opts->layout) {
+    case AG_VIDEO_SIDE_BY_SIDE:
+        vo->n_out = 1;
+        vo->out[0].n_eyes = 2;
+        vo->out[0].eyes[0] = 0;
+        vo->out[0].eyes[1] = 1;
+        break;
+    case AG_VIDEO_LEFT:
+    case AG_VIDEO_RIGHT:
+        vo->n_out = 1;
+        vo->out[0].n_eyes = 1;
+        vo->out[0].eyes[0] = opts->layout == AG_VIDEO_RIGHT;
+        break;
+    case AG_VIDEO_SPLIT:
+        vo->n_out = 2;
+        vo->out[0].n_eyes = vo->out[1].n_eyes = 1;
+        vo->out[0].eyes[0] = 0;
+        vo->out[1].eyes[0] = 1;
+        break;
+    }
+
+    if (strcmp (path, "-") == 0) {
+        if (opts->layout == AG_VIDEO_SPLIT) {
+            fprintf (stderr, "error: the split video layout needs a file path, "
+                     "not stdout\n");
+            goto fail;
+        }
+        if (isatty (STDOUT_FILENO)) {
+            fprintf (stderr, "error: refusing to write video to a terminal; "
+                     "redirect or pipe stdout\n");
+            goto fail;
+        }
+        fflush (stdout);
+        vo->out[0].fd = fcntl (STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+        if (vo->out[0].fd < 0 || dup2 (STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fprintf (stderr, "error: cannot take over stdout: %s\n",
+                     strerror (errno));
+            goto fail;
+        }
+        vo->out[0].name = g_strdup ("stdout");
+    } else if (opts->layout == AG_VIDEO_SPLIT) {
+        for (int i = 0; i < 2; i++) {
+            char *p = eye_path (path, i ? "right" : "left");
+            gboolean ok = open_file (&vo->out[i], p);
+            g_free (p);
+            if (!ok)
+                goto fail;
+        }
+    } else if (!open_file (&vo->out[0], path)) {
+        goto fail;
+    }
+
+    if (opts->timestamps_path) {
+        vo->timestamps = fopen (opts->timestamps_path, "w");
+        if (!vo->timestamps) {
+            fprintf (stderr, "error: cannot open '%s' for write: %s\n",
+                     opts->timestamps_path, strerror (errno));
+            goto fail;
+        }
+        fputs ("frame,frame_id,timestamp_ns,system_ns\n", vo->timestamps);
+    }
+
+    signal (SIGPIPE, SIG_IGN);
+    return vo;
+
+fail:
+    ag_video_out_close (vo);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Conversion                                                         */
+/* ------------------------------------------------------------------ */
+
+static inline guint8
+rgb_to_y (int r, int g, int b)
+{
+    return (guint8) ((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+}
+
+static inline guint8
+rgb_to_cb (int r, int g, int b)
+{
+    int v = (-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16;
+    return (guint8) CLAMP (v, 0, 255);
+}
+
+static inline guint8
+rgb_to_cr (int r, int g, int b)
+{
+    int v = (32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16;
+    return (guint8) CLAMP (v, 0, 255);
+}
+
+/* Convert one eye into the output's planes at column x0. */
+static void
+convert_eye (Output *o, const AgVideoFrame *f, int eye, guint x0,
+             gboolean chroma)
+{
+    guint w = f->width, h = f->height;
+    const guint8 *src = f->eye[eye];
+
+    for (guint y = 0; y < h; y++) {
+        const guint8 *s = src + (size_t) y * f->stride;
+        guint8 *d = o->y + (size_t) y * o->width + x0;
+        if (f->channels == 1) {
+            memcpy (d, s, w);
+            continue;
+        }
+        for (guint x = 0; x < w; x++, s += 3)
+            d[x] = rgb_to_y (s[0], s[1], s[2]);
+    }
+
+    /* Gray input keeps the neutral chroma set at allocation. */
+    if (!chroma || f->channels == 1)
+        return;
+
+    guint cw = (w + 1) / 2, ch = (h + 1) / 2;
+    for (guint cy = 0; cy < ch; cy++) {
+        const guint8 *r0 = src + (size_t) (2 * cy) * f->stride;
+        const guint8 *r1 = src + (size_t) MIN (2 * cy + 1, h - 1) * f->stride;
+        guint8 *db = o->cb + (size_t) cy * o->cw + x0 / 2;
+        guint8 *dr = o->cr + (size_t) cy * o->cw + x0 / 2;
+        for (guint cx = 0; cx < cw; cx++) {
+            size_t a = (size_t) (2 * cx) * 3;
+            size_t b = (size_t) MIN (2 * cx + 1, w - 1) * 3;
+            int r = (r0[a]     + r0[b]     + r1[a]     + r1[b]     + 2) >> 2;
+            int g = (r0[a + 1] + r0[b + 1] + r1[a + 1] + r1[b + 1] + 2) >> 2;
+            int bl = (r0[a + 2] + r0[b + 2] + r1[a + 2] + r1[b + 2] + 2) >> 2;
+            db[cx] = rgb_to_cb (r, g, bl);
+            dr[cx] = rgb_to_cr (r, g, bl);
+        }
+    }
+}
+
+/* Fix the geometry on the first frame and allocate every output. */
+static gboolean
+setup (AgVideoOut *vo, const AgVideoFrame *f)
+{
+    gboolean yuv = vo->opts.color == AG_VIDEO_YUV420;
+    if (yuv && vo->opts.layout == AG_VIDEO_SIDE_BY_SIDE && f->width % 2) {
+        fprintf (stderr, "error: side-by-side 4:2:0 video needs an even eye "
+                 "width, got %u\n", f->width);
+        return FALSE;
+    }
+
+    vo->eye_w    = f->width;
+    vo->eye_h    = f->height;
+    vo->channels = f->channels;
+    for (int i = 0; i < vo->n_out; i++) {
+        Output *o = &vo->out[i];
+        o->width  = f->width * (guint) o->n_eyes;
+        o->height = f->height;
+        size_t luma = (size_t) o->width * o->height;
+        size_t cn = 0;
+        if (yuv) {
+            o->cw = (o->width + 1) / 2;
+            o->ch = (o->height + 1) / 2;
+            cn = (size_t) o->cw * o->ch;
+        }
+        o->y = g_malloc (luma + 2 * cn);
+        if (yuv) {
+            o->cb = o->y + luma;
+            o->cr = o->cb + cn;
+            memset (o->cb, 128, 2 * cn);
+        }
+    }
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Writing                                                            */
+/* ------------------------------------------------------------------ */
+
+/* Write every iovec (a handful per frame), resuming after short writes
+ * to pipes. */
+static gboolean
+writev_all (AgVideoOut *vo, int fd, struct iovec *iov, int n)
+{
+    while (n > 0) {
+        ssize_t r = writev (fd, iov, n);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        vo->bytes += (guint64) r;
+        while (n > 0 && (size_t) r >= iov->iov_len) {
+            r -= (ssize_t) iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (guint8 *) iov->iov_base + r;
+            iov->iov_len -= (size_t) r;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean
+write_y4m (AgVideoOut *vo, Output *o)
+{
+    char header[128];
+    struct iovec iov[5];
+    int n = 0;
+
+    if (!o->header_done) {
+        /* Frame rate as a ratio: whole rates exactly, others to 1/1000. */
+        double fps = vo->opts.fps > 0.0 ? vo->opts.fps : 30.0;
+        guint num = (guint) MAX (1L, lround (fps * 1000.0)), den = 1000;
+        for (guint a = num, b = den; ; ) {
+            guint t = a % b;
+            if (t == 0) { num /= b; den /= b; break; }
+            a = b;
+            b = t;
+        }
+        int len = snprintf (header, sizeof header,
+                            "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C%s XCOLORRANGE=FULL\n",
+                            o->width, o->height, num, den,
+                            vo->opts.color == AG_VIDEO_YUV420 ? "420jpeg" : "mono");
+        iov[n++] = (struct iovec) { header, (size_t) len };
+    }
+    iov[n++] = (struct iovec) { (void *) "FRAME\n", 6 };
+    iov[n++] = (struct iovec) { o->y, (size_t) o->width * o->height };
+    if (vo->opts.color == AG_VIDEO_YUV420) {
+        iov[n++] = (struct iovec) { o->cb, (size_t) o->cw * o->ch };
+        iov[n++] = (struct iovec) { o->cr, (size_t) o->cw * o->ch };
+    }
+    if (!writev_all (vo, o->fd, iov, n))
+        return FALSE;
+    o->header_done = TRUE;
+    return TRUE;
+}
+
+static gboolean
+write_mjpeg (AgVideoOut *vo, Output *o)
+{
+    gboolean yuv = vo->opts.color == AG_VIDEO_YUV420;
+    AgJpegImage img = {
+        .source  = yuv ? AG_JPEG_YCBCR : AG_JPEG_GRAY,
+        .width   = o->width,
+        .height  = o->height,
+        .planes  = { o->y, o->cb, o->cr },
+        .strides = { o->width, o->cw, o->cw },
+    };
+    AgJpegOptions jo = { vo->opts.jpeg_quality, AG_JPEG_SUBSAMPLE_420 };
+    size_t len = 0;
+    guint8 *jpeg = ag_jpeg_encode (&img, &jo, &len);
+    if (!jpeg) {
+        errno = EINVAL;
+        return FALSE;
+    }
+
+    char head[128];
+    int hl = snprintf (head, sizeof head,
+                       "--" MJPEG_BOUNDARY "\r\n"
+                       "Content-Type: image/jpeg\r\n"
+                       "Content-Length: %zu\r\n\r\n", len);
+    struct iovec iov[3] = {
+        { head, (size_t) hl },
+        { jpeg, len },
+        { (void *) "\r\n", 2 },
+    };
+    gboolean ok = writev_all (vo, o->fd, iov, 3);
+    g_free (jpeg);
+    return ok;
+}
+
+int
+ag_video_out_write (AgVideoOut *vo, const AgVideoFrame *frame)
+{
+    if (vo->failed)
+        return -1;
+
+    if (vo->eye_w == 0) {
+        if (frame->width == 0 || frame->height == 0 ||
+            (frame->channels != 1 && frame->channels != 3) ||
+            frame->stride < (size_t) frame->width * (size_t) frame->channels) {
+            fprintf (stderr, "error: bad video frame (%ux%u, %d channels)\n",
+                     frame->width, frame->height, frame->channels);
+            vo->failed = TRUE;
+            return -1;
+        }
+        if (!setup (vo, frame)) {
+            vo->failed = TRUE;
+            return -1;
+        }
+    } else if (frame->width != vo->eye_w || frame->height != vo->eye_h ||
+               frame->channels != vo->channels) {
+        fprintf (stderr, "error: video frame changed from %ux%u to %ux%u\n",
+                 vo->eye_w, vo->eye_h, frame->width, frame->height);
+        vo->failed = TRUE;
+        return -1;
+    }
+
+    gboolean chroma = vo->opts.color == AG_VIDEO_YUV420;
+    for (int i = 0; i < vo->n_out; i++) {
+        Output *o = &vo->out[i];
+        for (int e = 0; e < o->n_eyes; e++)
+            convert_eye (o, frame, o->eyes[e], (guint) e * frame->width, chroma);
+
+        gboolean ok = vo->opts.format == AG_VIDEO_MJPEG ? write_mjpeg (vo, o)
+                                                         : write_y4m (vo, o);
+        if (!ok) {
+            fprintf (stderr, "error: video output '%s': %s\n",
+                     o->name, strerror (errno));
+            vo->failed = TRUE;
+            return -1;
+        }
+    }
+
+    if (vo->timestamps)
+        fprintf (vo->timestamps,
+                 "%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+                 ",%" G_GUINT64_FORMAT "\n", vo->frames, frame->frame_id,
+                 frame->timestamp_ns, frame->system_ns);
+    vo->frames++;
+    return 0;
+}
+
+guint64
+ag_video_out_frames (const AgVideoOut *vo)
+{
+    return vo->frames;
+}
+
+guint64
+ag_video_out_bytes (const AgVideoOut *vo)
+{
+    return vo->bytes;
+}
+
+void
+ag_video_out_close (AgVideoOut *vo)
+{
+    if (!vo)
+        return;
+    for (int i = 0; i < 2; i++) {
+        if (vo->out[i].fd >= 0)
+            close (vo->out[i].fd);
+        g_free (vo->out[i].name);
+        g_free (vo->out[i].y);
+    }
+    if (vo->timestamps)
+        fclose (vo->timestamps);
+    g_free (vo);
+}
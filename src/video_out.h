@@ -0,0 +1,112 @@
+/*
+ * video_out.h — raw stereo video sink (Y4M or MJPEG) for external encoders
+ *
+ * Frames are written to a file or to stdout ("-") so that ffmpeg or
+ * GStreamer can encode them on their own cores:
+ *
+ *   ag-cam-tools stream ... --headless --video-out - |
+ *       ffmpeg -f yuv4mpegpipe -i - -c:v libx264 out.mkv
+ *
+ * Y4M carries either the luma plane alone (C mono) or JFIF-range 4:2:0
+ * (C420jpeg).  MJPEG is a multipart/x-mixed-replace stream of JPEGs
+ * encoded straight from the same planes (ffmpeg: -f mpjpeg).  The eyes
+ * are placed side by side in one stream, or one eye is written alone, or
+ * each eye goes to its own file.
+ *
+ * Every frame is converted into planes owned by the sink and then
+ * written, headers included, with one writev per output, so a frame
+ * costs a single system call however the layout is arranged.  Device
+ * and host timestamps go to an optional CSV sidecar, one row per frame.
+ */
+
+#ifndef AG_VIDEO_OUT_H
+#define AG_VIDEO_OUT_H
+
+#include <glib.h>
+#include <stddef.h>
+
+typedef enum {
+    AG_VIDEO_Y4M,
+    AG_VIDEO_MJPEG,
+} AgVideoFormat;
+
+typedef enum {
+    AG_VIDEO_GRAY,              /* luma only */
+    AG_VIDEO_YUV420,            /* luma + half-resolution chroma */
+} AgVideoColor;
+
+typedef enum {
+    AG_VIDEO_SIDE_BY_SIDE,      /* [left | right] in one stream */
+    AG_VIDEO_LEFT,
+    AG_VIDEO_RIGHT,
+    AG_VIDEO_SPLIT,             /* <stem>_left<ext> and <stem>_right<ext> */
+} AgVideoLayout;
+
+typedef struct {
+    AgVideoFormat format;
+    AgVideoColor  color;
+    AgVideoLayout layout;
+    double        fps;              /* Y4M frame rate; <= 0 writes 30 */
+    int           jpeg_quality;     /* MJPEG, 1..100 */
+    const char   *timestamps_path;  /* CSV sidecar, or NULL for none */
+} AgVideoOptions;
+
+/* One stereo frame as the pipeline holds it. */
+typedef struct {
+    const guint8 *eye[2];       /* left, right */
+    int           channels;     /* 1 = gray, 3 = packed RGB */
+    guint         width;        /* per eye */
+    guint         height;
+    size_t        stride;       /* bytes between rows */
+    guint64       frame_id;
+    guint64       timestamp_ns; /* device timestamp */
+    guint64       system_ns;    /* host receive time */
+} AgVideoFrame;
+
+typedef struct AgVideoOut AgVideoOut;
+
+/* Y4M, gray, side by side, 30 fps, JPEG quality 90, no sidecar. */
+void ag_video_options_defaults (AgVideoOptions *opts);
+
+/* Parse "y4m"/"mjpeg", "gray"/"420" and "sbs"/"left"/"right"/"split".
+ * Each returns 0 on success, -1 otherwise. */
+int ag_video_parse_format (const char *str, AgVideoFormat *out);
+int ag_video_parse_color  (const char *str, AgVideoColor *out);
+int ag_video_parse_layout (const char *str, AgVideoLayout *out);
+
+/*
+ * Fill *opts from command-line values, leaving other fields untouched.
+ * Pass NULL strings / a negative quality for options not given.
+ * Returns NULL on success, or a static message naming the bad option.
+ */
+const char *ag_video_options_set (AgVideoOptions *opts,
+                                  const char *format,
+                                  const char *color,
+                                  const char *layout,
+                                  int jpeg_quality);
+
+/*
+ * Open the output(s).  path "-" claims stdout for the video: the real
+ * stdout is kept for the stream and fd 1 is pointed at stderr, so the
+ * tool's own messages cannot corrupt it.  Call this before anything is
+ * printed.  Refuses a terminal, and AG_VIDEO_SPLIT on stdout.  SIGPIPE
+ * is ignored from here on; a reader going away surfaces as a write
+ * error instead.  Returns NULL with a diagnostic on stderr.
+ */
+AgVideoOut *ag_video_out_open (const char *path, const AgVideoOptions *opts);
+
+/*
+ * Convert and write one frame.  The geometry of the first frame fixes
+ * the stream's; later frames must match.  Returns 0, or -1 with a
+ * diagnostic once the output failed (every later call fails quietly).
+ */
+int ag_video_out_write (AgVideoOut *vo, const AgVideoFrame *frame);
+
+/* Frames and bytes written so far (bytes summed over all outputs). */
+guint64 ag_video_out_frames (const AgVideoOut *vo);
+guint64 ag_video_out_bytes  (const AgVideoOut *vo);
+
+/* Close the outputs and sidecar.  NULL-safe. */
+void ag_video_out_close (AgVideoOut *vo);
+
+#endif /* AG_VIDEO_OUT_H */
@@ -1,13 +1,14 @@
 /*
- * gen_test_calibration.c — generate a minimal 128×128 calibration session
+ * gen_test_calibration.c — generate a minimal identity calibration session
  *
  * Creates a tiny but valid calibration session directory suitable for
- * hardware integration tests.  The remap files are only ~64 KB each
- * (vs ~6 MB for real 1440×1080 data), so upload/download cycles are
- * fast even over a slow GenICam file channel.
+ * hardware integration tests.  The default 128×128 remap files are only
+ * ~64 KB each (vs ~6 MB for real 1440×1080 data), so upload/download
+ * cycles are fast even over a slow GenICam file channel.  An explicit
+ * size produces full-geometry identity tables for the benchmarks.
  *
  * Usage:
- *   gen_test_calibration <output-dir>
+ *   gen_test_calibration <output-dir> [<width> <height>]
  *
  * Creates:
  *   <output-dir>/calib_result/remap_left.bin
@@ -21,8 +22,8 @@
 #include <stdint.h>
 #include <sys/stat.h>
 
-#define WIDTH   128
-#define HEIGHT  128
+#define DEFAULT_WIDTH   128
+#define DEFAULT_HEIGHT  128
 
 static int
 write_remap (const char *path, uint32_t width, uint32_t height)
@@ -96,12 +97,25 @@ mkdirs (const char *path)
 int
 main (int argc, char *argv[])
 {
-    if (argc != 2) {
-        fprintf (stderr, "usage: gen_test_calibration <output-dir>\n");
+    if (argc != 2 && argc != 4) {
+        fprintf (stderr,
+                 "usage: gen_test_calibration <output-dir> [<width> <height>]\n");
         return 1;
     }
 
     const char *out_dir = argv[1];
+    uint32_t width  = DEFAULT_WIDTH;
+    uint32_t height = DEFAULT_HEIGHT;
+    if (argc == 4) {
+        long w = strtol (argv[2], NULL, 10);
+        long h = strtol (argv[3], NULL, 10);
+        if (w <= 0 || h <= 0 || w > 16384 || h > 16384) {
+            fprintf (stderr, "error: width and height must be 1..16384\n");
+            return 1;
+        }
+        width  = (uint32_t) w;
+        height = (uint32_t) h;
+    }
 
     /* Create <out_dir>/calib_result/ */
     char calib_dir[4096];
@@ -111,14 +125,14 @@ main (int argc, char *argv[])
     char path[4096];
 
     snprintf (path, sizeof path, "%s/remap_left.bin", calib_dir);
-    if (write_remap (path, WIDTH, HEIGHT) != 0) return 1;
+    if (write_remap (path, width, height) != 0) return 1;
 
     snprintf (path, sizeof path, "%s/remap_right.bin", calib_dir);
-    if (write_remap (path, WIDTH, HEIGHT) != 0) return 1;
+    if (write_remap (path, width, height) != 0) return 1;
 
     snprintf (path, sizeof path, "%s/calibration_meta.json", calib_dir);
-    if (write_meta (path, WIDTH, HEIGHT) != 0) return 1;
+    if (write_meta (path, width, height) != 0) return 1;
 
-    printf ("Generated 128x128 test calibration in %s\n", out_dir);
+    printf ("Generated %ux%u test calibration in %s\n", width, height, out_dir);
     return 0;
 }
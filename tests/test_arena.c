@@ -0,0 +1,155 @@
+/*
+ * test_arena.c — unit tests for the aligned frame scratch arena
+ *
+ * Verifies 64-byte alignment of every sub-buffer, capacity accounting,
+ * mark/release and reset reuse, and that the hugepage request degrades
+ * gracefully to whatever backing the host provides.
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_arena [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "arena.h"
+
+#include <stdint.h>
+#include <string.h>
+
+void setUp (void) {}
+void tearDown (void) {}
+
+static gboolean
+aligned (const void *p)
+{
+    return ((uintptr_t) p % AG_ARENA_ALIGN) == 0;
+}
+
+void test_round_macro (void)
+{
+    TEST_ASSERT_EQUAL_UINT64 (0,   AG_ARENA_ROUND (0));
+    TEST_ASSERT_EQUAL_UINT64 (64,  AG_ARENA_ROUND (1));
+    TEST_ASSERT_EQUAL_UINT64 (64,  AG_ARENA_ROUND (64));
+    TEST_ASSERT_EQUAL_UINT64 (128, AG_ARENA_ROUND (65));
+}
+
+void test_allocations_are_aligned_and_disjoint (void)
+{
+    AgFrameArena *a = ag_frame_arena_new (4096, AG_ARENA_DEFAULT);
+    TEST_ASSERT_EQUAL_UINT64 (4096, ag_frame_arena_capacity (a));
+
+    guint8 *p1 = ag_frame_arena_alloc (a, 3);
+    guint8 *p2 = ag_frame_arena_alloc (a, 100);
+    int16_t *p3 = ag_frame_arena_alloc_n (a, int16_t, 7);
+
+    TEST_ASSERT_TRUE (aligned (p1));
+    TEST_ASSERT_TRUE (aligned (p2));
+    TEST_ASSERT_TRUE (aligned (p3));
+    TEST_ASSERT_TRUE (p2 >= p1 + 3);
+    TEST_ASSERT_TRUE ((guint8 *) p3 >= p2 + 100);
+
+    /* Each allocation is rounded to a whole cache line. */
+    TEST_ASSERT_EQUAL_UINT64 (64 + 128 + 64, ag_frame_arena_used (a));
+    TEST_ASSERT_EQUAL_UINT64 (4096 - 256, ag_frame_arena_available (a));
+
+    /* Buffers are writable end to end without clobbering neighbours. */
+    memset (p1, 0x11, 3);
+    memset (p2, 0x22, 100);
+    TEST_ASSERT_EQUAL_HEX8 (0x11, p1[2]);
+    TEST_ASSERT_EQUAL_HEX8 (0x22, p2[0]);
+
+    ag_frame_arena_free (a);
+}
+
+void test_capacity_rounds_up (void)
+{
+    AgFrameArena *a = ag_frame_arena_new (100, AG_ARENA_DEFAULT);
+    TEST_ASSERT_EQUAL_UINT64 (128, ag_frame_arena_capacity (a));
+    ag_frame_arena_alloc (a, 128);
+    TEST_ASSERT_EQUAL_UINT64 (0, ag_frame_arena_available (a));
+    ag_frame_arena_free (a);
+}
+
+void test_mark_release_reuses_memory (void)
+{
+    AgFrameArena *a = ag_frame_arena_new (1024, AG_ARENA_DEFAULT);
+    guint8 *keep = ag_frame_arena_alloc (a, 64);
+
+    size_t mark = ag_frame_arena_mark (a);
+    guint8 *tmp1 = ag_frame_arena_alloc (a, 200);
+    ag_frame_arena_release (a, mark);
+    TEST_ASSERT_EQUAL_UINT64 (64, ag_frame_arena_used (a));
+
+    guint8 *tmp2 = ag_frame_arena_alloc (a, 200);
+    TEST_ASSERT_EQUAL_PTR (tmp1, tmp2);
+    TEST_ASSERT_TRUE (tmp2 > keep);
+
+    /* Releasing to a mark beyond the fill level is ignored. */
+    ag_frame_arena_release (a, 1000);
+    TEST_ASSERT_EQUAL_UINT64 (64 + 256, ag_frame_arena_used (a));
+
+    ag_frame_arena_free (a);
+}
+
+void test_reset_returns_to_base (void)
+{
+    AgFrameArena *a = ag_frame_arena_new (512, AG_ARENA_DEFAULT);
+    guint8 *first = ag_frame_arena_alloc (a, 10);
+    ag_frame_arena_alloc (a, 300);
+
+    ag_frame_arena_reset (a);
+    TEST_ASSERT_EQUAL_UINT64 (0, ag_frame_arena_used (a));
+    TEST_ASSERT_EQUAL_PTR (first, ag_frame_arena_alloc (a, 10));
+
+    ag_frame_arena_free (a);
+}
+
+void test_small_hugepage_request_uses_heap (void)
+{
+    /* Below one 2 MiB page there is nothing to gain from huge pages. */
+    AgFrameArena *a = ag_frame_arena_new (4096, AG_ARENA_HUGEPAGES);
+    TEST_ASSERT_EQUAL_INT (AG_ARENA_BACKING_HEAP, ag_frame_arena_backing (a));
+    TEST_ASSERT_EQUAL_STRING ("heap", ag_frame_arena_backing_name (a));
+    ag_frame_arena_free (a);
+}
+
+void test_large_hugepage_request_is_usable (void)
+{
+    /* Whatever backing the host grants, the full capacity must be usable. */
+    size_t cap = (size_t) 6 << 20;
+    AgFrameArena *a = ag_frame_arena_new (cap, AG_ARENA_HUGEPAGES);
+    TEST_ASSERT_TRUE (ag_frame_arena_capacity (a) >= cap);
+
+    const char *name = ag_frame_arena_backing_name (a);
+    TEST_ASSERT_TRUE (strcmp (name, "heap") == 0 ||
+                      strcmp (name, "thp") == 0 ||
+                      strcmp (name, "hugetlb") == 0);
+
+    guint8 *p = ag_frame_arena_alloc (a, cap);
+    TEST_ASSERT_TRUE (aligned (p));
+    memset (p, 0xA5, cap);
+    TEST_ASSERT_EQUAL_HEX8 (0xA5, p[cap - 1]);
+
+    ag_frame_arena_free (a);
+}
+
+void test_free_null_is_noop (void)
+{
+    ag_frame_arena_free (NULL);
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_round_macro);
+    RUN_TEST (test_allocations_are_aligned_and_disjoint);
+    RUN_TEST (test_capacity_rounds_up);
+    RUN_TEST (test_mark_release_reuses_memory);
+    RUN_TEST (test_reset_returns_to_base);
+    RUN_TEST (test_small_hugepage_request_uses_heap);
+    RUN_TEST (test_large_hugepage_request_is_usable);
+    RUN_TEST (test_free_null_is_noop);
+    return UNITY_END ();
+}
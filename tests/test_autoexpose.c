@@ -0,0 +1,323 @@
+/*
+ * test_autoexpose.c — unit tests for the host-side auto-exposure controller
+ *
+ * No camera hardware is required.  A linear "camera" model maps
+ * exposure x gain to a uniform raw level, so convergence can be checked
+ * frame by frame.
+ *
+ * Build:  make test
+ * Run:    bin/test_autoexpose [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "autoexpose.h"
+
+#include <math.h>
+#include <string.h>
+
+void setUp (void) {}
+void tearDown (void) {}
+
+#define W 640
+#define H 480
+
+static guint8 frame[W * H];
+
+static void
+fill (guint8 v)
+{
+    memset (frame, v, sizeof frame);
+}
+
+/* Raw level of a scene whose radiance gives `k` counts per us at 0 dB. */
+static guint8
+simulate (const AgAeController *c, double k)
+{
+    double v = k * c->exposure_us * pow (10.0, c->gain_db / 20.0);
+    return (guint8) (v > 255.0 ? 255.0 : v);
+}
+
+/* ------------------------------------------------------------------ */
+
+void test_parse_ae_mode (void)
+{
+    AgAeMode m = AG_AE_OFF;
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_ae_mode ("host", &m));
+    TEST_ASSERT_EQUAL_INT (AG_AE_HOST, m);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_ae_mode ("camera", &m));
+    TEST_ASSERT_EQUAL_INT (AG_AE_CAMERA, m);
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_ae_mode ("auto", &m));
+}
+
+void test_histogram_samples_sparse_grid (void)
+{
+    AgAeHistogram h;
+    fill (100);
+    ag_ae_histogram (frame, W, H, 16, &h);
+    TEST_ASSERT_EQUAL_UINT32 (2 * (W / 16) * (H / 16), h.n);
+    TEST_ASSERT_EQUAL_UINT32 (h.n, h.bins[100]);
+    TEST_ASSERT_EQUAL_DOUBLE (100.0, ag_ae_histogram_mean (&h));
+}
+
+/* Column-interleaved DualBayer: eye = x & 1, eye column = x >> 1. */
+static void
+fill_eyes (guint8 (*px) (guint eye, guint ex, guint ey))
+{
+    for (guint y = 0; y < H; y++)
+        for (guint x = 0; x < W; x++)
+            frame[y * W + x] = px (x & 1, x >> 1, y);
+}
+
+static guint8
+cfa_pattern (guint eye, guint ex, guint ey)
+{
+    (void) eye;
+    /* R G / G B = 40 80 / 80 200 -> quad mean 100. */
+    return (ey & 1) ? ((ex & 1) ? 200 : 80) : ((ex & 1) ? 80 : 40);
+}
+
+static guint8
+left_dim (guint eye, guint ex, guint ey)
+{
+    (void) ex; (void) ey;
+    return eye ? 120 : 60;
+}
+
+void test_histogram_averages_bayer_quad (void)
+{
+    fill_eyes (cfa_pattern);
+    AgAeHistogram h;
+    ag_ae_histogram (frame, W, H, 7, &h);   /* step rounds to 8 */
+    TEST_ASSERT_EQUAL_UINT32 (h.n, h.bins[100]);
+}
+
+void test_histogram_reports_eye_balance (void)
+{
+    fill_eyes (left_dim);
+    AgAeHistogram h;
+    ag_ae_histogram (frame, W, H, AG_AE_SAMPLE_STEP, &h);
+    TEST_ASSERT_EQUAL_DOUBLE (60.0, h.left_mean);
+    TEST_ASSERT_EQUAL_DOUBLE (120.0, h.right_mean);
+    TEST_ASSERT_EQUAL_UINT32 (h.n / 2, h.bins[60]);
+
+    AgAeController c;
+    ag_ae_controller_init (&c, 5000, 0, 20, 90000, 0, 24);
+    ag_ae_controller_update (&c, &h);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 0.5, c.balance);
+}
+
+/* Identity remap for a (W/2) x H eye with the left `blind` columns of
+ * the left table marked out of view. */
+static AgRemapTable *
+identity_table (guint blind)
+{
+    AgRemapTable *t = g_new0 (AgRemapTable, 1);
+    t->width  = W / 2;
+    t->height = H;
+    t->offsets = g_new (uint32_t, (size_t) t->width * t->height);
+    for (guint v = 0; v < t->height; v++)
+        for (guint u = 0; u < t->width; u++)
+            t->offsets[v * t->width + u] =
+                (u < blind) ? AG_REMAP_SENTINEL : v * t->width + u;
+    return t;
+}
+
+static void
+free_table (AgRemapTable *t)
+{
+    g_free (t->offsets);
+    g_free (t);
+}
+
+void test_parse_ae_metering (void)
+{
+    AgAeMetering m = AG_AE_METER_FRAME;
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_ae_metering ("overlap", &m));
+    TEST_ASSERT_EQUAL_INT (AG_AE_METER_OVERLAP, m);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_ae_metering ("frame", &m));
+    TEST_ASSERT_EQUAL_INT (AG_AE_METER_FRAME, m);
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_ae_metering ("spot", &m));
+}
+
+void test_meter_keeps_only_overlap (void)
+{
+    AgRemapTable *l = identity_table (W / 4);   /* left half blind */
+    AgRemapTable *r = identity_table (0);
+    AgAeMeter *all  = ag_ae_meter_new_overlap (r, r, W, H, 1, 16, NULL, 1);
+    AgAeMeter *half = ag_ae_meter_new_overlap (l, r, W, H, 1, 16, NULL, 1);
+    TEST_ASSERT_NOT_NULL (all);
+    TEST_ASSERT_NOT_NULL (half);
+    TEST_ASSERT_EQUAL_UINT (all->n / 2, half->n);
+
+    /* Samples trace back to the eye each table belongs to. */
+    fill_eyes (left_dim);
+    AgAeHistogram h;
+    ag_ae_meter_histogram (half, frame, &h);
+    TEST_ASSERT_EQUAL_UINT32 (2 * half->n, h.n);
+    TEST_ASSERT_EQUAL_DOUBLE (60.0, h.left_mean);
+    TEST_ASSERT_EQUAL_DOUBLE (120.0, h.right_mean);
+
+    ag_ae_meter_free (all);
+    ag_ae_meter_free (half);
+    free_table (l);
+    free_table (r);
+}
+
+void test_meter_weights_window (void)
+{
+    AgRemapTable *t = identity_table (0);
+    AgRoi band = { .x = 0, .y = 0, .width = W / 2, .height = H / 2 };
+    AgAeMeter *m = ag_ae_meter_new_overlap (t, t, W, H, 1, 16, &band, 4);
+    TEST_ASSERT_NOT_NULL (m);
+
+    /* Top half bright, bottom half dark: the window dominates. */
+    for (guint y = 0; y < H; y++)
+        memset (frame + y * W, y < H / 2 ? 200 : 40, W);
+    AgAeHistogram h;
+    ag_ae_meter_histogram (m, frame, &h);
+    TEST_ASSERT_EQUAL_UINT32 (4 * h.bins[40], h.bins[200]);
+    TEST_ASSERT_DOUBLE_WITHIN (0.5, (4 * 200.0 + 40.0) / 5.0,
+                               ag_ae_histogram_mean (&h));
+
+    ag_ae_meter_free (m);
+    free_table (t);
+}
+
+void test_meter_rejects_bad_tables (void)
+{
+    AgRemapTable *blind = identity_table (W / 2);
+    AgRemapTable *ok    = identity_table (0);
+    TEST_ASSERT_NULL (ag_ae_meter_new_overlap (blind, ok, W, H, 1, 16, NULL, 1));
+    TEST_ASSERT_NULL (ag_ae_meter_new_overlap (ok, NULL, W, H, 1, 16, NULL, 1));
+    free_table (blind);
+    free_table (ok);
+}
+
+void test_fraction_at_or_above (void)
+{
+    AgAeHistogram h = { 0 };
+    h.bins[10]  = 90;
+    h.bins[252] = 10;
+    h.n = 100;
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 0.10,
+                               ag_ae_histogram_fraction_at_or_above (&h, 250));
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 1.00,
+                               ag_ae_histogram_fraction_at_or_above (&h, 0));
+    TEST_ASSERT_TRUE (ag_ae_histogram_fraction_at_or_above (&h, 253) == 0.0);
+}
+
+void test_in_deadband_no_write (void)
+{
+    AgAeController c;
+    ag_ae_controller_init (&c, 5000, 0, 20, 90000, 0, 24);
+    AgAeHistogram h;
+    fill ((guint8) AG_AE_TARGET_DEFAULT + 4);
+    ag_ae_histogram (frame, W, H, AG_AE_SAMPLE_STEP, &h);
+    TEST_ASSERT_FALSE (ag_ae_controller_update (&c, &h));
+    TEST_ASSERT_EQUAL_UINT (1, c.settled);
+    TEST_ASSERT_EQUAL_DOUBLE (5000.0, c.exposure_us);
+}
+
+void test_dark_frame_raises_exposure_before_gain (void)
+{
+    AgAeController c;
+    ag_ae_controller_init (&c, 5000, 0, 20, 90000, 0, 24);
+    AgAeHistogram h;
+    fill (32);
+    ag_ae_histogram (frame, W, H, AG_AE_SAMPLE_STEP, &h);
+    TEST_ASSERT_TRUE (ag_ae_controller_update (&c, &h));
+    TEST_ASSERT_TRUE (c.exposure_us > 5000.0);
+    TEST_ASSERT_EQUAL_DOUBLE (0.0, c.gain_db);
+    TEST_ASSERT_TRUE (c.exposure_us <= 5000.0 * AG_AE_MAX_STEP);
+}
+
+void test_exposure_limit_spills_into_gain (void)
+{
+    AgAeController c;
+    ag_ae_controller_init (&c, 10000, 0, 20, 10000, 0, 24);
+    AgAeHistogram h;
+    fill (32);
+    ag_ae_histogram (frame, W, H, AG_AE_SAMPLE_STEP, &h);
+    TEST_ASSERT_TRUE (ag_ae_controller_update (&c, &h));
+    TEST_ASSERT_EQUAL_DOUBLE (10000.0, c.exposure_us);
+    TEST_ASSERT_TRUE (c.gain_db > 0.0);
+}
+
+void test_bright_frame_cuts_gain_first (void)
+{
+    AgAeController c;
+    ag_ae_controller_init (&c, 90000, 12, 20, 90000, 0, 24);
+    AgAeHistogram h;
+    fill (200);
+    ag_ae_histogram (frame, W, H, AG_AE_SAMPLE_STEP, &h);
+    TEST_ASSERT_TRUE (ag_ae_controller_update (&c, &h));
+    TEST_ASSERT_EQUAL_DOUBLE (90000.0, c.exposure_us);
+    TEST_ASSERT_TRUE (c.gain_db < 12.0);
+}
+
+void test_clipped_highlights_pull_down (void)
+{
+    AgAeController c;
+    ag_ae_controller_init (&c, 5000, 0, 20, 90000, 0, 24);
+    /* Mean on target, but 10 % of quads clipped. */
+    AgAeHistogram h = { 0 };
+    h.bins[114] = 900;
+    h.bins[255] = 100;
+    h.n = 1000;
+    TEST_ASSERT_TRUE (ag_ae_controller_update (&c, &h));
+    TEST_ASSERT_TRUE (c.exposure_us < 5000.0);
+}
+
+void test_pinned_at_limit_no_write (void)
+{
+    AgAeController c;
+    ag_ae_controller_init (&c, 90000, 24, 20, 90000, 0, 24);
+    AgAeHistogram h;
+    fill (10);
+    ag_ae_histogram (frame, W, H, AG_AE_SAMPLE_STEP, &h);
+    TEST_ASSERT_FALSE (ag_ae_controller_update (&c, &h));
+}
+
+void test_converges_in_few_frames (void)
+{
+    static const double scenes[] = { 0.002, 0.05, 1.0 };
+    for (size_t s = 0; s < G_N_ELEMENTS (scenes); s++) {
+        AgAeController c;
+        ag_ae_controller_init (&c, 5000, 0, 20, 90000, 0, 24);
+        AgAeHistogram h;
+        int frames = 0;
+        while (c.settled < 2 && frames < 20) {
+            fill (simulate (&c, scenes[s]));
+            ag_ae_histogram (frame, W, H, AG_AE_SAMPLE_STEP, &h);
+            ag_ae_controller_update (&c, &h);
+            frames++;
+        }
+        TEST_ASSERT_TRUE_MESSAGE (frames <= 8, "too many frames to settle");
+        TEST_ASSERT_DOUBLE_WITHIN (AG_AE_TARGET_DEFAULT * AG_AE_DEADBAND_DEFAULT,
+                                   AG_AE_TARGET_DEFAULT, c.brightness);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+
+int main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_parse_ae_mode);
+    RUN_TEST (test_histogram_samples_sparse_grid);
+    RUN_TEST (test_histogram_averages_bayer_quad);
+    RUN_TEST (test_histogram_reports_eye_balance);
+    RUN_TEST (test_parse_ae_metering);
+    RUN_TEST (test_meter_keeps_only_overlap);
+    RUN_TEST (test_meter_weights_window);
+    RUN_TEST (test_meter_rejects_bad_tables);
+    RUN_TEST (test_fraction_at_or_above);
+    RUN_TEST (test_in_deadband_no_write);
+    RUN_TEST (test_dark_frame_raises_exposure_before_gain);
+    RUN_TEST (test_exposure_limit_spills_into_gain);
+    RUN_TEST (test_bright_frame_cuts_gain_first);
+    RUN_TEST (test_clipped_highlights_pull_down);
+    RUN_TEST (test_pinned_at_limit_no_write);
+    RUN_TEST (test_converges_in_few_frames);
+    return UNITY_END ();
+}
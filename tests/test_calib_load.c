@@ -10,6 +10,7 @@
 
 #include "../vendor/unity/unity.h"
 #include "calib_load.h"
+#include "calib_archive.h"
 
 #include <string.h>
 
@@ -189,9 +190,78 @@ void test_meta_fields_independent (void)
     ag_remap_table_free (right);
 }
 
+void test_meta_projection_from_npy (void)
+{
+    /* The sample session predates principal_point_right_px, so the
+     * right principal point comes from proj_mats_right.npy. */
+    AgCalibMeta meta = {0};
+    TEST_ASSERT_EQUAL_INT (0, ag_calib_load_meta (SAMPLE_SESSION, &meta));
+    TEST_ASSERT_TRUE (meta.has_projection);
+    TEST_ASSERT_FLOAT_WITHIN (EPSILON, 766.76, meta.cx_left);
+    TEST_ASSERT_FLOAT_WITHIN (EPSILON, 718.39, meta.cx_right);
+    TEST_ASSERT_FLOAT_WITHIN (EPSILON, 580.04, meta.cy);
+}
+
+void test_meta_projection_from_json (void)
+{
+    const char *json =
+        "{\"focal_length_px\": 900.0, \"baseline_cm\": 5.0,"
+        " \"principal_point_px\": [700.5, 540.25],"
+        " \"principal_point_right_px\": [690.0, 540.25]}";
+    AgCalibMeta meta = {0};
+    TEST_ASSERT_EQUAL_INT (0, ag_calib_meta_parse (json, strlen (json), &meta));
+    TEST_ASSERT_TRUE (meta.has_projection);
+    TEST_ASSERT_FLOAT_WITHIN (EPSILON, 700.5, meta.cx_left);
+    TEST_ASSERT_FLOAT_WITHIN (EPSILON, 690.0, meta.cx_right);
+    TEST_ASSERT_FLOAT_WITHIN (EPSILON, 540.25, meta.cy);
+
+    /* Left principal point alone is not a projection pair. */
+    const char *left_only = "{\"principal_point_px\": [700.5, 540.25]}";
+    AgCalibMeta meta2 = {0};
+    TEST_ASSERT_EQUAL_INT (0, ag_calib_meta_parse (left_only, strlen (left_only),
+                                                   &meta2));
+    TEST_ASSERT_FALSE (meta2.has_projection);
+
+    TEST_ASSERT_EQUAL_INT (-1, ag_calib_meta_parse ("{", 1, &meta2));
+}
+
 /* ------------------------------------------------------------------ */
 /*  Main                                                               */
 /* ------------------------------------------------------------------ */
+/* ------------------------------------------------------------------ */
+/*  Tests: ag_calib_crop_to_roi                                        */
+/* ------------------------------------------------------------------ */
+
+void test_crop_to_roi (void)
+{
+    AgCalibSource src = { .local_path = SAMPLE_SESSION, .slot = -1 };
+    AgRemapTable *left  = NULL;
+    AgRemapTable *right = NULL;
+    TEST_ASSERT_EQUAL_INT (0, ag_calib_load (NULL, &src, &left, &right, NULL));
+
+    /* Inactive ROI leaves the tables alone. */
+    AgRoi none = { 0 };
+    AgRemapTable *orig = left;
+    TEST_ASSERT_EQUAL_INT (0, ag_calib_crop_to_roi (&left, &right, &none,
+                                                    EXPECTED_WIDTH, EXPECTED_HEIGHT));
+    TEST_ASSERT_EQUAL_PTR (orig, left);
+
+    /* Tables for another resolution are rejected. */
+    AgRoi band = { 0, 300, EXPECTED_WIDTH, 480 };
+    TEST_ASSERT_EQUAL_INT (-1, ag_calib_crop_to_roi (&left, &right, &band,
+                                                     EXPECTED_WIDTH / 2,
+                                                     EXPECTED_HEIGHT / 2));
+    TEST_ASSERT_EQUAL_PTR (orig, left);
+
+    TEST_ASSERT_EQUAL_INT (0, ag_calib_crop_to_roi (&left, &right, &band,
+                                                    EXPECTED_WIDTH, EXPECTED_HEIGHT));
+    TEST_ASSERT_EQUAL_UINT32 (EXPECTED_WIDTH, left->width);
+    TEST_ASSERT_EQUAL_UINT32 (480, left->height);
+    TEST_ASSERT_EQUAL_UINT32 (480, right->height);
+
+    ag_remap_table_free (left);
+    ag_remap_table_free (right);
+}
 
 int
 main (void)
@@ -208,6 +278,10 @@ main (void)
     RUN_TEST (test_meta_parse_fields);
     RUN_TEST (test_meta_nonexistent_path);
     RUN_TEST (test_meta_fields_independent);
+    RUN_TEST (test_meta_projection_from_npy);
+    RUN_TEST (test_meta_projection_from_json);
+
+    RUN_TEST (test_crop_to_roi);
 
     return UNITY_END ();
 }
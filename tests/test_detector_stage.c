@@ -0,0 +1,177 @@
+/*
+ * test_detector_stage.c — unit tests for the asynchronous detector stage
+ *
+ * A fake detector sums the planes it is given (so copies can be
+ * checked) and can be made slow to exercise newest-wins dropping.
+ *
+ * Build:  make test
+ * Run:    bin/test_detector_stage [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "detector_stage.h"
+
+#include <string.h>
+
+#define W 64
+#define H 16
+
+void setUp (void) {}
+void tearDown (void) {}
+
+typedef struct {
+    gulong  delay_us;
+    gint    freed;               /* atomic */
+    gint    calls;               /* atomic */
+} FakeDetector;
+
+typedef struct {
+    FakeDetector *owner;
+    guint64       frame_id;
+    gint64        capture_us;
+    guint         left_sum;
+    guint         right_sum;
+} FakeResult;
+
+static gpointer
+fake_process (gpointer user, const AgDetectorFrame *frame)
+{
+    FakeDetector *d = user;
+    g_atomic_int_inc (&d->calls);
+    if (d->delay_us)
+        g_usleep (d->delay_us);
+
+    FakeResult *r = g_new0 (FakeResult, 1);
+    r->owner    = d;
+    r->frame_id = frame->frame_id;
+    r->capture_us = frame->capture_us;
+    for (guint i = 0; i < frame->width * frame->height; i++) {
+        r->left_sum  += frame->left[i];
+        r->right_sum += frame->right[i];
+    }
+    return r;
+}
+
+static void
+fake_free (gpointer result)
+{
+    FakeResult *r = result;
+    g_atomic_int_inc (&r->owner->freed);
+    g_free (r);
+}
+
+static const AgDetectorOps FAKE_OPS = { "fake", fake_process, fake_free };
+
+/* Poll until a result arrives (or ~2 s pass). */
+static gboolean
+wait_result (AgDetectorStage *st, AgDetectorResult *out)
+{
+    for (int i = 0; i < 2000; i++) {
+        if (ag_detector_stage_poll (st, out))
+            return TRUE;
+        g_usleep (1000);
+    }
+    return FALSE;
+}
+
+void test_result_carries_frame_id_and_copied_planes (void)
+{
+    FakeDetector d = { 0 };
+    AgDetectorStage *st = ag_detector_stage_new (&FAKE_OPS, &d, W, H);
+
+    guint8 left[W * H], right[W * H];
+    memset (left, 1, sizeof left);
+    memset (right, 2, sizeof right);
+    ag_detector_stage_submit (st, 42, 1000, left, right);
+    /* The caller may reuse its buffers at once. */
+    memset (left, 0, sizeof left);
+    memset (right, 0, sizeof right);
+
+    AgDetectorResult res;
+    TEST_ASSERT_TRUE (wait_result (st, &res));
+    FakeResult *r = res.result;
+    TEST_ASSERT_EQUAL_UINT64 (42, res.frame_id);
+    TEST_ASSERT_EQUAL_UINT64 (42, r->frame_id);
+    TEST_ASSERT_EQUAL_INT64 (1000, r->capture_us);
+    TEST_ASSERT_EQUAL_UINT (W * H, r->left_sum);
+    TEST_ASSERT_EQUAL_UINT (2 * W * H, r->right_sum);
+    TEST_ASSERT_TRUE (res.latency_us >= 0);
+    fake_free (r);
+
+    ag_detector_stage_free (st);
+}
+
+void test_poll_without_new_result_is_false (void)
+{
+    FakeDetector d = { 0 };
+    AgDetectorStage *st = ag_detector_stage_new (&FAKE_OPS, &d, W, H);
+    AgDetectorResult res;
+    TEST_ASSERT_FALSE (ag_detector_stage_poll (st, &res));
+
+    guint8 plane[W * H] = { 0 };
+    ag_detector_stage_submit (st, 1, 0, plane, plane);
+    TEST_ASSERT_TRUE (wait_result (st, &res));
+    fake_free (res.result);
+    TEST_ASSERT_FALSE (ag_detector_stage_poll (st, &res));
+
+    ag_detector_stage_free (st);
+}
+
+void test_slow_detector_drops_to_newest (void)
+{
+    FakeDetector d = { .delay_us = 20000 };
+    AgDetectorStage *st = ag_detector_stage_new (&FAKE_OPS, &d, W, H);
+
+    guint8 plane[W * H] = { 0 };
+    gint64 t0 = g_get_monotonic_time ();
+    for (guint64 f = 1; f <= 50; f++)
+        ag_detector_stage_submit (st, f, (gint64) f, plane, plane);
+    /* Submitting never waits for detection. */
+    TEST_ASSERT_TRUE (g_get_monotonic_time () - t0 < 20000);
+
+    /* The last frame submitted is always processed eventually. */
+    guint64 last = 0;
+    AgDetectorResult res;
+    while (last != 50 && wait_result (st, &res)) {
+        TEST_ASSERT_TRUE (res.frame_id > last);
+        last = res.frame_id;
+        fake_free (res.result);
+    }
+    TEST_ASSERT_EQUAL_UINT64 (50, last);
+
+    guint64 processed, dropped;
+    ag_detector_stage_counts (st, &processed, &dropped);
+    TEST_ASSERT_TRUE (dropped >= 45);
+    TEST_ASSERT_EQUAL_UINT64 (50, processed + dropped);
+    TEST_ASSERT_EQUAL_INT ((gint) processed, g_atomic_int_get (&d.calls));
+
+    ag_detector_stage_free (st);
+}
+
+void test_free_releases_unpolled_result (void)
+{
+    FakeDetector d = { 0 };
+    AgDetectorStage *st = ag_detector_stage_new (&FAKE_OPS, &d, W, H);
+
+    guint8 plane[W * H] = { 0 };
+    ag_detector_stage_submit (st, 1, 0, plane, plane);
+    for (int i = 0; i < 2000; i++) {
+        guint64 processed, dropped;
+        ag_detector_stage_counts (st, &processed, &dropped);
+        if (processed == 1)
+            break;
+        g_usleep (1000);
+    }
+    ag_detector_stage_free (st);
+    TEST_ASSERT_EQUAL_INT (1, g_atomic_int_get (&d.freed));
+}
+
+int main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_result_carries_frame_id_and_copied_planes);
+    RUN_TEST (test_poll_without_new_result_is_false);
+    RUN_TEST (test_slow_detector_drops_to_newest);
+    RUN_TEST (test_free_releases_unpolled_result);
+    return UNITY_END ();
+}
@@ -0,0 +1,351 @@
+#!/usr/bin/env bash
+#
+# test_fake_camera.sh — end-to-end throughput tests against a fake camera
+#
+# Starts Aravis's arv-fake-gv-camera on loopback with a PDH016S-shaped
+# GenICam description (tests/fixtures/fake_pdh016s.xml) and drives the
+# real acquisition paths through GVSP, with no hardware:
+#
+#   - capture        repeated single-frame captures, PGM geometry,
+#                    --count/--interval and --burst sequences
+#   - stream         --headless at a sustained rate, full resolution
+#   - stream -b 2    --headless, binned
+#   - depth-preview  --headless SGBM on an identity calibration
+#                    (skipped when built without OpenCV)
+#
+# Each streaming run must hold the configured fps with zero dropped
+# frames.  Throughput and per-frame latency (trigger → present, from
+# the --trace output) are written in the `make bench` JSON schema.
+#
+# Usage:
+#   make test-fake                    # via Makefile
+#   tests/test_fake_camera.sh         # direct
+#   FPS=30 DURATION=20 tests/test_fake_camera.sh
+#
+# Environment:
+#   TOOL       ag-cam-tools binary          (default: bin/ag-cam-tools)
+#   GEN        gen_test_calibration binary  (default: bin/gen_test_calibration)
+#   FAKE       fake camera binary           (default: arv-fake-gv-camera-0.8
+#                                            or arv-fake-gv-camera on PATH)
+#   FPS        trigger rate                 (default: 15)
+#   DURATION   seconds per streaming run    (default: 10)
+#   JSON_OUT   results file                 (default: bin/bench_e2e.json)
+#
+# Exit codes:
+#   0 = all tests passed
+#   1 = one or more tests failed
+#   77 = skipped (fake camera not installed)
+
+set -euo pipefail
+
+# ── Configuration ─────────────────────────────────────────────────────
+
+TOOL="${TOOL:-bin/ag-cam-tools}"
+GEN="${GEN:-bin/gen_test_calibration}"
+FAKE="${FAKE:-}"
+XML="${XML:-tests/fixtures/fake_pdh016s.xml}"
+FPS="${FPS:-15}"
+DURATION="${DURATION:-10}"
+JSON_OUT="${JSON_OUT:-bin/bench_e2e.json}"
+FAKE_ADDR="127.0.0.1"
+FAKE_SERIAL="AGFAKE01"
+
+# ── Colour helpers ────────────────────────────────────────────────────
+
+if [[ -t 1 ]]; then
+    GREEN='\033[0;32m'
+    RED='\033[0;31m'
+    YELLOW='\033[0;33m'
+    BOLD='\033[1m'
+    RESET='\033[0m'
+else
+    GREEN='' RED='' YELLOW='' BOLD='' RESET=''
+fi
+
+TESTS_RUN=0
+TESTS_PASSED=0
+TESTS_FAILED=0
+
+pass () {
+    TESTS_RUN=$((TESTS_RUN + 1))
+    TESTS_PASSED=$((TESTS_PASSED + 1))
+    echo -e "  ${GREEN}PASS${RESET}  $1"
+}
+
+fail () {
+    TESTS_RUN=$((TESTS_RUN + 1))
+    TESTS_FAILED=$((TESTS_FAILED + 1))
+    echo -e "  ${RED}FAIL${RESET}  $1"
+    if [[ -n "${2:-}" ]]; then
+        echo "        $2"
+    fi
+}
+
+skip () {
+    echo -e "  ${YELLOW}SKIP${RESET}  $1"
+}
+
+# ── Pre-flight ─────────────────────────────────────────────────────────
+
+if [[ ! -x "$TOOL" ]]; then
+    echo "error: $TOOL not found — run 'make' first"
+    exit 1
+fi
+
+if [[ -z "$FAKE" ]]; then
+    FAKE=$(command -v arv-fake-gv-camera-0.8 || command -v arv-fake-gv-camera || true)
+fi
+if [[ -z "$FAKE" || ! -x "$FAKE" ]]; then
+    echo -e "${YELLOW}SKIP: arv-fake-gv-camera not found (install the Aravis tools)${RESET}"
+    exit 77
+fi
+
+echo -e "${BOLD}=== Fake Camera Integration Tests ===${RESET}"
+echo "  fake camera: $FAKE"
+echo "  rate:        ${FPS} fps for ${DURATION} s per run"
+echo ""
+
+TMPDIR=$(mktemp -d)
+FAKE_PID=""
+cleanup () {
+    if [[ -n "$FAKE_PID" ]]; then
+        kill "$FAKE_PID" 2>/dev/null || true
+        wait "$FAKE_PID" 2>/dev/null || true
+    fi
+    rm -rf "$TMPDIR"
+}
+trap cleanup EXIT
+
+"$FAKE" -i "$FAKE_ADDR" -s "$FAKE_SERIAL" -g "$XML" >"$TMPDIR/fake.log" 2>&1 &
+FAKE_PID=$!
+
+# Wait until the fake camera answers discovery (or give up after 5 s;
+# --address still connects directly).
+for _ in $(seq 1 20); do
+    if "$TOOL" list 2>/dev/null | grep -q "$FAKE_SERIAL"; then
+        break
+    fi
+    if ! kill -0 "$FAKE_PID" 2>/dev/null; then
+        echo "error: fake camera exited:"
+        cat "$TMPDIR/fake.log"
+        exit 1
+    fi
+    sleep 0.25
+done
+
+DEVICE_OPTS=(--address "$FAKE_ADDR")
+
+# ── Result collection (bench JSON schema) ─────────────────────────────
+#
+# One line per run: <kernel> <per-eye W> <per-eye H> <trace.json> <log>
+
+RESULTS="$TMPDIR/results.txt"
+: > "$RESULTS"
+
+# Parse "Summary: N frames in T s (F fps), dropped D (...)" from a log.
+summary_field () {
+    sed -n 's/^Summary: \([0-9]*\) frames in \([0-9.]*\) s (\([0-9.]*\) fps), dropped \([0-9]*\).*/\1 \2 \3 \4/p' "$1" | tail -1
+}
+
+# Check a streaming run's summary against the configured rate.
+check_run () {
+    local label="$1" log="$2"
+    local summary frames fps dropped
+    summary=$(summary_field "$log")
+    if [[ -z "$summary" ]]; then
+        fail "$label: no summary line" "$(tail -5 "$log")"
+        return 1
+    fi
+    read -r frames _ fps dropped <<< "$summary"
+
+    if [[ "$frames" -gt 0 ]]; then
+        pass "$label: $frames frames delivered"
+    else
+        fail "$label: no frames delivered" "$(tail -5 "$log")"
+        return 1
+    fi
+
+    if [[ "$dropped" -eq 0 ]]; then
+        pass "$label: no dropped frames"
+    else
+        fail "$label: $dropped dropped frames" "$(grep '^Summary:' "$log")"
+    fi
+
+    # Allow 10% below the trigger rate for loop overhead.
+    if python3 -c "import sys; sys.exit(0 if $fps >= 0.9 * $FPS else 1)"; then
+        pass "$label: sustained ${fps} fps (target ${FPS})"
+    else
+        fail "$label: ${fps} fps below target ${FPS}"
+    fi
+}
+
+# ── Test 1: capture ───────────────────────────────────────────────────
+
+echo -e "${BOLD}Test 1: capture (3 consecutive single frames)${RESET}"
+CAP_DIR="$TMPDIR/capture"
+mkdir -p "$CAP_DIR"
+CAP_OK=0
+for i in 1 2 3; do
+    if "$TOOL" capture "${DEVICE_OPTS[@]}" -e pgm -o "$CAP_DIR/$i" \
+            >"$TMPDIR/capture_$i.log" 2>&1; then
+        CAP_OK=$((CAP_OK + 1))
+    fi
+done
+if [[ "$CAP_OK" -eq 3 ]]; then
+    pass "3 captures succeeded"
+else
+    fail "$((3 - CAP_OK)) of 3 captures failed" "$(tail -3 "$TMPDIR/capture_1.log")"
+fi
+
+LEFT=$(find "$CAP_DIR" -name '*_left.pgm' | head -1)
+if [[ -n "$LEFT" ]]; then
+    HDR=$(head -c 32 "$LEFT" | tr '\n' ' ')
+    if [[ "$HDR" == "P5 1440 1080 "* ]]; then
+        pass "left PGM is 1440x1080"
+    else
+        fail "left PGM geometry" "header: $HDR"
+    fi
+else
+    fail "left PGM not created"
+fi
+
+SEQ_DIR="$TMPDIR/capture_seq"
+if "$TOOL" capture "${DEVICE_OPTS[@]}" -e pgm -o "$SEQ_DIR" -n 5 \
+        --interval 100 >"$TMPDIR/capture_seq.log" 2>&1; then
+    SEQ_N=$(find "$SEQ_DIR" -name 'capture_*_f*_t*_left.pgm' | wc -l)
+    if [[ "$SEQ_N" -eq 5 ]]; then
+        pass "--count 5 --interval 100 wrote 5 pairs in one session"
+    else
+        fail "--count 5 wrote $SEQ_N pairs"
+    fi
+else
+    fail "capture --count 5 failed" "$(tail -3 "$TMPDIR/capture_seq.log")"
+fi
+
+BURST_DIR="$TMPDIR/capture_burst"
+if "$TOOL" capture "${DEVICE_OPTS[@]}" -e pgm -o "$BURST_DIR" -n 8 --burst \
+        >"$TMPDIR/capture_burst.log" 2>&1 &&
+   [[ $(find "$BURST_DIR" -name '*_right.pgm' | wc -l) -eq 8 ]]; then
+    pass "--burst wrote 8 pairs"
+else
+    fail "capture --burst" "$(tail -3 "$TMPDIR/capture_burst.log")"
+fi
+echo ""
+
+# ── Test 2: stream, full resolution ───────────────────────────────────
+
+echo -e "${BOLD}Test 2: stream --headless (1440x1080 per eye)${RESET}"
+"$TOOL" stream "${DEVICE_OPTS[@]}" --headless --duration "$DURATION" \
+    -f "$FPS" -x 5000 --trace "$TMPDIR/stream.json" \
+    >"$TMPDIR/stream.log" 2>&1 || true
+if check_run "stream" "$TMPDIR/stream.log"; then
+    echo "e2e/stream 1440 1080 $TMPDIR/stream.json $TMPDIR/stream.log" >> "$RESULTS"
+fi
+echo ""
+
+# ── Test 3: stream, binned ────────────────────────────────────────────
+
+echo -e "${BOLD}Test 3: stream --headless -b 2 (720x540 per eye)${RESET}"
+"$TOOL" stream "${DEVICE_OPTS[@]}" --headless --duration "$DURATION" \
+    -f "$FPS" -x 5000 -b 2 --trace "$TMPDIR/stream_bin2.json" \
+    >"$TMPDIR/stream_bin2.log" 2>&1 || true
+if check_run "stream -b 2" "$TMPDIR/stream_bin2.log"; then
+    echo "e2e/stream/bin2 720 540 $TMPDIR/stream_bin2.json $TMPDIR/stream_bin2.log" >> "$RESULTS"
+fi
+echo ""
+
+# ── Test 4: depth preview ─────────────────────────────────────────────
+
+echo -e "${BOLD}Test 4: depth-preview-classical --headless (SGBM, 720x540)${RESET}"
+CALIB="$TMPDIR/calib_720x540"
+if [[ -x "$GEN" ]] && "$GEN" "$CALIB" 720 540 >/dev/null; then
+    "$TOOL" depth-preview-classical "${DEVICE_OPTS[@]}" --headless \
+        --duration "$DURATION" -f "$FPS" -x 5000 -b 2 \
+        --calibration-local "$CALIB" --trace "$TMPDIR/depth.json" \
+        >"$TMPDIR/depth.log" 2>&1 || true
+    if grep -q "failed to create .* backend" "$TMPDIR/depth.log"; then
+        skip "depth-preview (built without OpenCV)"
+    elif check_run "depth-preview" "$TMPDIR/depth.log"; then
+        echo "e2e/depth-preview/sgbm 720 540 $TMPDIR/depth.json $TMPDIR/depth.log" >> "$RESULTS"
+    fi
+else
+    skip "depth-preview ($GEN not built)"
+fi
+echo ""
+
+# ── Throughput / latency report ───────────────────────────────────────
+
+if [[ -s "$RESULTS" ]]; then
+    mkdir -p "$(dirname "$JSON_OUT")"
+    python3 - "$RESULTS" "$JSON_OUT" <<'PY'
+import json, re, sys
+
+results_path, out_path = sys.argv[1], sys.argv[2]
+results = []
+for line in open(results_path):
+    kernel, w, h, trace_path, log_path = line.split()
+    w, h = int(w), int(h)
+
+    # Per-frame latency: first stage begin (trigger) to last stage end
+    # (present), over frames that reached present.
+    spans, presented = {}, set()
+    for ev in json.load(open(trace_path))["traceEvents"]:
+        if ev.get("ph") != "X":
+            continue
+        f = ev["args"]["frame"]
+        b, e = ev["ts"], ev["ts"] + ev["dur"]
+        lo, hi = spans.get(f, (b, e))
+        spans[f] = (min(lo, b), max(hi, e))
+        if ev["name"] == "present":
+            presented.add(f)
+    lat = sorted((spans[f][1] - spans[f][0]) * 1000.0 for f in presented)
+    if not lat:
+        continue
+
+    m = re.search(r"^Summary: (\d+) frames in ([\d.]+) s \(([\d.]+) fps\), "
+                  r"dropped (\d+)", open(log_path).read(), re.M)
+    frames, fps, dropped = int(m.group(1)), float(m.group(3)), int(m.group(4))
+
+    pixels = 2 * w * h                  # both eyes per frame
+    mean = sum(lat) / len(lat)
+    results.append({
+        "kernel":        kernel,
+        "width":         w,
+        "height":        h,
+        "mean_ns":       mean,
+        "median_ns":     lat[len(lat) // 2],
+        "min_ns":        lat[0],
+        "p99_ns":        lat[min(len(lat) - 1, int(0.99 * len(lat)))],
+        "mpx_per_s":     fps * pixels / 1e6,
+        "ns_per_px":     mean / pixels,
+        "cycles_per_px": None,
+        "mb_per_s":      fps * pixels / 1e6,
+        "fps":           fps,
+        "frames":        frames,
+        "dropped":       dropped,
+    })
+
+json.dump({"version": 1, "cycle_counter": None, "warmup": 0,
+           "reps": 0, "trim": 0, "results": results},
+          open(out_path, "w"), indent=2)
+
+print("%-24s %10s %10s %10s %8s" % ("run", "fps", "p50 ms", "p99 ms", "Mpx/s"))
+for r in results:
+    print("%-24s %10.2f %10.2f %10.2f %8.1f" % (
+        r["kernel"], r["fps"], r["median_ns"] / 1e6, r["p99_ns"] / 1e6,
+        r["mpx_per_s"]))
+print("Wrote %s" % out_path)
+PY
+    echo ""
+fi
+
+# ── Summary ───────────────────────────────────────────────────────────
+
+echo -e "${BOLD}────────────────────────────────────────${RESET}"
+if [[ $TESTS_FAILED -eq 0 ]]; then
+    echo -e "${GREEN}${BOLD}All $TESTS_PASSED tests passed.${RESET}"
+    exit 0
+else
+    echo -e "${RED}${BOLD}$TESTS_FAILED of $TESTS_RUN tests failed.${RESET}"
+    exit 1
+fi
@@ -15,6 +15,7 @@
 #include "../vendor/unity/unity.h"
 #include "focus.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
@@ -442,6 +443,242 @@ void test_minimum_valid_image (void)
     TEST_ASSERT_TRUE (score < 0.01);
 }
 
+/* ================================================================== */
+/*  SINGLE-PASS ENGINE — must equal the per-metric functions           */
+/* ================================================================== */
+
+/* Deterministic pseudo-random fill (LCG), full 0..255 range. */
+static void
+fill_noise (uint8_t *img, size_t n, uint32_t seed)
+{
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        img[i] = (uint8_t) (seed >> 24);
+    }
+}
+
+/* Compare ag_focus_score_all with ag_focus_score for every metric.
+ * Both are exact integer sums, so only the final divide rounds. */
+static void
+assert_all_matches (const uint8_t *img, int w, int h,
+                    int rx, int ry, int rw, int rh)
+{
+    double all[AG_FOCUS_METRIC_COUNT];
+    ag_focus_score_all (img, w, h, rx, ry, rw, rh, all);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++) {
+        double ref = ag_focus_score ((AgFocusMetric) m, img, w, h,
+                                     rx, ry, rw, rh);
+        TEST_ASSERT_DOUBLE_WITHIN (1e-9 * (1.0 + ref), ref, all[m]);
+    }
+}
+
+static void
+check_roi_set (const uint8_t *img, int w, int h)
+{
+    static const int rois[][4] = {
+        {  0,  0, 1000, 1000 },   /* whole image, clamped */
+        {  1,  1,   -2,   -2 },   /* whole image minus border (w/h added) */
+        {  3,  2,   37,   11 },   /* odd width: vector body + tail */
+        {  0,  5,   17,    4 },   /* starts at x=0 */
+        { -4, -4,   20,   20 },   /* negative origin */
+        {  2,  0,    3,    1 },   /* one row: Brenner only */
+        {  0,  0,    1,    1 },   /* single pixel */
+    };
+    for (size_t i = 0; i < sizeof rois / sizeof rois[0]; i++) {
+        int rw = rois[i][2] < 0 ? w + rois[i][2] : rois[i][2];
+        int rh = rois[i][3] < 0 ? h + rois[i][3] : rois[i][3];
+        assert_all_matches (img, w, h, rois[i][0], rois[i][1], rw, rh);
+    }
+    /* Right and bottom edges. */
+    assert_all_matches (img, w, h, w - 20, h - 6, 20, 6);
+    assert_all_matches (img, w, h, w - 3, 0, 3, h);
+}
+
+void test_score_all_matches_scalar_noise (void)
+{
+    enum { W = 83, H = 29 };
+    uint8_t img[W * H];
+    fill_noise (img, sizeof img, 12345);
+
+    check_roi_set (img, W, H);
+    ag_focus_engine_force_scalar (1);
+    check_roi_set (img, W, H);
+    ag_focus_engine_force_scalar (0);
+}
+
+void test_score_all_matches_scalar_edges (void)
+{
+    enum { W = 64, H = 24 };
+    uint8_t img[W * H];
+    fill_edge (img, W, H, 21);
+    check_roi_set (img, W, H);
+
+    fill_uniform (img, W, H, 200);
+    double all[AG_FOCUS_METRIC_COUNT];
+    ag_focus_score_all (img, W, H, 0, 0, W, H, all);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        TEST_ASSERT_EQUAL_DOUBLE (0.0, all[m]);
+}
+
+/* Worst-case gradients on rows longer than one lane-accumulator flush:
+ * a 0/255 checkerboard gives |Gx|, |Gy| and |L| at their maxima. */
+void test_score_all_long_rows_no_overflow (void)
+{
+    enum { W = 9000, H = 5 };
+    uint8_t *img = malloc ((size_t) W * H);
+    TEST_ASSERT_NOT_NULL (img);
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++)
+            img[y * W + x] = ((x + y) & 1) ? 255 : 0;
+
+    assert_all_matches (img, W, H, 0, 0, W, H);
+    fill_noise (img, (size_t) W * H, 777);
+    assert_all_matches (img, W, H, 0, 0, W, H);
+    assert_all_matches (img, W, H, 2047, 1, 4113, 3);
+    free (img);
+}
+
+void test_degenerate_roi_all_zero (void)
+{
+    enum { W = 16, H = 16 };
+    uint8_t img[W * H];
+    fill_edge (img, W, H, 8);
+
+    double all[AG_FOCUS_METRIC_COUNT] = { 1.0, 1.0, 1.0 };
+    ag_focus_score_all (img, W, H, 20, 20, 4, 4, all);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        TEST_ASSERT_EQUAL_DOUBLE (0.0, all[m]);
+}
+
+/* A plane embedded with step 3 and padded rows scores like the packed
+ * image, on both row kernels. */
+void test_strided_plane_matches_packed (void)
+{
+    enum { W = 45, H = 21, STEP = 3, STRIDE = W * STEP + 7 };
+    uint8_t img[W * H];
+    uint8_t *big = calloc ((size_t) STRIDE * H, 1);
+    fill_noise (img, sizeof img, 4242);
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++)
+            big[y * STRIDE + x * STEP] = img[y * W + x];
+
+    AgFocusPlane plane = { big, W, H, STEP, STRIDE };
+    for (int pass = 0; pass < 2; pass++) {
+        ag_focus_engine_force_scalar (pass);
+        double a[AG_FOCUS_METRIC_COUNT], b[AG_FOCUS_METRIC_COUNT];
+        ag_focus_score_all (img, W, H, 0, 0, W, H, a);
+        ag_focus_score_plane (&plane, 0, 0, W, H, b);
+        for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+            TEST_ASSERT_EQUAL_DOUBLE (a[m], b[m]);
+        ag_focus_score_all (img, W, H, 5, 3, 20, 9, a);
+        ag_focus_score_plane (&plane, 5, 3, 20, 9, b);
+        for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+            TEST_ASSERT_EQUAL_DOUBLE (a[m], b[m]);
+    }
+    ag_focus_engine_force_scalar (0);
+    free (big);
+}
+
+/* Green-site scoring equals the mean of the two extracted G planes and
+ * ignores whatever the R and B sites hold. */
+void test_bayer_green_ignores_red_blue (void)
+{
+    enum { W = 64, H = 40 };
+    uint8_t mosaic[W * H];
+    uint8_t g1[(W / 2) * (H / 2)], g2[(W / 2) * (H / 2)];
+    fill_noise (mosaic, sizeof mosaic, 99);
+    for (int y = 0; y < H / 2; y++)
+        for (int x = 0; x < W / 2; x++) {
+            g1[y * (W / 2) + x] = mosaic[(2 * y) * W + 2 * x + 1];
+            g2[y * (W / 2) + x] = mosaic[(2 * y + 1) * W + 2 * x];
+        }
+
+    AgFocusPlane plane = { mosaic, W, H, 1, W };
+    double green[AG_FOCUS_METRIC_COUNT];
+    double s1[AG_FOCUS_METRIC_COUNT], s2[AG_FOCUS_METRIC_COUNT];
+    ag_focus_score_bayer_green (&plane, 8, 6, 40, 24, green);
+    ag_focus_score_all (g1, W / 2, H / 2, 4, 3, 20, 12, s1);
+    ag_focus_score_all (g2, W / 2, H / 2, 4, 3, 20, 12, s2);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        TEST_ASSERT_DOUBLE_WITHIN (1e-9 * (1.0 + green[m]),
+                                   0.5 * (s1[m] + s2[m]), green[m]);
+
+    /* Flatten R and B: the green score must not move. */
+    for (int y = 0; y < H; y += 2)
+        for (int x = 0; x < W; x += 2) {
+            mosaic[y * W + x]           = 0;     /* R */
+            mosaic[(y + 1) * W + x + 1] = 255;   /* B */
+        }
+    double again[AG_FOCUS_METRIC_COUNT];
+    ag_focus_score_bayer_green (&plane, 8, 6, 40, 24, again);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        TEST_ASSERT_EQUAL_DOUBLE (green[m], again[m]);
+}
+
+/* Scoring one eye straight from a column-interleaved DualBayer frame
+ * equals scoring the deinterleaved eye. */
+void test_bayer_green_on_interleaved_frame (void)
+{
+    enum { EW = 48, H = 32, FW = EW * 2 };
+    uint8_t frame[FW * H];
+    uint8_t eye[EW * H];
+    fill_noise (frame, sizeof frame, 5150);
+
+    for (int e = 0; e < 2; e++) {
+        for (int y = 0; y < H; y++)
+            for (int x = 0; x < EW; x++)
+                eye[y * EW + x] = frame[y * FW + 2 * x + e];
+
+        AgFocusPlane view   = { frame + e, EW, H, 2, FW };
+        AgFocusPlane packed = { eye, EW, H, 1, EW };
+        double a[AG_FOCUS_METRIC_COUNT], b[AG_FOCUS_METRIC_COUNT];
+        ag_focus_score_bayer_green (&view, 4, 4, 36, 24, a);
+        ag_focus_score_bayer_green (&packed, 4, 4, 36, 24, b);
+        for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+            TEST_ASSERT_EQUAL_DOUBLE (b[m], a[m]);
+        TEST_ASSERT_TRUE (a[AG_FOCUS_METRIC_TENENGRAD] > 0.0);
+    }
+}
+
+/* Decimating the green planes by 2 equals scoring a half-size mosaic
+ * built from every other green sample of each plane. */
+void test_bayer_green_decimated (void)
+{
+    enum { W = 64, H = 48 };
+    uint8_t mosaic[W * H];
+    uint8_t half[(W / 2) * (H / 2)];
+    fill_noise (mosaic, sizeof mosaic, 4242);
+    for (int y = 0; y < H / 2; y++)
+        for (int x = 0; x < W / 2; x++)
+            half[y * (W / 2) + x] =
+                mosaic[(2 * y - (y & 1)) * W + 2 * x - (x & 1)];
+
+    AgFocusPlane full  = { mosaic, W, H, 1, W };
+    AgFocusPlane small = { half, W / 2, H / 2, 1, W / 2 };
+    double a[AG_FOCUS_METRIC_COUNT], b[AG_FOCUS_METRIC_COUNT];
+    ag_focus_score_bayer_green_decimated (&full, 8, 4, 48, 40, 2, a);
+    ag_focus_score_bayer_green (&small, 4, 2, 24, 20, b);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        TEST_ASSERT_EQUAL_DOUBLE (b[m], a[m]);
+
+    /* factor 1 is the undecimated scorer. */
+    ag_focus_score_bayer_green_decimated (&full, 8, 4, 48, 40, 1, a);
+    ag_focus_score_bayer_green (&full, 8, 4, 48, 40, b);
+    for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++)
+        TEST_ASSERT_EQUAL_DOUBLE (b[m], a[m]);
+}
+
+void test_engine_name (void)
+{
+    const char *name = ag_focus_engine ();
+    TEST_ASSERT_TRUE (strcmp (name, "avx2") == 0 ||
+                      strcmp (name, "neon") == 0 ||
+                      strcmp (name, "scalar") == 0);
+    ag_focus_engine_force_scalar (1);
+    TEST_ASSERT_EQUAL_STRING ("scalar", ag_focus_engine ());
+    ag_focus_engine_force_scalar (0);
+}
+
 /* ------------------------------------------------------------------ */
 /*  Main                                                               */
 /* ------------------------------------------------------------------ */
@@ -491,5 +728,18 @@ main (void)
     /* precision */
     RUN_TEST (test_minimum_valid_image);
 
+    /* single-pass engine */
+    RUN_TEST (test_score_all_matches_scalar_noise);
+    RUN_TEST (test_score_all_matches_scalar_edges);
+    RUN_TEST (test_score_all_long_rows_no_overflow);
+    RUN_TEST (test_degenerate_roi_all_zero);
+    RUN_TEST (test_engine_name);
+
+    /* strided planes and Bayer green sites */
+    RUN_TEST (test_strided_plane_matches_packed);
+    RUN_TEST (test_bayer_green_ignores_red_blue);
+    RUN_TEST (test_bayer_green_on_interleaved_frame);
+    RUN_TEST (test_bayer_green_decimated);
+
     return UNITY_END ();
 }
@@ -0,0 +1,249 @@
+/*
+ * test_focus_grid.c — unit tests for per-tile focus scoring
+ *
+ * Synthetic planes with sharp texture in chosen tiles check the tile
+ * layout, that threaded and inline scoring agree with scoring each tile
+ * directly, and the corner-ratio / tilt summary.
+ *
+ * Build:  make test
+ * Run:    bin/test_focus_grid [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "focus_grid.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define W 160
+#define H 96
+
+void setUp (void) {}
+void tearDown (void) {}
+
+/* Mid-grey with a 0/255 checkerboard inside [x0,x1) x [y0,y1). */
+static void
+fill_texture (guint8 *img, int x0, int y0, int x1, int y1)
+{
+    memset (img, 128, (size_t) W * H);
+    for (int y = y0; y < y1; y++)
+        for (int x = x0; x < x1; x++)
+            img[y * W + x] = ((x / 2 + y / 2) & 1) ? 255 : 0;
+}
+
+static void
+fill_noise (guint8 *img, size_t n, guint32 seed)
+{
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        img[i] = (guint8) (seed >> 24);
+    }
+}
+
+void test_parse_size (void)
+{
+    int c = 0, r = 0;
+    TEST_ASSERT_EQUAL_INT (0, ag_focus_grid_parse_size ("8x6", &c, &r));
+    TEST_ASSERT_EQUAL_INT (8, c);
+    TEST_ASSERT_EQUAL_INT (6, r);
+    TEST_ASSERT_EQUAL_INT (0, ag_focus_grid_parse_size ("3X1", &c, &r));
+    TEST_ASSERT_EQUAL_INT (3, c);
+    TEST_ASSERT_EQUAL_INT (1, r);
+    TEST_ASSERT_EQUAL_INT (-1, ag_focus_grid_parse_size ("8", &c, &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_focus_grid_parse_size ("0x6", &c, &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_focus_grid_parse_size ("8x33", &c, &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_focus_grid_parse_size ("8x6x", &c, &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_focus_grid_parse_size (NULL, &c, &r));
+}
+
+void test_tiles_partition_image (void)
+{
+    int cols = 7, rows = 5, w = 1001, h = 333;
+    long area = 0;
+    for (int r = 0; r < rows; r++)
+        for (int c = 0; c < cols; c++) {
+            int x, y, tw, th;
+            ag_focus_grid_tile_rect (cols, rows, w, h, c, r, &x, &y, &tw, &th);
+            TEST_ASSERT_TRUE (tw == w / cols || tw == w / cols + 1);
+            TEST_ASSERT_TRUE (th == h / rows || th == h / rows + 1);
+            if (c == cols - 1)
+                TEST_ASSERT_EQUAL_INT (w, x + tw);
+            if (r == rows - 1)
+                TEST_ASSERT_EQUAL_INT (h, y + th);
+            area += (long) tw * th;
+        }
+    TEST_ASSERT_EQUAL_INT (w * h, area);
+}
+
+/* Threaded and inline grids both equal scoring each tile directly. */
+void test_grid_matches_direct_scores (void)
+{
+    guint8 *left  = malloc (W * H);
+    guint8 *right = malloc (W * H);
+    fill_noise (left,  W * H, 1);
+    fill_noise (right, W * H, 2);
+
+    AgFocusPlane lp = { left, W, H, 1, W }, rp = { right, W, H, 1, W };
+    for (int threads = 1; threads <= 4; threads += 3) {
+        AgFocusGrid *g = ag_focus_grid_new (8, 6, threads);
+        TEST_ASSERT_NOT_NULL (g);
+        ag_focus_grid_score (g, &lp, &rp, FALSE);
+
+        for (int e = 0; e < 2; e++) {
+            const guint8 *img = e ? right : left;
+            for (int m = 0; m < AG_FOCUS_METRIC_COUNT; m++) {
+                const double *t = ag_focus_grid_tiles (g, (AgFocusGridEye) e,
+                                                       (AgFocusMetric) m);
+                for (int i = 0; i < 48; i++) {
+                    int x, y, tw, th;
+                    ag_focus_grid_tile_rect (8, 6, W, H, i % 8, i / 8,
+                                             &x, &y, &tw, &th);
+                    double ref = ag_focus_score ((AgFocusMetric) m, img, W, H,
+                                                 x, y, tw, th);
+                    TEST_ASSERT_DOUBLE_WITHIN (1e-9 * (1.0 + ref), ref, t[i]);
+                }
+            }
+        }
+        ag_focus_grid_free (g);
+    }
+    free (left);
+    free (right);
+}
+
+/* Texture in one corner tile per eye: that tile scores, the far one is flat. */
+void test_textured_tile_located (void)
+{
+    guint8 *left  = malloc (W * H);
+    guint8 *right = malloc (W * H);
+    fill_texture (left, 0, 0, W / 8, H / 6);
+    fill_texture (right, W - W / 8, H - H / 6, W, H);
+
+    AgFocusPlane lp = { left, W, H, 1, W }, rp = { right, W, H, 1, W };
+    AgFocusGrid *g = ag_focus_grid_new (8, 6, 2);
+    ag_focus_grid_score (g, &lp, &rp, FALSE);
+    const double *tl = ag_focus_grid_tiles (g, AG_FOCUS_GRID_LEFT,
+                                            AG_FOCUS_METRIC_TENENGRAD);
+    const double *tr = ag_focus_grid_tiles (g, AG_FOCUS_GRID_RIGHT,
+                                            AG_FOCUS_METRIC_TENENGRAD);
+    TEST_ASSERT_TRUE (tl[0] > 1000.0);
+    TEST_ASSERT_EQUAL_DOUBLE (0.0, tl[47]);
+    TEST_ASSERT_TRUE (tr[47] > 1000.0);
+    TEST_ASSERT_EQUAL_DOUBLE (0.0, tr[0]);
+    ag_focus_grid_free (g);
+    free (left);
+    free (right);
+}
+
+/* Green-site tiles read in place from an interleaved DualBayer frame
+ * equal ag_focus_score_bayer_green on each eye's tile. */
+void test_grid_bayer_green_in_place (void)
+{
+    enum { FW = 2 * W };
+    guint8 *frame = malloc ((size_t) FW * H);
+    guint8 *eye   = malloc ((size_t) W * H);
+    fill_noise (frame, (size_t) FW * H, 31337);
+
+    AgFocusPlane lv = { frame,     W, H, 2, FW };
+    AgFocusPlane rv = { frame + 1, W, H, 2, FW };
+    AgFocusGrid *g = ag_focus_grid_new (8, 6, 3);
+    ag_focus_grid_score (g, &lv, &rv, TRUE);
+
+    for (int e = 0; e < 2; e++) {
+        for (int y = 0; y < H; y++)
+            for (int x = 0; x < W; x++)
+                eye[y * W + x] = frame[y * FW + 2 * x + e];
+        AgFocusPlane packed = { eye, W, H, 1, W };
+        const double *t = ag_focus_grid_tiles (g, (AgFocusGridEye) e,
+                                               AG_FOCUS_METRIC_LAPLACIAN);
+        for (int i = 0; i < 48; i++) {
+            int x, y, tw, th;
+            ag_focus_grid_tile_rect (8, 6, W, H, i % 8, i / 8,
+                                     &x, &y, &tw, &th);
+            double ref[AG_FOCUS_METRIC_COUNT];
+            ag_focus_score_bayer_green (&packed, x, y, tw, th, ref);
+            TEST_ASSERT_EQUAL_DOUBLE (ref[AG_FOCUS_METRIC_LAPLACIAN], t[i]);
+        }
+    }
+    ag_focus_grid_free (g);
+    free (frame);
+    free (eye);
+}
+
+void test_summary_centre_and_ratios (void)
+{
+    /* 4x3: centre is the mean of tiles (1,1) and (2,1). */
+    double t[12] = {
+        2, 5, 5, 4,
+        5, 9, 11, 5,
+        1, 5, 5, 3,
+    };
+    AgFocusGridSummary s;
+    ag_focus_grid_summarize (t, 4, 3, &s);
+    TEST_ASSERT_EQUAL_DOUBLE (10.0, s.centre);
+    TEST_ASSERT_EQUAL_DOUBLE (2.0, s.corner[AG_FOCUS_GRID_TL]);
+    TEST_ASSERT_EQUAL_DOUBLE (4.0, s.corner[AG_FOCUS_GRID_TR]);
+    TEST_ASSERT_EQUAL_DOUBLE (1.0, s.corner[AG_FOCUS_GRID_BL]);
+    TEST_ASSERT_EQUAL_DOUBLE (3.0, s.corner[AG_FOCUS_GRID_BR]);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-12, 0.2, s.ratio[AG_FOCUS_GRID_TL]);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-12, 0.3, s.ratio[AG_FOCUS_GRID_BR]);
+
+    /* Left column mean 8/3, right column 12/3: right is sharper. */
+    TEST_ASSERT_DOUBLE_WITHIN (1e-12, (4.0 - 8.0 / 3.0) / (10.0 / 3.0),
+                               s.tilt_x);
+    /* Top row mean 4, bottom row 3.5: top is sharper. */
+    TEST_ASSERT_DOUBLE_WITHIN (1e-12, (3.5 - 4.0) / 3.75, s.tilt_y);
+}
+
+void test_summary_flat_and_single_tile (void)
+{
+    double zero[6] = { 0 };
+    AgFocusGridSummary s;
+    ag_focus_grid_summarize (zero, 3, 2, &s);
+    TEST_ASSERT_EQUAL_DOUBLE (0.0, s.ratio[AG_FOCUS_GRID_TL]);
+    TEST_ASSERT_EQUAL_DOUBLE (0.0, s.tilt_x);
+    TEST_ASSERT_EQUAL_DOUBLE (0.0, s.tilt_y);
+
+    double one = 7.0;
+    ag_focus_grid_summarize (&one, 1, 1, &s);
+    TEST_ASSERT_EQUAL_DOUBLE (7.0, s.centre);
+    TEST_ASSERT_EQUAL_DOUBLE (1.0, s.ratio[AG_FOCUS_GRID_BR]);
+}
+
+void test_csv_row_layout (void)
+{
+    double t[4] = { 1.5, 2, 3, 4 };
+    AgFocusGridSummary s;
+    ag_focus_grid_summarize (t, 2, 2, &s);
+
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream (&buf, &len);
+    ag_focus_grid_write_csv_header (f, 2, 2);
+    ag_focus_grid_write_csv_row (f, 42, 1.25, AG_FOCUS_GRID_RIGHT,
+                                 AG_FOCUS_METRIC_BRENNER, t, 2, 2, &s);
+    fclose (f);
+
+    TEST_ASSERT_EQUAL_STRING (
+        "frame,time_s,eye,metric,centre,tl,tr,bl,br,"
+        "ratio_tl,ratio_tr,ratio_bl,ratio_br,tilt_x,tilt_y,"
+        "r0c0,r0c1,r1c0,r1c1\n"
+        "42,1.250000,right,brenner,2.625,1.500,2.000,3.000,4.000,"
+        "0.5714,0.7619,1.1429,1.5238,0.2857,0.6667,"
+        "1.500,2.000,3.000,4.000\n", buf);
+    free (buf);
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_parse_size);
+    RUN_TEST (test_tiles_partition_image);
+    RUN_TEST (test_grid_matches_direct_scores);
+    RUN_TEST (test_textured_tile_located);
+    RUN_TEST (test_grid_bayer_green_in_place);
+    RUN_TEST (test_summary_centre_and_ratios);
+    RUN_TEST (test_summary_flat_and_single_tile);
+    RUN_TEST (test_csv_row_layout);
+    return UNITY_END ();
+}
@@ -0,0 +1,237 @@
+/*
+ * test_focus_sweep.c — unit tests for focus sweep recording and peak fit
+ *
+ * Synthetic focus curves (exact parabolas and Gaussians, and noisy
+ * Gaussians pushed frame by frame) check the least-squares vertex, when
+ * a sweep's peak becomes known, the ring order after wrap-around, the
+ * audio cue and the CSV layout.
+ *
+ * Build:  make test
+ * Run:    bin/test_focus_sweep [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "focus_sweep.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+void setUp (void) {}
+void tearDown (void) {}
+
+static double
+gaussian (double t, double peak, double t0, double sigma)
+{
+    return peak * exp (-(t - t0) * (t - t0) / (2.0 * sigma * sigma));
+}
+
+/* Uniform noise in [-amp, amp]. */
+static double
+noise (guint32 *seed, double amp)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return amp * ((*seed >> 8) / (double) (1u << 24) * 2.0 - 1.0);
+}
+
+void test_fit_names (void)
+{
+    TEST_ASSERT_EQUAL_INT (AG_FOCUS_FIT_PARABOLA,
+                           ag_focus_fit_from_string ("parabola"));
+    TEST_ASSERT_EQUAL_INT (AG_FOCUS_FIT_GAUSSIAN,
+                           ag_focus_fit_from_string ("gaussian"));
+    TEST_ASSERT_EQUAL_INT (-1, ag_focus_fit_from_string ("cubic"));
+    TEST_ASSERT_EQUAL_INT (-1, ag_focus_fit_from_string (NULL));
+    TEST_ASSERT_EQUAL_STRING ("gaussian",
+                              ag_focus_fit_name (AG_FOCUS_FIT_GAUSSIAN));
+}
+
+void test_fit_exact_parabola (void)
+{
+    double t[51], y[51];
+    for (int i = 0; i < 51; i++) {
+        t[i] = 0.05 * i;
+        y[i] = 100.0 - 50.0 * (t[i] - 1.3) * (t[i] - 1.3);
+    }
+    AgFocusPeak p;
+    TEST_ASSERT_TRUE (ag_focus_fit_peak (t, y, 51, AG_FOCUS_FIT_PARABOLA, &p));
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 1.3, p.t);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 100.0, p.score);
+    TEST_ASSERT_EQUAL_INT (51, p.n);
+}
+
+/* A Gaussian is exact under the log fit and only approximate as a
+ * parabola, which underestimates the flat top. */
+void test_fit_exact_gaussian (void)
+{
+    double t[41], y[41];
+    for (int i = 0; i < 41; i++) {
+        t[i] = 0.5 + 0.01 * i;
+        y[i] = gaussian (t[i], 80.0, 0.73, 0.1);
+    }
+    AgFocusPeak g, q;
+    TEST_ASSERT_TRUE (ag_focus_fit_peak (t, y, 41, AG_FOCUS_FIT_GAUSSIAN, &g));
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 0.73, g.t);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-7, 80.0, g.score);
+
+    TEST_ASSERT_TRUE (ag_focus_fit_peak (t, y, 41, AG_FOCUS_FIT_PARABOLA, &q));
+    TEST_ASSERT_DOUBLE_WITHIN (0.01, 0.73, q.t);
+    TEST_ASSERT_TRUE (fabs (q.score - 80.0) > fabs (g.score - 80.0));
+}
+
+void test_fit_rejects_no_maximum (void)
+{
+    double t[10], rising[10], valley[10], zero[10];
+    for (int i = 0; i < 10; i++) {
+        t[i] = i;
+        rising[i] = 10.0 + i;
+        valley[i] = (i - 4.5) * (i - 4.5);
+        zero[i] = i == 0 ? 0.0 : 30.0 - (i - 4.5) * (i - 4.5);
+    }
+    AgFocusPeak p;
+    TEST_ASSERT_FALSE (ag_focus_fit_peak (t, rising, 10,
+                                          AG_FOCUS_FIT_PARABOLA, &p));
+    TEST_ASSERT_FALSE (ag_focus_fit_peak (t, valley, 10,
+                                          AG_FOCUS_FIT_PARABOLA, &p));
+    TEST_ASSERT_FALSE (ag_focus_fit_peak (t, valley, 2,
+                                          AG_FOCUS_FIT_PARABOLA, &p));
+    TEST_ASSERT_TRUE (ag_focus_fit_peak (t, zero, 10,
+                                         AG_FOCUS_FIT_PARABOLA, &p));
+    TEST_ASSERT_FALSE (ag_focus_fit_peak (t, zero, 10,
+                                          AG_FOCUS_FIT_GAUSSIAN, &p));
+}
+
+/* A noisy sweep at 120 Hz: no peak while the score is still rising, then
+ * a prediction close to the true optimum once the lens has gone past. */
+void test_sweep_predicts_peak_after_passing (void)
+{
+    AgFocusSweep *s = ag_focus_sweep_new (AG_FOCUS_SWEEP_CAPACITY_DEFAULT,
+                                          AG_FOCUS_FIT_GAUSSIAN);
+    guint32 seed = 99;
+    AgFocusPeak p;
+    int i = 0;
+    for (; i < 120; i++) {
+        double t = i / 120.0;
+        double v = gaussian (t, 200.0, 1.25, 0.3);
+        ag_focus_sweep_push (s, t, v * (1.0 + noise (&seed, 0.02)), 50.0);
+    }
+    TEST_ASSERT_FALSE (ag_focus_sweep_peak (s, AG_FOCUS_SWEEP_LEFT, &p));
+
+    for (; i < 260; i++) {
+        double t = i / 120.0;
+        double v = gaussian (t, 200.0, 1.25, 0.3);
+        ag_focus_sweep_push (s, t, v * (1.0 + noise (&seed, 0.02)), 50.0);
+    }
+    TEST_ASSERT_TRUE (ag_focus_sweep_peak (s, AG_FOCUS_SWEEP_LEFT, &p));
+    TEST_ASSERT_DOUBLE_WITHIN (0.02, 1.25, p.t);
+    TEST_ASSERT_DOUBLE_WITHIN (4.0, 200.0, p.score);
+
+    /* The right eye never moved: flat scores have no peak. */
+    TEST_ASSERT_FALSE (ag_focus_sweep_peak (s, AG_FOCUS_SWEEP_RIGHT, &p));
+    ag_focus_sweep_free (s);
+}
+
+/* A higher score after a confirmed peak raises the prediction until a
+ * new fit is confirmed. */
+void test_sweep_keeps_peak_until_refit (void)
+{
+    AgFocusSweep *s = ag_focus_sweep_new (1024, AG_FOCUS_FIT_PARABOLA);
+    int i = 0;
+    for (; i < 100; i++)
+        ag_focus_sweep_push (s, i * 0.01,
+                             100.0 - 0.05 * (i - 40) * (i - 40), 1.0);
+    AgFocusPeak p;
+    TEST_ASSERT_TRUE (ag_focus_sweep_peak (s, AG_FOCUS_SWEEP_LEFT, &p));
+    TEST_ASSERT_DOUBLE_WITHIN (1e-6, 0.40, p.t);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-6, 100.0, p.score);
+
+    for (int k = 0; k < 5; k++, i++)
+        ag_focus_sweep_push (s, i * 0.01, 120.0, 1.0);
+    TEST_ASSERT_TRUE (ag_focus_sweep_peak (s, AG_FOCUS_SWEEP_LEFT, &p));
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 120.0, p.score);
+    ag_focus_sweep_free (s);
+}
+
+void test_ring_wraps_oldest_first (void)
+{
+    AgFocusSweep *s = ag_focus_sweep_new (8, AG_FOCUS_FIT_PARABOLA);
+    for (int i = 0; i < 20; i++)
+        ag_focus_sweep_push (s, i, 10.0 * i, -i);
+    TEST_ASSERT_EQUAL_UINT (8, ag_focus_sweep_len (s));
+    for (guint k = 0; k < 8; k++) {
+        double t, l, r;
+        ag_focus_sweep_get (s, k, &t, &l, &r);
+        TEST_ASSERT_EQUAL_DOUBLE (12.0 + k, t);
+        TEST_ASSERT_EQUAL_DOUBLE (10.0 * (12 + k), l);
+        TEST_ASSERT_EQUAL_DOUBLE (-(12.0 + k), r);
+    }
+    ag_focus_sweep_reset (s);
+    TEST_ASSERT_EQUAL_UINT (0, ag_focus_sweep_len (s));
+    ag_focus_sweep_free (s);
+}
+
+/* Cue: 1 before a peak is known, negative while falling away from it,
+ * positive and shrinking when coming back, about 0 at the peak. */
+void test_cue_tracks_distance_to_peak (void)
+{
+    AgFocusSweep *s = ag_focus_sweep_new (4096, AG_FOCUS_FIT_PARABOLA);
+    int i = 0;
+    double t = 0.0;
+    TEST_ASSERT_EQUAL_FLOAT (1.0f, ag_focus_sweep_cue (s));
+
+    /* Through the peak at x = 50 and on to x = 80. */
+    for (; i <= 80; i++, t += 0.01)
+        ag_focus_sweep_push (s, t, 100.0 - 0.02 * (i - 50) * (i - 50), 3.0);
+    float cue = ag_focus_sweep_cue (s);
+    /* Last five samples average 100 - 0.02 * 786. */
+    TEST_ASSERT_FLOAT_WITHIN (0.005f, -0.1572f, cue);
+
+    /* Back towards the peak. */
+    for (int x = 79; x >= 60; x--, t += 0.01)
+        ag_focus_sweep_push (s, t, 100.0 - 0.02 * (x - 50) * (x - 50), 3.0);
+    float back = ag_focus_sweep_cue (s);
+    TEST_ASSERT_TRUE (back > 0.0f && back < -cue);
+
+    for (int x = 59; x >= 50; x--, t += 0.01)
+        ag_focus_sweep_push (s, t, 100.0 - 0.02 * (x - 50) * (x - 50), 3.0);
+    TEST_ASSERT_FLOAT_WITHIN (0.01f, 0.0f, ag_focus_sweep_cue (s));
+    ag_focus_sweep_free (s);
+}
+
+void test_csv_rows (void)
+{
+    AgFocusSweep *s = ag_focus_sweep_new (64, AG_FOCUS_FIT_PARABOLA);
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream (&buf, &len);
+    ag_focus_sweep_write_csv_header (f);
+    ag_focus_sweep_push (s, 0.5, 12.25, 3.5);
+    ag_focus_sweep_write_csv_row (f, 7, s);
+    for (int i = 1; i <= 20; i++)
+        ag_focus_sweep_push (s, 0.5 + 0.1 * i,
+                             100.0 - (i - 10) * (i - 10), 3.5);
+    ag_focus_sweep_write_csv_row (f, 8, s);
+    fclose (f);
+
+    TEST_ASSERT_EQUAL_STRING (
+        "frame,time_s,left,right,peak_left_t,peak_left,peak_right_t,peak_right\n"
+        "7,0.500000,12.250,3.500,,,,\n"
+        "8,2.500000,0.000,3.500,1.500000,100.000,,\n", buf);
+    free (buf);
+    ag_focus_sweep_free (s);
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_fit_names);
+    RUN_TEST (test_fit_exact_parabola);
+    RUN_TEST (test_fit_exact_gaussian);
+    RUN_TEST (test_fit_rejects_no_maximum);
+    RUN_TEST (test_sweep_predicts_peak_after_passing);
+    RUN_TEST (test_sweep_keeps_peak_until_refit);
+    RUN_TEST (test_ring_wraps_oldest_first);
+    RUN_TEST (test_cue_tracks_distance_to_peak);
+    RUN_TEST (test_csv_rows);
+    return UNITY_END ();
+}
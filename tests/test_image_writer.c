@@ -0,0 +1,286 @@
+/*
+ * test_image_writer.c — unit tests for the asynchronous image writer
+ *
+ * Jobs here write nothing to disk: they record that they ran, and a
+ * gate lets a test hold the writers so the queue fills up.  Covers frame
+ * ownership (every frame freed exactly once, rejected frames left with
+ * the caller), completion callbacks on the dispatching thread with the
+ * write status, blocking and non-blocking backpressure, flush and the
+ * flush in free.
+ *
+ * Build:  make test
+ * Run:    bin/test_image_writer [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "image_writer.h"
+
+#include <stdlib.h>
+
+typedef struct {
+    int      index;
+    gboolean fail;
+} Frame;
+
+static GMutex   gate_lock;
+static GCond    gate_cond;
+static gboolean gate_closed;
+static gint     writes;
+static gint     frees;
+static int      done_ok;
+static int      done_failed;
+static GThread *done_thread;
+static gboolean done_off_thread;
+
+void setUp (void)
+{
+    gate_closed = FALSE;
+    g_atomic_int_set (&writes, 0);
+    g_atomic_int_set (&frees, 0);
+    done_ok = done_failed = 0;
+    done_thread = g_thread_self ();
+    done_off_thread = FALSE;
+}
+
+void tearDown (void) {}
+
+static void
+gate_set (gboolean closed)
+{
+    g_mutex_lock (&gate_lock);
+    gate_closed = closed;
+    g_cond_broadcast (&gate_cond);
+    g_mutex_unlock (&gate_lock);
+}
+
+static int
+write_frame (gpointer data)
+{
+    Frame *f = data;
+    g_mutex_lock (&gate_lock);
+    while (gate_closed)
+        g_cond_wait (&gate_cond, &gate_lock);
+    g_mutex_unlock (&gate_lock);
+    g_atomic_int_inc (&writes);
+    return f->fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void
+free_frame (gpointer data)
+{
+    g_atomic_int_inc (&frees);
+    g_free (data);
+}
+
+static void
+frame_done (gpointer user_data, int status)
+{
+    (void) user_data;
+    if (g_thread_self () != done_thread)
+        done_off_thread = TRUE;
+    if (status == EXIT_SUCCESS)
+        done_ok++;
+    else
+        done_failed++;
+}
+
+static AgImageJob
+job_for (int index, gboolean fail)
+{
+    Frame *f = g_new0 (Frame, 1);
+    f->index = index;
+    f->fail = fail;
+    AgImageJob job = { write_frame, f, free_frame, frame_done, NULL };
+    return job;
+}
+
+/* Poll until the writers have taken `n` jobs off the queue. */
+static void
+wait_queued (AgImageWriter *w, guint n)
+{
+    AgImageWriterStats s;
+    for (int i = 0; i < 2000; i++) {
+        ag_image_writer_stats (w, &s);
+        if (s.queued == n)
+            return;
+        g_usleep (1000);
+    }
+    TEST_FAIL_MESSAGE ("writers never picked up the queue");
+}
+
+static gpointer
+blocked_submitter (gpointer data)
+{
+    AgImageWriter *w = data;
+    AgImageJob job = job_for (99, FALSE);
+    ag_image_writer_submit (w, &job, TRUE);
+    return NULL;
+}
+
+static void
+test_every_job_written_and_freed (void)
+{
+    AgImageWriter *w = ag_image_writer_new (4, 8);
+    for (int i = 0; i < 200; i++) {
+        AgImageJob job = job_for (i, FALSE);
+        TEST_ASSERT_TRUE (ag_image_writer_submit (w, &job, TRUE));
+    }
+    ag_image_writer_flush (w);
+
+    TEST_ASSERT_EQUAL_INT (200, g_atomic_int_get (&writes));
+    TEST_ASSERT_EQUAL_INT (200, g_atomic_int_get (&frees));
+    TEST_ASSERT_EQUAL_INT (200, done_ok);
+    TEST_ASSERT_EQUAL_UINT (0, ag_image_writer_pending (w));
+
+    AgImageWriterStats s;
+    ag_image_writer_stats (w, &s);
+    TEST_ASSERT_EQUAL_UINT64 (200, s.submitted);
+    TEST_ASSERT_EQUAL_UINT64 (200, s.written);
+    TEST_ASSERT_TRUE (s.high_water <= 8);
+    ag_image_writer_free (w);
+}
+
+static void
+test_callbacks_run_on_dispatching_thread (void)
+{
+    AgImageWriter *w = ag_image_writer_new (2, 4);
+    for (int i = 0; i < 6; i++) {
+        AgImageJob job = job_for (i, i % 3 == 0);
+        ag_image_writer_submit (w, &job, TRUE);
+    }
+
+    /* Nothing runs the callbacks until the owner dispatches. */
+    while (g_atomic_int_get (&frees) < 6)
+        g_usleep (1000);
+    TEST_ASSERT_EQUAL_INT (0, done_ok + done_failed);
+    TEST_ASSERT_EQUAL_UINT (6, ag_image_writer_pending (w));
+
+    TEST_ASSERT_EQUAL_UINT (6, ag_image_writer_dispatch (w));
+    TEST_ASSERT_EQUAL_UINT (0, ag_image_writer_dispatch (w));
+    TEST_ASSERT_FALSE (done_off_thread);
+    TEST_ASSERT_EQUAL_INT (4, done_ok);
+    TEST_ASSERT_EQUAL_INT (2, done_failed);
+
+    AgImageWriterStats s;
+    ag_image_writer_stats (w, &s);
+    TEST_ASSERT_EQUAL_UINT64 (2, s.failed);
+    ag_image_writer_free (w);
+}
+
+static void
+test_full_queue_rejects_without_taking_frame (void)
+{
+    AgImageWriter *w = ag_image_writer_new (1, 2);
+    gate_set (TRUE);
+
+    /* One job held by the writer, two waiting: the queue is full. */
+    AgImageJob first = job_for (0, FALSE);
+    ag_image_writer_submit (w, &first, FALSE);
+    wait_queued (w, 0);
+    for (int i = 1; i <= 2; i++) {
+        AgImageJob job = job_for (i, FALSE);
+        TEST_ASSERT_TRUE (ag_image_writer_submit (w, &job, FALSE));
+    }
+
+    AgImageJob extra = job_for (3, FALSE);
+    TEST_ASSERT_FALSE (ag_image_writer_submit (w, &extra, FALSE));
+    g_free (extra.frame);               /* still ours */
+
+    AgImageWriterStats s;
+    ag_image_writer_stats (w, &s);
+    TEST_ASSERT_EQUAL_UINT64 (1, s.rejected);
+    TEST_ASSERT_EQUAL_UINT (2, s.queued);
+    TEST_ASSERT_EQUAL_UINT (1, s.active);
+    TEST_ASSERT_EQUAL_UINT (2, s.high_water);
+
+    gate_set (FALSE);
+    ag_image_writer_flush (w);
+    TEST_ASSERT_EQUAL_INT (3, g_atomic_int_get (&frees));
+    TEST_ASSERT_EQUAL_INT (3, done_ok);
+    ag_image_writer_free (w);
+}
+
+static void
+test_blocking_submit_waits_for_room (void)
+{
+    AgImageWriter *w = ag_image_writer_new (1, 1);
+    gate_set (TRUE);
+
+    AgImageJob a = job_for (0, FALSE);
+    ag_image_writer_submit (w, &a, TRUE);
+    wait_queued (w, 0);
+    AgImageJob b = job_for (1, FALSE);
+    ag_image_writer_submit (w, &b, TRUE);
+
+    GThread *t = g_thread_new ("submitter", blocked_submitter, w);
+    AgImageWriterStats s;
+    do {
+        g_usleep (1000);
+        ag_image_writer_stats (w, &s);
+    } while (s.blocked == 0);
+    TEST_ASSERT_EQUAL_UINT64 (2, s.submitted);
+
+    gate_set (FALSE);
+    g_thread_join (t);
+    ag_image_writer_flush (w);
+
+    ag_image_writer_stats (w, &s);
+    TEST_ASSERT_EQUAL_UINT64 (3, s.submitted);
+    TEST_ASSERT_EQUAL_UINT64 (1, s.blocked);
+    TEST_ASSERT_EQUAL_UINT64 (0, s.rejected);
+    TEST_ASSERT_EQUAL_INT (3, g_atomic_int_get (&writes));
+    ag_image_writer_free (w);
+}
+
+static void
+test_free_writes_everything_queued (void)
+{
+    AgImageWriter *w = ag_image_writer_new (2, 16);
+    gate_set (TRUE);
+    for (int i = 0; i < 10; i++) {
+        AgImageJob job = job_for (i, FALSE);
+        ag_image_writer_submit (w, &job, FALSE);
+    }
+    TEST_ASSERT_EQUAL_INT (0, g_atomic_int_get (&writes));
+    TEST_ASSERT_EQUAL_UINT (10, ag_image_writer_pending (w));
+
+    gate_set (FALSE);
+    ag_image_writer_free (w);
+    TEST_ASSERT_EQUAL_INT (10, g_atomic_int_get (&writes));
+    TEST_ASSERT_EQUAL_INT (10, g_atomic_int_get (&frees));
+    TEST_ASSERT_EQUAL_INT (10, done_ok);
+    TEST_ASSERT_FALSE (done_off_thread);
+}
+
+static void
+test_limits_clamped (void)
+{
+    AgImageWriter *w = ag_image_writer_new (0, 0);
+    gate_set (TRUE);
+    AgImageJob a = job_for (0, FALSE);
+    ag_image_writer_submit (w, &a, FALSE);
+    wait_queued (w, 0);
+    AgImageJob b = job_for (1, FALSE);
+    TEST_ASSERT_TRUE (ag_image_writer_submit (w, &b, FALSE));
+    AgImageJob c = job_for (2, FALSE);
+    TEST_ASSERT_FALSE (ag_image_writer_submit (w, &c, FALSE));
+    g_free (c.frame);
+    gate_set (FALSE);
+    ag_image_writer_free (w);
+    TEST_ASSERT_EQUAL_INT (2, g_atomic_int_get (&writes));
+
+    ag_image_writer_free (NULL);
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_every_job_written_and_freed);
+    RUN_TEST (test_callbacks_run_on_dispatching_thread);
+    RUN_TEST (test_full_queue_rejects_without_taking_frame);
+    RUN_TEST (test_blocking_submit_waits_for_room);
+    RUN_TEST (test_free_writes_everything_queued);
+    RUN_TEST (test_limits_clamped);
+    return UNITY_END ();
+}
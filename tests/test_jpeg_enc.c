@@ -0,0 +1,347 @@
+/*
+ * test_jpeg_enc.c — unit tests for the JPEG encoder
+ *
+ * Structure checks (markers, SOF0 geometry and components) run against
+ * either backend.  Sampling factors are only asserted for libjpeg, since
+ * stb picks its own.  Built with HAVE_LIBJPEG, every encoded image is
+ * also decoded with libjpeg and compared plane by plane: gray, RGB, and
+ * YCbCr at 4:2:0 and 4:4:4, with odd sizes, widths that are not a whole
+ * block and padded strides.
+ *
+ * Build:  make test
+ * Run:    bin/test_jpeg_enc [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "jpeg_enc.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+#define W 301
+#define H 203
+#define PAD 11
+
+static guint8 luma[(W + PAD) * H];
+static guint8 rgb[(W * 3 + PAD) * H];
+static guint8 cb[(W + PAD) * H];
+static guint8 cr[(W + PAD) * H];
+
+void setUp (void) {}
+void tearDown (void) {}
+
+static gboolean
+libjpeg_backend (void)
+{
+    return strcmp (ag_jpeg_backend_name (), "stb") != 0;
+}
+
+/* Smooth ramps with a little noise; planes are stride bytes per row. */
+static void
+fill (guint8 *plane, guint w, guint h, size_t stride, int bpp, int seed)
+{
+    guint32 s = 12345u + (guint32) seed;
+    for (guint y = 0; y < h; y++) {
+        for (guint x = 0; x < w * (guint) bpp; x++) {
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            plane[(size_t) y * stride + x] =
+                (guint8) (20 + (x / (guint) bpp) / 4 + y / 4 + 25 * (x % (guint) bpp) +
+                          seed * 5 + (s & 3));
+        }
+    }
+}
+
+typedef struct {
+    guint width, height;
+    int   n;
+    guint8 hv[3];
+} Sof;
+
+/* Check SOI/EOI and read the baseline frame header. */
+static gboolean
+parse (const guint8 *jpeg, size_t len, Sof *sof)
+{
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 ||
+        jpeg[len - 2] != 0xFF || jpeg[len - 1] != 0xD9)
+        return FALSE;
+    size_t pos = 2;
+    while (pos + 4 <= len && jpeg[pos] == 0xFF) {
+        guint8 marker = jpeg[pos + 1];
+        size_t seg = (size_t) jpeg[pos + 2] << 8 | jpeg[pos + 3];
+        if (pos + 2 + seg > len)
+            return FALSE;
+        if (marker == 0xC0) {
+            const guint8 *d = jpeg + pos + 4;
+            sof->height = (guint) d[1] << 8 | d[2];
+            sof->width  = (guint) d[3] << 8 | d[4];
+            sof->n      = d[5];
+            for (int c = 0; c < sof->n && c < 3; c++)
+                sof->hv[c] = d[6 + 3 * c + 1];
+            return TRUE;
+        }
+        pos += 2 + seg;
+    }
+    return FALSE;
+}
+
+static guint8 *
+encode_checked (const AgJpegImage *img, const AgJpegOptions *o,
+                size_t *len, Sof *sof)
+{
+    guint8 *jpeg = ag_jpeg_encode (img, o, len);
+    TEST_ASSERT_NOT_NULL (jpeg);
+    TEST_ASSERT_TRUE_MESSAGE (parse (jpeg, *len, sof), "no baseline SOF0");
+    TEST_ASSERT_EQUAL_UINT (img->width,  sof->width);
+    TEST_ASSERT_EQUAL_UINT (img->height, sof->height);
+    /* stb always writes three components. */
+    int n = img->source == AG_JPEG_GRAY && libjpeg_backend () ? 1 : 3;
+    TEST_ASSERT_EQUAL_INT (n, sof->n);
+    return jpeg;
+}
+
+#ifdef HAVE_LIBJPEG
+/* Decode to gray, RGB or YCbCr (chroma upsampled by the library). */
+static guint8 *
+decode (const guint8 *jpeg, size_t len, J_COLOR_SPACE space, int *comps)
+{
+    struct jpeg_decompress_struct d;
+    struct jpeg_error_mgr err;
+    d.err = jpeg_std_error (&err);
+    jpeg_create_decompress (&d);
+    jpeg_mem_src (&d, jpeg, (unsigned long) len);
+    jpeg_read_header (&d, TRUE);
+    d.out_color_space = space;
+    jpeg_start_decompress (&d);
+
+    size_t row = (size_t) d.output_width * (size_t) d.output_components;
+    guint8 *out = g_malloc (row * d.output_height);
+    while (d.output_scanline < d.output_height) {
+        JSAMPROW r = out + row * d.output_scanline;
+        jpeg_read_scanlines (&d, &r, 1);
+    }
+    *comps = d.output_components;
+    jpeg_finish_decompress (&d);
+    jpeg_destroy_decompress (&d);
+    return out;
+}
+
+/* PSNR of channel c of decoded (comps interleaved, w x h) against a
+ * plane sampled at (x >> shift, y >> shift). */
+static double
+psnr (const guint8 *decoded, int comps, int c, guint w, guint h,
+      const guint8 *plane, size_t stride, int bpp, int channel, int shift)
+{
+    double se = 0;
+    for (guint y = 0; y < h; y++) {
+        for (guint x = 0; x < w; x++) {
+            int a = decoded[((size_t) y * w + x) * (size_t) comps + (size_t) c];
+            int b = plane[(size_t) (y >> shift) * stride +
+                          (size_t) (x >> shift) * (size_t) bpp + (size_t) channel];
+            se += (double) (a - b) * (a - b);
+        }
+    }
+    double mse = se / ((double) w * h);
+    return mse > 0 ? 10.0 * log10 (255.0 * 255.0 / mse) : 99.0;
+}
+#endif
+
+static void
+test_gray_is_one_component (void)
+{
+    fill (luma, W, H, W + PAD, 1, 0);
+    AgJpegImage img = { AG_JPEG_GRAY, W, H, { luma }, { W + PAD } };
+    AgJpegOptions o;
+    ag_jpeg_options_defaults (&o);
+    size_t len;
+    Sof sof;
+    guint8 *jpeg = encode_checked (&img, &o, &len, &sof);
+    if (libjpeg_backend ())
+        TEST_ASSERT_EQUAL_HEX8 (0x11, sof.hv[0]);
+
+#ifdef HAVE_LIBJPEG
+    int comps;
+    guint8 *out = decode (jpeg, len, JCS_GRAYSCALE, &comps);
+    TEST_ASSERT_EQUAL_INT (1, comps);
+    TEST_ASSERT_TRUE (psnr (out, 1, 0, W, H, luma, W + PAD, 1, 0, 0) > 38.0);
+    g_free (out);
+#endif
+    g_free (jpeg);
+}
+
+static void
+test_rgb_subsampling (void)
+{
+    fill (rgb, W, H, W * 3 + PAD, 3, 1);
+    AgJpegImage img = { AG_JPEG_RGB, W, H, { rgb }, { W * 3 + PAD } };
+    AgJpegOptions o = { 85, AG_JPEG_SUBSAMPLE_420 };
+    static const guint8 y_hv[2] = { 0x22, 0x11 };
+
+    for (int s = AG_JPEG_SUBSAMPLE_420; s <= AG_JPEG_SUBSAMPLE_444; s++) {
+        o.subsample = (AgJpegSubsample) s;
+        size_t len;
+        Sof sof;
+        guint8 *jpeg = encode_checked (&img, &o, &len, &sof);
+        if (libjpeg_backend ()) {
+            TEST_ASSERT_EQUAL_HEX8 (y_hv[s], sof.hv[0]);
+            TEST_ASSERT_EQUAL_HEX8 (0x11, sof.hv[1]);
+            TEST_ASSERT_EQUAL_HEX8 (0x11, sof.hv[2]);
+        }
+#ifdef HAVE_LIBJPEG
+        int comps;
+        guint8 *out = decode (jpeg, len, JCS_RGB, &comps);
+        TEST_ASSERT_EQUAL_INT (3, comps);
+        for (int c = 0; c < 3; c++)
+            TEST_ASSERT_TRUE (psnr (out, 3, c, W, H, rgb, W * 3 + PAD, 3, c, 0) > 32.0);
+        g_free (out);
+#endif
+        g_free (jpeg);
+    }
+}
+
+/* Planar YCbCr of size w x h, chroma halved for 4:2:0. */
+static void
+ycbcr_round_trip (guint w, guint h, AgJpegSubsample subsample)
+{
+    int shift = subsample == AG_JPEG_SUBSAMPLE_420 ? 1 : 0;
+    guint cw = subsample == AG_JPEG_SUBSAMPLE_420 ? (w + 1) / 2 : w;
+    guint ch = subsample == AG_JPEG_SUBSAMPLE_420 ? (h + 1) / 2 : h;
+    size_t stride = w + PAD, cstride = cw + PAD;
+    fill (luma, w, h, stride, 1, 2);
+    fill (cb, cw, ch, cstride, 1, 3);
+    fill (cr, cw, ch, cstride, 1, 4);
+
+    AgJpegImage img = { AG_JPEG_YCBCR, w, h, { luma, cb, cr },
+                        { stride, cstride, cstride } };
+    AgJpegOptions o = { 92, subsample };
+    size_t len;
+    Sof sof;
+    guint8 *jpeg = encode_checked (&img, &o, &len, &sof);
+    if (libjpeg_backend ())
+        TEST_ASSERT_EQUAL_HEX8 (shift ? 0x22 : 0x11, sof.hv[0]);
+
+#ifdef HAVE_LIBJPEG
+    /* stb goes through RGB, which clips these out-of-gamut ramps. */
+    if (!libjpeg_backend ()) {
+        g_free (jpeg);
+        return;
+    }
+    int comps;
+    guint8 *out = decode (jpeg, len, JCS_YCbCr, &comps);
+    TEST_ASSERT_EQUAL_INT (3, comps);
+    TEST_ASSERT_TRUE (psnr (out, 3, 0, w, h, luma, stride, 1, 0, 0) > 40.0);
+    /* Decoded chroma is upsampled smoothly; the ramps keep it close to
+     * the nearest stored sample. */
+    TEST_ASSERT_TRUE (psnr (out, 3, 1, w, h, cb, cstride, 1, 0, shift) > 38.0);
+    TEST_ASSERT_TRUE (psnr (out, 3, 2, w, h, cr, cstride, 1, 0, shift) > 38.0);
+    g_free (out);
+#endif
+    g_free (jpeg);
+}
+
+static void
+test_ycbcr_planes (void)
+{
+    ycbcr_round_trip (W, H, AG_JPEG_SUBSAMPLE_420);
+    ycbcr_round_trip (W, H, AG_JPEG_SUBSAMPLE_444);
+    /* Less than one MCU, and widths that end mid-block. */
+    ycbcr_round_trip (9, 5, AG_JPEG_SUBSAMPLE_420);
+    ycbcr_round_trip (17, 33, AG_JPEG_SUBSAMPLE_444);
+    ycbcr_round_trip (64, 48, AG_JPEG_SUBSAMPLE_420);
+}
+
+static void
+test_quality_orders_size (void)
+{
+    fill (luma, W, H, W, 1, 5);
+    AgJpegImage img = { AG_JPEG_GRAY, W, H, { luma }, { W } };
+    size_t last = 0;
+    static const int qualities[] = { 30, 70, 95 };
+    for (size_t i = 0; i < G_N_ELEMENTS (qualities); i++) {
+        AgJpegOptions o = { qualities[i], AG_JPEG_SUBSAMPLE_420 };
+        size_t len;
+        guint8 *jpeg = ag_jpeg_encode (&img, &o, &len);
+        TEST_ASSERT_NOT_NULL (jpeg);
+        TEST_ASSERT_TRUE (len > last);
+        last = len;
+        g_free (jpeg);
+    }
+}
+
+static void
+test_write_matches_encode (void)
+{
+    fill (rgb, W, H, W * 3, 3, 6);
+    AgJpegImage img = { AG_JPEG_RGB, W, H, { rgb }, { W * 3 } };
+    AgJpegOptions o;
+    ag_jpeg_options_defaults (&o);
+    TEST_ASSERT_EQUAL_INT (AG_JPEG_QUALITY_DEFAULT, o.quality);
+    TEST_ASSERT_EQUAL_INT (AG_JPEG_SUBSAMPLE_420, o.subsample);
+
+    size_t len;
+    guint8 *jpeg = ag_jpeg_encode (&img, &o, &len);
+
+    char path[] = "/tmp/test_jpeg_enc_XXXXXX";
+    int fd = mkstemp (path);
+    TEST_ASSERT_TRUE (fd >= 0);
+    close (fd);
+    TEST_ASSERT_EQUAL_INT (EXIT_SUCCESS, ag_jpeg_write (path, &img, &o));
+    gchar *file;
+    gsize file_len;
+    TEST_ASSERT_TRUE (g_file_get_contents (path, &file, &file_len, NULL));
+    TEST_ASSERT_EQUAL_size_t (len, file_len);
+    TEST_ASSERT_EQUAL_MEMORY (jpeg, file, len);
+    unlink (path);
+    g_free (file);
+    g_free (jpeg);
+
+    TEST_ASSERT_EQUAL_INT (EXIT_FAILURE,
+                           ag_jpeg_write ("/no/such/dir/x.jpg", &img, &o));
+}
+
+static void
+test_bad_arguments_and_names (void)
+{
+    AgJpegOptions o;
+    ag_jpeg_options_defaults (&o);
+    size_t len;
+    AgJpegImage empty = { AG_JPEG_GRAY, 0, 4, { luma }, { 4 } };
+    TEST_ASSERT_NULL (ag_jpeg_encode (&empty, &o, &len));
+    AgJpegImage narrow = { AG_JPEG_RGB, 8, 4, { rgb }, { 20 } };
+    TEST_ASSERT_NULL (ag_jpeg_encode (&narrow, &o, &len));
+    AgJpegImage no_chroma = { AG_JPEG_YCBCR, 8, 4, { luma, cb, NULL }, { 8, 4, 4 } };
+    TEST_ASSERT_NULL (ag_jpeg_encode (&no_chroma, &o, &len));
+
+    guint8 one = 200;
+    AgJpegImage pixel = { AG_JPEG_GRAY, 1, 1, { &one }, { 1 } };
+    guint8 *jpeg = ag_jpeg_encode (&pixel, &o, &len);
+    TEST_ASSERT_NOT_NULL (jpeg);
+    g_free (jpeg);
+
+    AgJpegSubsample s;
+    TEST_ASSERT_EQUAL_INT (0, ag_jpeg_parse_subsample ("444", &s));
+    TEST_ASSERT_EQUAL_INT (AG_JPEG_SUBSAMPLE_444, s);
+    TEST_ASSERT_EQUAL_INT (0, ag_jpeg_parse_subsample ("420", &s));
+    TEST_ASSERT_EQUAL_INT (AG_JPEG_SUBSAMPLE_420, s);
+    TEST_ASSERT_EQUAL_INT (-1, ag_jpeg_parse_subsample ("422", &s));
+    TEST_ASSERT_NOT_NULL (ag_jpeg_backend_name ());
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_gray_is_one_component);
+    RUN_TEST (test_rgb_subsampling);
+    RUN_TEST (test_ycbcr_planes);
+    RUN_TEST (test_quality_orders_size);
+    RUN_TEST (test_write_matches_encode);
+    RUN_TEST (test_bad_arguments_and_names);
+    return UNITY_END ();
+}
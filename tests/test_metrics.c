@@ -0,0 +1,239 @@
+/*
+ * test_metrics.c — unit tests for the metrics registry and endpoint
+ *
+ * Verifies counter/gauge/histogram updates, histogram quantile
+ * accuracy, Prometheus text rendering (HELP/TYPE grouping, labels,
+ * cumulative buckets), the trace-stage bridge, listen-address
+ * validation and a round trip over the Unix-socket endpoint.
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_metrics [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void setUp (void) {}
+
+void tearDown (void)
+{
+    ag_trace_stop ();
+    ag_metrics_reset ();
+}
+
+static int
+count_substr (const char *haystack, const char *needle)
+{
+    int n = 0;
+    for (const char *p = haystack; (p = strstr (p, needle)); p += strlen (needle))
+        n++;
+    return n;
+}
+
+void test_counter_and_gauge (void)
+{
+    AgCounter *c = ag_metrics_counter ("t_frames_total", NULL, "Frames.");
+    ag_counter_inc (c);
+    ag_counter_add (c, 4);
+    TEST_ASSERT_EQUAL_UINT64 (5, ag_counter_get (c));
+    ag_counter_set (c, 42);
+    TEST_ASSERT_EQUAL_UINT64 (42, ag_counter_get (c));
+
+    AgGauge *g = ag_metrics_gauge ("t_fps", NULL, "FPS.");
+    ag_gauge_set (g, 29.5);
+    TEST_ASSERT_EQUAL_DOUBLE (29.5, ag_gauge_get (g));
+
+    /* NULL metrics (metrics disabled) are silently ignored. */
+    ag_counter_inc (NULL);
+    ag_gauge_set (NULL, 1.0);
+    ag_histogram_observe_ns (NULL, 1);
+    TEST_ASSERT_EQUAL_UINT64 (0, ag_counter_get (NULL));
+}
+
+void test_reregister_returns_same_series (void)
+{
+    AgCounter *a = ag_metrics_counter ("t_drops_total", "reason=\"timeout\"", "Drops.");
+    AgCounter *b = ag_metrics_counter ("t_drops_total", "reason=\"size\"", "Drops.");
+    TEST_ASSERT_TRUE (a != b);
+    TEST_ASSERT_TRUE (a == ag_metrics_counter ("t_drops_total",
+                                               "reason=\"timeout\"", "Drops."));
+}
+
+void test_histogram_quantiles (void)
+{
+    AgHistogram *h = ag_metrics_histogram ("t_latency_seconds", NULL, "Latency.");
+    TEST_ASSERT_EQUAL_UINT64 (0, ag_histogram_quantile_ns (h, 0.5));
+
+    /* 1..1000 µs uniformly: p50 ≈ 500 µs, p99 ≈ 990 µs. */
+    for (int us = 1; us <= 1000; us++)
+        ag_histogram_observe_ns (h, (uint64_t) us * 1000);
+    TEST_ASSERT_EQUAL_UINT64 (1000, ag_histogram_count (h));
+
+    double p50 = (double) ag_histogram_quantile_ns (h, 0.50);
+    double p99 = (double) ag_histogram_quantile_ns (h, 0.99);
+    TEST_ASSERT_DOUBLE_WITHIN (500e3 * 0.125, 500e3, p50);
+    TEST_ASSERT_DOUBLE_WITHIN (990e3 * 0.125, 990e3, p99);
+}
+
+void test_histogram_extremes (void)
+{
+    AgHistogram *h = ag_metrics_histogram ("t_extreme_seconds", NULL, "X.");
+    ag_histogram_observe_ns (h, 0);
+    ag_histogram_observe_ns (h, G_MAXUINT64 / 2);
+    TEST_ASSERT_EQUAL_UINT64 (2, ag_histogram_count (h));
+    TEST_ASSERT_TRUE (ag_histogram_quantile_ns (h, 0.0) < 1024);
+    TEST_ASSERT_TRUE (ag_histogram_quantile_ns (h, 1.0) >= 100000000000ull);
+}
+
+void test_render_text_format (void)
+{
+    AgCounter *t = ag_metrics_counter ("t_drops_total", "reason=\"timeout\"",
+                                       "Dropped frames.");
+    AgCounter *s = ag_metrics_counter ("t_drops_total", "reason=\"size\"",
+                                       "Dropped frames.");
+    ag_counter_add (t, 3);
+    ag_counter_add (s, 7);
+    ag_gauge_set (ag_metrics_gauge ("t_fps", NULL, "Frame rate."), 12.5);
+
+    char *text = ag_metrics_render ();
+    TEST_ASSERT_EQUAL_INT (1, count_substr (text, "# HELP t_drops_total Dropped frames.\n"));
+    TEST_ASSERT_EQUAL_INT (1, count_substr (text, "# TYPE t_drops_total counter\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "t_drops_total{reason=\"timeout\"} 3\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "t_drops_total{reason=\"size\"} 7\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "# TYPE t_fps gauge\nt_fps 12.5\n"));
+    g_free (text);
+}
+
+void test_render_histogram_buckets (void)
+{
+    AgHistogram *h = ag_metrics_histogram ("t_stage_seconds", "stage=\"pop\"",
+                                           "Stage latency.");
+    ag_histogram_observe_ns (h, 1500000);     /* 1.5 ms */
+    ag_histogram_observe_ns (h, 3000000);     /* 3 ms   */
+
+    char *text = ag_metrics_render ();
+    TEST_ASSERT_NOT_NULL (strstr (text, "# TYPE t_stage_seconds histogram\n"));
+    /* 2^21 ns ≈ 2.1 ms holds the first sample, 2^22 ns both. */
+    TEST_ASSERT_NOT_NULL (strstr (text,
+        "t_stage_seconds_bucket{stage=\"pop\",le=\"0.002097152\"} 1\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text,
+        "t_stage_seconds_bucket{stage=\"pop\",le=\"0.004194304\"} 2\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text,
+        "t_stage_seconds_bucket{stage=\"pop\",le=\"+Inf\"} 2\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "t_stage_seconds_sum{stage=\"pop\"} 0.004500000\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "t_stage_seconds_count{stage=\"pop\"} 2\n"));
+    g_free (text);
+}
+
+void test_trace_stage_bridge (void)
+{
+    ag_metrics_observe_trace_stages ();
+    /* Probes on, but no rings and no --trace stats line. */
+    TEST_ASSERT_FALSE (ag_trace_on);
+    TEST_ASSERT_NOT_EQUAL (0, ag_trace_begin ());
+
+    uint64_t t0 = ag_trace_now_ns ();
+    ag_trace_record (AG_STAGE_REMAP, t0, t0 + 2000000);
+    ag_trace_record (AG_STAGE_REMAP, t0, t0 + 2000000);
+
+    char *text = ag_metrics_render ();
+    TEST_ASSERT_NOT_NULL (strstr (text,
+        "ag_stage_latency_seconds_count{stage=\"remap\"} 2\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text,
+        "ag_stage_latency_seconds_count{stage=\"pop\"} 0\n"));
+    g_free (text);
+}
+
+void test_trace_stage_bridge_sums_per_frame (void)
+{
+    ag_metrics_observe_trace_stages ();
+
+    /* Two remaps per frame (disparity + display), 1 ms + 3 ms. */
+    uint64_t t0 = ag_trace_now_ns ();
+    for (guint64 f = 0; f < 3; f++) {
+        ag_trace_set_frame (f);
+        ag_trace_record (AG_STAGE_REMAP, t0, t0 + 1000000);
+        ag_trace_record (AG_STAGE_REMAP, t0, t0 + 3000000);
+    }
+    /* A frame is reported once the next one is tagged. */
+    ag_trace_set_frame (3);
+
+    char *text = ag_metrics_render ();
+    TEST_ASSERT_NOT_NULL (strstr (text,
+        "ag_stage_latency_seconds_count{stage=\"remap\"} 3\n"));
+    TEST_ASSERT_NOT_NULL (strstr (text,
+        "ag_stage_latency_seconds_sum{stage=\"remap\"} 0.012000000\n"));
+    g_free (text);
+}
+
+void test_listen_address_validation (void)
+{
+    TEST_ASSERT_TRUE (ag_metrics_listen_valid ("9464"));
+    TEST_ASSERT_TRUE (ag_metrics_listen_valid ("127.0.0.1:9464"));
+    TEST_ASSERT_TRUE (ag_metrics_listen_valid ("localhost:9464"));
+    TEST_ASSERT_TRUE (ag_metrics_listen_valid ("unix:/tmp/ag.sock"));
+    TEST_ASSERT_FALSE (ag_metrics_listen_valid ("0.0.0.0:9464"));
+    TEST_ASSERT_FALSE (ag_metrics_listen_valid ("70000"));
+    TEST_ASSERT_FALSE (ag_metrics_listen_valid ("abc"));
+    TEST_ASSERT_FALSE (ag_metrics_listen_valid ("unix:"));
+}
+
+void test_unix_socket_round_trip (void)
+{
+    char path[64], addr[80];
+    snprintf (path, sizeof path, "/tmp/test_metrics_%d.sock", (int) getpid ());
+    snprintf (addr, sizeof addr, "unix:%s", path);
+
+    ag_counter_add (ag_metrics_counter ("t_frames_total", NULL, "Frames."), 9);
+    TEST_ASSERT_EQUAL_INT (0, ag_metrics_serve (addr));
+
+    int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    g_strlcpy (sa.sun_path, path, sizeof sa.sun_path);
+    TEST_ASSERT_EQUAL_INT (0, connect (fd, (struct sockaddr *) &sa, sizeof sa));
+
+    const char req[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    TEST_ASSERT_EQUAL_INT ((int) sizeof req - 1,
+                           (int) write (fd, req, sizeof req - 1));
+
+    char resp[4096];
+    size_t got = 0;
+    ssize_t n;
+    while ((n = read (fd, resp + got, sizeof resp - 1 - got)) > 0)
+        got += (size_t) n;
+    resp[got] = '\0';
+    close (fd);
+
+    TEST_ASSERT_TRUE (g_str_has_prefix (resp, "HTTP/1.0 200 OK\r\n"));
+    TEST_ASSERT_NOT_NULL (strstr (resp, "\r\n\r\n# HELP t_frames_total"));
+    TEST_ASSERT_NOT_NULL (strstr (resp, "t_frames_total 9\n"));
+
+    ag_metrics_reset ();
+    TEST_ASSERT_NOT_EQUAL (0, access (path, F_OK));
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_counter_and_gauge);
+    RUN_TEST (test_reregister_returns_same_series);
+    RUN_TEST (test_histogram_quantiles);
+    RUN_TEST (test_histogram_extremes);
+    RUN_TEST (test_render_text_format);
+    RUN_TEST (test_render_histogram_buckets);
+    RUN_TEST (test_trace_stage_bridge);
+    RUN_TEST (test_trace_stage_bridge_sums_per_frame);
+    RUN_TEST (test_listen_address_validation);
+    RUN_TEST (test_unix_socket_round_trip);
+    return UNITY_END ();
+}
@@ -0,0 +1,303 @@
+/*
+ * test_png_fast.c — unit tests for the multi-threaded PNG encoder
+ *
+ * Every encoded file is decoded again here with plain zlib: chunk CRCs
+ * checked, the IDAT inflated through the zlib wrapper (which verifies
+ * the combined Adler-32) and the rows unfiltered, so a stitched stream
+ * that any decoder would reject fails the round trip.  Covers gray and
+ * RGB, each filter, stored and compressed levels, one and many bands,
+ * padded strides, the zlib header per level and argument checks.
+ *
+ * Build:  make test
+ * Run:    bin/test_png_fast [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "png_fast.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define W 301
+#define H 203
+
+static guint8 image[W * H * 3];
+
+void setUp (void) {}
+void tearDown (void) {}
+
+/* Smooth gradients plus noise: compressible, but not trivially. */
+static void
+make_image (int channels)
+{
+    guint32 s = 12345;
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            for (int c = 0; c < channels; c++) {
+                s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+                image[((size_t) y * W + x) * channels + c] =
+                    (guint8) (x + 2 * y + 40 * c + (s & 7));
+            }
+        }
+    }
+}
+
+static guint32
+get_be32 (const guint8 *p)
+{
+    return (guint32) p[0] << 24 | (guint32) p[1] << 16 |
+           (guint32) p[2] << 8 | p[3];
+}
+
+/*
+ * Decode what ag_png_encode produces (8-bit gray or RGB, filters 0-2)
+ * into pixels.  Returns FALSE on any structural or checksum error.
+ */
+static gboolean
+decode (const guint8 *png, size_t len, guint *w, guint *h, int *channels,
+        guint8 **pixels, guint8 *zlib_flg)
+{
+    static const guint8 sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (len < 8 || memcmp (png, sig, 8) != 0)
+        return FALSE;
+
+    GByteArray *idat = g_byte_array_new ();
+    gboolean ended = FALSE;
+    size_t pos = 8;
+    while (pos + 12 <= len && !ended) {
+        guint32 n = get_be32 (png + pos);
+        if (pos + 12 + n > len)
+            break;
+        const guint8 *type = png + pos + 4;
+        const guint8 *data = type + 4;
+        uLong crc = crc32 (crc32 (0L, Z_NULL, 0), type, 4 + n);
+        if (crc != get_be32 (data + n)) {
+            g_byte_array_free (idat, TRUE);
+            return FALSE;
+        }
+        if (memcmp (type, "IHDR", 4) == 0) {
+            *w = get_be32 (data);
+            *h = get_be32 (data + 4);
+            *channels = data[9] == 2 ? 3 : 1;
+        } else if (memcmp (type, "IDAT", 4) == 0) {
+            g_byte_array_append (idat, data, n);
+        } else if (memcmp (type, "IEND", 4) == 0) {
+            ended = TRUE;
+        }
+        pos += 12 + n;
+    }
+    if (!ended || pos != len || idat->len < 2) {
+        g_byte_array_free (idat, TRUE);
+        return FALSE;
+    }
+    *zlib_flg = idat->data[1];
+
+    size_t row = (size_t) *w * (size_t) *channels;
+    uLongf raw_len = (uLongf) ((row + 1) * *h);
+    guint8 *raw = g_malloc (raw_len);
+    uLongf got = raw_len;
+    int rc = uncompress (raw, &got, idat->data, idat->len);
+    g_byte_array_free (idat, TRUE);
+    if (rc != Z_OK || got != raw_len) {
+        g_free (raw);
+        return FALSE;
+    }
+
+    guint8 *out = g_malloc (row * *h);
+    for (guint y = 0; y < *h; y++) {
+        const guint8 *src = raw + (row + 1) * y;
+        guint8 *dst  = out + row * y;
+        guint8 *prev = y > 0 ? dst - row : NULL;
+        for (size_t i = 0; i < row; i++) {
+            guint8 a = i >= (size_t) *channels ? dst[i - (size_t) *channels] : 0;
+            guint8 b = prev ? prev[i] : 0;
+            switch (src[0]) {
+            case 0: dst[i] = src[1 + i]; break;
+            case 1: dst[i] = (guint8) (src[1 + i] + a); break;
+            case 2: dst[i] = (guint8) (src[1 + i] + b); break;
+            default: g_free (raw); g_free (out); return FALSE;
+            }
+        }
+    }
+    g_free (raw);
+    *pixels = out;
+    return TRUE;
+}
+
+/* Encode, decode and compare; returns the encoded size. */
+static size_t
+round_trip (int channels, AgPngFilter filter, int level, int threads,
+            size_t stride, const guint8 *pixels)
+{
+    AgPngOptions o = { level, filter, threads };
+    size_t len = 0;
+    guint8 *png = ag_png_encode (pixels, W, H, channels, stride, &o, &len);
+    TEST_ASSERT_NOT_NULL (png);
+
+    guint w = 0, h = 0;
+    int ch = 0;
+    guint8 *out = NULL, flg = 0;
+    TEST_ASSERT_TRUE_MESSAGE (decode (png, len, &w, &h, &ch, &out, &flg),
+                              "encoded PNG does not decode");
+    TEST_ASSERT_EQUAL_UINT (W, w);
+    TEST_ASSERT_EQUAL_UINT (H, h);
+    TEST_ASSERT_EQUAL_INT (channels, ch);
+    for (int y = 0; y < H; y++)
+        TEST_ASSERT_EQUAL_MEMORY (pixels + (size_t) y * stride,
+                                  out + (size_t) y * W * channels,
+                                  (size_t) W * channels);
+    g_free (out);
+    g_free (png);
+    return len;
+}
+
+static void
+test_round_trip_every_filter_and_level (void)
+{
+    static const int levels[] = { 0, 1, 3, 6, 9 };
+    for (int channels = 1; channels <= 3; channels += 2) {
+        make_image (channels);
+        for (int f = AG_PNG_FILTER_NONE; f <= AG_PNG_FILTER_UP; f++)
+            for (size_t l = 0; l < G_N_ELEMENTS (levels); l++)
+                round_trip (channels, (AgPngFilter) f, levels[l], 4,
+                            (size_t) W * channels, image);
+    }
+}
+
+static void
+test_bands_cost_little (void)
+{
+    make_image (3);
+    size_t one  = round_trip (3, AG_PNG_FILTER_UP, 6, 1, W * 3, image);
+    size_t many = round_trip (3, AG_PNG_FILTER_UP, 6, 6, W * 3, image);
+    TEST_ASSERT_TRUE_MESSAGE (many < one + one / 50, "bands cost over 2%");
+
+    /* More threads than bands of AG_PNG_BAND_ROWS_MIN rows is fine. */
+    round_trip (3, AG_PNG_FILTER_SUB, 1, AG_PNG_THREADS_MAX, W * 3, image);
+}
+
+static void
+test_filters_and_levels_shrink_output (void)
+{
+    make_image (3);
+    size_t stored = round_trip (3, AG_PNG_FILTER_NONE, 0, 4, W * 3, image);
+    size_t none1  = round_trip (3, AG_PNG_FILTER_NONE, 1, 4, W * 3, image);
+    size_t up1    = round_trip (3, AG_PNG_FILTER_UP,   1, 4, W * 3, image);
+    size_t up9    = round_trip (3, AG_PNG_FILTER_UP,   9, 4, W * 3, image);
+
+    /* Stored: raw filtered rows plus block headers and chunk framing. */
+    size_t raw = (size_t) (W * 3 + 1) * H;
+    TEST_ASSERT_TRUE (stored > raw);
+    TEST_ASSERT_TRUE (stored < raw + raw / 100 + 128);
+    TEST_ASSERT_TRUE (none1 < stored);
+    TEST_ASSERT_TRUE (up1 < none1);
+    TEST_ASSERT_TRUE (up9 <= up1);
+}
+
+static void
+test_padded_stride (void)
+{
+    enum { STRIDE = W + 13 };
+    static guint8 padded[STRIDE * H];
+    make_image (1);
+    memset (padded, 0xAA, sizeof padded);
+    for (int y = 0; y < H; y++)
+        memcpy (padded + (size_t) y * STRIDE, image + (size_t) y * W, W);
+    round_trip (1, AG_PNG_FILTER_UP, 3, 4, STRIDE, padded);
+    round_trip (1, AG_PNG_FILTER_SUB, 3, 1, STRIDE, padded);
+}
+
+static void
+test_zlib_header_matches_level (void)
+{
+    static const struct { int level; guint8 flg; } cases[] = {
+        { 0, 0x01 }, { 1, 0x01 }, { 3, 0x5E }, { 6, 0x9C }, { 9, 0xDA },
+    };
+    guint8 px[16 * 4];
+    memset (px, 7, sizeof px);
+    for (size_t i = 0; i < G_N_ELEMENTS (cases); i++) {
+        AgPngOptions o = { cases[i].level, AG_PNG_FILTER_UP, 1 };
+        size_t len;
+        guint8 *png = ag_png_encode (px, 16, 4, 1, 16, &o, &len);
+        guint w, h;
+        int ch;
+        guint8 *out, flg;
+        TEST_ASSERT_TRUE (decode (png, len, &w, &h, &ch, &out, &flg));
+        TEST_ASSERT_EQUAL_HEX8 (cases[i].flg, flg);
+        g_free (out);
+        g_free (png);
+    }
+}
+
+static void
+test_write_matches_encode (void)
+{
+    make_image (3);
+    AgPngOptions o;
+    ag_png_options_defaults (&o);
+    TEST_ASSERT_EQUAL_INT (AG_PNG_LEVEL_DEFAULT, o.level);
+    TEST_ASSERT_EQUAL_INT (AG_PNG_FILTER_UP, o.filter);
+
+    size_t len;
+    guint8 *png = ag_png_encode (image, W, H, 3, W * 3, &o, &len);
+
+    char path[] = "/tmp/test_png_fast_XXXXXX";
+    int fd = mkstemp (path);
+    TEST_ASSERT_TRUE (fd >= 0);
+    close (fd);
+    TEST_ASSERT_EQUAL_INT (EXIT_SUCCESS,
+                           ag_png_write (path, image, W, H, 3, W * 3, &o));
+    gchar *file;
+    gsize file_len;
+    TEST_ASSERT_TRUE (g_file_get_contents (path, &file, &file_len, NULL));
+    TEST_ASSERT_EQUAL_size_t (len, file_len);
+    TEST_ASSERT_EQUAL_MEMORY (png, file, len);
+    unlink (path);
+    g_free (file);
+    g_free (png);
+
+    TEST_ASSERT_EQUAL_INT (EXIT_FAILURE,
+                           ag_png_write ("/no/such/dir/x.png", image, W, H, 3,
+                                         W * 3, &o));
+}
+
+static void
+test_bad_arguments_and_filter_names (void)
+{
+    AgPngOptions o;
+    ag_png_options_defaults (&o);
+    size_t len;
+    TEST_ASSERT_NULL (ag_png_encode (image, 0, 4, 1, 4, &o, &len));
+    TEST_ASSERT_NULL (ag_png_encode (image, 4, 4, 2, 8, &o, &len));
+    TEST_ASSERT_NULL (ag_png_encode (image, 4, 4, 3, 11, &o, &len));
+
+    guint8 one = 200;
+    guint8 *png = ag_png_encode (&one, 1, 1, 1, 1, &o, &len);
+    TEST_ASSERT_NOT_NULL (png);
+    g_free (png);
+
+    AgPngFilter f;
+    TEST_ASSERT_EQUAL_INT (0, ag_png_parse_filter ("sub", &f));
+    TEST_ASSERT_EQUAL_INT (AG_PNG_FILTER_SUB, f);
+    TEST_ASSERT_EQUAL_INT (0, ag_png_parse_filter ("none", &f));
+    TEST_ASSERT_EQUAL_INT (AG_PNG_FILTER_NONE, f);
+    TEST_ASSERT_EQUAL_INT (-1, ag_png_parse_filter ("paeth", &f));
+    TEST_ASSERT_EQUAL_STRING ("up", ag_png_filter_name (AG_PNG_FILTER_UP));
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_round_trip_every_filter_and_level);
+    RUN_TEST (test_bands_cost_little);
+    RUN_TEST (test_filters_and_levels_shrink_output);
+    RUN_TEST (test_padded_stride);
+    RUN_TEST (test_zlib_header_matches_level);
+    RUN_TEST (test_write_matches_encode);
+    RUN_TEST (test_bad_arguments_and_filter_names);
+    return UNITY_END ();
+}
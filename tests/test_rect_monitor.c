@@ -0,0 +1,312 @@
+/*
+ * test_rect_monitor.c — unit tests for the rectification drift monitor
+ *
+ * The right image is resampled from a smoothed-noise left image with a
+ * known disparity and a known vertical error (a shift, a roll or a
+ * zoom), so the measured median, percentile and fitted slopes can be
+ * compared with the truth.  Also checks the alarm hysteresis, the check
+ * schedule, the metrics series and the time per check.
+ *
+ * Build:  make test
+ * Run:    bin/test_rect_monitor [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "rect_monitor.h"
+#include "metrics.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define W 640
+#define H 400
+#define DISPARITY 20
+
+static uint8_t left[W * H];
+static uint8_t right[W * H];
+static float   field[W * H];
+
+void setUp (void) {}
+
+void tearDown (void)
+{
+    ag_metrics_reset ();
+}
+
+/* Noise blurred twice with a 3x3 box: texture with smooth gradients, so
+ * bilinear resampling stays faithful at sub-pixel offsets. */
+static void
+make_texture (guint32 seed)
+{
+    static float tmp[W * H];
+    for (int i = 0; i < W * H; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        field[i] = (float) (seed >> 24);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        memcpy (tmp, field, sizeof tmp);
+        for (int y = 1; y < H - 1; y++)
+            for (int x = 1; x < W - 1; x++) {
+                float s = 0.0f;
+                for (int j = -1; j <= 1; j++)
+                    for (int i = -1; i <= 1; i++)
+                        s += tmp[(y + j) * W + x + i];
+                field[y * W + x] = s / 9.0f;
+            }
+    }
+    /* Stretch the blurred contrast back to most of the 8-bit range. */
+    for (int i = 0; i < W * H; i++)
+        left[i] = (uint8_t) CLAMP (128.0f + 4.0f * (field[i] - 128.0f),
+                                   0.0f, 255.0f);
+    for (int i = 0; i < W * H; i++)
+        field[i] = left[i];
+}
+
+static float
+sample (double x, double y)
+{
+    if (x < 0 || y < 0 || x >= W - 1 || y >= H - 1)
+        return 0.0f;
+    int ix = (int) x, iy = (int) y;
+    double fx = x - ix, fy = y - iy;
+    const float *p = field + iy * W + ix;
+    return (float) ((1 - fy) * ((1 - fx) * p[0] + fx * p[1]) +
+                    fy * ((1 - fx) * p[W] + fx * p[W + 1]));
+}
+
+/* Right image: the left point (x, y) appears at (x - DISPARITY, y + dy)
+ * with dy = offset + rotation * (x - cx) + scale * (y - cy). */
+static void
+make_right (double offset, double rotation, double scale)
+{
+    double cx = 0.5 * (W - 1), cy = 0.5 * (H - 1);
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++) {
+            double lx = x + DISPARITY, ly = y;
+            /* dy varies slowly; two fixed-point steps are plenty. */
+            for (int k = 0; k < 2; k++)
+                ly = y - (offset + rotation * (lx - cx) + scale * (ly - cy));
+            right[y * W + x] = (uint8_t) lround (sample (lx, ly));
+        }
+}
+
+static void
+config (AgRectMonitorConfig *cfg)
+{
+    ag_rect_monitor_config_defaults (cfg);
+    cfg->min_disparity   = 0;
+    cfg->num_disparities = 64;
+}
+
+void test_aligned_pair_has_no_vertical_error (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    make_texture (1);
+    make_right (0.0, 0.0, 0.0);
+
+    AgRectCheck c;
+    ag_rect_measure (&cfg, left, right, W, H, W, &c);
+    TEST_ASSERT_TRUE (c.corners > 200);
+    TEST_ASSERT_TRUE (c.matches > 0.8 * c.corners);
+    TEST_ASSERT_DOUBLE_WITHIN (0.05, 0.0, c.median_dy);
+    TEST_ASSERT_TRUE (c.p95_abs_dy < 0.2);
+    TEST_ASSERT_TRUE (c.residual < 0.1);
+}
+
+void test_integer_and_subpixel_shift (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    make_texture (2);
+
+    AgRectCheck c;
+    make_right (2.0, 0.0, 0.0);
+    ag_rect_measure (&cfg, left, right, W, H, W, &c);
+    TEST_ASSERT_TRUE (c.matches > 150);
+    TEST_ASSERT_DOUBLE_WITHIN (0.05, 2.0, c.median_dy);
+    TEST_ASSERT_DOUBLE_WITHIN (0.1, 2.0, c.offset);
+
+    make_right (-1.4, 0.0, 0.0);
+    ag_rect_measure (&cfg, left, right, W, H, W, &c);
+    TEST_ASSERT_DOUBLE_WITHIN (0.2, -1.4, c.median_dy);
+    TEST_ASSERT_DOUBLE_WITHIN (0.2, -1.4, c.offset);
+}
+
+/* A shift beyond the band cannot be matched at all. */
+void test_shift_outside_band_not_matched (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    cfg.band = 2;
+    make_texture (3);
+    make_right (5.0, 0.0, 0.0);
+
+    AgRectCheck c;
+    ag_rect_measure (&cfg, left, right, W, H, W, &c);
+    TEST_ASSERT_TRUE (c.corners > 200);
+    TEST_ASSERT_TRUE (c.matches < 0.1 * c.corners);
+}
+
+void test_fit_recovers_roll_and_zoom (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    make_texture (4);
+
+    AgRectCheck c;
+    make_right (0.0, 0.004, 0.0);        /* +-1.3 px across the width */
+    ag_rect_measure (&cfg, left, right, W, H, W, &c);
+    TEST_ASSERT_DOUBLE_WITHIN (0.0008, 0.004, c.rotation);
+    TEST_ASSERT_DOUBLE_WITHIN (0.0008, 0.0, c.scale);
+    TEST_ASSERT_DOUBLE_WITHIN (0.1, 0.0, c.offset);
+    TEST_ASSERT_TRUE (c.p95_abs_dy > 0.9);
+
+    make_right (0.3, 0.0, -0.006);       /* +-1.2 px top to bottom */
+    ag_rect_measure (&cfg, left, right, W, H, W, &c);
+    TEST_ASSERT_DOUBLE_WITHIN (0.0008, 0.0, c.rotation);
+    TEST_ASSERT_DOUBLE_WITHIN (0.0012, -0.006, c.scale);
+    TEST_ASSERT_DOUBLE_WITHIN (0.1, 0.3, c.offset);
+}
+
+void test_flat_image_has_no_corners (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    memset (left, 90, sizeof left);
+    memset (right, 90, sizeof right);
+
+    AgRectMonitor *m = ag_rect_monitor_new (&cfg);
+    AgRectCheck c;
+    TEST_ASSERT_FALSE (ag_rect_monitor_check (m, left, right, W, H, W, &c));
+    TEST_ASSERT_EQUAL_INT (0, c.corners);
+    TEST_ASSERT_EQUAL_INT (0, c.matches);
+
+    AgRectMonitorState st;
+    ag_rect_monitor_state (m, &st);
+    TEST_ASSERT_EQUAL_UINT64 (1, st.checks);
+    TEST_ASSERT_FALSE (st.alarm);
+    ag_rect_monitor_free (m);
+}
+
+/* Raised once past the threshold, held until the smoothed error falls
+ * well below it. */
+void test_alarm_hysteresis (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    cfg.alarm_px = 0.5;
+    make_texture (5);
+    AgRectMonitor *m = ag_rect_monitor_new (&cfg);
+    AgRectMonitorState st;
+    AgRectCheck c;
+
+    make_right (0.0, 0.0, 0.0);
+    TEST_ASSERT_FALSE (ag_rect_monitor_check (m, left, right, W, H, W, &c));
+
+    make_right (1.5, 0.0, 0.0);
+    TEST_ASSERT_FALSE (ag_rect_monitor_check (m, left, right, W, H, W, &c));
+    TEST_ASSERT_TRUE (ag_rect_monitor_check (m, left, right, W, H, W, &c));
+    TEST_ASSERT_FALSE (ag_rect_monitor_check (m, left, right, W, H, W, &c));
+    ag_rect_monitor_state (m, &st);
+    TEST_ASSERT_TRUE (st.alarm);
+    TEST_ASSERT_EQUAL_UINT64 (1, st.alarms);
+
+    /* Back in line: 0.99 -> 0.69 -> 0.48 -> 0.34; clears below 0.4. */
+    make_right (0.0, 0.0, 0.0);
+    ag_rect_monitor_check (m, left, right, W, H, W, &c);
+    ag_rect_monitor_check (m, left, right, W, H, W, &c);
+    ag_rect_monitor_state (m, &st);
+    TEST_ASSERT_TRUE (st.alarm);
+    ag_rect_monitor_check (m, left, right, W, H, W, &c);
+    ag_rect_monitor_state (m, &st);
+    TEST_ASSERT_FALSE (st.alarm);
+    TEST_ASSERT_EQUAL_UINT64 (7, st.checks);
+    ag_rect_monitor_free (m);
+}
+
+void test_config_and_schedule (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    cfg.every = 10;
+    AgRectMonitor *m = ag_rect_monitor_new (&cfg);
+    TEST_ASSERT_NOT_NULL (m);
+    TEST_ASSERT_TRUE (ag_rect_monitor_due (m, 0));
+    TEST_ASSERT_FALSE (ag_rect_monitor_due (m, 9));
+    TEST_ASSERT_TRUE (ag_rect_monitor_due (m, 20));
+    ag_rect_monitor_free (m);
+
+    AgRectMonitorConfig bad = cfg;
+    bad.every = 0;
+    TEST_ASSERT_NULL (ag_rect_monitor_new (&bad));
+    bad = cfg;
+    bad.band = 0;
+    TEST_ASSERT_NULL (ag_rect_monitor_new (&bad));
+    bad = cfg;
+    bad.band = AG_RECT_MONITOR_BAND_MAX + 1;
+    TEST_ASSERT_NULL (ag_rect_monitor_new (&bad));
+    bad = cfg;
+    bad.max_corners = AG_RECT_MONITOR_CORNERS_MAX + 1;
+    TEST_ASSERT_NULL (ag_rect_monitor_new (&bad));
+    bad = cfg;
+    bad.alarm_px = 0.0;
+    TEST_ASSERT_NULL (ag_rect_monitor_new (&bad));
+}
+
+void test_metrics_published (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    make_texture (6);
+    make_right (1.5, 0.0, 0.0);
+    AgRectMonitor *m = ag_rect_monitor_new (&cfg);
+    ag_rect_monitor_enable_metrics (m);
+
+    AgRectCheck c;
+    TEST_ASSERT_TRUE (ag_rect_monitor_check (m, left, right, W, H, W, &c));
+    char *text = ag_metrics_render ();
+    TEST_ASSERT_NOT_NULL (strstr (text, "ag_rect_alarm 1"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "ag_rect_checks_total 1"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "ag_rect_alarms_total 1"));
+    TEST_ASSERT_NOT_NULL (strstr (text, "ag_rect_vertical_median_pixels 1."));
+    TEST_ASSERT_NOT_NULL (strstr (text, "ag_rect_check_seconds_count 1"));
+    g_free (text);
+    ag_rect_monitor_free (m);
+}
+
+/* The budget is 1 ms per check; allow slack for slow or loaded CI. */
+void test_check_time_bounded (void)
+{
+    AgRectMonitorConfig cfg;
+    config (&cfg);
+    cfg.num_disparities = 128;
+    make_texture (7);
+    make_right (0.5, 0.0, 0.0);
+
+    AgRectCheck c;
+    double best = 1e9;
+    for (int i = 0; i < 5; i++) {
+        ag_rect_measure (&cfg, left, right, W, H, W, &c);
+        best = MIN (best, c.check_ms);
+    }
+    TEST_ASSERT_TRUE (c.check_ms > 0.0);
+    TEST_ASSERT_TRUE_MESSAGE (best < 5.0, "check far over its 1 ms budget");
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_aligned_pair_has_no_vertical_error);
+    RUN_TEST (test_integer_and_subpixel_shift);
+    RUN_TEST (test_shift_outside_band_not_matched);
+    RUN_TEST (test_fit_recovers_roll_and_zoom);
+    RUN_TEST (test_flat_image_has_no_corners);
+    RUN_TEST (test_alarm_hysteresis);
+    RUN_TEST (test_config_and_schedule);
+    RUN_TEST (test_metrics_published);
+    RUN_TEST (test_check_time_bounded);
+    return UNITY_END ();
+}
@@ -258,6 +258,91 @@ void test_gray_sentinel_produces_black (void)
     ag_remap_table_free (t);
 }
 
+/* ------------------------------------------------------------------ */
+/*  Tests: remap_crop                                                  */
+/* ------------------------------------------------------------------ */
+
+void test_crop_rebases_offsets (void)
+{
+    /* 6x4 table, each pixel sampling one column to its right. */
+    uint32_t w = 6, h = 4;
+    AgRemapTable *t = make_test_table (w, h, 0);
+    for (uint32_t y = 0; y < h; y++)
+        for (uint32_t x = 0; x < w; x++)
+            t->offsets[y * w + x] = (x + 1 < w) ? y * w + x + 1
+                                                : AG_REMAP_SENTINEL;
+
+    AgRemapTable *c = ag_remap_table_crop (t, 2, 1, 3, 2);
+    TEST_ASSERT_NOT_NULL (c);
+    TEST_ASSERT_EQUAL_UINT32 (3, c->width);
+    TEST_ASSERT_EQUAL_UINT32 (2, c->height);
+
+    /* (2,1) -> source (3,1) -> ROI-relative (1,0). */
+    TEST_ASSERT_EQUAL_UINT32 (1, c->offsets[0]);
+    TEST_ASSERT_EQUAL_UINT32 (2, c->offsets[1]);
+    /* (4,1) samples (5,1): outside the 3-wide ROI. */
+    TEST_ASSERT_EQUAL_UINT32 (AG_REMAP_SENTINEL, c->offsets[2]);
+    TEST_ASSERT_EQUAL_UINT32 (3 + 1, c->offsets[3]);
+
+    ag_remap_table_free (c);
+    ag_remap_table_free (t);
+}
+
+void test_crop_matches_full_frame_remap (void)
+{
+    AgRemapTable *t = ag_remap_table_load (SAMPLE_LEFT);
+    TEST_ASSERT_NOT_NULL (t);
+
+    uint32_t x0 = 200, y0 = 300, cw = 640, ch = 240;
+    size_t n = (size_t) t->width * t->height;
+    guint8 *full_src = g_malloc (n);
+    for (size_t i = 0; i < n; i++)
+        full_src[i] = (guint8) ((i * 31) ^ (i >> 7));
+    guint8 *full_dst = g_malloc (n);
+    ag_remap_gray (t, full_src, full_dst);
+
+    /* The same window acquired as an ROI. */
+    guint8 *roi_src = g_malloc ((size_t) cw * ch);
+    for (uint32_t y = 0; y < ch; y++)
+        memcpy (roi_src + (size_t) y * cw,
+                full_src + (size_t) (y0 + y) * t->width + x0, cw);
+
+    AgRemapTable *c = ag_remap_table_crop (t, x0, y0, cw, ch);
+    TEST_ASSERT_NOT_NULL (c);
+    guint8 *roi_dst = g_malloc ((size_t) cw * ch);
+    ag_remap_gray (c, roi_src, roi_dst);
+
+    /* Every pixel whose source stayed inside the ROI matches. */
+    size_t matched = 0;
+    for (uint32_t y = 0; y < ch; y++) {
+        for (uint32_t x = 0; x < cw; x++) {
+            if (c->offsets[y * cw + x] == AG_REMAP_SENTINEL)
+                continue;
+            TEST_ASSERT_EQUAL_UINT8 (full_dst[(size_t) (y0 + y) * t->width + x0 + x],
+                                     roi_dst[(size_t) y * cw + x]);
+            matched++;
+        }
+    }
+    TEST_ASSERT_TRUE (matched > (size_t) cw * ch / 2);
+
+    g_free (full_src);
+    g_free (full_dst);
+    g_free (roi_src);
+    g_free (roi_dst);
+    ag_remap_table_free (c);
+    ag_remap_table_free (t);
+}
+
+void test_crop_out_of_bounds (void)
+{
+    AgRemapTable *t = make_test_table (8, 8, 0);
+    TEST_ASSERT_NULL (ag_remap_table_crop (t, 4, 0, 5, 8));
+    TEST_ASSERT_NULL (ag_remap_table_crop (t, 0, 7, 8, 2));
+    TEST_ASSERT_NULL (ag_remap_table_crop (t, 0, 0, 0, 8));
+    TEST_ASSERT_NULL (ag_remap_table_crop (NULL, 0, 0, 1, 1));
+    ag_remap_table_free (t);
+}
+
 /* ------------------------------------------------------------------ */
 /*  Main                                                               */
 /* ------------------------------------------------------------------ */
@@ -285,5 +370,10 @@ main (void)
     RUN_TEST (test_gray_identity);
     RUN_TEST (test_gray_sentinel_produces_black);
 
+    /* remap_crop */
+    RUN_TEST (test_crop_rebases_offsets);
+    RUN_TEST (test_crop_matches_full_frame_remap);
+    RUN_TEST (test_crop_out_of_bounds);
+
     return UNITY_END ();
 }
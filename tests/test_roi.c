@@ -0,0 +1,92 @@
+/*
+ * test_roi.c — unit tests for --roi parsing and validation
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_roi [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "roi.h"
+
+void setUp (void) {}
+void tearDown (void) {}
+
+void test_parse_rows_only (void)
+{
+    AgRoi r = { 9, 9, 9, 9 };
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_roi ("300:480", &r));
+    TEST_ASSERT_EQUAL_UINT (300, r.y);
+    TEST_ASSERT_EQUAL_UINT (480, r.height);
+    TEST_ASSERT_EQUAL_UINT (0, r.x);
+    TEST_ASSERT_EQUAL_UINT (0, r.width);
+    TEST_ASSERT_TRUE (ag_roi_active (&r));
+}
+
+void test_parse_rows_and_columns (void)
+{
+    AgRoi r;
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_roi ("100:200:64:1024", &r));
+    TEST_ASSERT_EQUAL_UINT (100, r.y);
+    TEST_ASSERT_EQUAL_UINT (200, r.height);
+    TEST_ASSERT_EQUAL_UINT (64, r.x);
+    TEST_ASSERT_EQUAL_UINT (1024, r.width);
+}
+
+void test_parse_rejects_bad_syntax (void)
+{
+    AgRoi r;
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_roi ("300", &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_roi ("300:480:10", &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_roi ("300:0", &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_roi ("-2:480", &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_roi ("300:48x", &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_roi ("0:2:0:0", &r));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_roi (":", &r));
+}
+
+void test_resolve_fills_width (void)
+{
+    AgRoi r = { 0, 300, 0, 480 };
+    TEST_ASSERT_NULL (ag_roi_resolve (&r, 1440, 1080));
+    TEST_ASSERT_EQUAL_UINT (1440, r.width);
+}
+
+void test_resolve_bounds_and_parity (void)
+{
+    AgRoi r = { 0, 600, 0, 482 };
+    TEST_ASSERT_NOT_NULL (ag_roi_resolve (&r, 1440, 1080));   /* 1082 > 1080 */
+
+    r = (AgRoi) { 0, 301, 0, 480 };
+    TEST_ASSERT_NOT_NULL (ag_roi_resolve (&r, 1440, 1080));   /* odd */
+
+    r = (AgRoi) { 1000, 0, 500, 2 };
+    TEST_ASSERT_NOT_NULL (ag_roi_resolve (&r, 1440, 1080));
+
+    r = (AgRoi) { 940, 0, 500, 1080 };
+    TEST_ASSERT_NULL (ag_roi_resolve (&r, 1440, 1080));
+
+    r = (AgRoi) { 2, 0, 0, 2 };
+    TEST_ASSERT_NOT_NULL (ag_roi_resolve (&r, 1440, 1080));   /* x w/o width */
+}
+
+void test_zero_roi_is_full_frame (void)
+{
+    AgRoi r = { 0 };
+    TEST_ASSERT_NULL (ag_roi_resolve (&r, 1440, 1080));
+    TEST_ASSERT_FALSE (ag_roi_active (&r));
+    TEST_ASSERT_FALSE (ag_roi_active (NULL));
+}
+
+int main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_parse_rows_only);
+    RUN_TEST (test_parse_rows_and_columns);
+    RUN_TEST (test_parse_rejects_bad_syntax);
+    RUN_TEST (test_resolve_fills_width);
+    RUN_TEST (test_resolve_bounds_and_parity);
+    RUN_TEST (test_zero_roi_is_full_frame);
+    return UNITY_END ();
+}
@@ -0,0 +1,86 @@
+/*
+ * test_startup.c — unit tests for the --startup-profile phase recorder
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_startup [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "startup.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void setUp (void) {}
+void tearDown (void) {}
+
+void test_disabled_records_nothing (void)
+{
+    ag_startup_begin (FALSE);
+    ag_startup_mark ("resolve device");
+    TEST_ASSERT_FALSE (ag_startup_active ());
+    TEST_ASSERT_EQUAL_UINT (0, ag_startup_n_phases ());
+}
+
+void test_phases_recorded_in_order (void)
+{
+    ag_startup_begin (TRUE);
+    g_usleep (2000);
+    ag_startup_mark ("resolve device");
+    ag_startup_mark ("open camera");
+    TEST_ASSERT_EQUAL_UINT (2, ag_startup_n_phases ());
+    TEST_ASSERT_TRUE (ag_startup_phase_ms (0) >= 1.5);
+    TEST_ASSERT_TRUE (ag_startup_phase_ms (1) >= 0.0);
+    TEST_ASSERT_EQUAL_DOUBLE (0.0, ag_startup_phase_ms (5));
+}
+
+void test_mark_capacity_is_bounded (void)
+{
+    ag_startup_begin (TRUE);
+    for (int i = 0; i < AG_STARTUP_MAX_PHASES + 8; i++)
+        ag_startup_mark ("phase");
+    TEST_ASSERT_EQUAL_UINT (AG_STARTUP_MAX_PHASES, ag_startup_n_phases ());
+}
+
+void test_report_prints_phases_and_stops (void)
+{
+    ag_startup_begin (TRUE);
+    ag_startup_mark ("resolve device");
+    ag_startup_mark ("first frame");
+
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream (&buf, &len);
+    ag_startup_report (f);
+    fclose (f);
+
+    TEST_ASSERT_NOT_NULL (strstr (buf, "Startup profile:"));
+    char *a = strstr (buf, "resolve device");
+    char *b = strstr (buf, "first frame");
+    TEST_ASSERT_NOT_NULL (a);
+    TEST_ASSERT_NOT_NULL (b);
+    TEST_ASSERT_TRUE (a < b);
+    TEST_ASSERT_NOT_NULL (strstr (buf, "total"));
+    free (buf);
+
+    /* A second report (e.g. the next frame) prints nothing. */
+    TEST_ASSERT_FALSE (ag_startup_active ());
+    buf = NULL;
+    f = open_memstream (&buf, &len);
+    ag_startup_report (f);
+    fclose (f);
+    TEST_ASSERT_EQUAL_size_t (0, len);
+    free (buf);
+}
+
+int main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_disabled_records_nothing);
+    RUN_TEST (test_phases_recorded_in_order);
+    RUN_TEST (test_mark_capacity_is_bounded);
+    RUN_TEST (test_report_prints_phases_and_stops);
+    return UNITY_END ();
+}
@@ -0,0 +1,101 @@
+/*
+ * test_stream_pool.c — unit tests for the Aravis stream buffer pool
+ *
+ * Verifies slot layout (aligned, disjoint, contiguous), size accounting,
+ * out-of-range slots, and that a pool too large to lock still works.
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_stream_pool [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "arena.h"
+#include "stream_pool.h"
+
+#include <stdint.h>
+#include <string.h>
+
+void setUp (void) {}
+void tearDown (void) {}
+
+void test_slots_are_aligned_and_contiguous (void)
+{
+    /* Odd payload: slots are padded to the arena alignment. */
+    AgStreamPool *pool = ag_stream_pool_new (4, 1000);
+    TEST_ASSERT_EQUAL_UINT (4, ag_stream_pool_n_buffers (pool));
+    TEST_ASSERT_EQUAL_UINT64 (1000, ag_stream_pool_payload (pool));
+    TEST_ASSERT_EQUAL_UINT64 (4 * AG_ARENA_ROUND (1000),
+                              ag_stream_pool_bytes (pool));
+
+    guint8 *s0 = ag_stream_pool_slot (pool, 0);
+    for (guint i = 0; i < 4; i++) {
+        guint8 *s = ag_stream_pool_slot (pool, i);
+        TEST_ASSERT_EQUAL_UINT64 (0, (uintptr_t) s % AG_ARENA_ALIGN);
+        TEST_ASSERT_EQUAL_PTR (s0 + i * AG_ARENA_ROUND (1000), s);
+        memset (s, (int) i + 1, 1000);
+    }
+
+    /* Writing one slot end to end leaves its neighbours intact. */
+    for (guint i = 0; i < 4; i++) {
+        guint8 *s = ag_stream_pool_slot (pool, i);
+        TEST_ASSERT_EQUAL_HEX8 (i + 1, s[0]);
+        TEST_ASSERT_EQUAL_HEX8 (i + 1, s[999]);
+    }
+
+    ag_stream_pool_free (pool);
+}
+
+void test_slot_out_of_range_is_null (void)
+{
+    AgStreamPool *pool = ag_stream_pool_new (2, 64);
+    TEST_ASSERT_NOT_NULL (ag_stream_pool_slot (pool, 1));
+    TEST_ASSERT_NULL (ag_stream_pool_slot (pool, 2));
+    ag_stream_pool_free (pool);
+}
+
+void test_full_frame_pool_is_usable (void)
+{
+    /* Default continuous depth at full DualBayer resolution (~50 MB):
+     * usually beyond RLIMIT_MEMLOCK, so this also exercises the
+     * unlocked fallback. */
+    size_t payload = 2880 * 1080;
+    AgStreamPool *pool = ag_stream_pool_new (16, payload);
+
+    const char *backing = ag_stream_pool_backing_name (pool);
+    TEST_ASSERT_TRUE (strcmp (backing, "heap") == 0 ||
+                      strcmp (backing, "thp") == 0 ||
+                      strcmp (backing, "hugetlb") == 0);
+
+    guint8 *last = ag_stream_pool_slot (pool, 15);
+    memset (last, 0x5A, payload);
+    TEST_ASSERT_EQUAL_HEX8 (0x5A, last[payload - 1]);
+
+    ag_stream_pool_free (pool);
+}
+
+void test_small_pool_locks (void)
+{
+    /* 2 x 4 KiB fits within any default RLIMIT_MEMLOCK (64 KiB+). */
+    AgStreamPool *pool = ag_stream_pool_new (2, 4096);
+    TEST_ASSERT_TRUE (ag_stream_pool_locked (pool));
+    ag_stream_pool_free (pool);
+}
+
+void test_free_null_is_noop (void)
+{
+    ag_stream_pool_free (NULL);
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_slots_are_aligned_and_contiguous);
+    RUN_TEST (test_slot_out_of_range_is_null);
+    RUN_TEST (test_full_frame_pool_is_usable);
+    RUN_TEST (test_small_pool_locks);
+    RUN_TEST (test_free_null_is_noop);
+    return UNITY_END ();
+}
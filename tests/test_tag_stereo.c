@@ -0,0 +1,212 @@
+/*
+ * test_tag_stereo.c — unit tests for stereo AprilTag triangulation
+ *
+ * Corners are synthesised by projecting a known tag pose through an
+ * ideal rectified pair with the sample calibration's geometry.
+ * No camera hardware or apriltag library is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_tag_stereo [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "tag_stereo.h"
+
+#include <math.h>
+#include <string.h>
+
+void setUp (void) {}
+void tearDown (void) {}
+
+/* calibration/sample_calibration: P1/P2 and baseline. */
+static const AgStereoRig RIG = {
+    .f          = 875.2384,
+    .cx_left    = 766.7586,
+    .cx_right   = 718.3862,
+    .cy         = 580.0368,
+    .baseline_m = 0.040677,
+};
+
+#define TAG_SIZE 0.05
+
+/* Rotation from axis (unit) and angle. */
+static void
+axis_angle (double ax, double ay, double az, double ang, double R[9])
+{
+    double c = cos (ang), s = sin (ang), v = 1.0 - c;
+    R[0] = ax*ax*v + c;    R[1] = ax*ay*v - az*s; R[2] = ax*az*v + ay*s;
+    R[3] = ay*ax*v + az*s; R[4] = ay*ay*v + c;    R[5] = ay*az*v - ax*s;
+    R[6] = az*ax*v - ay*s; R[7] = az*ay*v + ax*s; R[8] = az*az*v + c;
+}
+
+static void
+project_tag (const double R[9], const double t[3],
+             double pl[4][2], double pr[4][2])
+{
+    double h = TAG_SIZE / 2.0;
+    const double model[4][3] = {
+        { -h,  h, 0 }, { h,  h, 0 }, { h, -h, 0 }, { -h, -h, 0 },
+    };
+    for (int c = 0; c < 4; c++) {
+        double X[3];
+        for (int k = 0; k < 3; k++)
+            X[k] = R[3*k] * model[c][0] + R[3*k + 1] * model[c][1] + t[k];
+        pl[c][0] = RIG.f * X[0] / X[2] + RIG.cx_left;
+        pr[c][0] = RIG.f * (X[0] - RIG.baseline_m) / X[2] + RIG.cx_right;
+        pl[c][1] = pr[c][1] = RIG.f * X[1] / X[2] + RIG.cy;
+    }
+}
+
+void test_match_pairs_unique_ids (void)
+{
+    int left[]  = { 4, 7, 9 };
+    int right[] = { 9, 4, 12 };
+    guint pairs[8][2];
+    guint n = ag_tag_stereo_match (left, 3, right, 3, pairs, 8);
+    TEST_ASSERT_EQUAL_UINT (2, n);
+    TEST_ASSERT_EQUAL_UINT (0, pairs[0][0]);
+    TEST_ASSERT_EQUAL_UINT (1, pairs[0][1]);
+    TEST_ASSERT_EQUAL_UINT (2, pairs[1][0]);
+    TEST_ASSERT_EQUAL_UINT (0, pairs[1][1]);
+}
+
+void test_match_skips_ambiguous_ids (void)
+{
+    int left[]  = { 5, 5, 6 };
+    int right[] = { 5, 6, 6 };
+    guint pairs[8][2];
+    TEST_ASSERT_EQUAL_UINT (0, ag_tag_stereo_match (left, 3, right, 3,
+                                                    pairs, 8));
+}
+
+void test_rigid_fit_recovers_transform (void)
+{
+    double R_true[9], t_true[3] = { 0.1, -0.2, 0.9 };
+    double n = sqrt (1.0 + 4.0 + 9.0);
+    axis_angle (1 / n, 2 / n, 3 / n, 0.7, R_true);
+
+    const double model[5][3] = {
+        { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 1, 0.5 },
+    };
+    double obs[5][3];
+    for (int i = 0; i < 5; i++)
+        for (int k = 0; k < 3; k++)
+            obs[i][k] = R_true[3*k] * model[i][0] + R_true[3*k + 1] * model[i][1] +
+                        R_true[3*k + 2] * model[i][2] + t_true[k];
+
+    double R[9], t[3];
+    ag_rigid_fit (model, (const double (*)[3]) obs, 5, R, t);
+    for (int i = 0; i < 9; i++)
+        TEST_ASSERT_DOUBLE_WITHIN (1e-9, R_true[i], R[i]);
+    for (int k = 0; k < 3; k++)
+        TEST_ASSERT_DOUBLE_WITHIN (1e-9, t_true[k], t[k]);
+}
+
+void test_triangulate_recovers_pose (void)
+{
+    double R_true[9], t_true[3] = { 0.06, -0.03, 0.45 };
+    axis_angle (0.0, 1.0, 0.0, 0.4, R_true);   /* tag yawed 23 degrees */
+
+    double pl[4][2], pr[4][2];
+    project_tag (R_true, t_true, pl, pr);
+
+    AgTagStereoPose pose;
+    TEST_ASSERT_EQUAL_INT (0, ag_tag_triangulate (&RIG, pl, pr, TAG_SIZE,
+                                                  AG_TAG_STEREO_MAX_EPIPOLAR_PX,
+                                                  &pose));
+    for (int k = 0; k < 3; k++)
+        TEST_ASSERT_DOUBLE_WITHIN (1e-9, t_true[k], pose.t[k]);
+    for (int i = 0; i < 9; i++)
+        TEST_ASSERT_DOUBLE_WITHIN (1e-9, R_true[i], pose.R[i]);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, TAG_SIZE, pose.edge_m);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 0.0, pose.rms_m);
+    TEST_ASSERT_DOUBLE_WITHIN (1e-9, 0.0, pose.epipolar_px);
+    /* f * B / Z at the tag centre, to within the tag's own depth spread. */
+    TEST_ASSERT_DOUBLE_WITHIN (2.0, RIG.f * RIG.baseline_m / t_true[2],
+                               pose.disparity_px);
+}
+
+void test_triangulate_depth_error_small_with_corner_noise (void)
+{
+    double R_true[9], t_true[3] = { 0.0, 0.0, 1.0 };
+    axis_angle (1.0, 0.0, 0.0, 0.0, R_true);
+
+    double pl[4][2], pr[4][2];
+    project_tag (R_true, t_true, pl, pr);
+    /* Quarter-pixel corner error in opposite directions on each eye:
+     * +/-0.5 px of disparity, alternating around the tag. */
+    for (int c = 0; c < 4; c++) {
+        pl[c][0] += (c & 1) ? 0.25 : -0.25;
+        pr[c][0] -= (c & 1) ? 0.25 : -0.25;
+    }
+
+    AgTagStereoPose pose;
+    TEST_ASSERT_EQUAL_INT (0, ag_tag_triangulate (&RIG, pl, pr, TAG_SIZE,
+                                                  AG_TAG_STEREO_MAX_EPIPOLAR_PX,
+                                                  &pose));
+    /* dZ = Z^2 / (f B) * dd is ~14 mm per half pixel at 1 m for a
+     * single corner; the fit averages the four. */
+    TEST_ASSERT_DOUBLE_WITHIN (0.003, 1.0, pose.t[2]);
+}
+
+void test_triangulate_rejects_epipolar_violation (void)
+{
+    double R_true[9], t_true[3] = { 0.0, 0.0, 0.5 };
+    axis_angle (0.0, 0.0, 1.0, 0.0, R_true);
+    double pl[4][2], pr[4][2];
+    project_tag (R_true, t_true, pl, pr);
+    pr[2][1] += 10.0;
+
+    AgTagStereoPose pose;
+    TEST_ASSERT_EQUAL_INT (-1, ag_tag_triangulate (&RIG, pl, pr, TAG_SIZE,
+                                                   AG_TAG_STEREO_MAX_EPIPOLAR_PX,
+                                                   &pose));
+}
+
+void test_triangulate_rejects_negative_disparity (void)
+{
+    double R_true[9], t_true[3] = { 0.0, 0.0, 0.5 };
+    axis_angle (0.0, 0.0, 1.0, 0.0, R_true);
+    double pl[4][2], pr[4][2];
+    project_tag (R_true, t_true, pl, pr);
+
+    AgTagStereoPose pose;
+    /* Eyes swapped. */
+    TEST_ASSERT_EQUAL_INT (-1, ag_tag_triangulate (&RIG, pr, pl, TAG_SIZE,
+                                                   AG_TAG_STEREO_MAX_EPIPOLAR_PX,
+                                                   &pose));
+}
+
+void test_ndjson_record (void)
+{
+    AgTagStereoPose pose;
+    memset (&pose, 0, sizeof pose);
+    pose.R[0] = pose.R[4] = pose.R[8] = 1.0;
+    pose.t[2] = 0.5;
+
+    FILE *f = tmpfile ();
+    TEST_ASSERT_NOT_NULL (f);
+    ag_tag_stereo_write_ndjson (f, 7, 123456, 3, &pose);
+    rewind (f);
+    char line[1024] = { 0 };
+    TEST_ASSERT_NOT_NULL (fgets (line, sizeof line, f));
+    fclose (f);
+
+    TEST_ASSERT_EQUAL_INT (0, strncmp (line, "{\"frame\":7,\"time_us\":123456,\"id\":3,", 35));
+    TEST_ASSERT_NOT_NULL (strstr (line, "\"t\":[0.00000,0.00000,0.50000]"));
+    TEST_ASSERT_EQUAL_STRING ("}\n", line + strlen (line) - 2);
+}
+
+int main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_match_pairs_unique_ids);
+    RUN_TEST (test_match_skips_ambiguous_ids);
+    RUN_TEST (test_rigid_fit_recovers_transform);
+    RUN_TEST (test_triangulate_recovers_pose);
+    RUN_TEST (test_triangulate_depth_error_small_with_corner_noise);
+    RUN_TEST (test_triangulate_rejects_epipolar_violation);
+    RUN_TEST (test_triangulate_rejects_negative_disparity);
+    RUN_TEST (test_ndjson_record);
+    return UNITY_END ();
+}
@@ -0,0 +1,164 @@
+/*
+ * test_tag_track.c — unit tests for AprilTag tracking windows
+ *
+ * No camera hardware or apriltag library is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_tag_track [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "tag_track.h"
+
+#define W 1440
+#define H 1080
+
+void setUp (void) {}
+void tearDown (void) {}
+
+/* Axis-aligned square tag of side s with its top-left corner at (x, y). */
+static void
+square (double p[4][2], double x, double y, double s)
+{
+    p[0][0] = x;     p[0][1] = y + s;
+    p[1][0] = x + s; p[1][1] = y + s;
+    p[2][0] = x + s; p[2][1] = y;
+    p[3][0] = x;     p[3][1] = y;
+}
+
+void test_starts_with_full_search (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 10);
+    TEST_ASSERT_TRUE (ag_tag_tracker_want_full (&t));
+}
+
+void test_window_pads_and_contains_tag (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 10);
+    double c[1][4][2];
+    square (c[0], 501, 301, 100);
+    ag_tag_tracker_update (&t, TRUE, (const double (*)[4][2]) c, 1, W, H);
+
+    TEST_ASSERT_FALSE (ag_tag_tracker_want_full (&t));
+    TEST_ASSERT_EQUAL_UINT (1, t.n_windows);
+    const AgTagWindow *w = &t.windows[0];
+    /* Padding is half the tag size on each side; offsets stay even. */
+    TEST_ASSERT_EQUAL_UINT (450, w->x0);
+    TEST_ASSERT_EQUAL_UINT (250, w->y0);
+    TEST_ASSERT_EQUAL_UINT (651, w->x1);
+    TEST_ASSERT_EQUAL_UINT (451, w->y1);
+    TEST_ASSERT_EQUAL_UINT (0, w->x0 % 2);
+    TEST_ASSERT_EQUAL_UINT (0, w->y0 % 2);
+}
+
+void test_small_tag_gets_minimum_pad (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 10);
+    double c[1][4][2];
+    square (c[0], 200, 200, 10);
+    ag_tag_tracker_update (&t, TRUE, (const double (*)[4][2]) c, 1, W, H);
+    TEST_ASSERT_EQUAL_UINT (1, t.n_windows);
+    TEST_ASSERT_EQUAL_UINT (200 - AG_TAG_TRACK_PAD_MIN, t.windows[0].x0);
+    TEST_ASSERT_EQUAL_UINT (210 + AG_TAG_TRACK_PAD_MIN, t.windows[0].x1);
+}
+
+void test_window_clamped_to_frame (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 10);
+    double c[1][4][2];
+    square (c[0], 5, H - 60, 50);
+    ag_tag_tracker_update (&t, TRUE, (const double (*)[4][2]) c, 1, W, H);
+    TEST_ASSERT_EQUAL_UINT (1, t.n_windows);
+    TEST_ASSERT_EQUAL_UINT (0, t.windows[0].x0);
+    TEST_ASSERT_EQUAL_UINT (H, t.windows[0].y1);
+}
+
+void test_overlapping_windows_merge (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 10);
+    double c[3][4][2];
+    square (c[0], 100, 100, 60);
+    square (c[1], 180, 110, 60);     /* overlaps the first once padded */
+    square (c[2], 1000, 800, 60);    /* far away */
+    ag_tag_tracker_update (&t, TRUE, (const double (*)[4][2]) c, 3, W, H);
+
+    TEST_ASSERT_EQUAL_UINT (2, t.n_windows);
+    for (guint i = 0; i < t.n_windows; i++)
+        for (guint j = i + 1; j < t.n_windows; j++)
+            TEST_ASSERT_FALSE (t.windows[i].x0 < t.windows[j].x1 &&
+                               t.windows[j].x0 < t.windows[i].x1 &&
+                               t.windows[i].y0 < t.windows[j].y1 &&
+                               t.windows[j].y0 < t.windows[i].y1);
+}
+
+void test_full_search_every_refresh_frames (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 4);
+    double c[1][4][2];
+    square (c[0], 500, 500, 80);
+
+    int fulls = 0;
+    for (int frame = 0; frame < 12; frame++) {
+        gboolean full = ag_tag_tracker_want_full (&t);
+        if (full)
+            fulls++;
+        TEST_ASSERT_EQUAL (frame % 4 == 0, full);
+        ag_tag_tracker_update (&t, full, (const double (*)[4][2]) c, 1, W, H);
+    }
+    TEST_ASSERT_EQUAL_INT (3, fulls);
+}
+
+void test_lost_tags_force_full_search (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 10);
+    double c[1][4][2];
+    square (c[0], 500, 500, 80);
+    ag_tag_tracker_update (&t, TRUE, (const double (*)[4][2]) c, 1, W, H);
+    TEST_ASSERT_FALSE (ag_tag_tracker_want_full (&t));
+
+    ag_tag_tracker_update (&t, FALSE, NULL, 0, W, H);
+    TEST_ASSERT_TRUE (ag_tag_tracker_want_full (&t));
+}
+
+void test_refresh_zero_disables_tracking (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 0);
+    double c[1][4][2];
+    square (c[0], 500, 500, 80);
+    ag_tag_tracker_update (&t, TRUE, (const double (*)[4][2]) c, 1, W, H);
+    TEST_ASSERT_TRUE (ag_tag_tracker_want_full (&t));
+    TEST_ASSERT_EQUAL_UINT (0, t.n_windows);
+}
+
+void test_large_coverage_falls_back_to_full (void)
+{
+    AgTagTracker t;
+    ag_tag_tracker_init (&t, 10);
+    double c[1][4][2];
+    square (c[0], 300, 200, 700);    /* close-up: window ~ whole frame */
+    ag_tag_tracker_update (&t, TRUE, (const double (*)[4][2]) c, 1, W, H);
+    TEST_ASSERT_TRUE (ag_tag_tracker_want_full (&t));
+}
+
+int main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_starts_with_full_search);
+    RUN_TEST (test_window_pads_and_contains_tag);
+    RUN_TEST (test_small_tag_gets_minimum_pad);
+    RUN_TEST (test_window_clamped_to_frame);
+    RUN_TEST (test_overlapping_windows_merge);
+    RUN_TEST (test_full_search_every_refresh_frames);
+    RUN_TEST (test_lost_tags_force_full_search);
+    RUN_TEST (test_refresh_zero_disables_tracking);
+    RUN_TEST (test_large_coverage_falls_back_to_full);
+    return UNITY_END ();
+}
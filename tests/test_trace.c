@@ -0,0 +1,220 @@
+/*
+ * test_trace.c — unit tests for the per-stage latency probes
+ *
+ * Verifies that disabled probes record nothing, that the rolling
+ * summary reports per-stage p50/p99 and resets between calls, and that
+ * the Chrome trace export is valid JSON with one track per thread.
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_trace [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "../vendor/cJSON.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static char trace_path[64];
+
+void setUp (void)
+{
+    snprintf (trace_path, sizeof trace_path, "/tmp/test_trace_%d.json",
+              (int) getpid ());
+}
+
+void tearDown (void)
+{
+    ag_trace_stop ();
+    unlink (trace_path);
+}
+
+/* Load the exported trace and count "X" events, optionally per name. */
+static int
+count_events (const char *name, int *n_threads)
+{
+    gchar *contents = NULL;
+    gsize len = 0;
+    TEST_ASSERT_TRUE (g_file_get_contents (trace_path, &contents, &len, NULL));
+    cJSON *root = cJSON_ParseWithLength (contents, len);
+    g_free (contents);
+    TEST_ASSERT_NOT_NULL (root);
+
+    cJSON *events = cJSON_GetObjectItemCaseSensitive (root, "traceEvents");
+    TEST_ASSERT_TRUE (cJSON_IsArray (events));
+
+    int count = 0, threads = 0;
+    const cJSON *ev;
+    cJSON_ArrayForEach (ev, events) {
+        const char *ph = cJSON_GetObjectItemCaseSensitive (ev, "ph")->valuestring;
+        const char *nm = cJSON_GetObjectItemCaseSensitive (ev, "name")->valuestring;
+        if (strcmp (ph, "M") == 0 && strcmp (nm, "thread_name") == 0)
+            threads++;
+        if (strcmp (ph, "X") == 0 && (!name || strcmp (nm, name) == 0))
+            count++;
+    }
+    cJSON_Delete (root);
+    if (n_threads) *n_threads = threads;
+    return count;
+}
+
+/* ------------------------------------------------------------------ */
+
+void test_disabled_probe_records_nothing (void)
+{
+    uint64_t t = ag_trace_begin ();
+    TEST_ASSERT_EQUAL_UINT64 (0, t);
+    ag_trace_end (AG_STAGE_REMAP, t);
+
+    char buf[256];
+    ag_trace_start ("main");
+    ag_trace_summary (buf, sizeof buf);
+    TEST_ASSERT_EQUAL_STRING ("", buf);
+}
+
+void test_stage_names (void)
+{
+    TEST_ASSERT_EQUAL_STRING ("trigger", ag_trace_stage_name (AG_STAGE_TRIGGER));
+    TEST_ASSERT_EQUAL_STRING ("colorize", ag_trace_stage_name (AG_STAGE_COLORIZE));
+    TEST_ASSERT_EQUAL_STRING ("present", ag_trace_stage_name (AG_STAGE_PRESENT));
+    TEST_ASSERT_EQUAL_STRING ("unknown", ag_trace_stage_name (AG_STAGE_COUNT));
+}
+
+void test_summary_percentiles (void)
+{
+    ag_trace_start ("main");
+    uint64_t base = ag_trace_now_ns ();
+
+    /* 100 frames with one remap each, taking 1..100 ms. */
+    for (int i = 1; i <= 100; i++) {
+        ag_trace_set_frame ((guint64) i);
+        ag_trace_record (AG_STAGE_REMAP, base, base + (uint64_t) i * 1000000u);
+    }
+
+    char buf[256];
+    ag_trace_summary (buf, sizeof buf);
+    TEST_ASSERT_EQUAL_STRING ("remap 50.00/99.00", buf);
+
+    /* Summary window restarts after each call. */
+    ag_trace_summary (buf, sizeof buf);
+    TEST_ASSERT_EQUAL_STRING ("", buf);
+}
+
+void test_summary_sums_repeated_stage_per_frame (void)
+{
+    ag_trace_start ("main");
+    uint64_t base = ag_trace_now_ns ();
+
+    /* Two remaps per frame (gray + RGB), 1 ms + 3 ms. */
+    for (int f = 0; f < 10; f++) {
+        ag_trace_set_frame ((guint64) f);
+        ag_trace_record (AG_STAGE_REMAP, base, base + 1000000);
+        ag_trace_record (AG_STAGE_DISPARITY, base, base + 5000000);
+        ag_trace_record (AG_STAGE_REMAP, base, base + 3000000);
+    }
+
+    char buf[256];
+    ag_trace_summary (buf, sizeof buf);
+    TEST_ASSERT_EQUAL_STRING ("remap 4.00/4.00 disparity 5.00/5.00", buf);
+}
+
+void test_summary_orders_stages (void)
+{
+    ag_trace_start ("main");
+    uint64_t base = ag_trace_now_ns ();
+    ag_trace_record (AG_STAGE_PRESENT, base, base + 2000000);
+    ag_trace_record (AG_STAGE_POP, base, base + 4000000);
+
+    char buf[256];
+    ag_trace_summary (buf, sizeof buf);
+    TEST_ASSERT_EQUAL_STRING ("pop 4.00/4.00 present 2.00/2.00", buf);
+}
+
+void test_summary_truncates_safely (void)
+{
+    ag_trace_start ("main");
+    uint64_t base = ag_trace_now_ns ();
+    for (int s = 0; s < AG_STAGE_COUNT; s++)
+        ag_trace_record ((AgTraceStage) s, base, base + 1000000);
+
+    char buf[16];
+    ag_trace_summary (buf, sizeof buf);
+    TEST_ASSERT_EQUAL_UINT (sizeof buf - 1, strlen (buf));
+}
+
+void test_chrome_export_scoped_probes (void)
+{
+    ag_trace_start ("main");
+    for (int f = 0; f < 5; f++) {
+        ag_trace_set_frame ((guint64) f);
+        uint64_t t = ag_trace_begin ();
+        ag_trace_end (AG_STAGE_DEBAYER, t);
+        t = ag_trace_begin ();
+        ag_trace_end (AG_STAGE_UPLOAD, t);
+    }
+
+    TEST_ASSERT_EQUAL_INT (0, ag_trace_write_chrome (trace_path));
+    int threads = 0;
+    TEST_ASSERT_EQUAL_INT (10, count_events (NULL, &threads));
+    TEST_ASSERT_EQUAL_INT (5, count_events ("debayer", NULL));
+    TEST_ASSERT_EQUAL_INT (1, threads);
+}
+
+static gpointer
+worker (gpointer data)
+{
+    (void) data;
+    ag_trace_name_thread ("worker");
+    for (int i = 0; i < 3; i++) {
+        uint64_t t = ag_trace_begin ();
+        ag_trace_end (AG_STAGE_DISPARITY, t);
+    }
+    return NULL;
+}
+
+void test_chrome_export_one_track_per_thread (void)
+{
+    ag_trace_start ("main");
+    uint64_t t = ag_trace_begin ();
+    ag_trace_end (AG_STAGE_POP, t);
+
+    GThread *th = g_thread_new ("worker", worker, NULL);
+    g_thread_join (th);
+
+    TEST_ASSERT_EQUAL_INT (0, ag_trace_write_chrome (trace_path));
+    int threads = 0;
+    TEST_ASSERT_EQUAL_INT (4, count_events (NULL, &threads));
+    TEST_ASSERT_EQUAL_INT (3, count_events ("disparity", NULL));
+    TEST_ASSERT_EQUAL_INT (2, threads);
+}
+
+void test_ring_keeps_newest_events (void)
+{
+    ag_trace_start ("main");
+    uint64_t base = ag_trace_now_ns ();
+    for (int i = 0; i < 70000; i++)
+        ag_trace_record (AG_STAGE_EXTRACT, base, base + 1000);
+
+    TEST_ASSERT_EQUAL_INT (0, ag_trace_write_chrome (trace_path));
+    TEST_ASSERT_EQUAL_INT (65536, count_events ("extract", NULL));
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_disabled_probe_records_nothing);
+    RUN_TEST (test_stage_names);
+    RUN_TEST (test_summary_percentiles);
+    RUN_TEST (test_summary_sums_repeated_stage_per_frame);
+    RUN_TEST (test_summary_orders_stages);
+    RUN_TEST (test_summary_truncates_safely);
+    RUN_TEST (test_chrome_export_scoped_probes);
+    RUN_TEST (test_chrome_export_one_track_per_thread);
+    RUN_TEST (test_ring_keeps_newest_events);
+    return UNITY_END ();
+}
@@ -0,0 +1,147 @@
+/*
+ * test_transport.c — unit tests for the GigE stream transport options
+ *
+ * Verifies parsing of --packet-socket, --socket-buffer, --packet-resend
+ * and the timeout ranges, and the packet-socket platform decision.
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_transport [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "transport.h"
+
+#include <string.h>
+
+void setUp (void) {}
+void tearDown (void) {}
+
+void test_parse_packet_socket (void)
+{
+    AgPacketSocket m = AG_PACKET_SOCKET_OFF;
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_packet_socket ("auto", &m));
+    TEST_ASSERT_EQUAL_INT (AG_PACKET_SOCKET_AUTO, m);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_packet_socket ("on", &m));
+    TEST_ASSERT_EQUAL_INT (AG_PACKET_SOCKET_ON, m);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_packet_socket ("off", &m));
+    TEST_ASSERT_EQUAL_INT (AG_PACKET_SOCKET_OFF, m);
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_packet_socket ("yes", &m));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_packet_socket ("", &m));
+    TEST_ASSERT_EQUAL_STRING ("on", ag_packet_socket_name (AG_PACKET_SOCKET_ON));
+}
+
+void test_parse_resend_policy (void)
+{
+    AgResendPolicy p = AG_RESEND_DEFAULT;
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_resend_policy ("never", &p));
+    TEST_ASSERT_EQUAL_INT (AG_RESEND_NEVER, p);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_resend_policy ("always", &p));
+    TEST_ASSERT_EQUAL_INT (AG_RESEND_ALWAYS, p);
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_resend_policy ("sometimes", &p));
+}
+
+void test_parse_socket_buffer (void)
+{
+    guint v = 1;
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_socket_buffer ("auto", &v));
+    TEST_ASSERT_EQUAL_UINT (0, v);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_socket_buffer ("8M", &v));
+    TEST_ASSERT_EQUAL_UINT (8u * 1024 * 1024, v);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_socket_buffer ("512k", &v));
+    TEST_ASSERT_EQUAL_UINT (512u * 1024, v);
+    TEST_ASSERT_EQUAL_INT (0, ag_parse_socket_buffer ("100000", &v));
+    TEST_ASSERT_EQUAL_UINT (100000, v);
+
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_socket_buffer ("1K", &v));     /* < 64K  */
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_socket_buffer ("512M", &v));   /* > 256M */
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_socket_buffer ("8MB", &v));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_socket_buffer ("-8M", &v));
+    TEST_ASSERT_EQUAL_INT (-1, ag_parse_socket_buffer ("M", &v));
+}
+
+void test_format_socket_buffer_round_trips (void)
+{
+    static const char *const inputs[] = { "auto", "8M", "512K", "100000" };
+    for (size_t i = 0; i < sizeof inputs / sizeof inputs[0]; i++) {
+        guint v = 0;
+        char buf[16];
+        TEST_ASSERT_EQUAL_INT (0, ag_parse_socket_buffer (inputs[i], &v));
+        ag_format_socket_buffer (v, buf, sizeof buf);
+        TEST_ASSERT_EQUAL_STRING (inputs[i], buf);
+    }
+}
+
+void test_options_set_fills_only_given_fields (void)
+{
+    AgTransportOptions o = { .stream_buffers = 32 };
+    TEST_ASSERT_NULL (ag_transport_options_set (&o, "off", "4M", 5000, -1,
+                                                "never"));
+    TEST_ASSERT_EQUAL_UINT (32, o.stream_buffers);
+    TEST_ASSERT_EQUAL_INT (AG_PACKET_SOCKET_OFF, o.packet_socket);
+    TEST_ASSERT_EQUAL_UINT (4u * 1024 * 1024, o.socket_buffer);
+    TEST_ASSERT_EQUAL_UINT (5000, o.packet_timeout_us);
+    TEST_ASSERT_EQUAL_UINT (0, o.frame_retention_us);
+    TEST_ASSERT_EQUAL_INT (AG_RESEND_NEVER, o.packet_resend);
+
+    AgTransportOptions d = { 0 };
+    TEST_ASSERT_NULL (ag_transport_options_set (&d, NULL, NULL, -1, -1, NULL));
+    TEST_ASSERT_EQUAL_INT (AG_PACKET_SOCKET_AUTO, d.packet_socket);
+    TEST_ASSERT_EQUAL_INT (AG_RESEND_DEFAULT, d.packet_resend);
+}
+
+void test_options_set_reports_bad_option (void)
+{
+    AgTransportOptions o = { 0 };
+    const char *err;
+
+    err = ag_transport_options_set (&o, "maybe", NULL, -1, -1, NULL);
+    TEST_ASSERT_NOT_NULL (strstr (err, "--packet-socket"));
+    err = ag_transport_options_set (&o, NULL, "1", -1, -1, NULL);
+    TEST_ASSERT_NOT_NULL (strstr (err, "--socket-buffer"));
+    err = ag_transport_options_set (&o, NULL, NULL, 10, -1, NULL);
+    TEST_ASSERT_NOT_NULL (strstr (err, "--packet-timeout"));
+    err = ag_transport_options_set (&o, NULL, NULL, -1, 20000000, NULL);
+    TEST_ASSERT_NOT_NULL (strstr (err, "--frame-retention"));
+    err = ag_transport_options_set (&o, NULL, NULL, -1, -1, "often");
+    TEST_ASSERT_NOT_NULL (strstr (err, "--packet-resend"));
+}
+
+void test_resolve_off_never_uses_packet_socket (void)
+{
+    const char *reason = NULL;
+    TEST_ASSERT_FALSE (ag_packet_socket_resolve (AG_PACKET_SOCKET_OFF, &reason));
+    TEST_ASSERT_EQUAL_STRING ("disabled", reason);
+}
+
+void test_resolve_auto_follows_capability (void)
+{
+    const char *reason = NULL;
+    gboolean use = ag_packet_socket_resolve (AG_PACKET_SOCKET_AUTO, &reason);
+    TEST_ASSERT_NOT_NULL (reason);
+    TEST_ASSERT_EQUAL (ag_packet_socket_supported () &&
+                       ag_packet_socket_permitted (), use);
+}
+
+void test_resolve_on_keeps_request_on_linux (void)
+{
+    gboolean use = ag_packet_socket_resolve (AG_PACKET_SOCKET_ON, NULL);
+    TEST_ASSERT_EQUAL (ag_packet_socket_supported (), use);
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_parse_packet_socket);
+    RUN_TEST (test_parse_resend_policy);
+    RUN_TEST (test_parse_socket_buffer);
+    RUN_TEST (test_format_socket_buffer_round_trips);
+    RUN_TEST (test_options_set_fills_only_given_fields);
+    RUN_TEST (test_options_set_reports_bad_option);
+    RUN_TEST (test_resolve_off_never_uses_packet_socket);
+    RUN_TEST (test_resolve_auto_follows_capability);
+    RUN_TEST (test_resolve_on_keeps_request_on_linux);
+    return UNITY_END ();
+}
@@ -0,0 +1,161 @@
+/*
+ * test_transport_profile.c — unit tests for tune-transport profiles
+ *
+ * Verifies sweep-list parsing, best-point selection (drop-free first,
+ * ties by resends then delay), profile path sanitizing, and the JSON
+ * save/load round trip.
+ *
+ * No camera hardware is required.
+ *
+ * Build:  make test
+ * Run:    bin/test_transport_profile [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "transport_profile.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+static gchar *tmpdir = NULL;
+
+void setUp (void)
+{
+    tmpdir = g_dir_make_tmp ("ag_tprof_XXXXXX", NULL);
+}
+
+void tearDown (void)
+{
+    if (tmpdir) {
+        gchar *path = ag_transport_profile_path (tmpdir, "CAM1");
+        g_remove (path);
+        g_free (path);
+        gchar *d = g_build_filename (tmpdir, "ag-cam-tools", "transport", NULL);
+        g_rmdir (d);
+        g_free (d);
+        d = g_build_filename (tmpdir, "ag-cam-tools", NULL);
+        g_rmdir (d);
+        g_free (d);
+        g_rmdir (tmpdir);
+        g_free (tmpdir);
+        tmpdir = NULL;
+    }
+}
+
+static AgTunePoint
+point (guint size, guint delay, guint64 completed, guint64 failed,
+       guint64 resent, guint64 missing)
+{
+    AgTunePoint p = {
+        .packet_size = size, .packet_delay_ns = delay,
+        .payload = 1000000, .completed = completed, .failed = failed,
+        .resent = resent, .missing = missing, .elapsed_s = 1.0,
+    };
+    return p;
+}
+
+void test_parse_list (void)
+{
+    guint v[4];
+    TEST_ASSERT_EQUAL_INT (3, ag_tune_parse_list ("1500,8000,9000", 576, 9000, v, 4));
+    TEST_ASSERT_EQUAL_UINT (1500, v[0]);
+    TEST_ASSERT_EQUAL_UINT (9000, v[2]);
+    TEST_ASSERT_EQUAL_INT (1, ag_tune_parse_list ("0", 0, 100, v, 4));
+
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_parse_list ("", 0, 100, v, 4));
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_parse_list ("1,,2", 0, 100, v, 4));
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_parse_list ("9001", 576, 9000, v, 4));
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_parse_list ("-1", 0, 100, v, 4));
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_parse_list ("1x", 0, 100, v, 4));
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_parse_list ("1,2,3,4,5", 0, 100, v, 4));
+}
+
+void test_pick_best_prefers_drop_free (void)
+{
+    AgTunePoint pts[] = {
+        point (9000, 0,     60, 2, 10, 40),   /* fastest but lossy */
+        point (8000, 0,     50, 0,  5,  0),
+        point (1500, 0,     30, 0,  0,  0),
+    };
+    TEST_ASSERT_EQUAL_INT (1, ag_tune_pick_best (pts, 3));
+    TEST_ASSERT_EQUAL_DOUBLE (50.0, ag_tune_point_mb_per_s (&pts[1]));
+}
+
+void test_pick_best_tie_breaks (void)
+{
+    AgTunePoint pts[] = {
+        point (8000, 5000, 100, 0, 20, 0),
+        point (9000, 2000, 100, 0,  3, 0),    /* fewer resends wins   */
+        point (9000,    0, 100, 0,  3, 0),    /* then smaller delay   */
+        point (6000,    0,  90, 0,  0, 0),    /* 10% slower: no tie   */
+    };
+    TEST_ASSERT_EQUAL_INT (2, ag_tune_pick_best (pts, 4));
+}
+
+void test_pick_best_none (void)
+{
+    AgTunePoint pts[] = {
+        point (9000, 0, 60, 0, 0, 1),
+        point (8000, 0,  0, 0, 0, 0),         /* nothing delivered */
+    };
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_pick_best (pts, 2));
+    TEST_ASSERT_EQUAL_INT (-1, ag_tune_pick_best (pts, 0));
+}
+
+void test_profile_path (void)
+{
+    gchar *p = ag_transport_profile_path ("/cfg", "AB-12.x");
+    TEST_ASSERT_EQUAL_STRING ("/cfg/ag-cam-tools/transport/AB-12.x.json", p);
+    g_free (p);
+
+    p = ag_transport_profile_path ("/cfg", "../a b");
+    TEST_ASSERT_EQUAL_STRING ("/cfg/ag-cam-tools/transport/_._a_b.json", p);
+    g_free (p);
+}
+
+void test_json_rejects_bad_profiles (void)
+{
+    AgTransportProfile prof;
+    TEST_ASSERT_EQUAL_INT (-1, ag_transport_profile_from_json ("not json", &prof));
+    TEST_ASSERT_EQUAL_INT (-1, ag_transport_profile_from_json (
+        "{\"packet_size\": 100, \"packet_delay_ns\": 0}", &prof));
+    TEST_ASSERT_EQUAL_INT (-1, ag_transport_profile_from_json (
+        "{\"packet_size\": 8000}", &prof));
+    TEST_ASSERT_EQUAL_INT (0, ag_transport_profile_from_json (
+        "{\"packet_size\": 8000, \"packet_delay_ns\": 2000}", &prof));
+    TEST_ASSERT_EQUAL_UINT (8000, prof.packet_size);
+    TEST_ASSERT_EQUAL_UINT (2000, prof.packet_delay_ns);
+}
+
+void test_save_load_remove (void)
+{
+    TEST_ASSERT_NOT_NULL (tmpdir);
+    gchar *path = ag_transport_profile_path (tmpdir, "CAM1");
+
+    AgTransportProfile in = { 8000, 5000, 112.5, 48.0 }, out;
+    TEST_ASSERT_EQUAL_INT (-1, ag_transport_profile_load (path, &out));
+    TEST_ASSERT_EQUAL_INT (0, ag_transport_profile_save (path, "CAM1", &in));
+    TEST_ASSERT_EQUAL_INT (0, ag_transport_profile_load (path, &out));
+    TEST_ASSERT_EQUAL_UINT (8000, out.packet_size);
+    TEST_ASSERT_EQUAL_UINT (5000, out.packet_delay_ns);
+    TEST_ASSERT_EQUAL_DOUBLE (112.5, out.mb_per_s);
+    TEST_ASSERT_EQUAL_DOUBLE (48.0, out.fps);
+
+    TEST_ASSERT_EQUAL_INT (0, ag_transport_profile_remove (path));
+    TEST_ASSERT_EQUAL_INT (-1, ag_transport_profile_load (path, &out));
+    TEST_ASSERT_EQUAL_INT (0, ag_transport_profile_remove (path));
+    g_free (path);
+}
+
+int main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_parse_list);
+    RUN_TEST (test_pick_best_prefers_drop_free);
+    RUN_TEST (test_pick_best_tie_breaks);
+    RUN_TEST (test_pick_best_none);
+    RUN_TEST (test_profile_path);
+    RUN_TEST (test_json_rejects_bad_profiles);
+    RUN_TEST (test_save_load_remove);
+    return UNITY_END ();
+}
@@ -0,0 +1,402 @@
+/*
+ * test_video_out.c — unit tests for the Y4M / MJPEG video sink
+ *
+ * Streams are written to temporary files and parsed back byte for byte:
+ * the Y4M stream header and frame rate ratio, side-by-side composition
+ * from padded rows, 4:2:0 conversion of known colours, odd sizes, the
+ * split layout's file names, MJPEG part framing, the timestamp sidecar,
+ * geometry checks, a reader closing the pipe, and option parsing.
+ *
+ * Build:  make test
+ * Run:    bin/test_video_out [-v]
+ */
+
+#include "../vendor/unity/unity.h"
+#include "video_out.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char tmpdir[256];
+
+void setUp (void)
+{
+    snprintf (tmpdir, sizeof (tmpdir), "/tmp/test_video_out_XXXXXX");
+    TEST_ASSERT_NOT_NULL (mkdtemp (tmpdir));
+}
+
+void tearDown (void)
+{
+    char cmd[512];
+    snprintf (cmd, sizeof (cmd), "rm -rf %s", tmpdir);
+    int rc = system (cmd);
+    (void) rc;
+}
+
+static char *
+tmp_path (const char *name)
+{
+    return g_build_filename (tmpdir, name, NULL);
+}
+
+static gchar *
+slurp (const char *path, gsize *len)
+{
+    gchar *data = NULL;
+    if (!g_file_get_contents (path, &data, len, NULL))
+        return NULL;
+    return data;
+}
+
+/* Gray eyes with PAD junk bytes at the end of every row. */
+#define GW 6
+#define GH 4
+#define PAD 5
+static guint8 gray_eye[2][GH][GW + PAD];
+
+static void
+make_gray (guint8 seed)
+{
+    memset (gray_eye, 0xEE, sizeof gray_eye);
+    for (int e = 0; e < 2; e++)
+        for (int y = 0; y < GH; y++)
+            for (int x = 0; x < GW; x++)
+                gray_eye[e][y][x] = (guint8) (seed + 100 * e + 10 * y + x);
+}
+
+static AgVideoFrame
+gray_frame (guint64 id)
+{
+    AgVideoFrame f = {
+        .eye = { &gray_eye[0][0][0], &gray_eye[1][0][0] },
+        .channels = 1, .width = GW, .height = GH, .stride = GW + PAD,
+        .frame_id = id, .timestamp_ns = 1000 * id, .system_ns = 2000 * id,
+    };
+    return f;
+}
+
+static void
+test_y4m_gray_side_by_side (void)
+{
+    char *path = tmp_path ("sbs.y4m");
+    AgVideoOptions o;
+    ag_video_options_defaults (&o);
+    o.fps = 10.0;
+    AgVideoOut *vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_NOT_NULL (vo);
+    for (int i = 0; i < 3; i++) {
+        make_gray ((guint8) i);
+        AgVideoFrame f = gray_frame ((guint64) i);
+        TEST_ASSERT_EQUAL_INT (0, ag_video_out_write (vo, &f));
+    }
+    TEST_ASSERT_EQUAL_UINT64 (3, ag_video_out_frames (vo));
+    guint64 bytes = ag_video_out_bytes (vo);
+    ag_video_out_close (vo);
+
+    gsize len;
+    gchar *data = slurp (path, &len);
+    TEST_ASSERT_NOT_NULL_MESSAGE (data, path);
+    const char *hdr = "YUV4MPEG2 W12 H4 F10:1 Ip A1:1 Cmono XCOLORRANGE=FULL\n";
+    size_t hl = strlen (hdr);
+    TEST_ASSERT_EQUAL_size_t (hl + 3 * (6 + 2 * GW * GH), len);
+    TEST_ASSERT_EQUAL_UINT64 (len, bytes);
+    TEST_ASSERT_EQUAL_MEMORY (hdr, data, hl);
+
+    const guint8 *p = (const guint8 *) data + hl;
+    for (int i = 0; i < 3; i++) {
+        make_gray ((guint8) i);
+        TEST_ASSERT_EQUAL_MEMORY ("FRAME\n", p, 6);
+        p += 6;
+        for (int y = 0; y < GH; y++) {
+            TEST_ASSERT_EQUAL_MEMORY (gray_eye[0][y], p, GW);
+            TEST_ASSERT_EQUAL_MEMORY (gray_eye[1][y], p + GW, GW);
+            p += 2 * GW;
+        }
+    }
+    g_free (data);
+    g_free (path);
+}
+
+static void
+test_y4m_420_from_rgb (void)
+{
+    /* Per eye 4x2: left mid gray, right pure red. */
+    guint8 left[2][4 * 3], right[2][4 * 3];
+    for (int y = 0; y < 2; y++)
+        for (int x = 0; x < 4; x++) {
+            left[y][3 * x] = left[y][3 * x + 1] = left[y][3 * x + 2] = 100;
+            right[y][3 * x] = 255;
+            right[y][3 * x + 1] = right[y][3 * x + 2] = 0;
+        }
+
+    char *path = tmp_path ("rgb.y4m");
+    AgVideoOptions o;
+    ag_video_options_defaults (&o);
+    o.color = AG_VIDEO_YUV420;
+    o.fps = 29.97;
+    AgVideoOut *vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_NOT_NULL (vo);
+    AgVideoFrame f = {
+        .eye = { &left[0][0], &right[0][0] }, .channels = 3,
+        .width = 4, .height = 2, .stride = 12,
+    };
+    TEST_ASSERT_EQUAL_INT (0, ag_video_out_write (vo, &f));
+    ag_video_out_close (vo);
+
+    gsize len;
+    gchar *data = slurp (path, &len);
+    TEST_ASSERT_NOT_NULL_MESSAGE (data, path);
+    const char *hdr = "YUV4MPEG2 W8 H2 F2997:100 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+    size_t hl = strlen (hdr);
+    TEST_ASSERT_EQUAL_size_t (hl + 6 + 16 + 4 + 4, len);
+    TEST_ASSERT_EQUAL_MEMORY (hdr, data, hl);
+
+    static const guint8 y[16] = { 100, 100, 100, 100, 76, 76, 76, 76,
+                                  100, 100, 100, 100, 76, 76, 76, 76 };
+    static const guint8 cb[4] = { 128, 128, 85, 85 };
+    static const guint8 cr[4] = { 128, 128, 255, 255 };
+    const guint8 *p = (const guint8 *) data + hl + 6;
+    TEST_ASSERT_EQUAL_HEX8_ARRAY (y, p, 16);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY (cb, p + 16, 4);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY (cr, p + 20, 4);
+    g_free (data);
+    g_free (path);
+}
+
+static void
+test_odd_sizes_and_geometry_checks (void)
+{
+    /* One eye of 5x3 at 4:2:0: chroma planes are 3x2, gray input keeps
+     * them neutral. */
+    static guint8 eye[3][5];
+    memset (eye, 42, sizeof eye);
+    AgVideoFrame f = {
+        .eye = { &eye[0][0], &eye[0][0] }, .channels = 1,
+        .width = 5, .height = 3, .stride = 5,
+    };
+    char *path = tmp_path ("odd.y4m");
+    AgVideoOptions o;
+    ag_video_options_defaults (&o);
+    o.color  = AG_VIDEO_YUV420;
+    o.layout = AG_VIDEO_RIGHT;
+    AgVideoOut *vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_NOT_NULL (vo);
+    TEST_ASSERT_EQUAL_INT (0, ag_video_out_write (vo, &f));
+
+    /* The first frame fixes the geometry. */
+    AgVideoFrame bigger = f;
+    bigger.height = 2;
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_out_write (vo, &bigger));
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_out_write (vo, &f));
+    TEST_ASSERT_EQUAL_UINT64 (1, ag_video_out_frames (vo));
+    ag_video_out_close (vo);
+
+    gsize len;
+    gchar *data = slurp (path, &len);
+    TEST_ASSERT_NOT_NULL_MESSAGE (data, path);
+    const char *body = strchr (data, '\n') + 1 + 6;
+    TEST_ASSERT_EQUAL_size_t ((size_t) (body - data) + 15 + 2 * 6, len);
+    TEST_ASSERT_EQUAL_HEX8 (42, (guint8) body[14]);
+    TEST_ASSERT_EQUAL_HEX8 (128, (guint8) body[15]);
+    TEST_ASSERT_EQUAL_HEX8 (128, (guint8) body[26]);
+    g_free (data);
+
+    /* Side by side, 4:2:0 chroma would straddle the eyes. */
+    o.layout = AG_VIDEO_SIDE_BY_SIDE;
+    vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_out_write (vo, &f));
+    ag_video_out_close (vo);
+
+    /* Bad first frame. */
+    o.color = AG_VIDEO_GRAY;
+    vo = ag_video_out_open (path, &o);
+    f.channels = 2;
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_out_write (vo, &f));
+    ag_video_out_close (vo);
+    g_free (path);
+}
+
+static void
+test_split_layout_and_sidecar (void)
+{
+    char *path = tmp_path ("rec.y4m");
+    char *ts = tmp_path ("rec.csv");
+    AgVideoOptions o;
+    ag_video_options_defaults (&o);
+    o.layout = AG_VIDEO_SPLIT;
+    o.timestamps_path = ts;
+    AgVideoOut *vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_NOT_NULL (vo);
+    make_gray (7);
+    for (guint64 id = 40; id < 42; id++) {
+        AgVideoFrame f = gray_frame (id);
+        TEST_ASSERT_EQUAL_INT (0, ag_video_out_write (vo, &f));
+    }
+    ag_video_out_close (vo);
+
+    for (int e = 0; e < 2; e++) {
+        char *p = tmp_path (e ? "rec_right.y4m" : "rec_left.y4m");
+        gsize len;
+        gchar *data = slurp (p, &len);
+        TEST_ASSERT_NOT_NULL_MESSAGE (data, p);
+        TEST_ASSERT_TRUE (g_str_has_prefix (data, "YUV4MPEG2 W6 H4 F30:1 "));
+        const guint8 *px = (const guint8 *) strchr (data, '\n') + 1 + 6;
+        for (int y = 0; y < GH; y++)
+            TEST_ASSERT_EQUAL_MEMORY (gray_eye[e][y], px + y * GW, GW);
+        g_free (data);
+        g_free (p);
+    }
+    TEST_ASSERT_FALSE (g_file_test (path, G_FILE_TEST_EXISTS));
+
+    gsize len;
+    gchar *csv = slurp (ts, &len);
+    TEST_ASSERT_NOT_NULL_MESSAGE (csv, ts);
+    TEST_ASSERT_EQUAL_STRING ("frame,frame_id,timestamp_ns,system_ns\n"
+                              "0,40,40000,80000\n"
+                              "1,41,41000,82000\n", csv);
+    g_free (csv);
+
+    /* No extension: the eye is appended. */
+    g_free (path);
+    path = tmp_path ("raw");
+    vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_NOT_NULL (vo);
+    ag_video_out_close (vo);
+    char *p = tmp_path ("raw_left");
+    TEST_ASSERT_TRUE (g_file_test (p, G_FILE_TEST_EXISTS));
+    g_free (p);
+
+    /* Split cannot share stdout. */
+    TEST_ASSERT_NULL (ag_video_out_open ("-", &o));
+    g_free (path);
+    g_free (ts);
+}
+
+static void
+test_mjpeg_parts (void)
+{
+    char *path = tmp_path ("rec.mjpeg");
+    AgVideoOptions o;
+    ag_video_options_defaults (&o);
+    o.format = AG_VIDEO_MJPEG;
+    o.color  = AG_VIDEO_YUV420;
+    AgVideoOut *vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_NOT_NULL (vo);
+    make_gray (3);
+    for (guint64 id = 0; id < 2; id++) {
+        AgVideoFrame f = gray_frame (id);
+        TEST_ASSERT_EQUAL_INT (0, ag_video_out_write (vo, &f));
+    }
+    ag_video_out_close (vo);
+
+    gsize len;
+    gchar *data = slurp (path, &len);
+    TEST_ASSERT_NOT_NULL_MESSAGE (data, path);
+    size_t pos = 0;
+    int parts = 0;
+    while (pos < len) {
+        const char *part = data + pos;
+        TEST_ASSERT_TRUE (g_str_has_prefix (part, "--agcamframe\r\n"
+                                                  "Content-Type: image/jpeg\r\n"
+                                                  "Content-Length: "));
+        const char *cl = strstr (part, "Content-Length: ") + 16;
+        size_t n = strtoul (cl, NULL, 10);
+        const guint8 *jpeg = (const guint8 *) strstr (cl, "\r\n\r\n") + 4;
+        TEST_ASSERT_EQUAL_HEX8 (0xFF, jpeg[0]);
+        TEST_ASSERT_EQUAL_HEX8 (0xD8, jpeg[1]);
+        TEST_ASSERT_EQUAL_HEX8 (0xD9, jpeg[n - 1]);
+        TEST_ASSERT_EQUAL_MEMORY ("\r\n", jpeg + n, 2);
+        pos = (size_t) ((const gchar *) jpeg - data) + n + 2;
+        parts++;
+    }
+    TEST_ASSERT_EQUAL_size_t (len, pos);
+    TEST_ASSERT_EQUAL_INT (2, parts);
+    g_free (data);
+    g_free (path);
+}
+
+static void
+test_closed_pipe_is_an_error (void)
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT (0, pipe (fds));
+    char *path = g_strdup_printf ("/dev/fd/%d", fds[1]);
+    AgVideoOptions o;
+    ag_video_options_defaults (&o);
+    AgVideoOut *vo = ag_video_out_open (path, &o);
+    TEST_ASSERT_NOT_NULL (vo);
+    close (fds[1]);
+    close (fds[0]);
+
+    /* SIGPIPE is ignored, so this returns instead of killing us. */
+    make_gray (0);
+    AgVideoFrame f = gray_frame (0);
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_out_write (vo, &f));
+    TEST_ASSERT_EQUAL_UINT64 (0, ag_video_out_frames (vo));
+    ag_video_out_close (vo);
+    g_free (path);
+
+    TEST_ASSERT_NULL (ag_video_out_open ("/no/such/dir/x.y4m", &o));
+}
+
+static void
+test_parse_names (void)
+{
+    AgVideoFormat fmt;
+    AgVideoColor color;
+    AgVideoLayout layout;
+    TEST_ASSERT_EQUAL_INT (0, ag_video_parse_format ("mjpeg", &fmt));
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_MJPEG, fmt);
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_parse_format ("h264", &fmt));
+    TEST_ASSERT_EQUAL_INT (0, ag_video_parse_color ("420", &color));
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_YUV420, color);
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_parse_color ("444", &color));
+    TEST_ASSERT_EQUAL_INT (0, ag_video_parse_layout ("split", &layout));
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_SPLIT, layout);
+    TEST_ASSERT_EQUAL_INT (0, ag_video_parse_layout ("sbs", &layout));
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_SIDE_BY_SIDE, layout);
+    TEST_ASSERT_EQUAL_INT (-1, ag_video_parse_layout ("top", &layout));
+}
+
+static void
+test_options_set (void)
+{
+    AgVideoOptions o;
+    ag_video_options_defaults (&o);
+    TEST_ASSERT_NULL (ag_video_options_set (&o, NULL, NULL, NULL, -1));
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_Y4M, o.format);
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_GRAY, o.color);
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_SIDE_BY_SIDE, o.layout);
+    TEST_ASSERT_EQUAL_INT (90, o.jpeg_quality);
+
+    /* Quality only applies to MJPEG. */
+    TEST_ASSERT_NOT_NULL (ag_video_options_set (&o, NULL, NULL, NULL, 75));
+    TEST_ASSERT_NULL (ag_video_options_set (&o, "mjpeg", "420", "left", 75));
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_MJPEG, o.format);
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_YUV420, o.color);
+    TEST_ASSERT_EQUAL_INT (AG_VIDEO_LEFT, o.layout);
+    TEST_ASSERT_EQUAL_INT (75, o.jpeg_quality);
+
+    TEST_ASSERT_NOT_NULL (ag_video_options_set (&o, NULL, NULL, NULL, 0));
+    TEST_ASSERT_NOT_NULL (ag_video_options_set (&o, NULL, NULL, NULL, 101));
+    TEST_ASSERT_NOT_NULL (ag_video_options_set (&o, "avi", NULL, NULL, -1));
+    TEST_ASSERT_NOT_NULL (ag_video_options_set (&o, NULL, "rgb", NULL, -1));
+    TEST_ASSERT_NOT_NULL (ag_video_options_set (&o, NULL, NULL, "both", -1));
+}
+
+int
+main (void)
+{
+    UNITY_BEGIN ();
+    RUN_TEST (test_y4m_gray_side_by_side);
+    RUN_TEST (test_y4m_420_from_rgb);
+    RUN_TEST (test_odd_sizes_and_geometry_checks);
+    RUN_TEST (test_split_layout_and_sidecar);
+    RUN_TEST (test_mjpeg_parts);
+    RUN_TEST (test_closed_pipe_is_an_error);
+    RUN_TEST (test_parse_names);
+    RUN_TEST (test_options_set);
+    return UNITY_END ();
+}